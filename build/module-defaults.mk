@@ -23,6 +23,10 @@ else
 CFLAGS += -DRELEASE_BUILD
 endif
 
+ifeq ("$(ALLOC_TRACKER_ENABLED)","1")
+CFLAGS += -DALLOC_TRACKER_ENABLED=1
+endif
+
 ifdef SPARK_TEST_DRIVER
 CFLAGS += -DSPARK_TEST_DRIVER=$(SPARK_TEST_DRIVER)
 endif
@@ -53,6 +53,13 @@ size_t HAL_EEPROM_Length();
 void HAL_EEPROM_Clear();
 bool HAL_EEPROM_Has_Pending_Erase();
 void HAL_EEPROM_Perform_Pending_Erase();
+/**
+ * Performs a bounded amount of deferred EEPROM work, such as a step of a background page swap.
+ * Called periodically by the system.
+ *
+ * @return `true` if there is more work to do.
+ */
+bool HAL_EEPROM_Perform_Background_Work(void* reserved);
 
 #ifdef __cplusplus
 }
@@ -84,6 +84,8 @@ DYNALIB_FN(BASE_IDX + 20, hal, HAL_RTC_Time_Is_Valid, uint8_t(void*))
 DYNALIB_FN(BASE_IDX + 21, hal, hal_timer_millis, uint64_t(void*))
 DYNALIB_FN(BASE_IDX + 22, hal, hal_timer_micros, uint64_t(void*))
 
+DYNALIB_FN(BASE_IDX + 23, hal, HAL_EEPROM_Perform_Background_Work, bool(void*))
+
 DYNALIB_END(hal)
 
 #undef BASE_IDX
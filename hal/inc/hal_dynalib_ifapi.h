@@ -65,6 +65,11 @@ DYNALIB_FN(28, hal_ifapi, if_event_handler_add_if, if_event_handler_cookie_t(if_
 DYNALIB_FN(29, hal_ifapi, if_event_handler_self, if_event_handler_cookie_t(if_t, if_event_handler_t, void*))
 DYNALIB_FN(30, hal_ifapi, if_event_handler_del, int(if_event_handler_cookie_t))
 DYNALIB_FN(31, hal_ifapi, if_request, int(if_t, int, void*, size_t, void*))
+DYNALIB_FN(32, hal_ifapi, if_capture_init, int(size_t))
+DYNALIB_FN(33, hal_ifapi, if_capture_start, int(if_t, unsigned int, size_t))
+DYNALIB_FN(34, hal_ifapi, if_capture_stop, int(if_t))
+DYNALIB_FN(35, hal_ifapi, if_capture_dump, int(if_capture_write_t, void*))
+DYNALIB_FN(36, hal_ifapi, if_capture_clear, int(void))
 
 DYNALIB_END(hal_ifapi)
 
@@ -48,6 +48,8 @@ DYNALIB_FN(12, hal_socket, sock_send, int(int, const void*, size_t, int))
 DYNALIB_FN(13, hal_socket, sock_sendto, int(int, const void*, size_t, int, const struct sockaddr*, socklen_t))
 DYNALIB_FN(14, hal_socket, sock_socket, int(int, int, int))
 DYNALIB_FN(15, hal_socket, sock_fcntl, int(int, int, ...))
+DYNALIB_FN(16, hal_socket, sock_get_stats, int(int, sock_stats*, void*))
+DYNALIB_FN(17, hal_socket, sock_get_netif_stats, int(uint8_t, sock_stats*, void*))
 
 DYNALIB_END(hal_socket)
 
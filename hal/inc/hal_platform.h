@@ -230,6 +230,14 @@
 #define HAL_PLATFORM_COMPRESSED_BINARIES (0)
 #endif // HAL_PLATFORM_COMPRESSED_BINARIES
 
+#ifndef HAL_PLATFORM_COMPRESSED_OTA
+#define HAL_PLATFORM_COMPRESSED_OTA (0)
+#endif // HAL_PLATFORM_COMPRESSED_OTA
+
+#ifndef HAL_PLATFORM_DELTA_OTA
+#define HAL_PLATFORM_DELTA_OTA (0)
+#endif // HAL_PLATFORM_DELTA_OTA
+
 #ifndef HAL_PLATFORM_NETWORK_MULTICAST
 #define HAL_PLATFORM_NETWORK_MULTICAST (0)
 #endif // HAL_PLATFORM_NETWORK_MULTICAST
@@ -242,4 +250,8 @@
 #define HAL_PLATFORM_IPV6 (0)
 #endif // HAL_PLATFORM_IPV6
 
+#ifndef HAL_PLATFORM_DCD_LOG
+#define HAL_PLATFORM_DCD_LOG (0)
+#endif // HAL_PLATFORM_DCD_LOG
+
 #endif /* HAL_PLATFORM_H */
@@ -107,6 +107,31 @@ int netdb_getaddrinfo(const char* hostname, const char* servname,
 int netdb_getnameinfo(const struct sockaddr* sa, socklen_t salen, char* host,
                       socklen_t hostlen, char* serv, socklen_t servlen, int flags);
 
+/**
+ * Statistics of the cache of resolved host addresses used by netdb_getaddrinfo().
+ *
+ * The cache is preserved across resets. Lookups served from the cache, including the ones
+ * that used an outdated address while the host was being resolved again in the background,
+ * did not have to wait for a DNS query.
+ */
+typedef struct netdb_cache_stats {
+    uint16_t size; /**< Size of this structure */
+    uint16_t entries; /**< Number of cached addresses */
+    uint32_t hits; /**< Lookups served with an up-to-date address */
+    uint32_t stale_hits; /**< Lookups served with an outdated address */
+    uint32_t misses; /**< Lookups that required a DNS query */
+} netdb_cache_stats;
+
+/**
+ * Get statistics of the cache of resolved host addresses.
+ *
+ * @param[out] stats     statistics
+ * @param[in]  reserved  reserved argument, must be NULL
+ *
+ * @returns    0 on success or a negative result code in case of an error.
+ */
+int netdb_get_cache_stats(netdb_cache_stats* stats, void* reserved);
+
 /**
  * @}
  *
@@ -258,6 +258,57 @@ int sock_socket(int domain, int type, int protocol);
  */
 int sock_fcntl(int s, int cmd, ...);
 
+/**
+ * Socket statistics.
+ *
+ * The counters are accumulated over the lifetime of a socket. The TCP connection parameters
+ * (`rtt`, `rto`, `retransmits`, `snd_buf` and `snd_wnd`) reflect the state of the connection
+ * at the time of the query and are set to 0 for other types of sockets and for aggregated
+ * statistics.
+ */
+typedef struct sock_stats {
+    uint16_t size; /**< Size of this structure */
+    uint8_t netif; /**< Index of the network interface used by the socket, or 0 if unknown */
+    uint8_t type; /**< Socket type: SOCK_STREAM, SOCK_DGRAM or SOCK_RAW, or 0 for aggregated statistics */
+    uint32_t tx_bytes; /**< Bytes sent */
+    uint32_t tx_count; /**< Successful send operations */
+    uint32_t tx_stalls; /**< Send operations that could not send all data because the send buffer was full */
+    uint32_t tx_time; /**< Time spent in send operations (milliseconds) */
+    uint32_t rx_bytes; /**< Bytes received */
+    uint32_t rx_count; /**< Successful receive operations */
+    uint32_t rx_time; /**< Time spent in receive operations (milliseconds) */
+    uint32_t rtt; /**< Smoothed round-trip time estimate (milliseconds) */
+    uint32_t rto; /**< Retransmission timeout (milliseconds) */
+    uint32_t retransmits; /**< Retransmissions of the oldest unacknowledged segment */
+    uint32_t snd_buf; /**< Available space in the send buffer (bytes) */
+    uint32_t snd_wnd; /**< Send window advertised by the peer (bytes) */
+} sock_stats;
+
+/**
+ * Get statistics of a socket.
+ *
+ * @param[in]  s         a socket that has been created with sock_socket()
+ * @param[out] stats     statistics
+ * @param[in]  reserved  reserved argument, must be NULL
+ *
+ * @returns    0 on success, SYSTEM_ERROR_NOT_FOUND if the socket is not open, or
+ *             SYSTEM_ERROR_OUT_OF_RANGE if the descriptor is greater than any valid socket
+ *             descriptor.
+ */
+int sock_get_stats(int s, sock_stats* stats, void* reserved);
+
+/**
+ * Get aggregated statistics of the sockets that have been used with a network interface,
+ * including the sockets that are closed.
+ *
+ * @param[in]  netif     interface index, or 0 to get the statistics of all interfaces
+ * @param[out] stats     statistics
+ * @param[in]  reserved  reserved argument, must be NULL
+ *
+ * @returns    0 on success or a negative result code in case of an error.
+ */
+int sock_get_netif_stats(uint8_t netif, sock_stats* stats, void* reserved);
+
 /**
  * @}
  *
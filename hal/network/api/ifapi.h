@@ -199,6 +199,14 @@ struct if_event {
 
 typedef void (*if_event_handler_t)(void* arg, if_t iface, const struct if_event* ev);
 
+enum if_capture_flag_t {
+    IF_CAPTURE_INBOUND  = 0x01,
+    IF_CAPTURE_OUTBOUND = 0x02,
+    IF_CAPTURE_ALL      = 0x03
+};
+
+typedef int (*if_capture_write_t)(const uint8_t* data, size_t size, void* ctx);
+
 typedef struct if_event_power_state if_req_power;
 
 enum if_req_t {
@@ -255,6 +263,13 @@ int if_event_handler_del(if_event_handler_cookie_t cookie);
 
 int if_request(if_t iface, int type, void* req, size_t reqsize, void* reserved);
 
+/* Packet capture, the captured packets are written in the pcap-ng format */
+int if_capture_init(size_t buf_size);
+int if_capture_start(if_t iface, unsigned int flags, size_t snap_len);
+int if_capture_stop(if_t iface);
+int if_capture_dump(if_capture_write_t write, void* ctx);
+int if_capture_clear(void);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
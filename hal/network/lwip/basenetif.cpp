@@ -17,16 +17,22 @@
 
 #include "basenetif.h"
 #include "lwiplock.h"
+#include "timer_hal.h"
+#include "check.h"
 
 using namespace particle::net;
 
 uint8_t BaseNetif::clientDataId_;
 std::once_flag BaseNetif::once_;
+particle::PcapngBuffer BaseNetif::captureBuf_;
+std::mutex BaseNetif::captureMutex_;
+volatile unsigned BaseNetif::captureCount_ = 0;
 
 BaseNetif::BaseNetif() {
 }
 
 BaseNetif::~BaseNetif() {
+    stopCapture();
     LwipTcpIpCoreLock lk;
     netif_remove_ext_callback(&netifEventHandlerCookie_);
     if_event_handler_del(eventHandlerCookie_);
@@ -46,6 +52,14 @@ void BaseNetif::registerHandlers() {
     eventHandlerCookie_ = if_event_handler_self(interface(), &BaseNetif::ifEventCb, this);
 }
 
+unsigned BaseNetif::getMetric() const {
+    return metric_;
+}
+
+void BaseNetif::setMetric(unsigned metric) {
+    metric_ = metric;
+}
+
 if_t BaseNetif::interface() {
     return (if_t)&netif_;
 }
@@ -63,3 +77,136 @@ void BaseNetif::netifEventCb(netif* iface, netif_nsc_reason_t reason, const neti
         self->netifEventHandler(reason, args);
     }
 }
+
+int BaseNetif::initCapture(size_t bufSize) {
+    std::lock_guard<std::mutex> lk(captureMutex_);
+    return captureBuf_.init(bufSize);
+}
+
+int BaseNetif::dumpCapture(PcapngBuffer::WriteCallback cb, void* ctx) {
+    size_t bufSize = 0;
+    {
+        std::lock_guard<std::mutex> lk(captureMutex_);
+        bufSize = captureBuf_.capacity();
+    }
+    if (!bufSize) {
+        return SYSTEM_ERROR_INVALID_STATE;
+    }
+    // The packets are written from a separate buffer, so that the write callback doesn't block
+    // the threads capturing the packets
+    PcapngBuffer buf;
+    CHECK(buf.init(bufSize));
+    {
+        std::lock_guard<std::mutex> lk(captureMutex_);
+        CHECK(captureBuf_.movePackets(&buf));
+    }
+    return buf.dump(cb, ctx);
+}
+
+void BaseNetif::clearCapture() {
+    std::lock_guard<std::mutex> lk(captureMutex_);
+    captureBuf_.clear();
+}
+
+int BaseNetif::startCapture(unsigned flags, size_t snapLen) {
+    LwipTcpIpCoreLock lk;
+    if (netif_get_client_data(&netif_, clientDataId_) != this) {
+        return SYSTEM_ERROR_INVALID_STATE;
+    }
+    std::lock_guard<std::mutex> captureLk(captureMutex_);
+    if (captureIfIndex_ < 0) {
+        char name[NETIF_NAMESIZE] = {};
+        netif_index_to_name(netif_get_index(&netif_), name);
+        captureIfIndex_ = CHECK(captureBuf_.addInterface(PcapngBuffer::LINKTYPE_RAW, snapLen, name));
+    } else {
+        CHECK(captureBuf_.setSnapLength(captureIfIndex_, snapLen));
+    }
+    if (!captureFlags_) {
+        // Outgoing packets are captured by substituting the output functions of the interface,
+        // so there's no overhead for the interfaces that are not being captured
+        captureOutput_ = netif_.output;
+        captureOutputIp6_ = netif_.output_ip6;
+        if (captureOutput_) {
+            netif_.output = &BaseNetif::captureOutputCb;
+        }
+        if (captureOutputIp6_) {
+            netif_.output_ip6 = &BaseNetif::captureOutputIp6Cb;
+        }
+        ++captureCount_;
+    }
+    captureFlags_ = flags & CAPTURE_ALL;
+    return 0;
+}
+
+void BaseNetif::stopCapture() {
+    LwipTcpIpCoreLock lk;
+    std::lock_guard<std::mutex> captureLk(captureMutex_);
+    if (!captureFlags_) {
+        return;
+    }
+    if (netif_.output == &BaseNetif::captureOutputCb) {
+        netif_.output = captureOutput_;
+    }
+    if (netif_.output_ip6 == &BaseNetif::captureOutputIp6Cb) {
+        netif_.output_ip6 = captureOutputIp6_;
+    }
+    captureOutput_ = nullptr;
+    captureOutputIp6_ = nullptr;
+    captureFlags_ = 0;
+    --captureCount_;
+}
+
+void BaseNetif::captureInput(netif* iface, pbuf* p) {
+    if (!captureCount_) {
+        return;
+    }
+    BaseNetif* self = static_cast<BaseNetif*>(netif_get_client_data(iface, clientDataId_));
+    if (self && self->interface() == iface) {
+        self->capture(p, CAPTURE_INBOUND);
+    }
+}
+
+err_t BaseNetif::captureOutputCb(netif* iface, pbuf* p, const ip4_addr_t* addr) {
+    BaseNetif* self = static_cast<BaseNetif*>(netif_get_client_data(iface, clientDataId_));
+    self->capture(p, CAPTURE_OUTBOUND);
+    return self->captureOutput_(iface, p, addr);
+}
+
+err_t BaseNetif::captureOutputIp6Cb(netif* iface, pbuf* p, const ip6_addr_t* addr) {
+    BaseNetif* self = static_cast<BaseNetif*>(netif_get_client_data(iface, clientDataId_));
+    self->capture(p, CAPTURE_OUTBOUND);
+    return self->captureOutputIp6_(iface, p, addr);
+}
+
+void BaseNetif::capture(pbuf* p, unsigned dir) {
+    if (!(captureFlags_ & dir)) {
+        return;
+    }
+    const uint64_t timestamp = hal_timer_micros(nullptr);
+    std::lock_guard<std::mutex> lk(captureMutex_);
+    if (captureIfIndex_ < 0) {
+        return;
+    }
+    const unsigned pcapDir = (dir == CAPTURE_INBOUND) ? PcapngBuffer::INBOUND : PcapngBuffer::OUTBOUND;
+    if (captureBuf_.startPacket(captureIfIndex_, timestamp, pcapDir, p->tot_len) < 0) {
+        return;
+    }
+    for (auto q = p; q != nullptr; q = q->next) {
+        captureBuf_.appendPacket(q->payload, q->len);
+    }
+    captureBuf_.endPacket();
+}
+
+extern "C" {
+
+int lwip_hook_ip4_input(pbuf* p, netif* inp) {
+    BaseNetif::captureInput(inp, p);
+    return 0;
+}
+
+int lwip_hook_ip6_input(pbuf* p, netif* inp) {
+    BaseNetif::captureInput(inp, p);
+    return 0;
+}
+
+} // extern "C"
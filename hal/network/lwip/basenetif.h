@@ -21,6 +21,7 @@
 #include <mutex>
 #include <lwip/netif.h>
 #include "ifapi.h"
+#include "pcapng_buffer.h"
 
 namespace particle { namespace net {
 
@@ -36,6 +37,41 @@ public:
     virtual int powerUp() = 0;
     virtual int powerDown() = 0;
 
+    enum CaptureFlag {
+        CAPTURE_INBOUND = 0x01,
+        CAPTURE_OUTBOUND = 0x02,
+        CAPTURE_ALL = CAPTURE_INBOUND | CAPTURE_OUTBOUND
+    };
+
+    static const size_t DEFAULT_CAPTURE_SNAP_LENGTH = 0; // No limit
+
+    /**
+     * Allocates the buffer for captured packets shared by all interfaces.
+     */
+    static int initCapture(size_t bufSize);
+    /**
+     * Writes the captured packets in the pcap-ng format and discards them. A temporary buffer of
+     * the same size is allocated while the packets are being written.
+     */
+    static int dumpCapture(PcapngBuffer::WriteCallback cb, void* ctx);
+    static void clearCapture();
+
+    /**
+     * Starts capturing the IP packets sent and/or received via this interface. The interface needs
+     * to be added to the lwIP stack.
+     */
+    int startCapture(unsigned flags = CAPTURE_ALL, size_t snapLen = DEFAULT_CAPTURE_SNAP_LENGTH);
+    void stopCapture();
+
+    static void captureInput(netif* iface, pbuf* p);
+
+    /**
+     * Routing metric of the interface. Among the interfaces that can reach a destination, the one
+     * with the lowest metric is preferred.
+     */
+    unsigned getMetric() const;
+    void setMetric(unsigned metric);
+
 protected:
     void registerHandlers();
 
@@ -46,14 +82,27 @@ private:
     static void ifEventCb(void* arg, if_t iface, const if_event* ev);
     static void netifEventCb(netif* iface, netif_nsc_reason_t reason, const netif_ext_callback_args_t* args);
 
+    static err_t captureOutputCb(netif* iface, pbuf* p, const ip4_addr_t* addr);
+    static err_t captureOutputIp6Cb(netif* iface, pbuf* p, const ip6_addr_t* addr);
+
+    void capture(pbuf* p, unsigned dir);
+
 protected:
     netif netif_ = {};
 
 private:
     netif_ext_callback_t netifEventHandlerCookie_;
     if_event_handler_cookie_t eventHandlerCookie_ = nullptr;
+    netif_output_fn captureOutput_ = nullptr;
+    netif_output_ip6_fn captureOutputIp6_ = nullptr;
+    unsigned captureFlags_ = 0;
+    int captureIfIndex_ = -1;
+    volatile unsigned metric_ = 0;
     static uint8_t clientDataId_;
     static std::once_flag once_;
+    static PcapngBuffer captureBuf_;
+    static std::mutex captureMutex_;
+    static volatile unsigned captureCount_; // Number of interfaces being captured
 };
 
 } } /* particle::net */
@@ -57,6 +57,9 @@ enum class NetifEvent {
     PowerOn = 5
 };
 
+// Maximum number of pbufs in a chain that is passed to the NCP client without copying it
+const size_t MAX_OUTPUT_PBUF_CHAIN_LENGTH = 8;
+
 } // anonymous
 
 using namespace particle::net;
@@ -268,15 +271,9 @@ void Esp32NcpNetif::ncpDataHandlerCb(int id, const uint8_t* data, size_t size, v
 
     pbuf* p = pbuf_alloc(PBUF_RAW, pktSize, PBUF_POOL);
     if (p != nullptr) {
-#if ETH_PAD_SIZE
-        /* drop the padding word */
-        pbuf_remove_header(p, ETH_PAD_SIZE);
-#endif /* ETH_PAD_SIZE */
-        memcpy(p->payload, data, size);
-#if ETH_PAD_SIZE
-        /* reclaim the padding word */
-        pbuf_add_header(p, ETH_PAD_SIZE);
-#endif /* ETH_PAD_SIZE */
+        // Copy the frame directly into the pool buffers, which may be chained if the frame is
+        // larger than PBUF_POOL_BUFSIZE, skipping the padding word
+        pbuf_take_at(p, data, size, ETH_PAD_SIZE);
 
         LwipTcpIpCoreLock lk;
         if (self->interface()->input(p, self->interface()) != ERR_OK) {
@@ -309,10 +306,24 @@ err_t Esp32NcpNetif::linkOutput(pbuf* p) {
         // non-queue packet
         wifiMan_->ncpClient()->dataChannelWrite(0, (const uint8_t*)p->payload, p->tot_len);
     } else {
-        pbuf* q = pbuf_clone(PBUF_LINK, PBUF_RAM, p);
-        if (q) {
-            wifiMan_->ncpClient()->dataChannelWrite(0, (const uint8_t*)q->payload, q->tot_len);
-            pbuf_free(q);
+        // Pass the chain to the NCP client as is instead of cloning it into a temporary pbuf
+        // allocated from the lwIP heap
+        const size_t iovCount = pbuf_clen(p);
+        if (iovCount <= MAX_OUTPUT_PBUF_CHAIN_LENGTH) {
+            NcpIoVec iov[MAX_OUTPUT_PBUF_CHAIN_LENGTH];
+            size_t i = 0;
+            for (pbuf* q = p; q; q = q->next) {
+                iov[i].data = (const uint8_t*)q->payload;
+                iov[i].size = q->len;
+                ++i;
+            }
+            wifiMan_->ncpClient()->dataChannelWritev(0, iov, iovCount);
+        } else {
+            pbuf* q = pbuf_clone(PBUF_LINK, PBUF_RAM, p);
+            if (q) {
+                wifiMan_->ncpClient()->dataChannelWrite(0, (const uint8_t*)q->payload, q->tot_len);
+                pbuf_free(q);
+            }
         }
     }
 
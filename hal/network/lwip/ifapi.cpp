@@ -812,14 +812,79 @@ int if_set_mtu(if_t iface, unsigned int mtu) {
 }
 
 int if_get_metric(if_t iface, unsigned int* metric) {
-    /* TODO */
-    *metric = 0;
+    LwipTcpIpCoreLock lk;
+
+    if (!netif_validate(iface) || !metric) {
+        return -1;
+    }
+
+    auto netif = getBaseNetif(iface);
+    *metric = netif ? netif->getMetric() : 0;
+
     return 0;
 }
 
 int if_set_metric(if_t iface, unsigned int metric) {
-    /* TODO */
-    return -1;
+    LwipTcpIpCoreLock lk;
+
+    if (!netif_validate(iface)) {
+        return -1;
+    }
+
+    auto netif = getBaseNetif(iface);
+    if (!netif) {
+        return -1;
+    }
+    netif->setMetric(metric);
+
+    return 0;
+}
+
+int if_capture_init(size_t buf_size) {
+    return BaseNetif::initCapture(buf_size);
+}
+
+int if_capture_start(if_t iface, unsigned int flags, size_t snap_len) {
+    static_assert((unsigned)IF_CAPTURE_INBOUND == (unsigned)BaseNetif::CAPTURE_INBOUND &&
+            (unsigned)IF_CAPTURE_OUTBOUND == (unsigned)BaseNetif::CAPTURE_OUTBOUND, "Capture flags don't match");
+
+    LwipTcpIpCoreLock lk;
+
+    if (!netif_validate(iface) || !(flags & IF_CAPTURE_ALL)) {
+        return -1;
+    }
+
+    auto netif = getBaseNetif(iface);
+    if (!netif) {
+        return -1;
+    }
+
+    return netif->startCapture(flags, snap_len);
+}
+
+int if_capture_stop(if_t iface) {
+    LwipTcpIpCoreLock lk;
+
+    if (!netif_validate(iface)) {
+        return -1;
+    }
+
+    auto netif = getBaseNetif(iface);
+    if (!netif) {
+        return -1;
+    }
+    netif->stopCapture();
+
+    return 0;
+}
+
+int if_capture_dump(if_capture_write_t write, void* ctx) {
+    return BaseNetif::dumpCapture(write, ctx);
+}
+
+int if_capture_clear(void) {
+    BaseNetif::clearCapture();
+    return 0;
 }
 
 int if_get_if_addrs(struct if_addrs** addrs) {
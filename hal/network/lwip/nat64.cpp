@@ -117,7 +117,9 @@ bool Nat64::enable(const Rule& rule) {
     disable(nullptr);
     rule_ = new Rule(rule);
     if (!pool_) {
-        pool_.reset(new SimpleAllocedPool(DEFAULT_MAX_TRANSLATION_ENTRIES * NAT64_ENTRY_SIZE));
+        // All entries have the same size, so a single size class is used
+        pool_.reset(new SlabAllocedPool(DEFAULT_MAX_TRANSLATION_ENTRIES * (NAT64_ENTRY_SIZE + sizeof(uintptr_t)),
+                &NAT64_ENTRY_SIZE, 1));
         enableSessionTimer();
     }
     return true;
@@ -27,7 +27,7 @@
 #include <memory>
 #include <cstring>
 #include "intrusive_list.h"
-#include "simple_pool_allocator.h"
+#include "slab_pool_allocator.h"
 #include "logging.h"
 #include "ipaddr_util.h"
 
@@ -248,7 +248,7 @@ private:
     BibTable icmpBibTable_;
     uint16_t icmpNextId_;
 
-    std::unique_ptr<SimpleAllocedPool> pool_;
+    std::unique_ptr<SlabAllocedPool> pool_;
 };
 
 /* IpTransportAddressGeneric */
@@ -24,8 +24,284 @@
 /* netdb_hal_impl.h should get included from netdb_hal.h automagically */
 #include "netdb_hal.h"
 #include <lwip/sockets.h>
+#include <lwip/dns.h>
 #include <errno.h>
 #include <algorithm>
+#include <mutex>
+#include <memory>
+
+#include "hal_platform.h"
+#include "dns_cache.h"
+#include "lwiplock.h"
+#include "rtc_hal.h"
+#include "system_error.h"
+#include "logging.h"
+#include "check.h"
+
+#if HAL_PLATFORM_FILESYSTEM
+#include "filesystem.h"
+#include "file_util.h"
+#include "scope_guard.h"
+#endif // HAL_PLATFORM_FILESYSTEM
+
+using namespace particle;
+
+namespace {
+
+/*
+ * LwIP's DNS table is lost on every reset, so the addresses resolved via getaddrinfo() are also
+ * cached in a file. lwIP doesn't report the TTLs of the records to its clients, which is why the
+ * cached addresses are considered fresh for a fixed amount of time. After that, they are still
+ * used, but the host is resolved again in the background.
+ */
+#if HAL_PLATFORM_FILESYSTEM
+const char* const DNS_CACHE_FILE = "/sys/dns_cache.bin";
+#endif
+
+DnsCache s_dnsCache;
+std::mutex s_dnsCacheMutex;
+std::mutex s_dnsCacheFileMutex; // Serializes the loading and saving of the cache
+bool s_dnsCacheLoaded = false;
+bool s_dnsCacheChanged = false;
+
+typedef std::lock_guard<std::mutex> DnsCacheLock;
+
+// Name and address family of a host that is being resolved in the background
+struct DnsCacheRevalidation {
+    char name[DnsCache::MAX_NAME_LENGTH + 1];
+    uint8_t family;
+};
+
+uint32_t currentTime() {
+    return HAL_RTC_Time_Is_Valid(nullptr) ? HAL_RTC_Get_UnixTime() : DnsCache::UNKNOWN_TIME;
+}
+
+// Reads the saved cache into a buffer. Returns the number of bytes read
+int loadDnsCache(uint8_t* buf, size_t size) {
+#if HAL_PLATFORM_FILESYSTEM
+    const auto fs = filesystem_get_instance(nullptr);
+    CHECK_TRUE(fs, SYSTEM_ERROR_FILE);
+    fs::FsLock lock(fs);
+    CHECK(filesystem_mount(fs));
+    lfs_info info = {};
+    if (lfs_stat(&fs->instance, DNS_CACHE_FILE, &info) != LFS_ERR_OK) {
+        return 0; // The cache has not been saved yet
+    }
+    lfs_file_t file = {};
+    CHECK(openFile(&file, DNS_CACHE_FILE, LFS_O_RDONLY));
+    SCOPE_GUARD({
+        lfs_file_close(&fs->instance, &file);
+    });
+    const int n = lfs_file_read(&fs->instance, &file, buf, size);
+    CHECK_TRUE(n >= 0, SYSTEM_ERROR_FILE);
+    return n;
+#else
+    return 0;
+#endif // HAL_PLATFORM_FILESYSTEM
+}
+
+void removeDnsCache() {
+#if HAL_PLATFORM_FILESYSTEM
+    const auto fs = filesystem_get_instance(nullptr);
+    if (fs) {
+        LOG(WARN, "Removing file: %s", DNS_CACHE_FILE);
+        fs::FsLock lock(fs);
+        lfs_remove(&fs->instance, DNS_CACHE_FILE);
+    }
+#endif // HAL_PLATFORM_FILESYSTEM
+}
+
+int saveDnsCache(const uint8_t* buf, size_t size) {
+#if HAL_PLATFORM_FILESYSTEM
+    const auto fs = filesystem_get_instance(nullptr);
+    CHECK_TRUE(fs, SYSTEM_ERROR_FILE);
+    fs::FsLock lock(fs);
+    CHECK(filesystem_mount(fs));
+    lfs_file_t file = {};
+    CHECK(openFile(&file, DNS_CACHE_FILE, LFS_O_WRONLY));
+    SCOPE_GUARD({
+        lfs_file_close(&fs->instance, &file);
+    });
+    int r = lfs_file_truncate(&fs->instance, &file, 0);
+    CHECK_TRUE(r == LFS_ERR_OK, SYSTEM_ERROR_FILE);
+    r = lfs_file_write(&fs->instance, &file, buf, size);
+    CHECK_TRUE(r == (int)size, SYSTEM_ERROR_FILE);
+#endif // HAL_PLATFORM_FILESYSTEM
+    return 0;
+}
+
+void loadDnsCacheIfNeeded() {
+    {
+        DnsCacheLock lock(s_dnsCacheMutex);
+        if (s_dnsCacheLoaded) {
+            return;
+        }
+    }
+    // The cache is updated from the TCP/IP thread so it's only locked while being deserialized
+    DnsCacheLock fileLock(s_dnsCacheFileMutex);
+    std::unique_ptr<uint8_t[]> buf(new(std::nothrow) uint8_t[DnsCache::MAX_SERIALIZED_SIZE]);
+    int r = buf ? loadDnsCache(buf.get(), DnsCache::MAX_SERIALIZED_SIZE) : SYSTEM_ERROR_NO_MEMORY;
+    bool invalid = false;
+    {
+        DnsCacheLock lock(s_dnsCacheMutex);
+        if (s_dnsCacheLoaded) {
+            return;
+        }
+        s_dnsCacheLoaded = true;
+        if (r > 0) {
+            r = s_dnsCache.deserialize(buf.get(), r);
+            invalid = (r < 0);
+        }
+    }
+    if (invalid) {
+        removeDnsCache();
+    }
+    if (r < 0) {
+        LOG(ERROR, "Unable to load DNS cache: %d", r);
+    }
+}
+
+void saveDnsCacheIfChanged() {
+    DnsCacheLock fileLock(s_dnsCacheFileMutex);
+    std::unique_ptr<uint8_t[]> buf;
+    size_t size = 0;
+    int r = 0;
+    {
+        // The cache is updated from the TCP/IP thread so it's only locked while being serialized
+        DnsCacheLock lock(s_dnsCacheMutex);
+        if (!s_dnsCacheChanged) {
+            return;
+        }
+        s_dnsCacheChanged = false;
+        size = s_dnsCache.serializedSize();
+        buf.reset(new(std::nothrow) uint8_t[size]);
+        r = buf ? s_dnsCache.serialize(buf.get(), size) : SYSTEM_ERROR_NO_MEMORY;
+    }
+    if (r >= 0) {
+        r = saveDnsCache(buf.get(), size);
+    }
+    if (r < 0) {
+        LOG(ERROR, "Unable to save DNS cache: %d", r);
+    }
+}
+
+void updateDnsCache(const char* name, uint8_t family, const ip_addr_t* addr) {
+    DnsCacheLock lock(s_dnsCacheMutex);
+    if (!addr) {
+        s_dnsCache.cancelRevalidation(name, family);
+        return;
+    }
+    if (family == AF_INET && IP_IS_V4(addr)) {
+        s_dnsCache.update(name, family, &ip_2_ip4(addr)->addr, sizeof(ip4_addr_t), currentTime());
+    } else if (family == AF_INET6 && IP_IS_V6(addr)) {
+        s_dnsCache.update(name, family, ip_2_ip6(addr)->addr, sizeof(ip_2_ip6(addr)->addr), currentTime());
+    } else {
+        s_dnsCache.cancelRevalidation(name, family);
+        return;
+    }
+    s_dnsCacheChanged = true;
+}
+
+// Records that a host has no address of the family, e.g. an IPv4-only host looked up with AF_UNSPEC
+void updateDnsCacheMissing(const char* name, uint8_t family) {
+    DnsCacheLock lock(s_dnsCacheMutex);
+    s_dnsCache.update(name, family, nullptr, 0, currentTime());
+    s_dnsCacheChanged = true;
+}
+
+void revalidateDnsCallback(const char* name, const ip_addr_t* addr, void* arg) {
+    std::unique_ptr<DnsCacheRevalidation> r(static_cast<DnsCacheRevalidation*>(arg));
+    updateDnsCache(r->name, r->family, addr);
+}
+
+// Resolves a host in the background and updates the cache entry
+void revalidateDnsCacheEntry(const char* name, uint8_t family) {
+    std::unique_ptr<DnsCacheRevalidation> r(new(std::nothrow) DnsCacheRevalidation());
+    if (!r) {
+        DnsCacheLock lock(s_dnsCacheMutex);
+        s_dnsCache.cancelRevalidation(name, family);
+        return;
+    }
+    strncpy(r->name, name, sizeof(r->name) - 1);
+    r->family = family;
+    ip_addr_t addr = {};
+    const uint8_t addrType = (family == AF_INET) ? LWIP_DNS_ADDRTYPE_IPV4 : LWIP_DNS_ADDRTYPE_IPV6;
+    LwipTcpIpCoreLock lk; // LwIP's DNS client API is not thread-safe
+    const auto ret = dns_gethostbyname_addrtype(name, &addr, revalidateDnsCallback, r.get(), addrType);
+    lk.unlock();
+    if (ret == ERR_INPROGRESS) {
+        r.release(); // Freed in the callback
+    } else {
+        updateDnsCache(name, family, (ret == ERR_OK) ? &addr : nullptr);
+    }
+}
+
+bool isDnsCacheable(const char* hostname, const struct addrinfo* hints) {
+    if (!hostname || !hints || (hints->ai_family != AF_INET && hints->ai_family != AF_INET6) ||
+            (hints->ai_flags & (AI_NUMERICHOST | AI_V4MAPPED))) {
+        return false;
+    }
+    const size_t len = strlen(hostname);
+    if (!len || len > DnsCache::MAX_NAME_LENGTH) {
+        return false;
+    }
+    ip_addr_t addr = {};
+    return !ipaddr_aton(hostname, &addr);
+}
+
+// Sets `resolved` to true if the host had to be resolved, and its result can be cached
+int cachedGetaddrinfo(const char* hostname, const char* servname, const struct addrinfo* hints,
+                      struct addrinfo** res, bool* resolved = nullptr) {
+    if (!isDnsCacheable(hostname, hints)) {
+        return lwip_getaddrinfo(hostname, servname, hints, res);
+    }
+    const uint8_t family = hints->ai_family;
+    uint8_t addr[DnsCache::MAX_ADDRESS_SIZE] = {};
+    size_t addrSize = sizeof(addr);
+    bool revalidate = false;
+    int r = 0;
+    {
+        loadDnsCacheIfNeeded();
+        DnsCacheLock lock(s_dnsCacheMutex);
+        r = s_dnsCache.lookup(hostname, family, addr, &addrSize, currentTime(), &revalidate);
+    }
+    if (r == DnsCache::FRESH || r == DnsCache::STALE) {
+        if (revalidate) {
+            revalidateDnsCacheEntry(hostname, family);
+        }
+        if (!addrSize) {
+            return EAI_FAIL; // The host has no address of this family
+        }
+        /* Let lwIP allocate the result for the cached address */
+        char str[INET6_ADDRSTRLEN] = {};
+        if (lwip_inet_ntop(family, addr, str, sizeof(str))) {
+            struct addrinfo h = *hints;
+            h.ai_flags |= AI_NUMERICHOST;
+            if (lwip_getaddrinfo(str, servname, &h, res) == 0) {
+                return 0;
+            }
+        }
+    }
+    if (resolved) {
+        *resolved = true;
+    }
+    r = lwip_getaddrinfo(hostname, servname, hints, res);
+    if (r == 0 && *res && (*res)->ai_addr && (*res)->ai_addr->sa_family == family) {
+        const auto sa = (*res)->ai_addr;
+        ip_addr_t a = {};
+        if (family == AF_INET) {
+            inet_addr_to_ip4addr(ip_2_ip4(&a), &((const struct sockaddr_in*)sa)->sin_addr);
+            IP_SET_TYPE_VAL(a, IPADDR_TYPE_V4);
+        } else {
+            inet6_addr_to_ip6addr(ip_2_ip6(&a), &((const struct sockaddr_in6*)sa)->sin6_addr);
+            IP_SET_TYPE_VAL(a, IPADDR_TYPE_V6);
+        }
+        updateDnsCache(hostname, family, &a);
+    }
+    return r;
+}
+
+} // unnamed
 
 struct hostent* netdb_gethostbyname(const char *name) {
     return lwip_gethostbyname(name);
@@ -42,26 +318,56 @@ void netdb_freeaddrinfo(struct addrinfo* ai) {
 
 int netdb_getaddrinfo(const char* hostname, const char* servname,
                       const struct addrinfo* hints, struct addrinfo** res) {
+    int r = 0;
     /* Change the behavior when AF_UNSPEC is used */
     if (hints && hints->ai_family == AF_UNSPEC) {
         struct addrinfo h = *hints;
 
         /* First perform a lookup with AF_INET6 */
         h.ai_family = AF_INET6;
-        int rinet6 = lwip_getaddrinfo(hostname, servname, &h, res);
+        bool resolvedInet6 = false;
+        int rinet6 = cachedGetaddrinfo(hostname, servname, &h, res, &resolvedInet6);
 
         /* Next perform a lookup with AF_INET */
         h.ai_family = AF_INET;
+        bool resolvedInet = false;
         /* FIXME: expects that there is either 1 or 0 results from the previous call */
-        int rinet = lwip_getaddrinfo(hostname, servname, &h, rinet6 == 0 && *res ? &((*res)->ai_next) : res);
+        int rinet = cachedGetaddrinfo(hostname, servname, &h, rinet6 == 0 && *res ? &((*res)->ai_next) : res,
+                &resolvedInet);
 
-        if (rinet6 == 0 || rinet == 0) {
-            return 0;
+        /* Cache the family the host has no address of, so that it's not queried on every lookup */
+        if (rinet6 != 0 && rinet == 0 && resolvedInet6) {
+            updateDnsCacheMissing(hostname, AF_INET6);
+        } else if (rinet != 0 && rinet6 == 0 && resolvedInet) {
+            updateDnsCacheMissing(hostname, AF_INET);
         }
 
-        return std::max(rinet, rinet6);
+        if (rinet6 == 0 || rinet == 0) {
+            r = 0;
+        } else {
+            r = std::max(rinet, rinet6);
+        }
+    } else {
+        r = cachedGetaddrinfo(hostname, servname, hints, res);
     }
-    return lwip_getaddrinfo(hostname, servname, hints, res);
+    saveDnsCacheIfChanged();
+    return r;
+}
+
+int netdb_get_cache_stats(netdb_cache_stats* stats, void* reserved) {
+    CHECK_TRUE(stats, SYSTEM_ERROR_INVALID_ARGUMENT);
+    loadDnsCacheIfNeeded();
+    DnsCacheLock lock(s_dnsCacheMutex);
+    const auto& s = s_dnsCache.stats();
+    netdb_cache_stats st = {};
+    st.entries = s_dnsCache.size();
+    st.hits = s.hits;
+    st.stale_hits = s.staleHits;
+    st.misses = s.misses;
+    const size_t size = std::min<size_t>(stats->size ? stats->size : sizeof(st), sizeof(st));
+    memcpy(stats, &st, size);
+    stats->size = size;
+    return 0;
 }
 
 int netdb_getnameinfo(const struct sockaddr* sa, socklen_t salen, char* host,
@@ -253,8 +253,6 @@ err_t OpenThreadNetif::initCb(netif* netif) {
 err_t OpenThreadNetif::outputIp6Cb(netif* netif, pbuf* p, const ip6_addr_t* addr) {
     auto self = static_cast<OpenThreadNetif*>(netif->state);
 
-    ot::ThreadLock lk;
-
     ip_addr_t src = {};
     ip_addr_t dst = {};
     struct ip6_hdr* ip6hdr = (struct ip6_hdr *)p->payload;
@@ -273,16 +271,24 @@ err_t OpenThreadNetif::outputIp6Cb(netif* netif, pbuf* p, const ip6_addr_t* addr
     settings.mLinkSecurityEnabled = 1;
     settings.mPriority = OT_MESSAGE_PRIORITY_NORMAL;
 
+    ot::ThreadLock lk;
+
     auto msg = otIp6NewMessage(self->ot_, &settings);
     if (msg == nullptr) {
         LOG(TRACE, "out of memory");
         return ERR_MEM;
     }
 
-    int ret = OT_ERROR_NONE;
+    // Allocate the message buffers for the entire chain at once instead of growing the message
+    // with every appended pbuf
+    int ret = otMessageSetLength(msg, p->tot_len);
 
+    uint16_t offset = 0;
     for (auto q = p; q != nullptr && ret == OT_ERROR_NONE; q = q->next) {
-        ret = otMessageAppend(msg, q->payload, q->len);
+        if (otMessageWrite(msg, offset, q->payload, q->len) != q->len) {
+            ret = OT_ERROR_NO_BUFS;
+        }
+        offset += q->len;
     }
 
     if (ret == OT_ERROR_NONE) {
@@ -800,6 +806,8 @@ void OpenThreadNetif::input(otMessage* msg) {
     }
     uint16_t len = otMessageGetLength(msg);
     //LOG(TRACE, "OpenThreadNetif(%x): input() length %u", this, len);
+    // Reserve the link headroom: with IPv6 forwarding enabled the packet may be forwarded
+    // to an Ethernet or Wi-Fi interface, which prepends its link header in place
     auto p = pbuf_alloc(PBUF_IP, len, PBUF_POOL);
     if (p) {
         uint16_t written = 0;
@@ -29,10 +29,22 @@ extern "C" {
 #include "socket_hal.h"
 #include "inet_hal.h"
 #include "system_error.h"
+#include "timer_hal.h"
 #include "lwiplock.h"
 
 using namespace particle::net::ppp;
 
+namespace {
+
+// The output is collected into writes of up to the maximum size of a multiplexer frame
+const size_t OUTPUT_BUFFER_SIZE = 1500;
+// Smaller frames, such as TCP ACKs and LCP echoes, are kept in the buffer for up to
+// OUTPUT_FLUSH_DELAY milliseconds to be written together with the subsequent frames
+const size_t OUTPUT_BATCH_FRAME_SIZE = 128;
+const unsigned OUTPUT_FLUSH_DELAY = 5;
+
+} // anonymous
+
 std::once_flag Client::once_;
 netif_ext_callback_t Client::netifCb_ = {};
 int Client::netifClientDataIdx_ = -1;
@@ -63,6 +75,7 @@ void Client::init() {
   if (!inited_) {
     LOG(TRACE, "PPP client initializing");
     inited_ = true;
+    SPARK_ASSERT(outputBuf_.init(OUTPUT_BUFFER_SIZE, OUTPUT_BATCH_FRAME_SIZE, &Client::writeOutputCb, this) == 0);
     pcb_ = pppapi_pppos_create(&if_, &Client::outputCb, &Client::notifyStatusCb, this);
     SPARK_ASSERT(pcb_);
     if_.flags &= ~NETIF_FLAG_UP;
@@ -125,7 +138,13 @@ bool Client::prepareConnect() {
 
   // FIXME:
   static const char UBLOX_NCP_CONNECT_COMMAND[] = "ATD*99***1#\r\n";
-  output((const uint8_t*)UBLOX_NCP_CONNECT_COMMAND, sizeof(UBLOX_NCP_CONNECT_COMMAND) - 1);
+  {
+    std::lock_guard<std::mutex> lk(outputMutex_);
+    // Discard the output of the previous session
+    outputBuf_.reset();
+    outputBuf_.resetStats();
+    outputBuf_.writeRaw((const uint8_t*)UBLOX_NCP_CONNECT_COMMAND, sizeof(UBLOX_NCP_CONNECT_COMMAND) - 1);
+  }
   return true;
 }
 
@@ -214,6 +233,11 @@ netif* Client::getIf() {
   return &if_;
 }
 
+PppOutputBuffer::Stats Client::outputStats() {
+  std::lock_guard<std::mutex> lk(outputMutex_);
+  return outputBuf_.stats();
+}
+
 void Client::loopCb(void* arg) {
   Client* self = static_cast<Client*>(arg);
   if (self) {
@@ -227,6 +251,10 @@ void Client::loop() {
   LOG(TRACE, "PPP thread started");
   while(!exit_) {
     unsigned qWait = 100;
+    const unsigned flushWait = flushOutput();
+    if (flushWait > 0) {
+      qWait = flushWait;
+    }
 
     switch (state_) {
       case STATE_CONNECT: {
@@ -274,7 +302,7 @@ void Client::loop() {
     }
 
     uint64_t ev = 0;
-    if (os_queue_take(queue_, &ev, qWait, nullptr) == 0) {
+    if (os_queue_take(queue_, &ev, qWait, nullptr) == 0 && ev != EVENT_FLUSH) {
       LOG(TRACE, "PPP thread event %s", eventNames_[ev]);
       /* Incoming event */
       switch (ev) {
@@ -357,13 +385,41 @@ uint32_t Client::outputCb(ppp_pcb* pcb, uint8_t* data, uint32_t len, void* ctx)
 uint32_t Client::output(const uint8_t* data, size_t len) {
   LOG_DEBUG(TRACE, "Outputing %lu bytes", len);
 
-  if (oCb_) {
-    auto r = oCb_(data, len, oCbCtx_);
-    if (r >= 0) {
+  std::lock_guard<std::mutex> lk(outputMutex_);
+  const bool pending = outputBuf_.hasPendingFrames();
+  if (outputBuf_.write(data, len) < 0) {
+    return 0;
+  }
+  if (!pending && outputBuf_.hasPendingFrames()) {
+    // Wake up the PPP thread to flush the batched frames
+    outputFlushTime_ = HAL_Timer_Get_Milli_Seconds() + OUTPUT_FLUSH_DELAY;
+    uint64_t ev = EVENT_FLUSH;
+    os_queue_put(queue_, &ev, 0, nullptr);
+  }
+  return len;
+}
+
+int Client::writeOutputCb(const uint8_t* data, size_t size, void* ctx) {
+  Client* self = static_cast<Client*>(ctx);
+  if (self->oCb_) {
+    const int r = self->oCb_(data, size, self->oCbCtx_);
+    if (r < 0) {
       return r;
     }
   }
+  return 0;
+}
 
+unsigned Client::flushOutput() {
+  std::lock_guard<std::mutex> lk(outputMutex_);
+  if (!outputBuf_.hasPendingFrames()) {
+    return 0;
+  }
+  const system_tick_t now = HAL_Timer_Get_Milli_Seconds();
+  if ((int32_t)(outputFlushTime_ - now) > 0) {
+    return outputFlushTime_ - now;
+  }
+  outputBuf_.flush();
   return 0;
 }
 
@@ -427,6 +483,11 @@ void Client::transition(State newState) {
       auto cb = cb_;
       auto ctx = cbCtx_;
       lk.unlock();
+      if (state_ == STATE_DISCONNECTED) {
+        const auto stats = outputStats();
+        LOG(TRACE, "PPP output: %u frames, %u writes, %u bytes", (unsigned)stats.frames, (unsigned)stats.writes,
+            (unsigned)stats.bytes);
+      }
       if (cb) {
         if (state_ == STATE_CONNECTED) {
           cb(this, EVENT_UP, ctx);
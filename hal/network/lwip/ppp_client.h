@@ -28,6 +28,7 @@ extern "C" {
 #if defined(PPP_SUPPORT) && PPP_SUPPORT
 
 #include "ppp_ipcp.h"
+#include "ppp_output_buffer.h"
 #include "concurrent_hal.h"
 #include <mutex>
 #include <atomic>
@@ -61,7 +62,8 @@ public:
     EVENT_ADM_UP      = 0x05,
     EVENT_ADM_DOWN    = 0x06,
     EVENT_ERROR       = 0x07,
-    EVENT_MAX         = 0x08
+    EVENT_FLUSH       = 0x08,
+    EVENT_MAX         = 0x09
   };
 
   enum State {
@@ -90,6 +92,8 @@ public:
 
   netif* getIf();
 
+  PppOutputBuffer::Stats outputStats();
+
 private:
 
   static constexpr const char* eventNames_[] = {
@@ -100,7 +104,8 @@ private:
     "DOWN",
     "ADM_UP",
     "ADM_DOWN",
-    "ERROR"
+    "ERROR",
+    "FLUSH"
   };
 
   static constexpr const char* stateNames_[] = {
@@ -124,6 +129,8 @@ private:
 
   static uint32_t outputCb(ppp_pcb* pcb, uint8_t* data, uint32_t len, void* ctx);
   uint32_t output(const uint8_t* data, size_t len);
+  static int writeOutputCb(const uint8_t* data, size_t size, void* ctx);
+  unsigned flushOutput();
 
   static void notifyPhaseCb(ppp_pcb* pcb, uint8_t phase, void* ctx);
   void notifyPhase(uint8_t phase);
@@ -164,6 +171,10 @@ private:
   OutputCallback oCb_ = nullptr;
   void* oCbCtx_ = nullptr;
 
+  std::mutex outputMutex_;
+  PppOutputBuffer outputBuf_;
+  system_tick_t outputFlushTime_ = 0;
+
   bool inited_ = false;
   std::atomic_bool running_;
   std::atomic_bool exit_;
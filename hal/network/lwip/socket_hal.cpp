@@ -23,10 +23,201 @@
 
 /* socket_hal_posix_impl.h should get included from socket_hal.h automagically */
 #include "socket_hal.h"
+#include "timer_hal.h"
+#include "lwiplock.h"
+#include "system_error.h"
+#include <lwip/priv/sockets_priv.h>
+#include <lwip/priv/tcp_priv.h>
+#include <lwip/api.h>
+#include <lwip/ip.h>
+#include <algorithm>
 #include <cstdarg>
+#include <cstring>
+#include <cerrno>
+#include <mutex>
+
+namespace {
+
+// Counters accumulated over the lifetime of a socket
+struct SocketCounters {
+  uint64_t txTime; // Microseconds
+  uint64_t rxTime;
+  uint32_t txBytes;
+  uint32_t txCount;
+  uint32_t txStalls;
+  uint32_t rxBytes;
+  uint32_t rxCount;
+};
+
+struct SocketEntry {
+  SocketCounters counters;
+  uint8_t type;
+  bool open;
+};
+
+// Counters of the closed sockets
+struct NetifEntry {
+  SocketCounters counters;
+  uint8_t netif;
+};
+
+const size_t MAX_NETIF_ENTRIES = 8;
+
+SocketEntry g_sockets[NUM_SOCKETS] = {};
+NetifEntry g_netifs[MAX_NETIF_ENTRIES] = {};
+SocketCounters g_closedCounters = {};
+// Protects the counters. When both locks are needed, the lwIP core lock is acquired first
+std::mutex g_statsMutex;
+
+SocketEntry* socketEntry(int s) {
+  const int index = s - LWIP_SOCKET_OFFSET;
+  if (index < 0 || index >= NUM_SOCKETS) {
+    return nullptr;
+  }
+  return &g_sockets[index];
+}
+
+void addCounters(SocketCounters* dest, const SocketCounters& src) {
+  dest->txTime += src.txTime;
+  dest->rxTime += src.rxTime;
+  dest->txBytes += src.txBytes;
+  dest->txCount += src.txCount;
+  dest->txStalls += src.txStalls;
+  dest->rxBytes += src.rxBytes;
+  dest->rxCount += src.rxCount;
+}
+
+void addCounters(sock_stats* dest, const SocketCounters& src) {
+  dest->tx_time += src.txTime / 1000;
+  dest->rx_time += src.rxTime / 1000;
+  dest->tx_bytes += src.txBytes;
+  dest->tx_count += src.txCount;
+  dest->tx_stalls += src.txStalls;
+  dest->rx_bytes += src.rxBytes;
+  dest->rx_count += src.rxCount;
+}
+
+void socketOpened(int s, int type) {
+  std::lock_guard<std::mutex> lk(g_statsMutex);
+  const auto e = socketEntry(s);
+  if (e) {
+    *e = SocketEntry();
+    e->type = type;
+    e->open = true;
+  }
+}
+
+void socketSent(int s, ssize_t ret, size_t size, uint64_t time) {
+  const int error = errno;
+  {
+    std::lock_guard<std::mutex> lk(g_statsMutex);
+    const auto e = socketEntry(s);
+    if (e && e->open) {
+      auto& c = e->counters;
+      c.txTime += time;
+      if (ret >= 0) {
+        c.txBytes += ret;
+        ++c.txCount;
+        if ((size_t)ret < size) {
+          ++c.txStalls;
+        }
+      } else if (error == EWOULDBLOCK || error == EAGAIN) {
+        ++c.txStalls;
+      }
+    }
+  }
+  errno = error;
+}
+
+void socketReceived(int s, ssize_t ret, uint64_t time) {
+  const int error = errno;
+  {
+    std::lock_guard<std::mutex> lk(g_statsMutex);
+    const auto e = socketEntry(s);
+    if (e && e->open) {
+      auto& c = e->counters;
+      c.rxTime += time;
+      if (ret >= 0) {
+        c.rxBytes += ret;
+        ++c.rxCount;
+      }
+    }
+  }
+  errno = error;
+}
+
+// Returns the index of the interface used by the socket. This function needs to be called with
+// the lwIP core lock held
+uint8_t socketNetif(int s) {
+  const auto sock = lwip_socket_dbg_get_socket(s);
+  if (!sock || !sock->conn || !sock->conn->pcb.ip) {
+    return NETIF_NO_INDEX;
+  }
+  const auto pcb = sock->conn->pcb.ip;
+  if (pcb->netif_idx != NETIF_NO_INDEX) {
+    return pcb->netif_idx;
+  }
+  if (ip_addr_isany(&pcb->remote_ip)) {
+    return NETIF_NO_INDEX;
+  }
+  const auto iface = ip_route(&pcb->local_ip, &pcb->remote_ip);
+  return iface ? netif_get_index(iface) : NETIF_NO_INDEX;
+}
+
+// Fills in the TCP connection parameters. This function needs to be called with the lwIP core
+// lock held
+void getTcpStats(int s, sock_stats* stats) {
+  const auto sock = lwip_socket_dbg_get_socket(s);
+  if (!sock || !sock->conn || NETCONNTYPE_GROUP(netconn_type(sock->conn)) != NETCONN_TCP ||
+      !sock->conn->pcb.tcp) {
+    return;
+  }
+  const auto pcb = sock->conn->pcb.tcp;
+  // The estimates are maintained in the units of the slow TCP timer, the average RTT is scaled by 8
+  stats->rtt = (pcb->sa > 0) ? (pcb->sa >> 3) * TCP_SLOW_INTERVAL : 0;
+  stats->rto = (pcb->rto > 0) ? pcb->rto * TCP_SLOW_INTERVAL : 0;
+  stats->retransmits = pcb->nrtx;
+  stats->snd_buf = tcp_sndbuf(pcb);
+  stats->snd_wnd = pcb->snd_wnd;
+}
+
+void socketClosed(int s) {
+  LwipTcpIpCoreLock lk;
+  const uint8_t netif = socketNetif(s);
+  std::lock_guard<std::mutex> statsLk(g_statsMutex);
+  const auto e = socketEntry(s);
+  if (!e || !e->open) {
+    return;
+  }
+  e->open = false;
+  addCounters(&g_closedCounters, e->counters);
+  if (netif == NETIF_NO_INDEX) {
+    return;
+  }
+  NetifEntry* entry = nullptr;
+  for (size_t i = 0; i < MAX_NETIF_ENTRIES; ++i) {
+    if (g_netifs[i].netif == netif) {
+      entry = &g_netifs[i];
+      break;
+    }
+    if (!entry && g_netifs[i].netif == NETIF_NO_INDEX) {
+      entry = &g_netifs[i];
+    }
+  }
+  if (entry) {
+    entry->netif = netif;
+    addCounters(&entry->counters, e->counters);
+  }
+}
+
+} // namespace
 
 int sock_accept(int s, struct sockaddr* addr, socklen_t* addrlen) {
-  return lwip_accept(s, addr, addrlen);
+  const int ret = lwip_accept(s, addr, addrlen);
+  if (ret >= 0) {
+    socketOpened(ret, SOCK_STREAM);
+  }
+  return ret;
 }
 
 int sock_bind(int s, const struct sockaddr* name, socklen_t namelen) {
@@ -54,6 +245,7 @@ int sock_setsockopt(int s, int level, int optname, const void* optval, socklen_t
 }
 
 int sock_close(int s) {
+  socketClosed(s);
   return lwip_close(s);
 }
 
@@ -66,25 +258,41 @@ int sock_listen(int s, int backlog) {
 }
 
 ssize_t sock_recv(int s, void* mem, size_t len, int flags) {
-  return lwip_recv(s, mem, len, flags);
+  const uint64_t t = hal_timer_micros(nullptr);
+  const ssize_t ret = lwip_recv(s, mem, len, flags);
+  socketReceived(s, ret, hal_timer_micros(nullptr) - t);
+  return ret;
 }
 
 ssize_t sock_recvfrom(int s, void* mem, size_t len, int flags,
                       struct sockaddr* from, socklen_t* fromlen) {
-  return lwip_recvfrom(s, mem, len, flags, from, fromlen);
+  const uint64_t t = hal_timer_micros(nullptr);
+  const ssize_t ret = lwip_recvfrom(s, mem, len, flags, from, fromlen);
+  socketReceived(s, ret, hal_timer_micros(nullptr) - t);
+  return ret;
 }
 
 ssize_t sock_send(int s, const void* dataptr, size_t size, int flags) {
-  return lwip_send(s, dataptr, size, flags);
+  const uint64_t t = hal_timer_micros(nullptr);
+  const ssize_t ret = lwip_send(s, dataptr, size, flags);
+  socketSent(s, ret, size, hal_timer_micros(nullptr) - t);
+  return ret;
 }
 
 ssize_t sock_sendto(int s, const void* dataptr, size_t size, int flags,
                     const struct sockaddr* to, socklen_t tolen) {
-  return lwip_sendto(s, dataptr, size, flags, to, tolen);
+  const uint64_t t = hal_timer_micros(nullptr);
+  const ssize_t ret = lwip_sendto(s, dataptr, size, flags, to, tolen);
+  socketSent(s, ret, size, hal_timer_micros(nullptr) - t);
+  return ret;
 }
 
 int sock_socket(int domain, int type, int protocol) {
-  return lwip_socket(domain, type, protocol);
+  const int ret = lwip_socket(domain, type, protocol);
+  if (ret >= 0) {
+    socketOpened(ret, type);
+  }
+  return ret;
 }
 
 int sock_fcntl(int s, int cmd, ...) {
@@ -94,3 +302,70 @@ int sock_fcntl(int s, int cmd, ...) {
   va_end(vl);
   return lwip_fcntl(s, cmd, val);
 }
+
+int sock_get_stats(int s, sock_stats* stats, void* reserved) {
+  if (!stats) {
+    return SYSTEM_ERROR_INVALID_ARGUMENT;
+  }
+  if (s - LWIP_SOCKET_OFFSET >= NUM_SOCKETS) {
+    return SYSTEM_ERROR_OUT_OF_RANGE;
+  }
+  if (!socketEntry(s)) {
+    return SYSTEM_ERROR_NOT_FOUND;
+  }
+  sock_stats st = {};
+  st.size = sizeof(st);
+  LwipTcpIpCoreLock lk;
+  {
+    std::lock_guard<std::mutex> statsLk(g_statsMutex);
+    const auto e = socketEntry(s);
+    if (!e->open) {
+      return SYSTEM_ERROR_NOT_FOUND;
+    }
+    st.type = e->type;
+    addCounters(&st, e->counters);
+  }
+  st.netif = socketNetif(s);
+  getTcpStats(s, &st);
+  const size_t size = std::min<size_t>(stats->size ? stats->size : sizeof(st), sizeof(st));
+  memcpy(stats, &st, size);
+  stats->size = size;
+  return 0;
+}
+
+int sock_get_netif_stats(uint8_t netif, sock_stats* stats, void* reserved) {
+  if (!stats) {
+    return SYSTEM_ERROR_INVALID_ARGUMENT;
+  }
+  sock_stats st = {};
+  st.size = sizeof(st);
+  st.netif = netif;
+  LwipTcpIpCoreLock lk;
+  // Determine the interfaces of the open sockets before acquiring the statistics lock
+  uint8_t netifs[NUM_SOCKETS] = {};
+  if (netif != NETIF_NO_INDEX) {
+    for (int i = 0; i < NUM_SOCKETS; ++i) {
+      netifs[i] = socketNetif(LWIP_SOCKET_OFFSET + i);
+    }
+  }
+  std::lock_guard<std::mutex> statsLk(g_statsMutex);
+  if (netif == NETIF_NO_INDEX) {
+    addCounters(&st, g_closedCounters);
+  } else {
+    for (size_t i = 0; i < MAX_NETIF_ENTRIES; ++i) {
+      if (g_netifs[i].netif == netif) {
+        addCounters(&st, g_netifs[i].counters);
+        break;
+      }
+    }
+  }
+  for (int i = 0; i < NUM_SOCKETS; ++i) {
+    if (g_sockets[i].open && (netif == NETIF_NO_INDEX || netifs[i] == netif)) {
+      addCounters(&st, g_sockets[i].counters);
+    }
+  }
+  const size_t size = std::min<size_t>(stats->size ? stats->size : sizeof(st), sizeof(st));
+  memcpy(stats, &st, size);
+  stats->size = size;
+  return 0;
+}
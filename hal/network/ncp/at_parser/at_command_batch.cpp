@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "at_command_batch.h"
+
+#include "system_error.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+
+namespace particle {
+
+AtBatchResponse::AtBatchResponse() :
+        lineCount_(0),
+        result_(SYSTEM_ERROR_INVALID_STATE),
+        resultErrorCode_(0) {
+}
+
+const char* AtBatchResponse::line(size_t index) const {
+    if (index >= lineCount_) {
+        return nullptr;
+    }
+    const char* s = data_.data();
+    for (size_t i = 0; i < index; ++i) {
+        s += strlen(s) + 1;
+    }
+    return s;
+}
+
+int AtBatchResponse::scanf(const char* fmt, ...) const {
+    va_list args;
+    va_start(args, fmt);
+    const int ret = vscanf(fmt, args);
+    va_end(args);
+    return ret;
+}
+
+int AtBatchResponse::vscanf(const char* fmt, va_list args) const {
+    if (lineCount_ == 0) {
+        return SYSTEM_ERROR_NOT_FOUND;
+    }
+    const int n = vsscanf(data_.data(), fmt, args);
+    if (n < 0) {
+        return SYSTEM_ERROR_BAD_DATA;
+    }
+    return n;
+}
+
+int AtBatchResponse::appendLine(const char* data, size_t size) {
+    // Truncate the response data if it doesn't fit in the buffer
+    const size_t avail = MAX_DATA_SIZE - data_.size();
+    if (avail == 0) {
+        return 0;
+    }
+    size = std::min(size, avail - 1);
+    if (!data_.append(data, size) || !data_.append('\0')) {
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    ++lineCount_;
+    return 0;
+}
+
+void AtBatchResponse::reset() {
+    data_.clear();
+    lineCount_ = 0;
+    result_ = SYSTEM_ERROR_INVALID_STATE;
+    resultErrorCode_ = 0;
+}
+
+AtCommandBatch::AtCommandBatch() :
+        lookahead_(DEFAULT_LOOKAHEAD) {
+}
+
+int AtCommandBatch::add(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    const int ret = vadd(0 /* timeout */, fmt, args);
+    va_end(args);
+    return ret;
+}
+
+int AtCommandBatch::add(unsigned timeout, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    const int ret = vadd(timeout, fmt, args);
+    va_end(args);
+    return ret;
+}
+
+int AtCommandBatch::vadd(unsigned timeout, const char* fmt, va_list args) {
+    va_list args2;
+    va_copy(args2, args);
+    const int n = vsnprintf(nullptr, 0, fmt, args2);
+    va_end(args2);
+    if (n <= 0) {
+        return (n < 0) ? SYSTEM_ERROR_UNKNOWN : SYSTEM_ERROR_INVALID_ARGUMENT;
+    }
+    Command cmd;
+    // Reserve space for the terminating null that is written by vsnprintf()
+    if (!cmd.data.resize(n + 1)) {
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    vsnprintf(cmd.data.data(), n + 1, fmt, args);
+    cmd.data.resize(n);
+    cmd.timeout = timeout;
+    cmd.echoed = false;
+    if (!cmds_.append(std::move(cmd))) {
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    return cmds_.size() - 1;
+}
+
+} // particle
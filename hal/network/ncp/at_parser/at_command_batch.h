@@ -0,0 +1,263 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "spark_wiring_vector.h"
+
+#include <cstddef>
+#include <cstdarg>
+
+namespace particle {
+
+namespace detail {
+
+class AtParserImpl;
+
+} // particle::detail
+
+/**
+ * Response to an AT command executed as part of a batch.
+ *
+ * Unlike `AtResponse`, this class stores the entire response data, so the responses to all
+ * commands of a batch can be inspected after the batch has been executed:
+ *
+ * ```cpp
+ * char iccid[32] = {};
+ * const auto& resp = batch.response(0);
+ * if (resp.result() == AtResponse::OK && resp.scanf("+CCID: %31s", iccid) == 1) {
+ *     LOG(INFO, "ICCID: %s", iccid);
+ * }
+ * ```
+ *
+ * @see `AtCommandBatch`
+ */
+class AtBatchResponse {
+public:
+    /**
+     * Maximum number of characters of the response data stored by this object.
+     */
+    static const size_t MAX_DATA_SIZE = 512;
+
+    /**
+     * Constructs a response object.
+     */
+    AtBatchResponse();
+    /**
+     * Returns the final result code.
+     *
+     * @return One of the values defined by `AtResponse::Result`, or a negative result code if
+     *         the command could not be executed.
+     */
+    int result() const;
+    /**
+     * Returns the error code reported via the "+CME ERROR" or "+CMS ERROR" result code.
+     *
+     * @return Error code.
+     */
+    int resultErrorCode() const;
+    /**
+     * Returns the number of response lines.
+     */
+    size_t lineCount() const;
+    /**
+     * Returns a response line.
+     *
+     * @param index Line index.
+     * @return Null-terminated string, or `nullptr` if the index is out of range.
+     */
+    const char* line(size_t index) const;
+    /**
+     * Parses the first response line.
+     *
+     * @param fmt scanf-style format string.
+     * @param ... Output arguments.
+     * @return Number of items matched and assigned, or a negative result code in case of an error.
+     */
+    int scanf(const char* fmt, ...) const __attribute__((format(scanf, 2, 3)));
+    /**
+     * Parses the first response line.
+     *
+     * @param fmt scanf-style format string.
+     * @param args Output arguments.
+     * @return Number of items matched and assigned, or a negative result code in case of an error.
+     */
+    int vscanf(const char* fmt, va_list args) const;
+
+private:
+    spark::Vector<char> data_; // Null-terminated response lines
+    size_t lineCount_;
+    int result_;
+    int resultErrorCode_;
+
+    int appendLine(const char* data, size_t size);
+    void reset();
+
+    friend class AtCommandBatch;
+    friend class detail::AtParserImpl;
+};
+
+/**
+ * Batch of independent AT commands.
+ *
+ * The commands are sent by `AtParser::execBatch()` in the order in which they were added.
+ * By default, the parser waits for the final result code of a command before sending the next
+ * command, just like it does for commands sent via `AtParser::command()`. If the DCE can queue
+ * incoming command lines while it's processing a command, setting the lookahead to a value
+ * greater than 1 makes the parser send up to that number of commands without waiting for their
+ * responses. This saves the round trip between the DTE and DCE for every command.
+ *
+ * ```cpp
+ * AtCommandBatch batch;
+ * batch.lookahead(3);
+ * batch.add("AT+CCID");
+ * batch.add("AT+CGSN");
+ * batch.add("AT+CSQ");
+ * CHECK(parser.execBatch(&batch));
+ * ```
+ *
+ * The DCE is expected to process the commands in order. Only commands that don't affect how
+ * the following commands of the batch are parsed should be pipelined, e.g. a command that
+ * changes the echo setting or the format of the result codes should be sent on its own.
+ *
+ * @see `AtParser::execBatch()`
+ */
+class AtCommandBatch {
+public:
+    /**
+     * Default number of commands sent ahead.
+     *
+     * @see `lookahead()`
+     */
+    static const size_t DEFAULT_LOOKAHEAD = 1;
+
+    /**
+     * Constructs an empty batch.
+     */
+    AtCommandBatch();
+    /**
+     * Formats and adds an AT command to the batch.
+     *
+     * @param fmt printf-style format string.
+     * @param ... Formatting arguments.
+     * @return Index of the command, or a negative result code in case of an error.
+     */
+    int add(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+    /**
+     * Formats and adds an AT command to the batch.
+     *
+     * This method is similar to `add(const char* fmt, ...)`, but it also overrides the default
+     * command timeout.
+     *
+     * @param timeout Timeout in milliseconds.
+     * @param fmt printf-style format string.
+     * @param ... Formatting arguments.
+     * @return Index of the command, or a negative result code in case of an error.
+     *
+     * @see `AtParserConfig::commandTimeout()`
+     */
+    int add(unsigned timeout, const char* fmt, ...) __attribute__((format(printf, 3, 4)));
+    /**
+     * Formats and adds an AT command to the batch.
+     *
+     * @param timeout Timeout in milliseconds, or `0` to use the default command timeout.
+     * @param fmt printf-style format string.
+     * @param args Formatting arguments.
+     * @return Index of the command, or a negative result code in case of an error.
+     */
+    int vadd(unsigned timeout, const char* fmt, va_list args);
+    /**
+     * Sets the maximum number of commands that are sent before the final result code of the
+     * oldest of them is received.
+     *
+     * @param count Number of commands.
+     * @return This batch object.
+     *
+     * @see `DEFAULT_LOOKAHEAD`
+     */
+    AtCommandBatch& lookahead(size_t count);
+    /**
+     * Returns the maximum number of commands that are sent before the final result code of the
+     * oldest of them is received.
+     *
+     * @see `DEFAULT_LOOKAHEAD`
+     */
+    size_t lookahead() const;
+    /**
+     * Returns the number of commands in the batch.
+     */
+    size_t size() const;
+    /**
+     * Returns the response to a command.
+     *
+     * @param index Command index.
+     * @return Response object.
+     */
+    const AtBatchResponse& response(size_t index) const;
+    /**
+     * Removes all commands from the batch.
+     */
+    void clear();
+
+private:
+    struct Command {
+        spark::Vector<char> data; // Command line without the terminator
+        unsigned timeout; // Command timeout, or 0 if the default timeout is used
+        bool echoed; // Set if the command echo has been received
+        AtBatchResponse resp; // Response
+    };
+
+    spark::Vector<Command> cmds_;
+    size_t lookahead_;
+
+    friend class detail::AtParserImpl;
+};
+
+inline int AtBatchResponse::result() const {
+    return result_;
+}
+
+inline int AtBatchResponse::resultErrorCode() const {
+    return resultErrorCode_;
+}
+
+inline size_t AtBatchResponse::lineCount() const {
+    return lineCount_;
+}
+
+inline AtCommandBatch& AtCommandBatch::lookahead(size_t count) {
+    lookahead_ = (count > 0) ? count : 1;
+    return *this;
+}
+
+inline size_t AtCommandBatch::lookahead() const {
+    return lookahead_;
+}
+
+inline size_t AtCommandBatch::size() const {
+    return cmds_.size();
+}
+
+inline const AtBatchResponse& AtCommandBatch::response(size_t index) const {
+    return cmds_.at(index).resp;
+}
+
+inline void AtCommandBatch::clear() {
+    cmds_.clear();
+}
+
+} // particle
@@ -99,6 +99,12 @@ int AtParser::execCommand(unsigned timeout, const char* fmt, ...) {
     return cmd.exec();
 }
 
+int AtParser::execBatch(AtCommandBatch* batch) {
+    CHECK_TRUE(p_, SYSTEM_ERROR_INVALID_STATE);
+    CHECK_TRUE(batch, SYSTEM_ERROR_INVALID_ARGUMENT);
+    return p_->execBatch(batch);
+}
+
 int AtParser::addUrcHandler(const char* prefix, UrcHandler handler, void* data) {
     CHECK_TRUE(p_, SYSTEM_ERROR_INVALID_STATE);
     return p_->addUrcHandler(prefix, handler, data);
@@ -28,6 +28,7 @@ class AtParserImpl;
 } // particle::detail
 
 class AtCommand;
+class AtCommandBatch;
 class AtResponse;
 class AtResponseReader;
 class Stream;
@@ -316,6 +317,20 @@ public:
      * @see `AtParserConfig::commandTimeout()`
      */
     int execCommand(unsigned timeout, const char* fmt, ...);
+    /**
+     * Executes a batch of AT commands.
+     *
+     * The responses to the commands are stored in the batch object. A command that completed
+     * with a final result code other than `AtResponse::OK` doesn't stop the execution of the
+     * batch.
+     *
+     * @param batch Batch of AT commands.
+     * @return `0` if a final result code has been received for all commands, or a negative result
+     *         code in case of an error.
+     *
+     * @see `AtCommandBatch`
+     */
+    int execBatch(AtCommandBatch* batch);
     /**
      * Registers an URC handler.
      *
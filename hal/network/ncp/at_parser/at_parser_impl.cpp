@@ -109,7 +109,10 @@ inline system_tick_t millis() {
 AtParserImpl::AtParserImpl(AtParserConfig conf) :
         cmdTerm_(cmdTermStr(conf.commandTerminator())),
         cmdTermSize_(strlen(cmdTerm_)),
-        conf_(std::move(conf)) {
+        conf_(std::move(conf)),
+        batch_(nullptr),
+        batchBegin_(0),
+        batchEnd_(0) {
     reset();
 }
 
@@ -320,6 +323,60 @@ int AtParserImpl::processUrc(unsigned timeout) {
     return urcCount;
 }
 
+int AtParserImpl::execBatch(AtCommandBatch* batch) {
+    if (!checkStatus(StatusFlag::READY)) {
+        return SYSTEM_ERROR_BUSY;
+    }
+    const size_t count = batch->cmds_.size();
+    for (size_t i = 0; i < count; ++i) {
+        auto& cmd = batch->cmds_.at(i);
+        cmd.echoed = false;
+        cmd.resp.reset();
+    }
+    clearStatus(StatusFlag::READY);
+    batch_ = batch;
+    batchBegin_ = 0;
+    batchEnd_ = 0;
+    int ret = 0;
+    // Make sure the previous command has been terminated
+    if (checkStatus(StatusFlag::FLUSH_CMD)) {
+        unsigned timeout = conf_.commandTimeout();
+        ret = flushCommand(&timeout);
+    }
+    while (ret >= 0 && batchBegin_ < count) {
+        // Send the following commands without waiting for the responses to the previous ones
+        while (batchEnd_ < count && batchEnd_ - batchBegin_ < batch->lookahead_) {
+            const auto& cmd = batch->cmds_.at(batchEnd_);
+            unsigned timeout = cmd.timeout ? cmd.timeout : conf_.commandTimeout();
+            ret = sendBatchCommand(cmd.data.data(), cmd.data.size(), &timeout);
+            if (ret < 0) {
+                break;
+            }
+            ++batchEnd_;
+        }
+        if (ret < 0) {
+            break;
+        }
+        const auto& cmd = batch->cmds_.at(batchBegin_);
+        cmdTimeout_ = cmd.timeout ? cmd.timeout : conf_.commandTimeout();
+        ret = readBatchResponse(batchBegin_);
+        if (ret < 0) {
+            break;
+        }
+        ++batchBegin_;
+    }
+    if (ret < 0) {
+        // None of the remaining commands can be considered executed
+        for (size_t i = batchBegin_; i < count; ++i) {
+            batch->cmds_.at(i).resp.result_ = ret;
+        }
+    }
+    batch_ = nullptr;
+    clearStatus(StatusFlag::HAS_RESULT | StatusFlag::HAS_ECHO);
+    setStatus(StatusFlag::READY);
+    return (ret < 0) ? ret : 0;
+}
+
 void AtParserImpl::reset() {
     bufPos_ = 0;
     cmdSize_ = 0;
@@ -374,6 +431,64 @@ int AtParserImpl::waitEcho() {
     return 0;
 }
 
+int AtParserImpl::sendBatchCommand(const char* data, size_t size, unsigned* timeout) {
+    size_t n = size;
+    const int ret = write(data, &n, timeout);
+    cmdSize_ = appendToBuf(cmdData_, CMD_BUF_SIZE, data, n);
+    if (cmdSize_ > 0) {
+        // The command needs to be terminated even if it has not been written entirely
+        cmdTermOffs_ = 0;
+        setStatus(StatusFlag::FLUSH_CMD);
+    }
+    CHECK(ret);
+    return flushCommand(timeout);
+}
+
+int AtParserImpl::readBatchResponse(size_t index) {
+    auto& cmd = batch_->cmds_.at(index);
+    const bool echoEnabled = conf_.echoEnabled();
+    // The echoes of the commands that have been sent ahead may be received before the response
+    // to this command, so the parser looks for all of them
+    while (echoEnabled && !cmd.echoed) {
+        if (!checkStatus(StatusFlag::LINE_BEGIN)) {
+            CHECK(nextLine(&cmdTimeout_));
+        }
+        CHECK(parseLine(ParseFlag::PARSE_ECHO | ParseFlag::PARSE_URC, &cmdTimeout_));
+        CHECK(nextLine(&cmdTimeout_));
+    }
+    unsigned flags = ParseFlag::PARSE_RESULT | ParseFlag::PARSE_URC;
+    if (echoEnabled) {
+        flags |= ParseFlag::PARSE_ECHO;
+    }
+    for (;;) {
+        // LINE_END is also set at the beginning of an empty line
+        if (!checkStatus(StatusFlag::LINE_BEGIN) || checkStatus(StatusFlag::LINE_END)) {
+            CHECK(nextLine(&cmdTimeout_));
+        }
+        const int ret = CHECK(parseLine(flags, &cmdTimeout_));
+        if (ret == ParseResult::PARSED_RESULT) {
+            break;
+        }
+        if (ret == ParseResult::NO_MATCH) {
+            char line[RESP_BUF_SIZE];
+            size_t size = 0;
+            do {
+                size += CHECK(readLine(line + size, sizeof(line) - size, &cmdTimeout_));
+            } while (!checkStatus(StatusFlag::LINE_END) && size < sizeof(line));
+            if (!checkStatus(StatusFlag::LINE_END)) {
+                // Discard the rest of the line
+                CHECK(readLine(nullptr, 0, &cmdTimeout_));
+            }
+            if (size > 0) {
+                CHECK(cmd.resp.appendLine(line, size));
+            }
+        }
+    }
+    cmd.resp.result_ = result_;
+    cmd.resp.resultErrorCode_ = errorCode_;
+    return 0;
+}
+
 int AtParserImpl::parseLine(unsigned flags, unsigned* timeout) {
     int ret = ParseResult::NO_MATCH;
     for (;;) {
@@ -512,6 +627,9 @@ int AtParserImpl::parseUrc(const UrcHandler** handler) {
 }
 
 int AtParserImpl::parseEcho() {
+    if (batch_) {
+        return parseBatchEcho();
+    }
     if (bufPos_ == 0) {
         return ParseResult::READ_MORE;
     }
@@ -527,6 +645,39 @@ int AtParserImpl::parseEcho() {
     return ParseResult::PARSED_ECHO;
 }
 
+int AtParserImpl::parseBatchEcho() {
+    if (bufPos_ == 0) {
+        return ParseResult::READ_MORE;
+    }
+    // Check if the buffer contents match any of the commands that have been sent but not echoed yet
+    bool readMore = false;
+    for (size_t i = batchBegin_; i < batchEnd_; ++i) {
+        auto& cmd = batch_->cmds_.at(i);
+        if (cmd.echoed) {
+            continue;
+        }
+        const size_t cmdSize = cmd.data.size();
+        if (memcmp(buf_, cmd.data.data(), std::min(bufPos_, cmdSize)) != 0) {
+            continue;
+        }
+        if (cmdSize >= INPUT_BUF_SIZE) {
+            if (bufPos_ < INPUT_BUF_SIZE) {
+                readMore = true;
+                continue;
+            }
+        } else if (bufPos_ <= cmdSize) {
+            // The echo should be followed by a newline character
+            readMore = true;
+            continue;
+        } else if (!isNewline(buf_[cmdSize])) {
+            continue;
+        }
+        cmd.echoed = true;
+        return ParseResult::PARSED_ECHO;
+    }
+    return readMore ? ParseResult::READ_MORE : ParseResult::NO_MATCH;
+}
+
 int AtParserImpl::readLine(char* data, size_t size, unsigned* timeout) {
     size_t bytesRead = 0;
     for (;;) {
@@ -19,6 +19,7 @@
 
 #include "at_parser.h"
 #include "at_response.h"
+#include "at_command_batch.h"
 
 #include "timer_hal.h"
 
@@ -69,6 +70,8 @@ public:
     void removeUrcHandler(const char* prefix);
     int processUrc(unsigned timeout);
 
+    int execBatch(AtCommandBatch* batch);
+
     void reset();
 
     void echoEnabled(bool enabled);
@@ -132,13 +135,21 @@ private:
     Vector<UrcHandler> urcHandlers_; // URC handlers
     AtParserConfig conf_; // Parser settings
 
+    AtCommandBatch* batch_; // Batch that is being executed
+    size_t batchBegin_; // Index of the oldest batch command whose response is not received yet
+    size_t batchEnd_; // Number of batch commands sent
+
     int readRespLine(char* data, size_t size);
     int waitEcho();
 
+    int sendBatchCommand(const char* data, size_t size, unsigned* timeout);
+    int readBatchResponse(size_t index);
+
     int parseLine(unsigned flags, unsigned* timeout);
     int parseResult();
     int parseUrc(const UrcHandler** handler);
     int parseEcho();
+    int parseBatchEcho();
 
     int readLine(char* data, size_t size, unsigned* timeout);
     int nextLine(unsigned* timeout);
@@ -18,6 +18,7 @@
 #pragma once
 
 #include "platform_ncp.h"
+#include "system_error.h"
 
 namespace particle {
 
@@ -57,6 +58,12 @@ struct NcpConnectionStateChangedEvent: NcpEvent {
 typedef void(*NcpEventHandler)(const NcpEvent& event, void* data);
 typedef void(*NcpDataHandler)(int id, const uint8_t* data, size_t size, void* ctx);
 
+// Buffer containing a part of a packet written to a data channel
+struct NcpIoVec {
+    const uint8_t* data;
+    size_t size;
+};
+
 class NcpClientConfig {
 public:
     NcpClientConfig();
@@ -97,6 +104,11 @@ public:
     virtual int updateFirmware(InputStream* file, size_t size) = 0;
 
     virtual int dataChannelWrite(int id, const uint8_t* data, size_t size) = 0;
+    /**
+     * Writes a packet stored in multiple buffers to a data channel. The default implementation
+     * only supports packets stored in a single buffer.
+     */
+    virtual int dataChannelWritev(int id, const NcpIoVec* iov, size_t iovCount);
     virtual void processEvents() = 0;
 
     virtual AtParser* atParser();
@@ -124,6 +136,13 @@ private:
     bool locked_;
 };
 
+inline int NcpClient::dataChannelWritev(int id, const NcpIoVec* iov, size_t iovCount) {
+    if (iovCount != 1) {
+        return SYSTEM_ERROR_NOT_SUPPORTED;
+    }
+    return dataChannelWrite(id, iov->data, iov->size);
+}
+
 inline NcpClientConfig::NcpClientConfig() :
         eventHandler_(nullptr),
         eventHandlerData_(nullptr) {
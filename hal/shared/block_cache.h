@@ -0,0 +1,350 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "system_error.h"
+
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <new>
+
+namespace particle {
+
+/**
+ * NOR flash device accessed via `BlockCache`.
+ */
+class BlockDevice {
+public:
+    virtual ~BlockDevice() = default;
+
+    virtual int read(uint32_t addr, void* data, size_t size) = 0;
+    virtual int write(uint32_t addr, const void* data, size_t size) = 0;
+    virtual int erase(uint32_t addr, size_t size) = 0;
+};
+
+/**
+ * Read and write cache for a flash device.
+ *
+ * Reads are served from an LRU cache of fixed-size lines. A miss that continues the previous
+ * read also fetches the following lines, so that sequential reads are performed in large
+ * transfers. Consecutive programs of adjacent ranges are collected in a buffer and written with
+ * a single device operation when a non-adjacent range is programmed, the buffered range is read
+ * from the device, a sector is erased, or `sync()` is called. The order in which the data is
+ * programmed is preserved. Lines affected by a program or erase operation are invalidated, so
+ * reading the data back always verifies the actual contents of the device.
+ *
+ * A cache with no lines and no program buffer passes all operations through to the device.
+ */
+class BlockCache {
+public:
+    struct Stats {
+        uint32_t reads; // Read operations
+        uint32_t readBytes;
+        uint32_t readHits; // Cache lines read from the cache
+        uint32_t readMisses; // Cache lines read from the device
+        uint32_t progs; // Program operations
+        uint32_t progBytes;
+        uint32_t erases; // Erase operations
+        uint32_t deviceReads; // Operations performed on the device
+        uint32_t deviceReadBytes;
+        uint32_t deviceWrites;
+        uint32_t deviceWriteBytes;
+        uint32_t deviceErases;
+    };
+
+    explicit BlockCache(BlockDevice* device) :
+            device_(device),
+            stats_(),
+            deviceSize_(0),
+            lineSize_(0),
+            lineCount_(0),
+            readAhead_(0),
+            progBufSize_(0),
+            progAddr_(0),
+            progSize_(0),
+            nextReadAddr_(INVALID_ADDRESS),
+            useCount_(0) {
+    }
+
+    /**
+     * Allocates the buffers and invalidates the cache.
+     *
+     * @param deviceSize Size of the device. Must be a multiple of the line size.
+     * @param lineSize Size of a cache line.
+     * @param lineCount Number of cache lines.
+     * @param readAhead Maximum number of lines fetched ahead on a sequential read.
+     * @param progBufSize Size of the buffer for coalesced programs.
+     */
+    int init(size_t deviceSize, size_t lineSize, size_t lineCount, size_t readAhead, size_t progBufSize) {
+        if (lineCount && (!lineSize || deviceSize % lineSize)) {
+            return SYSTEM_ERROR_INVALID_ARGUMENT;
+        }
+        if (readAhead >= lineCount) {
+            readAhead = lineCount ? lineCount - 1 : 0;
+        }
+        if (lineCount * lineSize != lineCount_ * lineSize_) {
+            lineData_.reset();
+            lineData_.reset(lineCount ? new(std::nothrow) uint8_t[lineCount * lineSize] : nullptr);
+            if (lineCount && !lineData_) {
+                return SYSTEM_ERROR_NO_MEMORY;
+            }
+        }
+        if (lineCount != lineCount_) {
+            lines_.reset();
+            lines_.reset(lineCount ? new(std::nothrow) Line[lineCount] : nullptr);
+            if (lineCount && !lines_) {
+                return SYSTEM_ERROR_NO_MEMORY;
+            }
+        }
+        if (progBufSize != progBufSize_) {
+            progBuf_.reset();
+            progBuf_.reset(progBufSize ? new(std::nothrow) uint8_t[progBufSize] : nullptr);
+            if (progBufSize && !progBuf_) {
+                return SYSTEM_ERROR_NO_MEMORY;
+            }
+        }
+        deviceSize_ = deviceSize;
+        lineSize_ = lineSize;
+        lineCount_ = lineCount;
+        readAhead_ = readAhead;
+        progBufSize_ = progBufSize;
+        progSize_ = 0;
+        invalidate();
+        return 0;
+    }
+
+    int read(uint32_t addr, void* data, size_t size) {
+        ++stats_.reads;
+        stats_.readBytes += size;
+        const bool sequential = (addr == nextReadAddr_);
+        nextReadAddr_ = addr + size;
+        if (!lineCount_) {
+            if (overlapsProgBuffer(addr, size)) {
+                const int ret = sync();
+                if (ret < 0) {
+                    return ret;
+                }
+            }
+            return deviceRead(addr, data, size);
+        }
+        auto d = (uint8_t*)data;
+        while (size > 0) {
+            const uint32_t lineAddr = addr - addr % lineSize_;
+            const size_t offs = addr - lineAddr;
+            const size_t n = (size < lineSize_ - offs) ? size : lineSize_ - offs;
+            int line = findLine(lineAddr);
+            if (line < 0) {
+                ++stats_.readMisses;
+                line = fetchLines(lineAddr, sequential ? readAhead_ : 0);
+                if (line < 0) {
+                    return line;
+                }
+            } else {
+                ++stats_.readHits;
+            }
+            lines_[line].lastUse = ++useCount_;
+            memcpy(d, lineData(line) + offs, n);
+            addr += n;
+            d += n;
+            size -= n;
+        }
+        return 0;
+    }
+
+    int prog(uint32_t addr, const void* data, size_t size) {
+        ++stats_.progs;
+        stats_.progBytes += size;
+        // The cached data is not patched with the expected contents of the flash: littlefs reads
+        // the programmed data back to verify it, and that read needs to reach the device
+        invalidateLines(addr, size);
+        if (progSize_ > 0 && addr == progAddr_ + progSize_ && progSize_ + size <= progBufSize_) {
+            memcpy(progBuf_.get() + progSize_, data, size);
+            progSize_ += size;
+            return 0;
+        }
+        const int ret = sync();
+        if (ret < 0) {
+            return ret;
+        }
+        if (size >= progBufSize_) {
+            return deviceWrite(addr, data, size);
+        }
+        memcpy(progBuf_.get(), data, size);
+        progAddr_ = addr;
+        progSize_ = size;
+        return 0;
+    }
+
+    int erase(uint32_t addr, size_t size) {
+        ++stats_.erases;
+        const int ret = sync();
+        if (ret < 0) {
+            return ret;
+        }
+        // Erased lines are read from the device again for the same reason as programmed ones
+        invalidateLines(addr, size);
+        return deviceErase(addr, size);
+    }
+
+    /**
+     * Writes the buffered data to the device.
+     */
+    int sync() {
+        if (!progSize_) {
+            return 0;
+        }
+        const size_t size = progSize_;
+        progSize_ = 0;
+        return deviceWrite(progAddr_, progBuf_.get(), size);
+    }
+
+    /**
+     * Discards the cached data. The data that has not been written to the device yet is discarded
+     * as well.
+     */
+    void invalidate() {
+        for (size_t i = 0; i < lineCount_; ++i) {
+            lines_[i].valid = false;
+        }
+        progSize_ = 0;
+        nextReadAddr_ = INVALID_ADDRESS;
+    }
+
+    const Stats& stats() const {
+        return stats_;
+    }
+
+    void resetStats() {
+        stats_ = Stats();
+    }
+
+private:
+    static const uint32_t INVALID_ADDRESS = 0xffffffff;
+
+    struct Line {
+        uint32_t addr;
+        uint32_t lastUse;
+        bool valid;
+    };
+
+    BlockDevice* device_;
+    std::unique_ptr<uint8_t[]> lineData_;
+    std::unique_ptr<Line[]> lines_;
+    std::unique_ptr<uint8_t[]> progBuf_;
+    Stats stats_;
+    size_t deviceSize_;
+    size_t lineSize_;
+    size_t lineCount_;
+    size_t readAhead_;
+    size_t progBufSize_;
+    uint32_t progAddr_;
+    size_t progSize_;
+    uint32_t nextReadAddr_;
+    uint32_t useCount_;
+
+    uint8_t* lineData(size_t line) {
+        return lineData_.get() + line * lineSize_;
+    }
+
+    int findLine(uint32_t addr) const {
+        for (size_t i = 0; i < lineCount_; ++i) {
+            if (lines_[i].valid && lines_[i].addr == addr) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    // Reads the line at the given address and up to `readAhead` following lines that are not
+    // cached. Returns the index of the line
+    int fetchLines(uint32_t addr, size_t readAhead) {
+        size_t count = 1;
+        while (count <= readAhead && addr + (count + 1) * lineSize_ <= deviceSize_ &&
+                findLine(addr + count * lineSize_) < 0) {
+            ++count;
+        }
+        // The lines are read into adjacent slots starting from the least recently used one
+        size_t first = 0;
+        for (size_t i = 0; i < lineCount_; ++i) {
+            if (!lines_[i].valid) {
+                first = i;
+                break;
+            }
+            if (lines_[i].lastUse < lines_[first].lastUse) {
+                first = i;
+            }
+        }
+        if (first + count > lineCount_) {
+            first = lineCount_ - count;
+        }
+        if (overlapsProgBuffer(addr, count * lineSize_)) {
+            const int ret = sync();
+            if (ret < 0) {
+                return ret;
+            }
+        }
+        for (size_t i = first; i < first + count; ++i) {
+            lines_[i].valid = false;
+        }
+        const int ret = deviceRead(addr, lineData(first), count * lineSize_);
+        if (ret < 0) {
+            return ret;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            Line& line = lines_[first + i];
+            line.addr = addr + i * lineSize_;
+            line.lastUse = useCount_;
+            line.valid = true;
+        }
+        return first;
+    }
+
+    void invalidateLines(uint32_t addr, size_t size) {
+        for (size_t i = 0; i < lineCount_; ++i) {
+            Line& line = lines_[i];
+            if (line.addr < addr + size && line.addr + lineSize_ > addr) {
+                line.valid = false;
+            }
+        }
+    }
+
+    bool overlapsProgBuffer(uint32_t addr, size_t size) const {
+        return progSize_ > 0 && addr < progAddr_ + progSize_ && addr + size > progAddr_;
+    }
+
+    int deviceRead(uint32_t addr, void* data, size_t size) {
+        ++stats_.deviceReads;
+        stats_.deviceReadBytes += size;
+        return device_->read(addr, data, size);
+    }
+
+    int deviceWrite(uint32_t addr, const void* data, size_t size) {
+        ++stats_.deviceWrites;
+        stats_.deviceWriteBytes += size;
+        return device_->write(addr, data, size);
+    }
+
+    int deviceErase(uint32_t addr, size_t size) {
+        ++stats_.deviceErases;
+        return device_->erase(addr, size);
+    }
+};
+
+} // namespace particle
@@ -0,0 +1,352 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "system_error.h"
+
+#include <cstring>
+#include <strings.h>
+#include <cstdint>
+#include <cstddef>
+
+namespace particle {
+
+/**
+ * Cache of resolved host addresses that can be saved to persistent storage.
+ *
+ * An entry is fresh for `maxAge` seconds after it has been resolved. After that, and whenever
+ * the current time is unknown, e.g. after a reset before the time is synchronized, the entry is
+ * stale. A stale entry can still be used, but the caller is expected to resolve the host again
+ * in the background and update the entry with the result. Entries that have been stale for more
+ * than `maxStale` seconds are discarded.
+ *
+ * An entry can have no address to record that the host has no address of its family, e.g. an
+ * IPv4-only host looked up with both families. Such an entry is returned with an address size of
+ * 0 and ages in the same way, so the query for the missing family can be skipped.
+ *
+ * The least recently used entry is replaced when the cache is full.
+ */
+class DnsCache {
+public:
+    enum LookupResult {
+        NOT_FOUND = 0,
+        FRESH = 1,
+        STALE = 2
+    };
+
+    struct Stats {
+        uint32_t hits; // Lookups served with a fresh entry
+        uint32_t staleHits; // Lookups served with a stale entry
+        uint32_t misses; // Lookups that need to be resolved
+        uint32_t updates; // Entries added or updated
+    };
+
+    static const size_t MAX_ENTRIES = 8;
+    static const size_t MAX_NAME_LENGTH = 63;
+    static const size_t MAX_ADDRESS_SIZE = 16;
+    static const uint32_t DEFAULT_MAX_AGE = 30 * 60;
+    static const uint32_t DEFAULT_MAX_STALE = 7 * 24 * 60 * 60;
+    static const uint32_t UNKNOWN_TIME = 0;
+
+    static const uint32_t FORMAT_MAGIC = 0x63736e64; // "dnsc"
+    static const uint8_t FORMAT_VERSION = 1;
+    // Header, followed by the entries: family, address size, name length, reserved, resolution time,
+    // address (none if the host has no address of the family), name
+    static const size_t MAX_SERIALIZED_SIZE = 8 + MAX_ENTRIES * (8 + MAX_ADDRESS_SIZE + MAX_NAME_LENGTH);
+
+    DnsCache() :
+            stats_(),
+            count_(0),
+            useCount_(0),
+            maxAge_(DEFAULT_MAX_AGE),
+            maxStale_(DEFAULT_MAX_STALE) {
+    }
+
+    /**
+     * Sets the lifetime of the entries.
+     *
+     * @param maxAge Number of seconds an entry is fresh.
+     * @param maxStale Number of seconds a stale entry can be used.
+     */
+    void lifetime(uint32_t maxAge, uint32_t maxStale) {
+        maxAge_ = maxAge;
+        maxStale_ = maxStale;
+    }
+
+    /**
+     * Finds the address of a host.
+     *
+     * @param name Host name.
+     * @param family Address family.
+     * @param[out] addr Address.
+     * @param[in,out] addrSize Size of the address buffer. Set to the size of the address, or 0 if
+     *        the host has no address of this family.
+     * @param now Current time in seconds since the Unix epoch, or `UNKNOWN_TIME`.
+     * @param[out] revalidate Set to `true` if the entry is stale and the caller should resolve
+     *        the host again. It's only set once until the entry is updated or
+     *        `cancelRevalidation()` is called.
+     * @return `FRESH`, `STALE` or `NOT_FOUND`.
+     */
+    int lookup(const char* name, uint8_t family, void* addr, size_t* addrSize, uint32_t now,
+            bool* revalidate = nullptr) {
+        if (revalidate) {
+            *revalidate = false;
+        }
+        const int index = find(name, family);
+        if (index < 0) {
+            ++stats_.misses;
+            return NOT_FOUND;
+        }
+        Entry& e = entries_[index];
+        const bool known = (now != UNKNOWN_TIME && e.time != UNKNOWN_TIME && now >= e.time);
+        if (known && now - e.time >= maxAge_ && now - e.time - maxAge_ >= maxStale_) {
+            removeAt(index);
+            ++stats_.misses;
+            return NOT_FOUND;
+        }
+        if (e.addrSize > *addrSize) {
+            return SYSTEM_ERROR_TOO_LARGE;
+        }
+        memcpy(addr, e.addr, e.addrSize);
+        *addrSize = e.addrSize;
+        e.lastUse = ++useCount_;
+        if (known && now - e.time < maxAge_) {
+            ++stats_.hits;
+            return FRESH;
+        }
+        ++stats_.staleHits;
+        if (revalidate && !e.revalidating) {
+            e.revalidating = true;
+            *revalidate = true;
+        }
+        return STALE;
+    }
+
+    /**
+     * Adds or updates an entry.
+     *
+     * @param addrSize Size of the address, or 0 if the host has no address of this family.
+     * @return 0 on success or a negative result code in case of an error.
+     */
+    int update(const char* name, uint8_t family, const void* addr, size_t addrSize, uint32_t now) {
+        const size_t nameLen = strlen(name);
+        if (!nameLen || nameLen > MAX_NAME_LENGTH || addrSize > MAX_ADDRESS_SIZE || (addrSize && !addr)) {
+            return SYSTEM_ERROR_INVALID_ARGUMENT;
+        }
+        int index = find(name, family);
+        if (index < 0) {
+            if (count_ < MAX_ENTRIES) {
+                index = count_++;
+            } else {
+                index = 0;
+                for (size_t i = 1; i < count_; ++i) {
+                    if (entries_[i].lastUse < entries_[index].lastUse) {
+                        index = i;
+                    }
+                }
+            }
+            Entry& e = entries_[index];
+            e = Entry();
+            memcpy(e.name, name, nameLen + 1);
+            e.family = family;
+            e.lastUse = ++useCount_;
+        }
+        Entry& e = entries_[index];
+        if (addrSize) {
+            memcpy(e.addr, addr, addrSize);
+        }
+        e.addrSize = addrSize;
+        e.time = now;
+        e.revalidating = false;
+        ++stats_.updates;
+        return 0;
+    }
+
+    /**
+     * Allows the stale entry to be revalidated again, e.g. after the host could not be resolved.
+     */
+    void cancelRevalidation(const char* name, uint8_t family) {
+        const int index = find(name, family);
+        if (index >= 0) {
+            entries_[index].revalidating = false;
+        }
+    }
+
+    void remove(const char* name, uint8_t family) {
+        const int index = find(name, family);
+        if (index >= 0) {
+            removeAt(index);
+        }
+    }
+
+    void clear() {
+        count_ = 0;
+    }
+
+    size_t size() const {
+        return count_;
+    }
+
+    /**
+     * Returns the size of the serialized cache.
+     */
+    size_t serializedSize() const {
+        size_t size = HEADER_SIZE;
+        for (size_t i = 0; i < count_; ++i) {
+            size += ENTRY_HEADER_SIZE + entries_[i].addrSize + strlen(entries_[i].name);
+        }
+        return size;
+    }
+
+    /**
+     * Serializes the cache.
+     *
+     * @return Number of bytes written or a negative result code in case of an error.
+     */
+    int serialize(uint8_t* data, size_t size) const {
+        if (size < serializedSize()) {
+            return SYSTEM_ERROR_TOO_LARGE;
+        }
+        uint8_t* d = data;
+        const uint32_t magic = FORMAT_MAGIC;
+        memcpy(d, &magic, 4);
+        d[4] = FORMAT_VERSION;
+        d[5] = count_;
+        d[6] = 0;
+        d[7] = 0;
+        d += HEADER_SIZE;
+        // Entries are written from the least to the most recently used one
+        const Entry* prev = nullptr;
+        for (size_t n = 0; n < count_; ++n) {
+            const Entry* e = nullptr;
+            for (size_t i = 0; i < count_; ++i) {
+                const Entry& c = entries_[i];
+                if ((!prev || c.lastUse > prev->lastUse) && (!e || c.lastUse < e->lastUse)) {
+                    e = &c;
+                }
+            }
+            const size_t nameLen = strlen(e->name);
+            d[0] = e->family;
+            d[1] = e->addrSize;
+            d[2] = nameLen;
+            d[3] = 0;
+            memcpy(d + 4, &e->time, 4);
+            d += ENTRY_HEADER_SIZE;
+            memcpy(d, e->addr, e->addrSize);
+            d += e->addrSize;
+            memcpy(d, e->name, nameLen);
+            d += nameLen;
+            prev = e;
+        }
+        return d - data;
+    }
+
+    /**
+     * Replaces the contents of the cache with the serialized data.
+     */
+    int deserialize(const uint8_t* data, size_t size) {
+        count_ = 0;
+        if (size < HEADER_SIZE) {
+            return SYSTEM_ERROR_BAD_DATA;
+        }
+        uint32_t magic = 0;
+        memcpy(&magic, data, 4);
+        if (magic != FORMAT_MAGIC || data[4] != FORMAT_VERSION || data[5] > MAX_ENTRIES) {
+            return SYSTEM_ERROR_BAD_DATA;
+        }
+        const size_t count = data[5];
+        const uint8_t* d = data + HEADER_SIZE;
+        const uint8_t* end = data + size;
+        for (size_t i = 0; i < count; ++i) {
+            if (end - d < (ptrdiff_t)ENTRY_HEADER_SIZE) {
+                count_ = 0;
+                return SYSTEM_ERROR_BAD_DATA;
+            }
+            const size_t addrSize = d[1];
+            const size_t nameLen = d[2];
+            if (addrSize > MAX_ADDRESS_SIZE || !nameLen || nameLen > MAX_NAME_LENGTH ||
+                    (size_t)(end - d) < ENTRY_HEADER_SIZE + addrSize + nameLen) {
+                count_ = 0;
+                return SYSTEM_ERROR_BAD_DATA;
+            }
+            Entry& e = entries_[count_++];
+            e = Entry();
+            e.family = d[0];
+            e.addrSize = addrSize;
+            memcpy(&e.time, d + 4, 4);
+            d += ENTRY_HEADER_SIZE;
+            memcpy(e.addr, d, addrSize);
+            d += addrSize;
+            memcpy(e.name, d, nameLen);
+            d += nameLen;
+            e.lastUse = ++useCount_;
+        }
+        return 0;
+    }
+
+    const Stats& stats() const {
+        return stats_;
+    }
+
+    void resetStats() {
+        stats_ = Stats();
+    }
+
+private:
+    static const size_t HEADER_SIZE = 8;
+    static const size_t ENTRY_HEADER_SIZE = 8;
+
+    static_assert(MAX_SERIALIZED_SIZE == HEADER_SIZE + MAX_ENTRIES * (ENTRY_HEADER_SIZE + MAX_ADDRESS_SIZE +
+            MAX_NAME_LENGTH), "Invalid MAX_SERIALIZED_SIZE");
+
+    struct Entry {
+        char name[MAX_NAME_LENGTH + 1];
+        uint8_t addr[MAX_ADDRESS_SIZE];
+        uint32_t time; // Time the entry was resolved
+        uint32_t lastUse;
+        uint8_t family;
+        uint8_t addrSize;
+        bool revalidating;
+    };
+
+    Entry entries_[MAX_ENTRIES];
+    Stats stats_;
+    size_t count_;
+    uint32_t useCount_;
+    uint32_t maxAge_;
+    uint32_t maxStale_;
+
+    int find(const char* name, uint8_t family) const {
+        for (size_t i = 0; i < count_; ++i) {
+            const Entry& e = entries_[i];
+            if (e.family == family && strcasecmp(e.name, name) == 0) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    void removeAt(size_t index) {
+        --count_;
+        if (index != count_) {
+            entries_[index] = entries_[count_];
+        }
+    }
+};
+
+} // namespace particle
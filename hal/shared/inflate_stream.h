@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "stream.h"
+#include "system_error.h"
+#include "miniz.h"
+
+#include <climits>
+#include <memory>
+#include <new>
+
+// Maximum size of the decompression window (the deflate format doesn't allow windows larger than 32KB)
+#ifndef INFLATE_STREAM_MAX_WINDOW_SIZE
+#define INFLATE_STREAM_MAX_WINDOW_SIZE (32 * 1024)
+#endif
+
+namespace particle {
+
+/**
+ * Output stream decompressing deflate data and writing it to another stream.
+ *
+ * The decompressed data is produced into a circular buffer, which needs to be at least as large
+ * as the window the data was compressed with. Input can be written in chunks of arbitrary size.
+ */
+class InflateStream: public OutputStream {
+public:
+    enum Flag {
+        ZLIB_HEADER = 0x01 // The data is wrapped into a zlib container (RFC 1950)
+    };
+
+    explicit InflateStream(OutputStream* output) :
+            output_(output),
+            windowSize_(0),
+            windowOffs_(0),
+            status_(TINFL_STATUS_FAILED),
+            flags_(0) {
+    }
+
+    /**
+     * Initializes the stream.
+     *
+     * @param windowSize Size of the window buffer. Must be a power of two.
+     * @param flags Stream flags (see `Flag`).
+     */
+    int init(size_t windowSize, unsigned flags = 0) {
+        if (!windowSize || (windowSize & (windowSize - 1)) || windowSize > INFLATE_STREAM_MAX_WINDOW_SIZE) {
+            return SYSTEM_ERROR_INVALID_ARGUMENT;
+        }
+        if (!decomp_) {
+            decomp_.reset(new(std::nothrow) tinfl_decompressor);
+            if (!decomp_) {
+                return SYSTEM_ERROR_NO_MEMORY;
+            }
+        }
+        if (windowSize != windowSize_) {
+            window_.reset(new(std::nothrow) char[windowSize]);
+            if (!window_) {
+                windowSize_ = 0;
+                return SYSTEM_ERROR_NO_MEMORY;
+            }
+            windowSize_ = windowSize;
+        }
+        tinfl_init(decomp_.get());
+        windowOffs_ = 0;
+        status_ = TINFL_STATUS_NEEDS_MORE_INPUT;
+        flags_ = (flags & ZLIB_HEADER) ? TINFL_FLAG_PARSE_ZLIB_HEADER : 0;
+        return 0;
+    }
+
+    /**
+     * Decompresses a chunk of the input data.
+     *
+     * @return Number of bytes consumed, or a negative error code. Data following the end of the
+     *         compressed stream is not consumed.
+     */
+    int write(const char* data, size_t size) override {
+        return decompress(data, size, TINFL_FLAG_HAS_MORE_INPUT);
+    }
+
+    /**
+     * Signals the end of the input data.
+     *
+     * @return 0 if the compressed stream has been decompressed completely, or a negative error code.
+     */
+    int finish() {
+        const int ret = decompress(nullptr, 0, 0);
+        if (ret < 0) {
+            return ret;
+        }
+        return done() ? 0 : SYSTEM_ERROR_BAD_DATA;
+    }
+
+    bool done() const {
+        return status_ == TINFL_STATUS_DONE;
+    }
+
+    int flush() override {
+        return output_->flush();
+    }
+
+    int availForWrite() override {
+        return done() ? 0 : INT_MAX;
+    }
+
+    int waitEvent(unsigned flags, unsigned timeout = 0) override {
+        return 0;
+    }
+
+    /**
+     * Parses a zlib header.
+     *
+     * @return Window size used by the compressor, or a negative error code if the data doesn't
+     *         start with a valid zlib header.
+     */
+    static int zlibWindowSize(const char* data, size_t size) {
+        if (size < 2) {
+            return SYSTEM_ERROR_NOT_ENOUGH_DATA;
+        }
+        const unsigned cmf = (uint8_t)data[0];
+        const unsigned flg = (uint8_t)data[1];
+        // Deflate method, no preset dictionary, valid header checksum
+        if ((cmf & 0x0f) != 8 || (cmf >> 4) > 7 || (flg & 0x20) || ((cmf << 8) | flg) % 31 != 0) {
+            return SYSTEM_ERROR_BAD_DATA;
+        }
+        return 1 << ((cmf >> 4) + 8);
+    }
+
+private:
+    OutputStream* output_;
+    std::unique_ptr<tinfl_decompressor> decomp_;
+    std::unique_ptr<char[]> window_;
+    size_t windowSize_;
+    size_t windowOffs_;
+    tinfl_status status_;
+    int flags_;
+
+    int decompress(const char* data, size_t size, int flags) {
+        if (status_ == TINFL_STATUS_DONE) {
+            return 0;
+        }
+        if (status_ < 0) {
+            return SYSTEM_ERROR_BAD_DATA;
+        }
+        size_t consumed = 0;
+        do {
+            size_t inSize = size - consumed;
+            size_t outSize = windowSize_ - windowOffs_;
+            status_ = tinfl_decompress(decomp_.get(), (const mz_uint8*)data + consumed, &inSize, (mz_uint8*)window_.get(),
+                    (mz_uint8*)window_.get() + windowOffs_, &outSize, flags | flags_);
+            consumed += inSize;
+            if (outSize > 0) {
+                const int ret = output_->writeAll(window_.get() + windowOffs_, outSize);
+                if (ret < 0) {
+                    status_ = TINFL_STATUS_FAILED;
+                    return ret;
+                }
+                windowOffs_ = (windowOffs_ + outSize) & (windowSize_ - 1);
+            }
+            if (status_ < 0) {
+                return SYSTEM_ERROR_BAD_DATA;
+            }
+        } while (status_ == TINFL_STATUS_HAS_MORE_OUTPUT);
+        return consumed;
+    }
+};
+
+} // namespace particle
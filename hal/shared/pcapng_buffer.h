@@ -0,0 +1,433 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "system_error.h"
+
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace particle {
+
+/**
+ * Ring buffer of captured packets in the pcap-ng format.
+ *
+ * The packets are stored as Enhanced Packet Blocks. When the buffer is full, the oldest packets
+ * are discarded. `dump()` writes a complete pcap-ng file, which starts with a Section Header Block
+ * and the Interface Description Blocks of all registered interfaces, followed by the packets that
+ * are currently in the buffer.
+ *
+ * A packet is added with a `startPacket()` call followed by any number of `appendPacket()` calls
+ * and `endPacket()`, so that a packet stored in a chain of buffers can be added without copying
+ * it to a contiguous buffer first.
+ *
+ * All timestamps are in microseconds. The blocks are written in the host byte order, which is
+ * assumed to be little-endian.
+ */
+class PcapngBuffer {
+public:
+    typedef int (*WriteCallback)(const uint8_t* data, size_t size, void* ctx);
+
+    enum Direction {
+        INBOUND = 1,
+        OUTBOUND = 2
+    };
+
+    struct Stats {
+        uint32_t packets; // Packets added to the buffer
+        uint32_t bytes; // Captured bytes
+        uint32_t truncated; // Packets truncated to the snapshot length
+        uint32_t evicted; // Packets discarded to make room for newer packets
+        uint32_t dropped; // Packets that didn't fit in the buffer
+    };
+
+    static const uint16_t LINKTYPE_ETHERNET = 1;
+    static const uint16_t LINKTYPE_RAW = 101; // Raw IPv4 or IPv6 packets
+    static const size_t MAX_INTERFACES = 8;
+    static const size_t MAX_INTERFACE_NAME_LENGTH = 15;
+
+    static const uint32_t SECTION_HEADER_BLOCK = 0x0a0d0d0a;
+    static const uint32_t INTERFACE_DESCRIPTION_BLOCK = 0x00000001;
+    static const uint32_t ENHANCED_PACKET_BLOCK = 0x00000006;
+    static const uint32_t BYTE_ORDER_MAGIC = 0x1a2b3c4d;
+
+    PcapngBuffer() :
+            stats_(),
+            bufSize_(0),
+            head_(0),
+            tail_(0),
+            used_(0),
+            ifaceCount_(0),
+            packetPos_(0),
+            packetCapLen_(0),
+            packetLeft_(0),
+            packetFlags_(0),
+            packetActive_(false) {
+    }
+
+    /**
+     * Allocates the buffer and discards the captured packets.
+     */
+    int init(size_t bufSize) {
+        if (bufSize < minBlockSize()) {
+            return SYSTEM_ERROR_INVALID_ARGUMENT;
+        }
+        if (bufSize != bufSize_) {
+            buf_.reset();
+            buf_.reset(new(std::nothrow) uint8_t[bufSize]);
+            if (!buf_) {
+                bufSize_ = 0;
+                return SYSTEM_ERROR_NO_MEMORY;
+            }
+            bufSize_ = bufSize;
+        }
+        clear();
+        return 0;
+    }
+
+    /**
+     * Registers an interface. Returns the index of the interface.
+     *
+     * @param linkType Link-layer header type.
+     * @param snapLen Maximum number of bytes captured from each packet (0 means no limit).
+     * @param name Name of the interface.
+     */
+    int addInterface(uint16_t linkType, uint32_t snapLen, const char* name) {
+        if (ifaceCount_ == MAX_INTERFACES) {
+            return SYSTEM_ERROR_LIMIT_EXCEEDED;
+        }
+        Interface& iface = ifaces_[ifaceCount_];
+        iface.linkType = linkType;
+        iface.snapLen = snapLen;
+        memset(iface.name, 0, sizeof(iface.name));
+        if (name) {
+            strncpy(iface.name, name, MAX_INTERFACE_NAME_LENGTH);
+        }
+        return ifaceCount_++;
+    }
+
+    /**
+     * Changes the snapshot length of an interface. The new length is reported in the subsequent
+     * dumps.
+     */
+    int setSnapLength(unsigned iface, uint32_t snapLen) {
+        if (iface >= ifaceCount_) {
+            return SYSTEM_ERROR_NOT_FOUND;
+        }
+        ifaces_[iface].snapLen = snapLen;
+        return 0;
+    }
+
+    /**
+     * Starts a new packet.
+     *
+     * @param iface Interface index.
+     * @param timestamp Time at which the packet was captured.
+     * @param dir Direction of the packet (see the `Direction` enum).
+     * @param size Original size of the packet.
+     */
+    int startPacket(unsigned iface, uint64_t timestamp, unsigned dir, size_t size) {
+        if (!buf_ || packetActive_) {
+            return SYSTEM_ERROR_INVALID_STATE;
+        }
+        if (iface >= ifaceCount_) {
+            return SYSTEM_ERROR_NOT_FOUND;
+        }
+        const uint32_t snapLen = ifaces_[iface].snapLen;
+        size_t capLen = size;
+        if (snapLen && capLen > snapLen) {
+            capLen = snapLen;
+            ++stats_.truncated;
+        }
+        const size_t blockSize = packetBlockSize(capLen);
+        if (blockSize > bufSize_) {
+            ++stats_.dropped;
+            return SYSTEM_ERROR_TOO_LARGE;
+        }
+        // Discard the oldest packets
+        while (bufSize_ - used_ < blockSize) {
+            uint32_t n = 0;
+            peek(tail_ + 4, &n, sizeof(n));
+            tail_ = (tail_ + n) % bufSize_;
+            used_ -= n;
+            ++stats_.evicted;
+        }
+        const uint32_t header[] = {
+            ENHANCED_PACKET_BLOCK,
+            (uint32_t)blockSize,
+            iface,
+            (uint32_t)(timestamp >> 32),
+            (uint32_t)timestamp,
+            (uint32_t)capLen,
+            (uint32_t)size
+        };
+        packetPos_ = head_;
+        put(header, sizeof(header));
+        packetCapLen_ = capLen;
+        packetLeft_ = capLen;
+        packetFlags_ = dir & (INBOUND | OUTBOUND);
+        packetActive_ = true;
+        return 0;
+    }
+
+    /**
+     * Appends data to the current packet. The data beyond the snapshot length is ignored.
+     */
+    int appendPacket(const void* data, size_t size) {
+        if (!packetActive_) {
+            return SYSTEM_ERROR_INVALID_STATE;
+        }
+        const size_t n = (size < packetLeft_) ? size : packetLeft_;
+        put(data, n);
+        packetLeft_ -= n;
+        return 0;
+    }
+
+    /**
+     * Completes the current packet.
+     */
+    int endPacket() {
+        if (!packetActive_) {
+            return SYSTEM_ERROR_INVALID_STATE;
+        }
+        packetActive_ = false;
+        if (packetLeft_ > 0) {
+            // Less data was appended than was expected, discard the packet
+            head_ = packetPos_;
+            return SYSTEM_ERROR_INVALID_ARGUMENT;
+        }
+        const uint32_t zero = 0;
+        put(&zero, pad(packetCapLen_) - packetCapLen_);
+        const uint32_t blockSize = packetBlockSize(packetCapLen_);
+        const uint32_t trailer[] = {
+            OPTION_EPB_FLAGS | (4 << 16), // epb_flags
+            packetFlags_,
+            OPTION_END, // opt_endofopt
+            blockSize
+        };
+        put(trailer, sizeof(trailer));
+        used_ += blockSize;
+        ++stats_.packets;
+        stats_.bytes += packetCapLen_;
+        return 0;
+    }
+
+    /**
+     * Adds a packet stored in a contiguous buffer.
+     */
+    int addPacket(unsigned iface, uint64_t timestamp, unsigned dir, const void* data, size_t size) {
+        int ret = startPacket(iface, timestamp, dir, size);
+        if (ret < 0) {
+            return ret;
+        }
+        ret = appendPacket(data, size);
+        if (ret < 0) {
+            return ret;
+        }
+        return endPacket();
+    }
+
+    /**
+     * Writes the pcap-ng file with the captured packets.
+     *
+     * The buffer is not modified. The write callback can be invoked several times.
+     */
+    int dump(WriteCallback cb, void* ctx) const {
+        if (!cb) {
+            return SYSTEM_ERROR_INVALID_ARGUMENT;
+        }
+        // Section Header Block
+        const uint32_t shb[] = {
+            SECTION_HEADER_BLOCK,
+            SECTION_HEADER_BLOCK_SIZE,
+            BYTE_ORDER_MAGIC,
+            1, // Major version 1, minor version 0
+            0xffffffff, // Section length is not specified
+            0xffffffff,
+            SECTION_HEADER_BLOCK_SIZE
+        };
+        int ret = cb((const uint8_t*)shb, sizeof(shb), ctx);
+        if (ret < 0) {
+            return ret;
+        }
+        // Interface Description Blocks
+        for (size_t i = 0; i < ifaceCount_; ++i) {
+            const Interface& iface = ifaces_[i];
+            const size_t nameLen = strlen(iface.name);
+            const uint32_t blockSize = interfaceBlockSize(nameLen);
+            uint32_t idb[(INTERFACE_BLOCK_SIZE + 4 /* if_name */ + MAX_INTERFACE_NAME_LENGTH + 1) / 4] = {};
+            idb[0] = INTERFACE_DESCRIPTION_BLOCK;
+            idb[1] = blockSize;
+            idb[2] = iface.linkType;
+            idb[3] = iface.snapLen;
+            size_t n = 4;
+            if (nameLen) {
+                idb[n++] = OPTION_IF_NAME | (nameLen << 16); // if_name
+                memcpy(&idb[n], iface.name, nameLen);
+                n += pad(nameLen) / 4;
+            }
+            idb[n++] = OPTION_END; // opt_endofopt
+            idb[n++] = blockSize;
+            ret = cb((const uint8_t*)idb, blockSize, ctx);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+        // Enhanced Packet Blocks
+        if (used_ > 0) {
+            const size_t n = (tail_ + used_ <= bufSize_) ? used_ : bufSize_ - tail_;
+            ret = cb(buf_.get() + tail_, n, ctx);
+            if (ret < 0) {
+                return ret;
+            }
+            if (n < used_) {
+                ret = cb(buf_.get(), used_ - n, ctx);
+                if (ret < 0) {
+                    return ret;
+                }
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * Moves the captured packets and the registered interfaces to another buffer. The storage of
+     * that buffer is taken over by this buffer, which continues with no packets.
+     *
+     * This allows writing the packets out without blocking the capture for the duration of the
+     * dump.
+     */
+    int movePackets(PcapngBuffer* dest) {
+        if (!dest || dest == this || !dest->buf_ || packetActive_) {
+            return SYSTEM_ERROR_INVALID_ARGUMENT;
+        }
+        std::swap(buf_, dest->buf_);
+        std::swap(bufSize_, dest->bufSize_);
+        dest->head_ = head_;
+        dest->tail_ = tail_;
+        dest->used_ = used_;
+        dest->packetActive_ = false;
+        for (size_t i = 0; i < ifaceCount_; ++i) {
+            dest->ifaces_[i] = ifaces_[i];
+        }
+        dest->ifaceCount_ = ifaceCount_;
+        clear();
+        return 0;
+    }
+
+    /**
+     * Discards the captured packets. The registered interfaces are kept.
+     */
+    void clear() {
+        head_ = 0;
+        tail_ = 0;
+        used_ = 0;
+        packetActive_ = false;
+    }
+
+    /**
+     * Returns the number of bytes occupied by the captured packets.
+     */
+    size_t size() const {
+        return used_;
+    }
+
+    /**
+     * Returns the size of the buffer.
+     */
+    size_t capacity() const {
+        return bufSize_;
+    }
+
+    const Stats& stats() const {
+        return stats_;
+    }
+
+    void resetStats() {
+        stats_ = Stats();
+    }
+
+private:
+    struct Interface {
+        uint16_t linkType;
+        uint32_t snapLen;
+        char name[MAX_INTERFACE_NAME_LENGTH + 1];
+    };
+
+    static const uint32_t SECTION_HEADER_BLOCK_SIZE = 28;
+    static const uint32_t INTERFACE_BLOCK_SIZE = 24; // Not including the options
+    static const uint32_t PACKET_BLOCK_SIZE = 44; // Not including the packet data
+
+    static const uint16_t OPTION_END = 0;
+    static const uint16_t OPTION_IF_NAME = 2;
+    static const uint16_t OPTION_EPB_FLAGS = 2;
+
+    std::unique_ptr<uint8_t[]> buf_;
+    Interface ifaces_[MAX_INTERFACES];
+    Stats stats_;
+    size_t bufSize_;
+    size_t head_; // Write position
+    size_t tail_; // Position of the oldest packet
+    size_t used_; // Size of the complete packets
+    size_t ifaceCount_;
+    size_t packetPos_; // Position of the current packet
+    size_t packetCapLen_;
+    size_t packetLeft_;
+    uint32_t packetFlags_;
+    bool packetActive_;
+
+    static size_t pad(size_t size) {
+        return (size + 3) & ~(size_t)3;
+    }
+
+    static size_t packetBlockSize(size_t capLen) {
+        return PACKET_BLOCK_SIZE + pad(capLen);
+    }
+
+    static size_t interfaceBlockSize(size_t nameLen) {
+        return INTERFACE_BLOCK_SIZE + (nameLen ? 4 + pad(nameLen) : 0);
+    }
+
+    static size_t minBlockSize() {
+        return PACKET_BLOCK_SIZE;
+    }
+
+    void put(const void* data, size_t size) {
+        auto d = (const uint8_t*)data;
+        while (size > 0) {
+            const size_t n = (size < bufSize_ - head_) ? size : bufSize_ - head_;
+            memcpy(buf_.get() + head_, d, n);
+            head_ = (head_ + n) % bufSize_;
+            d += n;
+            size -= n;
+        }
+    }
+
+    void peek(size_t pos, void* data, size_t size) const {
+        auto d = (uint8_t*)data;
+        for (size_t i = 0; i < size; ++i) {
+            d[i] = buf_[(pos + i) % bufSize_];
+        }
+    }
+};
+
+} // namespace particle
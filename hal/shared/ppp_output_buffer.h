@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "system_error.h"
+
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <new>
+
+namespace particle {
+
+/**
+ * Buffer for the HDLC-framed output of a PPP stack.
+ *
+ * The PPP stack produces a frame in several small writes. The buffer collects them, so that
+ * every frame is written to the underlying channel, such as a multiplexer channel, with a single
+ * write. A complete frame is written immediately, unless it's smaller than the batching threshold.
+ * In that case it's kept in the buffer and written together with the subsequent frames. The owner
+ * of the buffer needs to call `flush()` shortly after `hasPendingFrames()` becomes `true`.
+ *
+ * A frame larger than the buffer is written in several parts.
+ */
+class PppOutputBuffer {
+public:
+    typedef int (*WriteCallback)(const uint8_t* data, size_t size, void* ctx);
+
+    struct Stats {
+        uint32_t frames; // Complete frames
+        uint32_t writes; // Writes to the channel
+        uint32_t bytes; // Bytes written to the channel
+        uint32_t errors; // Failed writes
+    };
+
+    static const uint8_t FLAG = 0x7e; // HDLC flag sequence
+
+    PppOutputBuffer() :
+            stats_(),
+            bufSize_(0),
+            size_(0),
+            frameSize_(0),
+            batchFrameSize_(0),
+            pending_(false),
+            writeCb_(nullptr),
+            writeCtx_(nullptr) {
+    }
+
+    /**
+     * Initializes the buffer.
+     *
+     * @param bufSize Size of the buffer, which is normally the maximum size of a write to the channel.
+     * @param batchFrameSize Frames smaller than this size are batched with the subsequent frames.
+     * @param cb Callback writing data to the channel.
+     * @param ctx Context data for the callback.
+     */
+    int init(size_t bufSize, size_t batchFrameSize, WriteCallback cb, void* ctx) {
+        if (!bufSize || !cb) {
+            return SYSTEM_ERROR_INVALID_ARGUMENT;
+        }
+        if (bufSize != bufSize_) {
+            buf_.reset();
+            buf_.reset(new(std::nothrow) uint8_t[bufSize]);
+            if (!buf_) {
+                bufSize_ = 0;
+                return SYSTEM_ERROR_NO_MEMORY;
+            }
+            bufSize_ = bufSize;
+        }
+        batchFrameSize_ = batchFrameSize;
+        writeCb_ = cb;
+        writeCtx_ = ctx;
+        reset();
+        return 0;
+    }
+
+    /**
+     * Appends the output of the PPP stack.
+     */
+    int write(const uint8_t* data, size_t size) {
+        if (!buf_) {
+            return SYSTEM_ERROR_INVALID_STATE;
+        }
+        if (!size) {
+            return 0;
+        }
+        // Don't split a new frame between two writes if the buffer contains complete frames only
+        if (pending_ && !frameSize_ && size > bufSize_ - size_) {
+            const int ret = flush();
+            if (ret < 0) {
+                return ret;
+            }
+        }
+        const bool frameEnd = (data[size - 1] == FLAG);
+        frameSize_ += size;
+        while (size > 0) {
+            if (size_ == bufSize_) {
+                const int ret = flush();
+                if (ret < 0) {
+                    return ret;
+                }
+            }
+            const size_t n = (size < bufSize_ - size_) ? size : bufSize_ - size_;
+            memcpy(buf_.get() + size_, data, n);
+            size_ += n;
+            data += n;
+            size -= n;
+        }
+        if (frameEnd) {
+            ++stats_.frames;
+            const size_t frameSize = frameSize_;
+            frameSize_ = 0;
+            if (frameSize >= batchFrameSize_) {
+                return flush();
+            }
+            pending_ = true;
+        }
+        return 0;
+    }
+
+    /**
+     * Writes data that is not HDLC-framed, such as an AT command, to the channel after the
+     * buffered data. The data is not counted as a part of a frame.
+     */
+    int writeRaw(const uint8_t* data, size_t size) {
+        if (!buf_) {
+            return SYSTEM_ERROR_INVALID_STATE;
+        }
+        const int ret = flush();
+        if (ret < 0) {
+            return ret;
+        }
+        if (!size) {
+            return 0;
+        }
+        return writeChannel(data, size);
+    }
+
+    /**
+     * Writes the buffered data to the channel.
+     */
+    int flush() {
+        pending_ = false;
+        if (!size_) {
+            return 0;
+        }
+        const size_t size = size_;
+        size_ = 0;
+        return writeChannel(buf_.get(), size);
+    }
+
+    /**
+     * Discards the buffered data.
+     */
+    void reset() {
+        size_ = 0;
+        frameSize_ = 0;
+        pending_ = false;
+    }
+
+    /**
+     * Returns `true` if the buffer contains complete frames that haven't been written yet.
+     */
+    bool hasPendingFrames() const {
+        return pending_;
+    }
+
+    const Stats& stats() const {
+        return stats_;
+    }
+
+    void resetStats() {
+        stats_ = Stats();
+    }
+
+private:
+    std::unique_ptr<uint8_t[]> buf_;
+    Stats stats_;
+    size_t bufSize_;
+    size_t size_;
+    size_t frameSize_; // Size of the incomplete frame
+    size_t batchFrameSize_;
+    bool pending_;
+    WriteCallback writeCb_;
+    void* writeCtx_;
+
+    int writeChannel(const uint8_t* data, size_t size) {
+        ++stats_.writes;
+        stats_.bytes += size;
+        const int ret = writeCb_(data, size, writeCtx_);
+        if (ret < 0) {
+            ++stats_.errors;
+            return ret;
+        }
+        return 0;
+    }
+};
+
+} // namespace particle
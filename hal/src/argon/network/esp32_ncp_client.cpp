@@ -105,9 +105,13 @@ int Esp32NcpClient::init(const NcpClientConfig& conf) {
     decltype(muxerAtStream_) muxStrm(new(std::nothrow) decltype(muxerAtStream_)::element_type(&muxer_, ESP32_NCP_AT_CHANNEL));
     CHECK_TRUE(muxStrm, SYSTEM_ERROR_NO_MEMORY);
     CHECK(muxStrm->init(ESP32_NCP_AT_CHANNEL_RX_BUFFER_SIZE));
+    // Initialize buffer for packets that are written in multiple parts
+    std::unique_ptr<uint8_t[]> txBuf(new(std::nothrow) uint8_t[ESP32_NCP_MAX_MUXER_FRAME_SIZE]);
+    CHECK_TRUE(txBuf, SYSTEM_ERROR_NO_MEMORY);
     CHECK(initParser(serial.get()));
     serial_ = std::move(serial);
     muxerAtStream_ = std::move(muxStrm);
+    txBuf_ = std::move(txBuf);
     conf_ = conf;
     ncpState_ = NcpState::OFF;
     prevNcpState_ = NcpState::OFF;
@@ -647,4 +651,21 @@ int Esp32NcpClient::dataChannelWrite(int id, const uint8_t* data, size_t size) {
     return SYSTEM_ERROR_INVALID_ARGUMENT;
 }
 
+int Esp32NcpClient::dataChannelWritev(int id, const NcpIoVec* iov, size_t iovCount) {
+    if (iovCount == 1) {
+        return dataChannelWrite(id, iov->data, iov->size);
+    }
+    // Each write is sent as a separate muxer frame, so the packet needs to be assembled in a
+    // contiguous buffer first. This method is only called from the lwIP thread, which allows
+    // using the same preallocated buffer for all packets
+    CHECK_TRUE(txBuf_, SYSTEM_ERROR_INVALID_STATE);
+    size_t size = 0;
+    for (size_t i = 0; i < iovCount; ++i) {
+        CHECK_TRUE(iov[i].size <= ESP32_NCP_MAX_MUXER_FRAME_SIZE - size, SYSTEM_ERROR_TOO_LARGE);
+        memcpy(txBuf_.get() + size, iov[i].data, iov[i].size);
+        size += iov[i].size;
+    }
+    return dataChannelWrite(id, txBuf_.get(), size);
+}
+
 } // particle
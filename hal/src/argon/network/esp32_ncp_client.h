@@ -49,6 +49,7 @@ public:
     int getFirmwareModuleVersion(uint16_t* ver) override;
     int updateFirmware(InputStream* file, size_t size) override;
     int dataChannelWrite(int id, const uint8_t* data, size_t size) override;
+    int dataChannelWritev(int id, const NcpIoVec* iov, size_t iovCount) override;
     void processEvents() override;
     AtParser* atParser() override;
     void lock() override;
@@ -74,6 +75,7 @@ private:
     gsm0710::Muxer<particle::Stream, StaticRecursiveMutex> muxer_;
     std::unique_ptr<particle::MuxerChannelStream<decltype(muxer_)> > muxerAtStream_;
     bool muxerNotStarted_;
+    std::unique_ptr<uint8_t[]> txBuf_;
 
     int initParser(Stream* stream);
     int checkParser();
@@ -164,10 +164,16 @@ extern "C" {
 
 struct netif* lwip_hook_ip4_route_src(const ip4_addr_t* src, const ip4_addr_t* dst) {
     if (src == nullptr) {
-        if (en2 && netifCanForwardIpv4(en2->interface())) {
-            return en2->interface();
-        } else if (pp3 && netifCanForwardIpv4(pp3->interface())) {
-            return pp3->interface();
+        /* Prefer the interface with the lowest metric, Ethernet if the metrics are equal */
+        BaseNetif* best = nullptr;
+        for (auto netif: { en2, pp3 }) {
+            if (netif && netifCanForwardIpv4(netif->interface()) &&
+                    (!best || netif->getMetric() < best->getMetric())) {
+                best = netif;
+            }
+        }
+        if (best) {
+            return best->interface();
         }
     }
 
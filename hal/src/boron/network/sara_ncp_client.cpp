@@ -33,6 +33,7 @@
 #include "core_hal.h"
 
 #include "stream_util.h"
+#include "tlv_file.h"
 
 #include "spark_wiring_interrupts.h"
 #include "spark_wiring_vector.h"
@@ -96,6 +97,23 @@ const auto UBLOX_NCP_SIM_SELECT_PIN = 23;
 
 const unsigned REGISTRATION_CHECK_INTERVAL = 15 * 1000;
 const unsigned REGISTRATION_TIMEOUT = 5 * 60 * 1000;
+// Time after which the modem is switched to automatic operator selection if it can't register
+// with the last serving operator
+const unsigned REGISTRATION_SEED_TIMEOUT = 60 * 1000;
+
+// Time to wait for the modem to stop sending data before issuing commands
+const unsigned UBLOX_NCP_SKIP_TIMEOUT = 1000;
+// Same as above, but for a modem that has been initialized before and is known to be responsive
+const unsigned UBLOX_NCP_FAST_SKIP_TIMEOUT = 100;
+
+const auto UBLOX_NCP_PROFILE_FILE = "/sys/sara_ncp.dat";
+const uint16_t UBLOX_NCP_PROFILE_KEY = 1;
+// Needs to be incremented when the persistent settings applied in initReady() change
+const unsigned UBLOX_NCP_PROFILE_CONFIG_VERSION = 1;
+
+uint32_t hashString(const char* str) {
+    return HAL_Core_Compute_CRC32((const uint8_t*)str, strlen(str));
+}
 
 } // anonymous
 
@@ -134,6 +152,10 @@ int SaraNcpClient::init(const NcpClientConfig& conf) {
     regCheckTime_ = 0;
     parserError_ = 0;
     ready_ = false;
+    profileLoaded_ = false;
+    profileUpdatePending_ = false;
+    operatorSeeded_ = false;
+    iccidHash_ = 0;
     resetRegistrationState();
     return 0;
 }
@@ -600,17 +622,24 @@ int SaraNcpClient::waitReady() {
     if (ready_) {
         return 0;
     }
+    if (!profileLoaded_) {
+        // Proceed with the full initialization if the profile can't be loaded
+        loadProfile();
+        profileLoaded_ = true;
+    }
     muxer_.stop();
     CHECK(serial_->setBaudRate(UBLOX_NCP_DEFAULT_SERIAL_BAUDRATE));
     CHECK(initParser(serial_.get()));
     // Enable voltage translator
     CHECK(modemSetUartState(true));
-    skipAll(serial_.get(), 1000);
+    skipAll(serial_.get(), UBLOX_NCP_SKIP_TIMEOUT);
     parser_.reset();
     ready_ = waitAtResponse(20000) == 0;
 
     if (ready_) {
-        skipAll(serial_.get(), 1000);
+        // A modem that has been initialized before only needs to flush the responses to the
+        // AT commands sent while it was starting up
+        skipAll(serial_.get(), profile_.configHash ? UBLOX_NCP_FAST_SKIP_TIMEOUT : UBLOX_NCP_SKIP_TIMEOUT);
         parser_.reset();
         parserError_ = 0;
         LOG(TRACE, "NCP ready to accept AT commands");
@@ -751,9 +780,29 @@ int SaraNcpClient::initReady() {
     // Select either internal or external SIM card slot depending on the configuration
     CHECK(selectSimCard());
 
-    // Just in case disconnect
-    int r = CHECK_PARSER(parser_.execCommand("AT+COPS=2,2"));
-    // CHECK_TRUE(r == AtResponse::OK, SYSTEM_ERROR_AT_NOT_OK);
+    // Persistent settings don't need to be applied again if this modem has already been
+    // initialized with the current version of the settings
+    char imei[32] = {};
+    {
+        auto resp = parser_.sendCommand("AT+CGSN");
+        CHECK_PARSER(resp.readLine(imei, sizeof(imei)));
+        CHECK_PARSER_OK(resp.readResult());
+    }
+    char config[64] = {};
+    snprintf(config, sizeof(config), "%s,%d,%u", imei, ncpId(), UBLOX_NCP_PROFILE_CONFIG_VERSION);
+    const uint32_t configHash = hashString(config);
+    const bool configured = (profile_.configHash == configHash);
+    if (configured) {
+        LOG(TRACE, "Modem settings are up to date");
+    }
+
+    int r = 0;
+    if (!configured) {
+        // Just in case disconnect. A modem that has been initialized before is allowed to keep
+        // registering with the network while it's being initialized
+        r = CHECK_PARSER(parser_.execCommand("AT+COPS=2,2"));
+        // CHECK_TRUE(r == AtResponse::OK, SYSTEM_ERROR_AT_NOT_OK);
+    }
 
     // Reformat the operator string to be numeric
     // (allows the capture of `mcc` and `mnc`)
@@ -763,44 +812,46 @@ int SaraNcpClient::initReady() {
         // Change the baudrate to 921600
         CHECK(changeBaudRate(UBLOX_NCP_RUNTIME_SERIAL_BAUDRATE_U2));
         // Check that the modem is responsive at the new baudrate
-        skipAll(serial_.get(), 1000);
+        skipAll(serial_.get(), configured ? UBLOX_NCP_FAST_SKIP_TIMEOUT : UBLOX_NCP_SKIP_TIMEOUT);
         CHECK(waitAtResponse(10000));
     }
 
     if (ncpId() == MESH_NCP_SARA_R410) {
-        // Force Cat M1-only mode
-        auto resp = parser_.sendCommand("AT+URAT?");
-        unsigned selectAct = 0, preferAct1 = 0, preferAct2 = 0;
-        r = CHECK_PARSER(resp.scanf("+URAT: %u,%u,%u", &selectAct, &preferAct1, &preferAct2));
-        CHECK_PARSER_OK(resp.readResult());
-        if (selectAct != 7 || (r >= 2 && preferAct1 != 7) || (r >= 3 && preferAct2 != 7)) { // 7: LTE Cat M1
-            // This is a persistent setting
-            CHECK_PARSER_OK(parser_.execCommand("AT+URAT=7"));
-        }
-        // Force eDRX mode to be disabled. AT+CEDRXS=0 doesn't seem disable eDRX completely, so
-        // so we're disabling it for each reported RAT individually
-        Vector<unsigned> acts;
-        resp = parser_.sendCommand("AT+CEDRXS?");
-        while (resp.hasNextLine()) {
-            unsigned act = 0;
-            r = resp.scanf("+CEDRXS: %u", &act);
-            if (r == 1) { // Ignore scanf() errors
-                CHECK_TRUE(acts.append(act), SYSTEM_ERROR_NO_MEMORY);
+        if (!configured) {
+            // Force Cat M1-only mode
+            auto resp = parser_.sendCommand("AT+URAT?");
+            unsigned selectAct = 0, preferAct1 = 0, preferAct2 = 0;
+            r = CHECK_PARSER(resp.scanf("+URAT: %u,%u,%u", &selectAct, &preferAct1, &preferAct2));
+            CHECK_PARSER_OK(resp.readResult());
+            if (selectAct != 7 || (r >= 2 && preferAct1 != 7) || (r >= 3 && preferAct2 != 7)) { // 7: LTE Cat M1
+                // This is a persistent setting
+                CHECK_PARSER_OK(parser_.execCommand("AT+URAT=7"));
             }
-        }
-        CHECK_PARSER_OK(resp.readResult());
-        int lastError = AtResponse::OK;
-        for (unsigned act: acts) {
-            // This command may fail for unknown reason. eDRX mode is a persistent setting and, eventually,
-            // it will get applied for each RAT during subsequent re-initialization attempts
-            r = CHECK_PARSER(parser_.execCommand("AT+CEDRXS=3,%u", act)); // 3: Disable the use of eDRX
-            if (r != AtResponse::OK) {
-                lastError = r;
+            // Force eDRX mode to be disabled. AT+CEDRXS=0 doesn't seem disable eDRX completely, so
+            // so we're disabling it for each reported RAT individually
+            Vector<unsigned> acts;
+            resp = parser_.sendCommand("AT+CEDRXS?");
+            while (resp.hasNextLine()) {
+                unsigned act = 0;
+                r = resp.scanf("+CEDRXS: %u", &act);
+                if (r == 1) { // Ignore scanf() errors
+                    CHECK_TRUE(acts.append(act), SYSTEM_ERROR_NO_MEMORY);
+                }
+            }
+            CHECK_PARSER_OK(resp.readResult());
+            int lastError = AtResponse::OK;
+            for (unsigned act: acts) {
+                // This command may fail for unknown reason. eDRX mode is a persistent setting and, eventually,
+                // it will get applied for each RAT during subsequent re-initialization attempts
+                r = CHECK_PARSER(parser_.execCommand("AT+CEDRXS=3,%u", act)); // 3: Disable the use of eDRX
+                if (r != AtResponse::OK) {
+                    lastError = r;
+                }
             }
+            CHECK_PARSER_OK(lastError);
+            // Force Power Saving mode to be disabled for good measure
+            CHECK_PARSER_OK(parser_.execCommand("AT+CPSMS=0"));
         }
-        CHECK_PARSER_OK(lastError);
-        // Force Power Saving mode to be disabled for good measure
-        CHECK_PARSER_OK(parser_.execCommand("AT+CPSMS=0"));
     } else {
         // Power saving
         CHECK_PARSER_OK(parser_.execCommand("AT+UPSV=0"));
@@ -859,6 +910,12 @@ int SaraNcpClient::initReady() {
 
     muxerSg.dismiss();
 
+    if (!configured) {
+        profile_.configHash = configHash;
+        // Not critical, the settings will be applied again on the next initialization
+        saveProfile();
+    }
+
     return 0;
 }
 
@@ -870,8 +927,13 @@ int SaraNcpClient::checkSimCard() {
     r = CHECK_PARSER(resp.readResult());
     CHECK_TRUE(r == AtResponse::OK, SYSTEM_ERROR_AT_NOT_OK);
     if (!strcmp(code, "READY")) {
-        r = parser_.execCommand("AT+CCID");
+        auto resp = parser_.sendCommand("AT+CCID");
+        char iccid[32] = {};
+        r = CHECK_PARSER(resp.scanf("+CCID: %31s", iccid));
+        CHECK_TRUE(r == 1, SYSTEM_ERROR_AT_RESPONSE_UNEXPECTED);
+        r = CHECK_PARSER(resp.readResult());
         CHECK_TRUE(r == AtResponse::OK, SYSTEM_ERROR_AT_NOT_OK);
+        iccidHash_ = hashString(iccid);
         return 0;
     }
     return SYSTEM_ERROR_UNKNOWN;
@@ -888,11 +950,30 @@ int SaraNcpClient::configureApn(const CellularNetworkConfig& conf) {
         CHECK_TRUE(r == AtResponse::OK, SYSTEM_ERROR_AT_NOT_OK);
         netConf_ = networkConfigForImsi(buf, strlen(buf));
     }
-    // FIXME: for now IPv4 context only
-    auto resp = parser_.sendCommand("AT+CGDCONT=1,\"IP\",\"%s\"",
-            netConf_.hasApn() ? netConf_.apn() : "");
+    // The PDP context is a persistent setting, don't change it if it's already configured. This
+    // also allows the modem to stay registered if it has registered on its own
+    const char* apn = netConf_.hasApn() ? netConf_.apn() : "";
+    bool apnConfigured = false;
+    auto resp = parser_.sendCommand("AT+CGDCONT?");
+    while (resp.hasNextLine()) {
+        int cid = 0;
+        char type[16] = {};
+        char ctxApn[64] = {};
+        const int n = resp.scanf("+CGDCONT: %d,\"%15[^\"]\",\"%63[^\"]", &cid, type, ctxApn);
+        if (n >= 2 && cid == 1 && !strcmp(type, "IP") && !strcmp(ctxApn, apn)) { // Ignore scanf() errors
+            apnConfigured = true;
+        }
+    }
     int r = CHECK_PARSER(resp.readResult());
     CHECK_TRUE(r == AtResponse::OK, SYSTEM_ERROR_AT_NOT_OK);
+    if (!apnConfigured) {
+        // The context can't be changed while the modem is registered
+        r = CHECK_PARSER(parser_.execCommand("AT+COPS=2,2"));
+        // FIXME: for now IPv4 context only
+        resp = parser_.sendCommand("AT+CGDCONT=1,\"IP\",\"%s\"", apn);
+        r = CHECK_PARSER(resp.readResult());
+        CHECK_TRUE(r == AtResponse::OK, SYSTEM_ERROR_AT_NOT_OK);
+    }
 
     // If we have a password and user, set it to PDP context #2
     // Set the type of auth (CHAP by default)
@@ -927,27 +1008,90 @@ int SaraNcpClient::registerNet() {
 
     connectionState(NcpConnectionState::CONNECTING);
 
-    // NOTE: up to 3 mins
-    r = CHECK_PARSER(parser_.execCommand(3 * 60 * 1000, "AT+COPS=0,2"));
-    // Ignore response code here
-    // CHECK_TRUE(r == AtResponse::OK, SYSTEM_ERROR_AT_NOT_OK);
-
-    if (conf_.ncpIdentifier() != MESH_NCP_SARA_R410) {
-        r = CHECK_PARSER(parser_.execCommand("AT+CREG?"));
-        CHECK_TRUE(r == AtResponse::OK, SYSTEM_ERROR_AT_NOT_OK);
-        r = CHECK_PARSER(parser_.execCommand("AT+CGREG?"));
-        CHECK_TRUE(r == AtResponse::OK, SYSTEM_ERROR_AT_NOT_OK);
+    operatorSeeded_ = false;
+    profileUpdatePending_ = true;
+    if (profile_.oper[0] && profile_.iccidHash == iccidHash_) {
+        // The modem might have registered with the network on its own already
+        CHECK(queryRegistrationState());
+        if (connState_ != NcpConnectionState::CONNECTED) {
+            // Try the last serving operator first. The modem falls back to automatic operator
+            // selection if the operator is not available
+            LOG(TRACE, "Registering with the last serving operator: %s", profile_.oper);
+            r = CHECK_PARSER(parser_.execCommand(3 * 60 * 1000, "AT+COPS=4,2,\"%s\",%d", profile_.oper,
+                    (int)profile_.act));
+            operatorSeeded_ = true;
+        }
     } else {
-        r = CHECK_PARSER(parser_.execCommand("AT+CEREG?"));
-        CHECK_TRUE(r == AtResponse::OK, SYSTEM_ERROR_AT_NOT_OK);
+        // NOTE: up to 3 mins
+        r = CHECK_PARSER(parser_.execCommand(3 * 60 * 1000, "AT+COPS=0,2"));
+        // Ignore response code here
+        // CHECK_TRUE(r == AtResponse::OK, SYSTEM_ERROR_AT_NOT_OK);
     }
 
+    CHECK(queryRegistrationState());
+
     regStartTime_ = millis();
     regCheckTime_ = regStartTime_;
 
     return 0;
 }
 
+int SaraNcpClient::queryRegistrationState() {
+    if (conf_.ncpIdentifier() != MESH_NCP_SARA_R410) {
+        CHECK_PARSER_OK(parser_.execCommand("AT+CREG?"));
+        CHECK_PARSER_OK(parser_.execCommand("AT+CGREG?"));
+    } else {
+        CHECK_PARSER_OK(parser_.execCommand("AT+CEREG?"));
+    }
+    return 0;
+}
+
+int SaraNcpClient::loadProfile() {
+    profile_ = Profile();
+    services::settings::TlvFile file(UBLOX_NCP_PROFILE_FILE);
+    CHECK(file.init());
+    SCOPE_GUARD({
+        file.deInit();
+    });
+    Profile profile = {};
+    const ssize_t n = file.get(UBLOX_NCP_PROFILE_KEY, (uint8_t*)&profile, sizeof(profile));
+    if (n != sizeof(profile)) {
+        return (n < 0) ? n : SYSTEM_ERROR_BAD_DATA;
+    }
+    profile.oper[sizeof(profile.oper) - 1] = '\0';
+    profile_ = profile;
+    return 0;
+}
+
+int SaraNcpClient::saveProfile() {
+    services::settings::TlvFile file(UBLOX_NCP_PROFILE_FILE);
+    CHECK(file.init());
+    SCOPE_GUARD({
+        file.deInit();
+    });
+    CHECK(file.set(UBLOX_NCP_PROFILE_KEY, (const uint8_t*)&profile_, sizeof(profile_)));
+    CHECK(file.sync());
+    return 0;
+}
+
+int SaraNcpClient::updateProfile() {
+    char oper[sizeof(profile_.oper)] = {};
+    int act = -1;
+    auto resp = parser_.sendCommand("AT+COPS?");
+    int r = CHECK_PARSER(resp.scanf("+COPS: %*d,%*d,\"%6[0-9]\",%d", oper, &act));
+    CHECK_TRUE(r == 2, SYSTEM_ERROR_AT_RESPONSE_UNEXPECTED);
+    CHECK_PARSER_OK(resp.readResult());
+    if (profile_.iccidHash == iccidHash_ && !strcmp(profile_.oper, oper) && profile_.act == act) {
+        return 0;
+    }
+    memcpy(profile_.oper, oper, sizeof(oper));
+    profile_.act = act;
+    profile_.iccidHash = iccidHash_;
+    LOG(TRACE, "Serving operator: %s", oper);
+    CHECK(saveProfile());
+    return 0;
+}
+
 void SaraNcpClient::ncpState(NcpState state) {
     if (ncpState_ == NcpState::DISABLED) {
         return;
@@ -1067,6 +1211,12 @@ int SaraNcpClient::processEventsImpl() {
     CHECK_TRUE(ncpState_ == NcpState::ON, SYSTEM_ERROR_INVALID_STATE);
     parser_.processUrc(); // Ignore errors
     checkRegistrationState();
+    if (connState_ == NcpConnectionState::CONNECTED && profileUpdatePending_) {
+        // Remember the serving operator for the next registration
+        profileUpdatePending_ = false;
+        operatorSeeded_ = false;
+        updateProfile(); // Ignore errors
+    }
     if (connState_ != NcpConnectionState::CONNECTING ||
             millis() - regCheckTime_ < REGISTRATION_CHECK_INTERVAL) {
         return 0;
@@ -1074,12 +1224,15 @@ int SaraNcpClient::processEventsImpl() {
     SCOPE_GUARD({
         regCheckTime_ = millis();
     });
-    if (conf_.ncpIdentifier() != MESH_NCP_SARA_R410) {
-        CHECK_PARSER_OK(parser_.execCommand("AT+CREG?"));
-        CHECK_PARSER_OK(parser_.execCommand("AT+CGREG?"));
-    } else {
-        CHECK_PARSER_OK(parser_.execCommand("AT+CEREG?"));
+    if (operatorSeeded_ && millis() - regStartTime_ >= REGISTRATION_SEED_TIMEOUT) {
+        LOG(WARN, "Unable to register with the last serving operator, using automatic selection");
+        operatorSeeded_ = false;
+        profile_.oper[0] = '\0';
+        saveProfile(); // Ignore errors
+        const int r = CHECK_PARSER(parser_.execCommand(3 * 60 * 1000, "AT+COPS=0,2"));
+        (void)r;
     }
+    CHECK(queryRegistrationState());
     if (connState_ == NcpConnectionState::CONNECTING &&
             millis() - regStartTime_ >= REGISTRATION_TIMEOUT) {
         LOG(WARN, "Resetting the modem due to the network registration timeout");
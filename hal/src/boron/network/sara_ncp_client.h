@@ -90,6 +90,22 @@ private:
     system_tick_t regStartTime_;
     system_tick_t regCheckTime_;
 
+    // Persistent settings applied to the modem during the last full initialization and the
+    // network the modem was last registered with. The profile is stored in the filesystem and
+    // allows skipping the settings that are already applied when the modem is powered on again
+    struct Profile {
+        uint32_t configHash; // Hash of the modem identity and the applied settings
+        uint32_t iccidHash; // SIM card the operator below was used with
+        char oper[7]; // MCC and MNC of the last serving operator
+        int8_t act; // Access technology of the last serving operator
+    };
+
+    Profile profile_ = {};
+    bool profileLoaded_ = false;
+    bool profileUpdatePending_ = false;
+    bool operatorSeeded_ = false;
+    uint32_t iccidHash_ = 0;
+
     int queryAndParseAtCops(CellularSignalQuality* qual);
     int initParser(Stream* stream);
     int checkParser();
@@ -100,7 +116,11 @@ private:
     int checkSimCard();
     int configureApn(const CellularNetworkConfig& conf);
     int registerNet();
+    int queryRegistrationState();
     int changeBaudRate(unsigned int baud);
+    int loadProfile();
+    int saveProfile();
+    int updateProfile();
     static int muxChannelStateCb(uint8_t channel, decltype(muxer_)::ChannelState oldState,
             decltype(muxer_)::ChannelState newState, void* ctx);
     void ncpState(NcpState state);
@@ -1,6 +1,10 @@
 #include "dct_hal.h"
 
 #include "dcd_flash_impl.h"
+#include "hal_platform.h"
+#if HAL_PLATFORM_DCD_LOG
+#include "dcd_log.h"
+#endif
 
 namespace {
 
@@ -8,13 +12,19 @@ uint32_t calculateCRC(const void* data, size_t len) {
     return Compute_CRC32(reinterpret_cast<const uint8_t*>(data), len);
 }
 
+#if HAL_PLATFORM_DCD_LOG
+using Dcd = LogDCD<UpdateDCD<InternalFlashStore, 16*1024, 0x8004000, 0x8008000, calculateCRC>, sizeof(application_dct_t)>;
+#else
+using Dcd = UpdateDCD<InternalFlashStore, 16*1024, 0x8004000, 0x8008000, calculateCRC>;
+#endif
+
 /**
  * The DCD is called before constructors have executed (from HAL_Core_Config) so we need to manually construct
  * rather than rely upon global construction.
  */
-UpdateDCD<InternalFlashStore, 16*1024, 0x8004000, 0x8008000, calculateCRC>& dcd()
+Dcd& dcd()
 {
-    static UpdateDCD<InternalFlashStore, 16*1024, 0x8004000, 0x8008000, calculateCRC> dcd;
+    static Dcd dcd;
     return dcd;
 }
 
@@ -58,5 +68,14 @@ int dct_write_app_data(const void* data, uint32_t offset, uint32_t size) {
 void dcd_migrate_data() {
     dct_lock(1);
     dcd().migrate();
+    dcd().sync();
+    dct_unlock(1);
+}
+
+void dcd_flush_data() {
+#if HAL_PLATFORM_DCD_LOG
+    dct_lock(1);
+    dcd().flush();
     dct_unlock(1);
+#endif
 }
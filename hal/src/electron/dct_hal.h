@@ -26,6 +26,10 @@ extern "C" {
 #endif
 
 void dcd_migrate_data();
+/**
+ * Makes the current data readable by the code that doesn't support the log-structured DCD.
+ */
+void dcd_flush_data();
 
 #ifdef __cplusplus
 } // extern "C"
@@ -43,6 +43,9 @@
 
 #include "eeprom_file.h"
 #include "eeprom_hal.h"
+#include "flash_device.h"
+#include <csignal>
+#include <cstdlib>
 
 using std::cout;
 
@@ -132,13 +135,38 @@ const char* eeprom_bin = "eeprom.bin";
 
 #ifndef UNIT_TEST
 
+static void print_flash_stats()
+{
+    flash_device().print_stats(cout);
+}
+
+static void exit_on_signal(int)
+{
+    exit(0);
+}
+
+static void open_flash()
+{
+    FlashDevice::Timing timing;
+    timing.simulate = deviceConfig.flash_latency;
+    flash_device().set_timing(timing);
+    flash_device().open(deviceConfig.flash_file);
+    if (deviceConfig.flash_stats) {
+        atexit(print_flash_stats);
+        // The device normally runs until it's interrupted
+        signal(SIGINT, exit_on_signal);
+        signal(SIGTERM, exit_on_signal);
+    }
+}
+
 extern "C" int main(int argc, char* argv[])
 {
     log_set_callbacks(log_message_callback, log_write_callback, log_enabled_callback, nullptr);
     if (read_device_config(argc, argv)) {
-    		// init the eeprom so that a file of size 0 can be used to trigger the save.
+    		open_flash();
     		HAL_EEPROM_Init();
-    		if (exists_file(eeprom_bin)) {
+    		// import the eeprom contents into a new flash image
+    		if (flash_device().created() && exists_file(eeprom_bin)) {
     			GCC_EEPROM_Load(eeprom_bin);
     		}
 			app_setup_and_loop();
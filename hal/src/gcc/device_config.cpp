@@ -17,6 +17,7 @@
  */
 
 #include "device_config.h"
+#include "fleet.h"
 #include "core_msg.h"
 #include "filesystem.h"
 #include <cstdlib>
@@ -95,6 +96,11 @@ public:
             ("server_key,sk", po::value<string>(&config.server_key)->default_value("server_key.der"), "the filename containing the server public key")
             ("state,s", po::value<string>(&config.periph_directory)->default_value("state"), "the directory where device state and peripherals is stored")
 			("protocol,p", po::value<ProtocolFactory>(&config.protocol)->default_value(PROTOCOL_LIGHTSSL), "the cloud communication protocol to use")
+            ("fleet,f", po::value<uint16_t>(&config.fleet_size)->default_value(0), "the number of virtual devices to run, each in its own process")
+            ("fleet_stats", po::value<uint16_t>(&config.fleet_stats_interval)->default_value(10), "the interval in seconds at which fleet statistics are printed (0 to disable)")
+            ("flash", po::value<string>(&config.flash_file)->default_value("flash.bin"), "the filename of the emulated flash image, created if it doesn't exist")
+            ("flash_latency", po::bool_switch(&config.flash_latency), "delay flash operations by the typical time they take on the hardware")
+            ("flash_stats", po::bool_switch(&config.flash_stats), "print flash I/O statistics on exit")
 			;
 
         command_line_options.add(program_options).add(device_options);
@@ -182,6 +188,10 @@ bool read_device_config(int argc, char* argv[])
         return false;
     }
 
+    if (parser.config.fleet_size && !run_fleet(parser.config)) {
+        return false; // All devices of the fleet have exited
+    }
+
     deviceConfig.read(parser.config);
     return true;
 }
@@ -203,5 +213,8 @@ void DeviceConfig::read(Configuration& configuration)
     setLoggerLevel(LoggerOutputLevel(NO_LOG_LEVEL-configuration.log_level));
 
     this->protocol = configuration.protocol;
+    this->flash_file = configuration.flash_file;
+    this->flash_latency = configuration.flash_latency;
+    this->flash_stats = configuration.flash_stats;
 }
 
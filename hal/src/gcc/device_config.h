@@ -53,6 +53,11 @@ struct Configuration
     std::string periph_directory;
     uint16_t log_level = 0;
     ProtocolFactory protocol = PROTOCOL_LIGHTSSL;
+    uint16_t fleet_size = 0;
+    uint16_t fleet_stats_interval = 10;
+    std::string flash_file;
+    bool flash_latency = false;
+    bool flash_stats = false;
 };
 
 
@@ -65,6 +70,9 @@ struct DeviceConfig
     uint8_t device_key[1024];
     uint8_t server_key[1024];
     ProtocolFactory protocol;
+    std::string flash_file;
+    bool flash_latency;
+    bool flash_stats;
 
     size_t hex2bin(const std::string& hex, uint8_t* dest, size_t destLen);
 
@@ -19,94 +19,96 @@
 
 #include "eeprom_hal.h"
 #include "eeprom_file.h"
+#include "eeprom_emulation.h"
+#include "flash_device.h"
 #include "filesystem.h"
 #include <string.h>
-#include <string>
 
 /*
- * Implements eeprom either as a transient storage,
- * or as a persisted storage, depending upon if the file exists.
- *
+ * Implements eeprom using the same emulation as the hardware platforms, on top
+ * of the emulated flash. The data is persisted in the flash image.
  */
 
-static uint8_t eeprom[2048];
+using FlashEEPROM = EEPROMEmulation<FlashDeviceStore<FLASH_EEPROM_PAGE_SIZE>, FLASH_EEPROM_PAGE1_ADDRESS, FLASH_EEPROM_PAGE_SIZE,
+        FLASH_EEPROM_PAGE2_ADDRESS, FLASH_EEPROM_PAGE_SIZE>;
 
-std::string eeprom_file;
+static FlashEEPROM flashEEPROM;
 
 /**
- * Write the eeprom state to the file.
- * This currently writes the entire file.
- */
-void GCC_EEPROM_Flush()
-{
-	if (eeprom_file.length()) {
-		GCC_EEPROM_Save(eeprom_file.c_str());
-	}
-}
-
-/**
- * Initializes the eeprom. If the eeprom file has already been
- * loaded, this function does nothing. Otherwise, it erases the
- * eeprom storage to 0xFF to emulate NAND flash.
+ * Initializes the eeprom. This function does nothing until the flash image
+ * is opened, since it's called during static initialization.
  */
 void HAL_EEPROM_Init()
 {
-	if (!eeprom_file.length())
-		HAL_EEPROM_Clear();
+	if (flash_device().is_open())
+		flashEEPROM.init();
 }
 
 uint8_t HAL_EEPROM_Read(uint32_t index)
 {
-	uint8_t val;
-	HAL_EEPROM_Get(index, &val, 1);
+	uint8_t val = 0xFF;
+	flashEEPROM.get(index, val);
 	return val;
 }
 
 void HAL_EEPROM_Write(uint32_t index, uint8_t data)
 {
-	HAL_EEPROM_Put(index, &data, 1);
+	flashEEPROM.put(index, data);
 }
 
 void HAL_EEPROM_Get(uint32_t index, void *data, size_t length)
 {
-	memcpy(data, eeprom+index, length);
+	flashEEPROM.get(index, data, length);
 }
 
 void HAL_EEPROM_Put(uint32_t index, const void *data, size_t length)
 {
-	memcpy(eeprom+index, data, length);
-	GCC_EEPROM_Flush();
+	flashEEPROM.put(index, data, length);
 }
 
 size_t HAL_EEPROM_Length()
 {
-	return sizeof(eeprom);
+	return flashEEPROM.capacity();
 }
 
 void HAL_EEPROM_Clear()
 {
-	memset(eeprom, 0xFF, sizeof(eeprom));
-	GCC_EEPROM_Flush();
+	flashEEPROM.clear();
 }
 
 bool HAL_EEPROM_Has_Pending_Erase()
 {
-	return false;
+	return flashEEPROM.hasPendingErase();
 }
 
 void HAL_EEPROM_Perform_Pending_Erase()
 {
+	flashEEPROM.performPendingErase();
 }
 
+/**
+ * Imports the eeprom contents from a file. Only the bytes that differ
+ * from the current contents are written to the flash.
+ */
 void GCC_EEPROM_Load(const char* filename)
 {
-	read_file(filename, eeprom, sizeof(eeprom));
-	eeprom_file = filename;
+	uint8_t data[FlashEEPROM::capacity()];
+	memset(data, 0xFF, sizeof(data));
+	read_file(filename, data, sizeof(data));
+	flashEEPROM.put(0, data, sizeof(data));
 }
 
+/**
+ * Exports the eeprom contents to a file.
+ */
 void GCC_EEPROM_Save(const char* filename)
 {
-	write_file(filename, eeprom, sizeof(eeprom));
+	uint8_t data[FlashEEPROM::capacity()];
+	flashEEPROM.get(0, data, sizeof(data));
+	write_file(filename, data, sizeof(data));
 }
 
-
+bool HAL_EEPROM_Perform_Background_Work(void* reserved)
+{
+	return flashEEPROM.performBackgroundWork();
+}
@@ -0,0 +1,269 @@
+/**
+  Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include "flash_device.h"
+#include "service_debug.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <thread>
+
+#include <boost/format.hpp>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using std::string;
+
+namespace {
+
+#ifndef _WIN32
+
+/**
+ * Maps a file into memory, creating it and filling it with the given value if it doesn't exist.
+ * Returns `nullptr` if the file has the wrong size.
+ */
+void* map_file(const string& filename, size_t size, uint8_t fill, bool* created)
+{
+    int fd = ::open(filename.c_str(), O_RDWR);
+    *created = (fd < 0);
+    if (fd < 0) {
+        fd = ::open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            throw std::runtime_error(string("unable to create file '") + filename + "'");
+        }
+        if (ftruncate(fd, size) != 0) {
+            ::close(fd);
+            throw std::runtime_error(string("unable to resize file '") + filename + "'");
+        }
+    }
+    struct stat st = {};
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size != size) {
+        ::close(fd);
+        return nullptr;
+    }
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        throw std::runtime_error(string("unable to map file '") + filename + "'");
+    }
+    if (*created) {
+        memset(p, fill, size);
+    }
+    return p;
+}
+
+void unmap_file(void* p, size_t size)
+{
+    munmap(p, size);
+}
+
+#else
+
+// There's no mmap() on Windows: the contents are kept in memory and are not persisted
+void* map_file(const string& filename, size_t size, uint8_t fill, bool* created)
+{
+    void* p = operator new(size);
+    memset(p, fill, size);
+    *created = true;
+    return p;
+}
+
+void unmap_file(void* p, size_t size)
+{
+    operator delete(p);
+}
+
+#endif // !defined(_WIN32)
+
+} // namespace
+
+FlashDevice::FlashDevice() :
+        memory(nullptr),
+        wear(nullptr),
+        memory_size(0),
+        image_created(false)
+{
+}
+
+FlashDevice::~FlashDevice()
+{
+    close();
+}
+
+void FlashDevice::open(const string& filename, uint32_t size)
+{
+    close();
+    if (size % FLASH_DEVICE_SECTOR_SIZE) {
+        throw std::invalid_argument("flash size should be a multiple of the sector size");
+    }
+    bool created = false;
+    memory = (uint8_t*)map_file(filename, size, 0xff, &image_created);
+    if (!memory) {
+        throw std::runtime_error(string("flash image '") + filename + "' has unexpected size, expected " + std::to_string(size) + " bytes");
+    }
+    const size_t wear_size = size / FLASH_DEVICE_SECTOR_SIZE * sizeof(uint32_t);
+    wear = (uint32_t*)map_file(filename + ".wear", wear_size, 0, &created);
+    if (!wear || (image_created && !created)) {
+        // Reset the wear counters of a recreated image
+        if (wear) {
+            unmap_file(wear, wear_size);
+        }
+        std::remove((filename + ".wear").c_str());
+        wear = (uint32_t*)map_file(filename + ".wear", wear_size, 0, &created);
+    }
+    memory_size = size;
+    reset_stats();
+    INFO("flash image %s, %u bytes%s", filename.c_str(), (unsigned)size, image_created ? " (created)" : "");
+}
+
+void FlashDevice::close()
+{
+    if (memory) {
+        unmap_file(wear, memory_size / FLASH_DEVICE_SECTOR_SIZE * sizeof(uint32_t));
+        unmap_file(memory, memory_size);
+        memory = nullptr;
+        wear = nullptr;
+        memory_size = 0;
+    }
+}
+
+int FlashDevice::read(uint32_t address, void* data, size_t size)
+{
+    if (!is_valid_range(address, size)) {
+        return FLASH_INVALID_RANGE;
+    }
+    memcpy(data, memory + address, size);
+    ++statistics.reads;
+    statistics.bytes_read += size;
+    busy(size * timing.read_ns_per_byte / 1000);
+    return FLASH_OK;
+}
+
+int FlashDevice::program(uint32_t address, const void* data, size_t size)
+{
+    if (!is_valid_range(address, size)) {
+        return FLASH_INVALID_RANGE;
+    }
+    int result = FLASH_OK;
+    const uint8_t* src = (const uint8_t*)data;
+    while (size) {
+        // A program operation can't cross a page boundary
+        const size_t n = std::min<size_t>(size, FLASH_DEVICE_PAGE_SIZE - address % FLASH_DEVICE_PAGE_SIZE);
+        if (wear[address / FLASH_DEVICE_SECTOR_SIZE] >= timing.endurance) {
+            return FLASH_WORN_OUT;
+        }
+        uint8_t* dest = memory + address;
+        for (size_t i = 0; i < n; ++i) {
+            if ((dest[i] & src[i]) != src[i]) {
+                result = FLASH_NOT_ERASED;
+            }
+            dest[i] &= src[i];
+        }
+        ++statistics.page_programs;
+        statistics.bytes_programmed += n;
+        busy(timing.program_us_per_page);
+        address += n;
+        src += n;
+        size -= n;
+    }
+    if (result != FLASH_OK) {
+        ++statistics.program_errors;
+        DEBUG("flash program error: location not erased");
+    }
+    return result;
+}
+
+int FlashDevice::erase_sector(uint32_t address)
+{
+    if (!is_valid_range(address, 1)) {
+        return FLASH_INVALID_RANGE;
+    }
+    const uint32_t sector = address / FLASH_DEVICE_SECTOR_SIZE;
+    if (wear[sector] >= timing.endurance) {
+        return FLASH_WORN_OUT;
+    }
+    memset(memory + sector * FLASH_DEVICE_SECTOR_SIZE, 0xff, FLASH_DEVICE_SECTOR_SIZE);
+    ++wear[sector];
+    statistics.max_sector_erases = std::max(statistics.max_sector_erases, wear[sector]);
+    ++statistics.sector_erases;
+    busy(timing.erase_us_per_sector);
+    return FLASH_OK;
+}
+
+int FlashDevice::erase(uint32_t address, size_t size)
+{
+    if (!is_valid_range(address, size)) {
+        return FLASH_INVALID_RANGE;
+    }
+    const uint32_t end = address + size;
+    for (address -= address % FLASH_DEVICE_SECTOR_SIZE; address < end; address += FLASH_DEVICE_SECTOR_SIZE) {
+        const int result = erase_sector(address);
+        if (result != FLASH_OK) {
+            return result;
+        }
+    }
+    return FLASH_OK;
+}
+
+const uint8_t* FlashDevice::data_at(uint32_t address) const
+{
+    if (!is_valid_range(address, 0)) {
+        return nullptr;
+    }
+    return memory + address;
+}
+
+void FlashDevice::reset_stats()
+{
+    statistics = Stats();
+    if (wear) {
+        statistics.max_sector_erases = *std::max_element(wear, wear + memory_size / FLASH_DEVICE_SECTOR_SIZE);
+    }
+}
+
+void FlashDevice::print_stats(std::ostream& out) const
+{
+    out << boost::format("flash: %u reads (%u bytes), %u page programs (%u bytes), %u sector erases, %u program errors; "
+            "busy time %.1f ms; max sector wear %u/%u") % statistics.reads % statistics.bytes_read %
+            statistics.page_programs % statistics.bytes_programmed % statistics.sector_erases %
+            statistics.program_errors % (statistics.busy_us / 1000.0) % statistics.max_sector_erases %
+            timing.endurance << std::endl;
+}
+
+void FlashDevice::busy(uint64_t us)
+{
+    statistics.busy_us += us;
+    if (timing.simulate && us) {
+        std::this_thread::sleep_for(std::chrono::microseconds(us));
+    }
+}
+
+FlashDevice& flash_device()
+{
+    static FlashDevice device;
+    return device;
+}
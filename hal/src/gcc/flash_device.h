@@ -0,0 +1,193 @@
+/**
+  Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+// Layout of the emulated flash
+const uint32_t FLASH_DEVICE_SECTOR_SIZE = 4 * 1024;
+const uint32_t FLASH_DEVICE_PAGE_SIZE = 256;
+
+const uint32_t FLASH_EEPROM_PAGE_SIZE = 16 * 1024;
+const uint32_t FLASH_EEPROM_PAGE1_ADDRESS = 0x00000;
+const uint32_t FLASH_EEPROM_PAGE2_ADDRESS = 0x04000;
+const uint32_t FLASH_OTA_ADDRESS = 0x08000;
+const uint32_t FLASH_OTA_LENGTH = 100 * 1024;
+const uint32_t FLASH_DEVICE_SIZE = 0x22000;
+
+/**
+ * Emulated NOR flash backed by a memory-mapped image file.
+ *
+ * The device enforces the semantics of the real hardware: programming can only clear bits, so
+ * writing data over a location that hasn't been erased is reported as an error, programming
+ * is performed in pages, and erasing is performed in sectors. The number of erase cycles of each
+ * sector is stored in a separate `.wear` file next to the image, so the wear accumulates across
+ * runs of the device.
+ *
+ * Every operation is accounted for in the statistics together with its estimated duration, which
+ * allows measuring the flash I/O cost of changes to the storage code on the host. Optionally, the
+ * calling thread is delayed by the estimated duration of each operation.
+ */
+class FlashDevice
+{
+public:
+    enum Result
+    {
+        FLASH_OK = 0,
+        FLASH_INVALID_RANGE = -1,
+        FLASH_NOT_ERASED = -2,
+        FLASH_WORN_OUT = -3,
+        FLASH_NOT_OPEN = -4
+    };
+
+    // Typical characteristics of a serial NOR flash
+    struct Timing
+    {
+        unsigned read_ns_per_byte = 20;
+        unsigned program_us_per_page = 700;
+        unsigned erase_us_per_sector = 45000;
+        unsigned endurance = 100000; // Erase cycles
+        bool simulate = false; // Delay the calling thread
+    };
+
+    struct Stats
+    {
+        uint64_t reads = 0;
+        uint64_t bytes_read = 0;
+        uint64_t page_programs = 0;
+        uint64_t bytes_programmed = 0;
+        uint64_t sector_erases = 0;
+        uint64_t busy_us = 0; // Estimated time spent by the device performing the operations
+        uint32_t program_errors = 0; // Programming of locations that were not erased
+        uint32_t max_sector_erases = 0; // Erase cycles of the most worn sector, including the previous runs
+    };
+
+    FlashDevice();
+    ~FlashDevice();
+
+    /**
+     * Opens the image file, creating an erased image if the file doesn't exist.
+     */
+    void open(const std::string& filename, uint32_t size = FLASH_DEVICE_SIZE);
+    void close();
+
+    bool is_open() const
+    {
+        return memory != nullptr;
+    }
+
+    /**
+     * Returns `true` if the image file didn't exist and has been created by `open()`.
+     */
+    bool created() const
+    {
+        return image_created;
+    }
+
+    uint32_t size() const
+    {
+        return memory_size;
+    }
+
+    int read(uint32_t address, void* data, size_t size);
+    int program(uint32_t address, const void* data, size_t size);
+    int erase_sector(uint32_t address);
+
+    /**
+     * Erases all sectors overlapping with the given range.
+     */
+    int erase(uint32_t address, size_t size);
+
+    /**
+     * Returns a pointer to the mapped contents of the flash. Accesses via the pointer are not
+     * accounted for in the statistics.
+     */
+    const uint8_t* data_at(uint32_t address) const;
+
+    void set_timing(const Timing& timing)
+    {
+        this->timing = timing;
+    }
+
+    const Stats& stats() const
+    {
+        return statistics;
+    }
+
+    void reset_stats();
+    void print_stats(std::ostream& out) const;
+
+private:
+    uint8_t* memory;
+    uint32_t* wear;
+    uint32_t memory_size;
+    bool image_created;
+    Timing timing;
+    Stats statistics;
+
+    bool is_valid_range(uint32_t address, size_t size) const
+    {
+        return memory && address <= memory_size && size <= memory_size - address;
+    }
+
+    void busy(uint64_t us);
+};
+
+/**
+ * Returns the flash device of the virtual device.
+ */
+FlashDevice& flash_device();
+
+/**
+ * Implements access to the emulated flash, providing the interface expected by dcd.h and
+ * eeprom_emulation.h. `SectorSize` is the size of the sectors as seen by the storage code,
+ * which can be a multiple of the sector size of the device.
+ */
+template<uint32_t SectorSize>
+class FlashDeviceStore
+{
+public:
+    static int eraseSector(unsigned address)
+    {
+        return flash_device().erase(address - (address % SectorSize), SectorSize);
+    }
+
+    static int erase(unsigned address, unsigned size)
+    {
+        return flash_device().erase(address, size);
+    }
+
+    static int write(unsigned offset, const void* data, unsigned size)
+    {
+        return flash_device().program(offset, data, size);
+    }
+
+    static int read(unsigned offset, void* data, unsigned size)
+    {
+        return flash_device().read(offset, data, size);
+    }
+
+    static const uint8_t* dataAt(unsigned address)
+    {
+        return flash_device().data_at(address);
+    }
+};
@@ -0,0 +1,334 @@
+/**
+  Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include "fleet.h"
+#include "diagnostics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/format.hpp>
+
+#ifndef _WIN32
+#include <csignal>
+#include <cerrno>
+#include <climits>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+#endif // !defined(_WIN32)
+
+#ifndef _WIN32
+
+using std::string;
+using std::chrono::steady_clock;
+
+namespace {
+
+// Cloud connection status reported by the system via the `cloud:stat` diagnostic source
+enum CloudStatus {
+    CLOUD_DISCONNECTED = 0,
+    CLOUD_CONNECTING = 1,
+    CLOUD_CONNECTED = 2
+};
+
+enum FleetEventType: uint32_t {
+    FLEET_EVENT_CONNECTED = 1, // Value: time it took to connect and complete the handshake (ms)
+    FLEET_EVENT_DISCONNECTED = 2
+};
+
+// Event reported by a device process to the supervisor
+struct FleetEvent {
+    uint32_t device; // Device index
+    uint32_t type; // Event type (see FleetEventType)
+    uint32_t value;
+};
+
+const unsigned STATUS_POLL_INTERVAL = 10; // Milliseconds
+const char* const DEVICE_ID_PLACEHOLDER = "{id}";
+
+class LatencyStats
+{
+    std::vector<uint32_t> samples;
+
+public:
+    void add(uint32_t value)
+    {
+        samples.push_back(value);
+    }
+
+    size_t count() const
+    {
+        return samples.size();
+    }
+
+    string format() const
+    {
+        if (samples.empty()) {
+            return "n/a";
+        }
+        std::vector<uint32_t> s(samples);
+        std::sort(s.begin(), s.end());
+        uint64_t sum = 0;
+        for (uint32_t v: s) {
+            sum += v;
+        }
+        return (boost::format("min %u, avg %u, p50 %u, p95 %u, max %u") % s.front() % (sum / s.size()) %
+                s[s.size() / 2] % s[s.size() * 95 / 100] % s.back()).str();
+    }
+};
+
+string fleet_device_id(const string& base_id, unsigned index)
+{
+    if (base_id.length() != 24) {
+        throw std::invalid_argument(string("expected device ID of length 24, got: '") + base_id + "'");
+    }
+    uint8_t id[12];
+    for (unsigned i = 0; i < sizeof(id); ++i) {
+        id[i] = std::stoul(base_id.substr(i * 2, 2), nullptr, 16);
+    }
+    // Add the index to the ID as a 96-bit big endian number
+    unsigned carry = index;
+    for (int i = sizeof(id) - 1; i >= 0 && carry; --i) {
+        carry += id[i];
+        id[i] = carry & 0xff;
+        carry >>= 8;
+    }
+    string result;
+    for (uint8_t b: id) {
+        result += (boost::format("%02x") % (unsigned)b).str();
+    }
+    return result;
+}
+
+string replace_device_id(string value, const string& device_id)
+{
+    const size_t pos = value.find(DEVICE_ID_PLACEHOLDER);
+    if (pos != string::npos) {
+        value.replace(pos, strlen(DEVICE_ID_PLACEHOLDER), device_id);
+    }
+    return value;
+}
+
+int cloud_status(int32_t* status)
+{
+    const diag_source* src = nullptr;
+    const int ret = diag_get_source(DIAG_ID_CLOUD_CONNECTION_STATUS, &src, nullptr);
+    if (ret != 0) {
+        return ret; // The diagnostics service is not started yet
+    }
+    diag_source_get_cmd_data data = {};
+    data.size = sizeof(data);
+    data.data = status;
+    data.data_size = sizeof(*status);
+    return src->callback(src, DIAG_SOURCE_CMD_GET, &data);
+}
+
+volatile sig_atomic_t stop_requested = 0;
+
+void request_stop(int)
+{
+    stop_requested = 1;
+}
+
+string absolute_path(const string& path)
+{
+    if (path.empty() || path[0] == '/') {
+        return path;
+    }
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        throw std::runtime_error("unable to determine the current directory");
+    }
+    return string(cwd) + "/" + path;
+}
+
+void make_directories(const string& path)
+{
+    size_t pos = 0;
+    do {
+        pos = path.find('/', pos + 1);
+        const string dir = path.substr(0, pos);
+        if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+            throw std::runtime_error(string("unable to create directory '") + dir + "'");
+        }
+    } while (pos != string::npos);
+}
+
+/**
+ * Monitors the cloud connection status of this device and reports changes to the supervisor.
+ */
+void report_events(int fd, unsigned device)
+{
+    int32_t last_status = CLOUD_DISCONNECTED;
+    auto connecting_time = steady_clock::now();
+    for (;;) {
+        int32_t status = CLOUD_DISCONNECTED;
+        if (cloud_status(&status) == 0 && status != last_status) {
+            FleetEvent event = {};
+            event.device = device;
+            if (status == CLOUD_CONNECTING) {
+                connecting_time = steady_clock::now();
+            } else if (status == CLOUD_CONNECTED) {
+                event.type = FLEET_EVENT_CONNECTED;
+                event.value = std::chrono::duration_cast<std::chrono::milliseconds>(steady_clock::now() - connecting_time).count();
+            } else if (last_status == CLOUD_CONNECTED) {
+                event.type = FLEET_EVENT_DISCONNECTED;
+            }
+            // Writes of up to PIPE_BUF bytes are atomic, so events of different devices don't interleave
+            if (event.type && write(fd, &event, sizeof(event)) != sizeof(event)) {
+                return; // The supervisor has exited
+            }
+            last_status = status;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(STATUS_POLL_INTERVAL));
+    }
+}
+
+class FleetSupervisor
+{
+    std::vector<pid_t> devices;
+    std::vector<bool> connected;
+    LatencyStats connect_time;
+    unsigned disconnects = 0;
+
+    void handle_event(const FleetEvent& event)
+    {
+        if (event.device >= connected.size()) {
+            return;
+        }
+        if (event.type == FLEET_EVENT_CONNECTED) {
+            connected[event.device] = true;
+            connect_time.add(event.value);
+        } else if (event.type == FLEET_EVENT_DISCONNECTED) {
+            connected[event.device] = false;
+            ++disconnects;
+        }
+    }
+
+    void print_stats()
+    {
+        const size_t online = std::count(connected.begin(), connected.end(), true);
+        std::cout << boost::format("fleet: %u/%u devices connected, %u connections, %u disconnects; connect time (ms): %s") %
+                online % devices.size() % connect_time.count() % disconnects % connect_time.format() << std::endl;
+    }
+
+public:
+    void add(pid_t pid)
+    {
+        devices.push_back(pid);
+        connected.push_back(false);
+    }
+
+    void run(int fd, unsigned stats_interval)
+    {
+        signal(SIGINT, request_stop);
+        signal(SIGTERM, request_stop);
+        bool stopping = false;
+        auto next_stats = steady_clock::now() + std::chrono::seconds(stats_interval);
+        for (;;) {
+            if (stop_requested && !stopping) {
+                for (pid_t pid: devices) {
+                    kill(pid, SIGTERM);
+                }
+                stopping = true;
+            }
+            pollfd p = {};
+            p.fd = fd;
+            p.events = POLLIN;
+            if (poll(&p, 1, 100) > 0) {
+                FleetEvent event = {};
+                const ssize_t n = read(fd, &event, sizeof(event));
+                if (n == 0) {
+                    break; // All devices have exited
+                }
+                if (n == sizeof(event)) {
+                    handle_event(event);
+                }
+            }
+            if (stats_interval && steady_clock::now() >= next_stats) {
+                print_stats();
+                next_stats += std::chrono::seconds(stats_interval);
+            }
+        }
+        while (waitpid(-1, nullptr, 0) > 0) {
+        }
+        print_stats();
+    }
+};
+
+} // namespace
+
+#endif // !defined(_WIN32)
+
+bool run_fleet(Configuration& configuration)
+{
+#ifndef _WIN32
+    int fds[2];
+    if (pipe(fds) != 0) {
+        throw std::runtime_error("unable to create a pipe");
+    }
+    const string base_id = configuration.device_id;
+    const string state_dir = absolute_path(configuration.periph_directory);
+    FleetSupervisor supervisor;
+    for (unsigned i = 0; i < configuration.fleet_size; ++i) {
+        const string device_id = fleet_device_id(base_id, i);
+        const pid_t pid = fork();
+        if (pid < 0) {
+            throw std::runtime_error("unable to start a virtual device");
+        }
+        if (pid == 0) {
+#ifdef __linux__
+            prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+            close(fds[0]);
+            configuration.device_id = device_id;
+            configuration.device_key = absolute_path(replace_device_id(configuration.device_key, device_id));
+            configuration.server_key = absolute_path(replace_device_id(configuration.server_key, device_id));
+            // The device state, including the emulated EEPROM, is stored in the current directory
+            configuration.periph_directory = state_dir + "/" + device_id;
+            make_directories(configuration.periph_directory);
+            if (chdir(configuration.periph_directory.c_str()) != 0) {
+                throw std::runtime_error(string("unable to change directory to '") + configuration.periph_directory + "'");
+            }
+            std::thread(report_events, fds[1], i).detach();
+            return true;
+        }
+        supervisor.add(pid);
+    }
+    close(fds[1]);
+    std::cout << boost::format("fleet: started %u devices") % configuration.fleet_size << std::endl;
+    supervisor.run(fds[0], configuration.fleet_stats_interval);
+    close(fds[0]);
+    return false;
+#else
+    throw std::invalid_argument("fleet mode is not supported on this platform");
+#endif
+}
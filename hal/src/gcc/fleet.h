@@ -0,0 +1,34 @@
+/**
+  Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#pragma once
+
+#include "device_config.h"
+
+/**
+ * Runs a fleet of `configuration.fleet_size` virtual devices.
+ *
+ * Each device runs in its own process with its own device ID, keys and state directory. The
+ * device IDs are assigned sequentially starting from the configured device ID, and the `{id}`
+ * placeholder in the key file names is replaced with the ID of the device. The calling process
+ * supervises the devices and periodically prints aggregated statistics of their cloud connections.
+ *
+ * @return `true` in a device process, in which case the configuration has been updated for that
+ *         device, or `false` in the supervisor process once all devices have exited.
+ */
+bool run_fleet(Configuration& configuration);
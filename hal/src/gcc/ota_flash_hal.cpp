@@ -5,6 +5,7 @@
 #include "service_debug.h"
 #include "core_hal.h"
 #include "filesystem.h"
+#include "flash_device.h"
 #include "bytes2hexbuf.h"
 
 void HAL_System_Info(hal_system_info_t* info, bool create, void* reserved)
@@ -16,12 +17,12 @@ void HAL_System_Info(hal_system_info_t* info, bool create, void* reserved)
 
 uint32_t HAL_OTA_FlashAddress()
 {
-    return 0;
+    return FLASH_OTA_ADDRESS;
 }
 
 uint32_t HAL_OTA_FlashLength()
 {
-    return 1024*100;
+    return FLASH_OTA_LENGTH;
 }
 
 uint16_t HAL_OTA_ChunkSize()
@@ -29,21 +30,27 @@ uint16_t HAL_OTA_ChunkSize()
     return 512;
 }
 
-FILE* output_file;
+static uint32_t ota_file_address = 0;
+static uint32_t ota_file_size = 0;
 
 bool HAL_FLASH_Begin(uint32_t sFLASH_Address, uint32_t fileSize, void* reserved)
 {
-    output_file = fopen("output.bin", "wb");
+    if (sFLASH_Address < FLASH_OTA_ADDRESS || fileSize > FLASH_OTA_ADDRESS + FLASH_OTA_LENGTH - sFLASH_Address) {
+        return false;
+    }
+    ota_file_address = sFLASH_Address;
+    ota_file_size = fileSize;
     DEBUG("flash started");
-    return output_file;
+    return flash_device().erase(sFLASH_Address, fileSize) == FlashDevice::FLASH_OK;
 }
 
 int HAL_FLASH_Update(const uint8_t *pBuffer, uint32_t address, uint32_t length, void* reserved)
 {
 	DEBUG("flash write %d %d", address, length);
-	fseek(output_file, address, SEEK_SET);
-    fwrite(pBuffer, length, 1, output_file);
-    return 0;
+	if (address < FLASH_OTA_ADDRESS || length > FLASH_OTA_ADDRESS + FLASH_OTA_LENGTH - address) {
+		return -1;
+	}
+	return flash_device().program(address, pBuffer, length) == FlashDevice::FLASH_OK ? 0 : -1;
 }
 
 int HAL_FLASH_OTA_Validate(hal_module_t* mod, bool userDepsOptional, module_validation_flags_t flags, void* reserved)
@@ -53,8 +60,8 @@ int HAL_FLASH_OTA_Validate(hal_module_t* mod, bool userDepsOptional, module_vali
 
  hal_update_complete_t HAL_FLASH_End(hal_module_t* mod)
 {
-	 fclose(output_file);
-	 output_file = NULL;
+	 // the received image is also saved to a file for inspection
+	 write_file("output.bin", flash_device().data_at(ota_file_address), ota_file_size);
      return HAL_UPDATE_APPLIED;
 }
 
@@ -29,6 +29,13 @@
 #include "socket_hal.h"
 #include "inet_hal.h"
 #include "core_msg.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #pragma GCC diagnostic ignored "-Wunused-variable"
@@ -48,8 +55,15 @@ const sock_handle_t SOCKET_COUNT = sock_handle_t(8);
 const sock_handle_t SOCKET_MAX =  SOCKET_COUNT*2;
 const sock_handle_t SOCKET_INVALID = (sock_handle_t)-1;
 
+const size_t TCP_RX_BUFFER_LIMIT = 64 * 1024; // Maximum amount of received data buffered per TCP socket
+const size_t TCP_TX_BUFFER_LIMIT = 64 * 1024; // Maximum amount of data queued for sending per TCP socket
+const size_t TCP_READ_CHUNK_SIZE = 4096;
+const size_t UDP_RX_QUEUE_LIMIT = 32; // Maximum number of datagrams buffered per UDP socket
+const size_t UDP_MAX_DATAGRAM_SIZE = 65536;
+
 boost::asio::io_service device_io_service;
-boost::system::error_code ec;
+
+using boost::system::error_code;
 
 boost::array<ip::tcp::socket, SOCKET_COUNT> tcp_handles = {
     ip::tcp::socket(device_io_service),
@@ -139,6 +153,231 @@ bool is_valid(ip::udp::socket& handle) {
     return &handle!=&invalid_udp();
 }
 
+/**
+ * All operations on the sockets are performed asynchronously by a dedicated I/O thread, which
+ * waits for readiness of all sockets at once (epoll on Linux). The received data is buffered,
+ * and the data to be sent is queued, so the HAL functions don't make any system calls when
+ * there's no data to receive, and a slow peer doesn't block the calling thread.
+ *
+ * The buffers are shared between the I/O thread and the calling threads and are protected by
+ * `sock_mutex`.
+ */
+std::mutex sock_mutex;
+std::condition_variable sock_cond;
+
+struct TcpState
+{
+    unsigned generation = 0; // Incremented when the socket is closed, to ignore stale completions
+    std::vector<char> rx;
+    size_t rx_offset = 0;
+    error_code rx_error;
+    bool reading = false;
+    char read_buf[TCP_READ_CHUNK_SIZE];
+    std::vector<char> tx;
+    std::vector<char> tx_sending; // Data being sent by the I/O thread
+    error_code tx_error;
+    bool writing = false;
+
+    size_t rx_available() const
+    {
+        return rx.size() - rx_offset;
+    }
+
+    size_t tx_queued() const
+    {
+        return tx.size() + tx_sending.size();
+    }
+
+    void reset()
+    {
+        ++generation;
+        rx.clear();
+        rx_offset = 0;
+        rx_error.clear();
+        reading = false;
+        tx.clear();
+        tx_sending.clear();
+        tx_error.clear();
+        writing = false;
+    }
+};
+
+struct Datagram
+{
+    ip::udp::endpoint endpoint;
+    std::vector<char> data;
+};
+
+struct UdpState
+{
+    unsigned generation = 0;
+    std::deque<Datagram> rx;
+    error_code rx_error;
+    bool reading = false;
+    ip::udp::endpoint sender;
+    std::vector<char> read_buf;
+
+    void reset()
+    {
+        ++generation;
+        rx.clear();
+        rx_error.clear();
+        reading = false;
+    }
+};
+
+boost::array<TcpState, SOCKET_COUNT> tcp_states;
+boost::array<UdpState, SOCKET_COUNT> udp_states;
+
+TcpState& tcp_state(sock_handle_t sd)
+{
+    return tcp_states[sd];
+}
+
+UdpState& udp_state(sock_handle_t sd)
+{
+    return udp_states[sd-SOCKET_COUNT];
+}
+
+class IoThread
+{
+    boost::asio::io_service::work work;
+    std::thread thread;
+
+public:
+    IoThread()
+        : work(device_io_service),
+          thread([]() { device_io_service.run(); })
+    {
+    }
+
+    ~IoThread()
+    {
+        device_io_service.stop();
+        thread.join();
+    }
+
+    bool is_current() const
+    {
+        return std::this_thread::get_id()==thread.get_id();
+    }
+};
+
+IoThread& io_thread()
+{
+    static IoThread thread;
+    return thread;
+}
+
+/**
+ * Runs a function in the I/O thread and waits for its result.
+ */
+template<typename F>
+auto io_call(F func) -> decltype(func())
+{
+    if (io_thread().is_current())
+        return func();
+    std::packaged_task<decltype(func())()> task(func);
+    auto result = task.get_future();
+    device_io_service.post([&task]() { task(); });
+    return result.get();
+}
+
+// The functions below are called in the I/O thread with sock_mutex locked
+
+void start_tcp_read(sock_handle_t sd)
+{
+    auto& state = tcp_state(sd);
+    auto& socket = tcp_from(sd);
+    if (state.reading || state.rx_error || !socket.is_open() || state.rx_available()>=TCP_RX_BUFFER_LIMIT)
+        return;
+    state.reading = true;
+    const unsigned generation = state.generation;
+    socket.async_read_some(boost::asio::buffer(state.read_buf), [sd, generation](const error_code& error, size_t size) {
+        std::lock_guard<std::mutex> lock(sock_mutex);
+        auto& state = tcp_state(sd);
+        if (state.generation!=generation)
+            return;
+        state.reading = false;
+        if (error) {
+            state.rx_error = error;
+        } else {
+            if (state.rx_offset>0) {
+                state.rx.erase(state.rx.begin(), state.rx.begin()+state.rx_offset);
+                state.rx_offset = 0;
+            }
+            state.rx.insert(state.rx.end(), state.read_buf, state.read_buf+size);
+        }
+        sock_cond.notify_all();
+        start_tcp_read(sd);
+    });
+}
+
+void start_tcp_write(sock_handle_t sd)
+{
+    auto& state = tcp_state(sd);
+    auto& socket = tcp_from(sd);
+    if (state.writing || state.tx.empty() || !socket.is_open())
+        return;
+    state.writing = true;
+    state.tx_sending.swap(state.tx);
+    const unsigned generation = state.generation;
+    boost::asio::async_write(socket, boost::asio::buffer(state.tx_sending), [sd, generation](const error_code& error, size_t size) {
+        std::lock_guard<std::mutex> lock(sock_mutex);
+        auto& state = tcp_state(sd);
+        if (state.generation!=generation)
+            return;
+        state.writing = false;
+        state.tx_sending.clear();
+        if (error) {
+            state.tx_error = error;
+            state.tx.clear();
+        }
+        sock_cond.notify_all();
+        start_tcp_write(sd);
+    });
+}
+
+void start_udp_read(sock_handle_t sd)
+{
+    auto& state = udp_state(sd);
+    auto& socket = udp_from(sd);
+    if (state.reading || state.rx_error || !socket.is_open() || state.rx.size()>=UDP_RX_QUEUE_LIMIT)
+        return;
+    state.reading = true;
+    state.read_buf.resize(UDP_MAX_DATAGRAM_SIZE);
+    const unsigned generation = state.generation;
+    socket.async_receive_from(boost::asio::buffer(state.read_buf), state.sender, [sd, generation](const error_code& error, size_t size) {
+        std::lock_guard<std::mutex> lock(sock_mutex);
+        auto& state = udp_state(sd);
+        if (state.generation!=generation)
+            return;
+        state.reading = false;
+        if (!error) {
+            state.rx.push_back(Datagram{ state.sender, std::vector<char>(state.read_buf.begin(), state.read_buf.begin()+size) });
+        } else if (error!=boost::asio::error::connection_refused) { // ICMP port unreachable
+            DEBUG("socket receive error: %d %s", error.value(), error.message().c_str());
+            state.rx_error = error;
+        }
+        sock_cond.notify_all();
+        start_udp_read(sd);
+    });
+}
+
+// Resumes reading after the application has consumed some of the buffered data. Called with sock_mutex locked
+template<typename State>
+void resume_read(sock_handle_t sd, State& state, void (*start)(sock_handle_t))
+{
+    if (state.reading || state.rx_error)
+        return;
+    const unsigned generation = state.generation;
+    device_io_service.post([sd, generation, &state, start]() {
+        std::lock_guard<std::mutex> lock(sock_mutex);
+        if (state.generation==generation)
+            start(sd);
+    });
+}
+
 
 
 class TCPServer
@@ -174,7 +413,10 @@ public:
 
 	~TCPServer()
 	{
-		acceptor.cancel();
+		io_call([this]() {
+			error_code error;
+			acceptor.cancel(error);
+		});
 	}
 
 	sock_handle_t accept()
@@ -183,10 +425,17 @@ public:
 		if (!socket_handle_valid(handle))
 			return handle;
 
-		ip::tcp::socket& sock = tcp_from(handle);
-
-		acceptor.accept(sock, ec);
-		return !ec ? handle : socket_handle_invalid();
+		return io_call([this, handle]() {
+			ip::tcp::socket& sock = tcp_from(handle);
+			error_code error;
+			acceptor.accept(sock, error);
+			if (error)
+				return socket_handle_invalid();
+			std::lock_guard<std::mutex> lock(sock_mutex);
+			tcp_state(handle).reset();
+			start_tcp_read(handle);
+			return handle;
+		});
 	}
 
 
@@ -236,7 +485,7 @@ TCPServers servers;
 sock_result_t socket_create_tcp_server(uint16_t port, network_interface_t nif)
 {
 	DEBUG("Creating TCP Server on port %d", port);
-	TCPServer* server = new TCPServer(port);
+	TCPServer* server = io_call([port]() { return new TCPServer(port); });
 	return servers.add(server);
 }
 
@@ -262,9 +511,20 @@ int32_t socket_connect(sock_handle_t sd, const sockaddr_t *addr, long addrlen)
     ip::address_v4::bytes_type address = {{ dest[0], dest[1], dest[2], dest[3] }};
     ip::tcp::endpoint endpoint(boost::asio::ip::address_v4(address),port);
 
-    handle.connect(endpoint, ec);
-    bool open = handle.is_open();
-    return ec.value();
+    std::promise<error_code> connected;
+    device_io_service.post([&handle, &connected, endpoint]() {
+        handle.async_connect(endpoint, [&connected](const error_code& error) {
+            connected.set_value(error);
+        });
+    });
+    const error_code error = connected.get_future().get();
+    if (!error) {
+        device_io_service.post([sd]() {
+            std::lock_guard<std::mutex> lock(sock_mutex);
+            start_tcp_read(sd);
+        });
+    }
+    return error.value();
 }
 
 sock_result_t socket_reset_blocking_call()
@@ -277,45 +537,69 @@ sock_result_t socket_receive(sock_handle_t sd, void* buffer, socklen_t len, syst
     auto& handle = tcp_from(sd);
     if (!is_valid(handle))
         return -1;
-    boost::asio::socket_base::bytes_readable command(true);
-    handle.io_control(command);
-    std::size_t available = command.get();
-    sock_result_t result = 0;
-    if (_timeout || available) {
-        available = handle.read_some(boost::asio::buffer(buffer, len), ec);
-        result = ec.value() ? -abs(ec.value()) : available;
-        if (ec.value()) {
-            if (ec.value() == boost::system::errc::resource_deadlock_would_occur || // EDEADLK (35)
-                ec.value() == boost::system::errc::resource_unavailable_try_again) { // EAGAIN (11)
-                result = 0; // No data available
-            } else {
-                DEBUG("socket receive error: %d %s, read=%d", ec.value(), ec.message().c_str(), available);
-            }
+    std::unique_lock<std::mutex> lock(sock_mutex);
+    auto& state = tcp_state(sd);
+    if (_timeout && !state.rx_available() && !state.rx_error) {
+        sock_cond.wait_for(lock, std::chrono::milliseconds(_timeout), [&state]() {
+            return state.rx_available() || state.rx_error;
+        });
+    }
+    if (state.rx_available()) {
+        const size_t size = std::min<size_t>(len, state.rx_available());
+        memcpy(buffer, state.rx.data()+state.rx_offset, size);
+        state.rx_offset += size;
+        if (state.rx_offset==state.rx.size()) {
+            state.rx.clear();
+            state.rx_offset = 0;
         }
+        resume_read(sd, state, start_tcp_read);
+        return size;
     }
-    return result;
+    if (state.rx_error) {
+        DEBUG("socket receive error: %d %s", state.rx_error.value(), state.rx_error.message().c_str());
+        return -abs(state.rx_error.value());
+    }
+    return 0; // No data available
 }
 
-sock_result_t socket_send(sock_handle_t sd, const void* buffer, socklen_t len)
+sock_result_t socket_send_ex(sock_handle_t sd, const void* buffer, socklen_t len, uint32_t flags, system_tick_t timeout, void* reserved)
 {
     auto& socket = tcp_from(sd);
     if (!is_valid(socket))
         return -1;
-    try
-    {
-        sock_result_t result = write(socket, boost::asio::buffer(buffer, len));
-        return result;
-    }
-    catch (boost::system::system_error e)
-    {
-        return -1;
+    std::unique_lock<std::mutex> lock(sock_mutex);
+    auto& state = tcp_state(sd);
+    const auto deadline = std::chrono::steady_clock::now()+std::chrono::milliseconds(timeout);
+    size_t sent = 0;
+    for (;;) {
+        if (state.tx_error)
+            return sent ? sent : -1;
+        const size_t size = std::min<size_t>(len-sent, TCP_TX_BUFFER_LIMIT-state.tx_queued());
+        if (size) {
+            const char* data = static_cast<const char*>(buffer)+sent;
+            state.tx.insert(state.tx.end(), data, data+size);
+            sent += size;
+            if (!state.writing) {
+                const unsigned generation = state.generation;
+                device_io_service.post([sd, generation]() {
+                    std::lock_guard<std::mutex> lock(sock_mutex);
+                    if (tcp_state(sd).generation==generation)
+                        start_tcp_write(sd);
+                });
+            }
+        }
+        if (sent==len || !timeout)
+            break;
+        // Wait until some of the queued data is sent
+        if (sock_cond.wait_until(lock, deadline)==std::cv_status::timeout)
+            break;
     }
+    return sent;
 }
 
-sock_result_t socket_send_ex(sock_handle_t sd, const void* buffer, socklen_t len, uint32_t flags, system_tick_t timeout, void* reserved)
+sock_result_t socket_send(sock_handle_t sd, const void* buffer, socklen_t len)
 {
-    /* NOTE: non-blocking mode and timeouts are not supported */
-    return socket_send(sd, buffer, len);
+    return socket_send_ex(sd, buffer, len, 0, 0, nullptr);
 }
 
 sock_result_t socket_create_nonblocking_server(sock_handle_t sock, uint16_t port)
@@ -326,10 +610,21 @@ sock_result_t socket_create_nonblocking_server(sock_handle_t sock, uint16_t port
 
 sock_result_t socket_receivefrom(sock_handle_t sock, void* buffer, socklen_t bufLen, uint32_t flags, sockaddr_t* addr, socklen_t* addrsize)
 {
-	ip::udp::endpoint endpoint;
 	auto& socket = udp_from(sock);
+	if (!is_valid(socket))
+		return -1;
+	std::unique_lock<std::mutex> lock(sock_mutex);
+	auto& state = udp_state(sock);
+	if (state.rx.empty()) {
+		// Receive errors are not reported to the application, same as before
+		return 0;
+	}
+	const Datagram datagram = std::move(state.rx.front());
+	state.rx.pop_front();
+	resume_read(sock, state, start_udp_read);
+	lock.unlock();
 
-	int count = socket.receive_from(boost::asio::buffer(buffer, bufLen), endpoint, 0, ec);
+	const ip::udp::endpoint& endpoint = datagram.endpoint;
 	if (addr && addrsize && *addrsize>=6u) {
 		uint16_t port = endpoint.port();
 		addr->sa_data[0] = port >> 8;
@@ -340,19 +635,11 @@ sock_result_t socket_receivefrom(sock_handle_t sock, void* buffer, socklen_t buf
 		addr->sa_data[4] = (ip >> 8) & 0xFF;
 		addr->sa_data[5] = (ip >> 0) & 0xFF;
 	}
-
-	sock_handle_t result = ec.value();
-
-    if (result == boost::asio::error::would_block)
-        return 0;
-    if (result==boost::asio::error::try_again)
-	   return 0;
-	if (!result)
-		DEBUG("count: %d", count);
-	else
-		DEBUG("result: %d %s", ec.value(), ec.message().c_str());
-
-	return result ? result : count;
+	// The datagram is truncated if the buffer is too small, as with recvfrom()
+	const size_t count = std::min<size_t>(bufLen, datagram.data.size());
+	memcpy(buffer, datagram.data.data(), count);
+	DEBUG("count: %d", count);
+	return count;
 }
 
 sock_result_t socket_sendto(sock_handle_t sd, const void* buffer, socklen_t len, uint32_t flags, sockaddr_t* addr, socklen_t addr_size)
@@ -365,13 +652,14 @@ sock_result_t socket_sendto(sock_handle_t sd, const void* buffer, socklen_t len,
     ip::udp::endpoint endpoint(boost::asio::ip::address_v4(address),port);
 
 	auto& socket = udp_from(sd);
-	int count = socket.send_to(boost::asio::buffer(buffer, len), endpoint, 0, ec);
-
-	sock_handle_t result = ec.value();
-    if (result == boost::asio::error::would_block)
-        return 0;
-
-    return result ? result : count;
+	return io_call([&]() -> sock_result_t {
+		error_code error;
+		int count = socket.send_to(boost::asio::buffer(buffer, len), endpoint, 0, error);
+		sock_handle_t result = error.value();
+		if (result == boost::asio::error::would_block)
+			return 0;
+		return result ? result : count;
+	});
 }
 
 
@@ -399,16 +687,31 @@ sock_result_t socket_close(sock_handle_t socket)
 	}
 	else if (socket>=SOCKET_COUNT)
     {
-    		auto& s = udp_from(socket);
-    		s.shutdown(boost::asio::ip::udp::socket::shutdown_both, ec);
-    		udp_from(socket).close();
+		auto& s = udp_from(socket);
+		if (is_valid(s)) {
+			io_call([&]() {
+				std::lock_guard<std::mutex> lock(sock_mutex);
+				udp_state(socket).reset();
+				error_code error;
+				s.shutdown(boost::asio::ip::udp::socket::shutdown_both, error);
+				s.close(error);
+			});
+		}
     }
     else
     {
-    		auto& s = tcp_from(socket);
-		s.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
-    		s.close();
+		auto& s = tcp_from(socket);
+		if (is_valid(s)) {
+			io_call([&]() {
+				std::lock_guard<std::mutex> lock(sock_mutex);
+				tcp_state(socket).reset();
+				error_code error;
+				s.shutdown(boost::asio::ip::tcp::socket::shutdown_both, error);
+				s.close(error);
+			});
+		}
     }
+    sock_cond.notify_all();
     return 0;
 }
 
@@ -426,8 +729,11 @@ sock_result_t socket_shutdown(sock_handle_t socket, int how)
         } else if (how == SHUT_RD) {
             shflags = boost::asio::ip::tcp::socket::shutdown_receive;
         }
-        s.shutdown(shflags, ec);
-        return (sock_result_t)ec.value();
+        return io_call([&]() {
+            error_code error;
+            s.shutdown(shflags, error);
+            return (sock_result_t)error.value();
+        });
     }
 
     return -1;
@@ -442,39 +748,39 @@ sock_handle_t socket_create(uint8_t family, uint8_t type, uint8_t protocol, uint
     if (handle==SOCKET_INVALID)
         return -1;
 
-    if (udp) {
-        auto& socket = udp_from(handle);
-        socket.open(ip::udp::v4(), ec);
-        sock_handle_t result = ec.value();
-        if (result)				// error
-            return result;
-
-        boost::asio::ip::udp::endpoint listen_endpoint(ip::udp::v4(), port);
-        socket.open(listen_endpoint.protocol(), ec);
-
-        socket.set_option(boost::asio::ip::udp::socket::reuse_address(true));
+    return io_call([=]() -> sock_handle_t {
+        error_code error;
+        if (udp) {
+            auto& socket = udp_from(handle);
+            boost::asio::ip::udp::endpoint listen_endpoint(ip::udp::v4(), port);
+            socket.open(listen_endpoint.protocol(), error);
+            if (error)				// error
+                return error.value();
+
+            socket.set_option(boost::asio::ip::udp::socket::reuse_address(true), error);
+
+            socket.bind(listen_endpoint, error);
+            if (error) {
+                DEBUG("%d %s", port, error.message().c_str());
+                socket.close();
+                return error.value();
+            }
 
-        socket.bind(listen_endpoint, ec);
-        result = ec.value();
-        if (result) {
-            DEBUG("%d %s", port, ec.message().c_str());
-            return result;
+            std::lock_guard<std::mutex> lock(sock_mutex);
+            udp_state(handle).reset();
+            start_udp_read(handle);
         }
-
-        socket.non_blocking(true, ec);
-    }
-    else {
-        auto& socket = tcp_from(handle);
-        socket.open(ip::tcp::v4(), ec);
-        sock_handle_t result = ec.value();
-        if (result)
-            return result;
-
-        socket.non_blocking(true, ec);
-    }
-
-    sock_handle_t result = ec.value();
-    return result ? result : handle;
+        else {
+            auto& socket = tcp_from(handle);
+            socket.open(ip::tcp::v4(), error);
+            if (error)
+                return error.value();
+
+            std::lock_guard<std::mutex> lock(sock_mutex);
+            tcp_state(handle).reset();
+        }
+        return handle;
+    });
 }
 
 uint8_t socket_handle_valid(sock_handle_t handle) {
@@ -500,10 +806,13 @@ sock_result_t socket_join_multicast(const HAL_IPAddress* addr, network_interface
 			auto& s = udp_from(socket);
 			ip::address_v4 address(addr->ipv4);
 			DEBUG("join multicast %s", address.to_string().c_str());
-			s.set_option(ip::multicast::enable_loopback(true));
-			boost::asio::ip::multicast::join_group option(address);
-			s.set_option(option);
-			return 0;
+			return io_call([&]() -> sock_result_t {
+				error_code error;
+				s.set_option(ip::multicast::enable_loopback(true), error);
+				boost::asio::ip::multicast::join_group option(address);
+				s.set_option(option, error);
+				return error.value();
+			});
 		}
 	}
     return -1;
@@ -109,4 +109,7 @@ void GCC_EEPROM_Save(const char* filename)
 	write_file(filename, eeprom, sizeof(eeprom));
 }
 
-
+bool HAL_EEPROM_Perform_Background_Work(void* reserved)
+{
+	return false;
+}
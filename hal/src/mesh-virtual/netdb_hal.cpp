@@ -23,6 +23,7 @@
 
 /* netdb_hal_impl.h should get included from netdb_hal.h automagically */
 #include "netdb_hal.h"
+#include "system_error.h"
 #include <errno.h>
 
 struct hostent* netdb_gethostbyname(const char *name) {
@@ -49,3 +50,7 @@ int netdb_getnameinfo(const struct sockaddr* sa, socklen_t salen, char* host,
   errno = ENOSYS;
   return EAI_SYSTEM;
 }
+
+int netdb_get_cache_stats(netdb_cache_stats* stats, void* reserved) {
+  return SYSTEM_ERROR_NOT_SUPPORTED;
+}
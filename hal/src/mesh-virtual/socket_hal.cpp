@@ -23,6 +23,7 @@
 
 /* socket_hal_posix_impl.h should get included from socket_hal.h automagically */
 #include "socket_hal.h"
+#include "system_error.h"
 
 int sock_accept(int s, struct sockaddr* addr, socklen_t* addrlen) {
   return lwip_accept(s, addr, addrlen);
@@ -85,3 +86,11 @@ ssize_t sock_sendto(int s, const void* dataptr, size_t size, int flags,
 int sock_socket(int domain, int type, int protocol) {
   return lwip_socket(domain, type, protocol);
 }
+
+int sock_get_stats(int s, sock_stats* stats, void* reserved) {
+  return SYSTEM_ERROR_NOT_SUPPORTED;
+}
+
+int sock_get_netif_stats(uint8_t netif, sock_stats* stats, void* reserved) {
+  return SYSTEM_ERROR_NOT_SUPPORTED;
+}
@@ -8,6 +8,7 @@
 #include "ota_flash_hal_impl.h"
 #include "miniz.h"
 #include "stream.h"
+#include "inflate_stream.h"
 #include "check.h"
 #include "ota_flash_hal_impl.h"
 #include <memory>
@@ -82,72 +83,6 @@ tinfl_status Deflator::write(const char* in_buffer, size_t& in_length, char* out
 	return status;
 }
 
-
-class DecompressStream : public OutputStream {
-	Deflator deflator_;
-	char* buffer_;
-	size_t length_;
-	OutputStream& output_;
-	size_t out_offset_;
-
-public:
-
-	DecompressStream(char* buffer, size_t length, OutputStream& output)
-: buffer_(buffer), length_(length), output_(output), out_offset_(0) {}
-
-	/**
-	 * Write to the stream.
-	 * @param buffer The compressed data to decompress
-	 * @param length	The amount of data to write
-	 * @returns The number of bytes written from the buffer.
-	 */
-	int write(const char* buffer, size_t length) override;
-
-	int flush() override {
-		int result = write(buffer_, 0);
-		output_.flush();
-		return result;
-	}
-
-	int availForWrite() override {
-		return length_-out_offset_;
-	}
-
-	int waitEvent(unsigned flags, unsigned timeout = 0) override {
-		return 0;
-	}
-
-};
-
-/**
- * Write to the stream.
- * @param buffer The compressed data to decompress
- * @param length	The amount of data to write
- * @returns The number of bytes written from the buffer.
- */
-int DecompressStream::write(const char* buffer, const size_t length)  {
-	bool hasMore = length;
-	size_t consumed = 0;
-	tinfl_status status;
-	do {
-		size_t out_length = length_-out_offset_;
-		size_t in_length = length-consumed;
-		status = deflator_.write(buffer+consumed, in_length, this->buffer_, this->buffer_+out_offset_, out_length, hasMore);
-		if (status<0) {
-			return SYSTEM_ERROR_BAD_DATA;
-		}
-		consumed += in_length;
-		if (out_length) {
-			output_.writeAll(this->buffer_+out_offset_, out_length);
-			out_offset_ = (out_offset_ + out_length) % length_;
-		}
-	}
-	while (status == TINFL_STATUS_HAS_MORE_OUTPUT);
-
-	// exit when Done, or there is an error
-	return (status<TINFL_STATUS_DONE) ? status : consumed;
-}
-
 } // namespace particle
 
 #ifdef HAL_REPLACE_BOOTLOADER_OTA
@@ -217,9 +152,17 @@ bool bootloader_update_if_needed()
     	// todo - take from the bootloader module bounds
         OTAUpdateStream otaUpdateStream;
         otaUpdateStream.begin(module_bootloader.maximum_size);
-        auto decompress = std::make_unique<DecompressStream>(buffer.get(), buffer_size, otaUpdateStream);
-        decompress->write((const char*)bootloader_image, bootloader_image_size);
-        updated = !decompress->flush();
+        buffer.reset();
+        auto decompress = std::make_unique<InflateStream>(&otaUpdateStream);
+        int ret = decompress->init(buffer_size);
+        if (ret == 0) {
+            ret = decompress->write((const char*)bootloader_image, bootloader_image_size);
+        }
+        if (ret >= 0) {
+            ret = decompress->finish();
+        }
+        decompress->flush();
+        updated = (ret == 0);
     }
     return updated;
 }
@@ -217,3 +217,7 @@ bool HAL_EEPROM_Has_Pending_Erase() {
 void HAL_EEPROM_Perform_Pending_Erase() {
 
 }
+
+bool HAL_EEPROM_Perform_Background_Work(void* reserved) {
+    return false;
+}
@@ -78,6 +78,10 @@
 
 #define HAL_PLATFORM_COMPRESSED_BINARIES (1)
 
+#define HAL_PLATFORM_COMPRESSED_OTA (1)
+
+#define HAL_PLATFORM_DELTA_OTA (1)
+
 #define HAL_PLATFORM_NETWORK_MULTICAST (1)
 
 #define HAL_PLATFORM_BUTTON_DEBOUNCE_IN_SYSTICK (1)
@@ -26,6 +26,12 @@ INCLUDE_DIRS += $(HAL_MODULE_PATH)/network/ncp
 INCLUDE_DIRS += $(HAL_MODULE_PATH)/network/ncp/at_parser
 endif
 
+# The filesystem block cache keeps about 5KB of heap allocated, see littlefs/filesystem.h
+USE_FILESYSTEM_CACHE ?= n
+ifeq ("$(USE_FILESYSTEM_CACHE)","y")
+CFLAGS += -DFILESYSTEM_CACHE_ENABLED=1
+endif
+
 HAL_LINK ?= $(findstring hal,$(MAKE_DEPENDENCIES))
 
 HAL_DEPS = third_party/lwip third_party/freertos third_party/openthread third_party/wiznet_driver gsm0710muxer
@@ -26,11 +26,59 @@ using namespace particle::fs;
 #if MODULE_FUNCTION != MOD_FUNC_BOOTLOADER
 
 #include "static_recursive_mutex.h"
+#include "block_cache.h"
+
+using particle::BlockCache;
 
 namespace {
 
 static StaticRecursiveMutex s_lfs_mutex;
 
+class ExflashBlockDevice: public particle::BlockDevice {
+public:
+    int read(uint32_t addr, void* data, size_t size) override {
+        return hal_exflash_read(addr, (uint8_t*)data, size);
+    }
+
+    int write(uint32_t addr, const void* data, size_t size) override {
+        return hal_exflash_write(addr, (const uint8_t*)data, size);
+    }
+
+    int erase(uint32_t addr, size_t size) override {
+        return hal_exflash_erase_sector(addr, size / FILESYSTEM_BLOCK_SIZE);
+    }
+};
+
+ExflashBlockDevice s_exflash;
+BlockCache s_cache(&s_exflash);
+
+int storage_read(uint32_t addr, void* data, size_t size) {
+    return s_cache.read(addr, data, size);
+}
+
+int storage_write(uint32_t addr, const void* data, size_t size) {
+    return s_cache.prog(addr, data, size);
+}
+
+int storage_erase(uint32_t addr, size_t size) {
+    return s_cache.erase(addr, size);
+}
+
+int storage_sync() {
+    return s_cache.sync();
+}
+
+int storage_init() {
+    int r = s_cache.init(FILESYSTEM_BLOCK_SIZE * FILESYSTEM_BLOCK_COUNT, FILESYSTEM_CACHE_LINE_SIZE,
+            FILESYSTEM_CACHE_LINE_COUNT, FILESYSTEM_CACHE_READ_AHEAD, FILESYSTEM_CACHE_PROG_BUFFER_SIZE);
+    if (r) {
+        LOG_DEBUG(ERROR, "Unable to initialize the block cache: %d", r);
+        /* Access the flash directly */
+        r = s_cache.init(FILESYSTEM_BLOCK_SIZE * FILESYSTEM_BLOCK_COUNT, 0, 0, 0, 0);
+    }
+    return r;
+}
+
 } /* anonymous */
 
 int filesystem_lock(filesystem_t* fs) {
@@ -40,6 +88,8 @@ int filesystem_lock(filesystem_t* fs) {
 
 int filesystem_unlock(filesystem_t* fs) {
     (void)fs;
+    /* Make sure all data written by the operation is stored in the flash */
+    storage_sync();
     return !s_lfs_mutex.unlock();
 }
 
@@ -55,6 +105,30 @@ __attribute__((weak)) int filesystem_unlock(filesystem_t* fs) {
     return 0;
 }
 
+namespace {
+
+int storage_read(uint32_t addr, void* data, size_t size) {
+    return hal_exflash_read(addr, (uint8_t*)data, size);
+}
+
+int storage_write(uint32_t addr, const void* data, size_t size) {
+    return hal_exflash_write(addr, (const uint8_t*)data, size);
+}
+
+int storage_erase(uint32_t addr, size_t size) {
+    return hal_exflash_erase_sector(addr, size / FILESYSTEM_BLOCK_SIZE);
+}
+
+int storage_sync() {
+    return 0;
+}
+
+int storage_init() {
+    return 0;
+}
+
+} /* anonymous */
+
 #endif /* MODULE_FUNCTION != MOD_FUNC_BOOTLOADER */
 
 
@@ -63,7 +137,7 @@ namespace {
 int fs_read(const struct lfs_config* c, lfs_block_t block,
             lfs_off_t off, void* buffer, lfs_size_t size)
 {
-    int r = hal_exflash_read(block * c->block_size + off, (uint8_t*)buffer, size);
+    int r = storage_read(block * c->block_size + off, buffer, size);
     if (r) {
         LOG_DEBUG(ERROR, "fs_read error %d", r);
     }
@@ -73,7 +147,7 @@ int fs_read(const struct lfs_config* c, lfs_block_t block,
 int fs_prog(const struct lfs_config* c, lfs_block_t block,
             lfs_off_t off, const void* buffer, lfs_size_t size)
 {
-    int r = hal_exflash_write(block * c->block_size + off, (const uint8_t*)buffer, size);
+    int r = storage_write(block * c->block_size + off, buffer, size);
     if (r) {
         LOG_DEBUG(ERROR, "fs_prog error %d", r);
     }
@@ -82,7 +156,7 @@ int fs_prog(const struct lfs_config* c, lfs_block_t block,
 
 int fs_erase(const struct lfs_config* c, lfs_block_t block)
 {
-    int r = hal_exflash_erase_sector(block * c->block_size, 1);
+    int r = storage_erase(block * c->block_size, c->block_size);
     if (r) {
         LOG_DEBUG(ERROR, "fs_erase error %d", r);
     }
@@ -91,7 +165,11 @@ int fs_erase(const struct lfs_config* c, lfs_block_t block)
 
 int fs_sync(const struct lfs_config *c)
 {
-    return 0;
+    int r = storage_sync();
+    if (r) {
+        LOG_DEBUG(ERROR, "fs_sync error %d", r);
+    }
+    return r;
 }
 
 #ifdef DEBUG_BUILD
@@ -225,6 +303,14 @@ void fs_dump(filesystem_t* fs)
             (unsigned long)(100.0f - (((float)svfs.f_bfree / (float)svfs.f_blocks) * 100)));
     }
 
+#if MODULE_FUNCTION != MOD_FUNC_BOOTLOADER
+    const BlockCache::Stats& cs = s_cache.stats();
+    LOG_PRINTF(TRACE, "Cache: %lu reads (%lu bytes, %lu hits, %lu misses), %lu progs (%lu bytes), %lu erases\r\n",
+            cs.reads, cs.readBytes, cs.readHits, cs.readMisses, cs.progs, cs.progBytes, cs.erases);
+    LOG_PRINTF(TRACE, "Flash: %lu reads (%lu bytes), %lu writes (%lu bytes), %lu erases\r\n\r\n",
+            cs.deviceReads, cs.deviceReadBytes, cs.deviceWrites, cs.deviceWriteBytes, cs.deviceErases);
+#endif /* MODULE_FUNCTION != MOD_FUNC_BOOTLOADER */
+
     /* Recursively traverse directories */
     char tmpbuf[(LFS_NAME_MAX + 1) * 2] = {};
     tmpbuf[0] = '/';
@@ -264,6 +350,11 @@ int filesystem_mount(filesystem_t* fs) {
     fs->config.file_buffer = fs->file_buffer;
 #endif /* LFS_NO_MALLOC */
 
+    ret = storage_init();
+    if (ret) {
+        return ret;
+    }
+
     ret = lfs_mount(&fs->instance, &fs->config);
     if (!ret) {
         /* IMPORTANT: manually calling deorphan here to validate the filesystem.
@@ -315,6 +406,7 @@ int filesystem_unmount(filesystem_t* fs) {
 
     if (fs->state) {
         ret = lfs_unmount(&fs->instance);
+        storage_sync();
         fs->state = false;
     }
 
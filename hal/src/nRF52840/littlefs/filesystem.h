@@ -37,6 +37,34 @@ extern "C" {
 #define FILESYSTEM_BLOCK_COUNT  (sFLASH_PAGECOUNT / 2)
 #define FILESYSTEM_LOOKAHEAD    (128)
 
+/* Block cache between littlefs and the external flash (see block_cache.h). The lines and
+ * the program buffer stay allocated for as long as the filesystem is mounted, so the cache is
+ * only enabled when FILESYSTEM_CACHE_ENABLED is defined (USE_FILESYSTEM_CACHE=y). Without it
+ * all operations are passed through to the flash */
+#ifndef FILESYSTEM_CACHE_ENABLED
+#define FILESYSTEM_CACHE_ENABLED            (0)
+#endif
+#ifndef FILESYSTEM_CACHE_LINE_SIZE
+#define FILESYSTEM_CACHE_LINE_SIZE          (512)
+#endif
+#ifndef FILESYSTEM_CACHE_LINE_COUNT
+#if FILESYSTEM_CACHE_ENABLED
+#define FILESYSTEM_CACHE_LINE_COUNT         (8)
+#else
+#define FILESYSTEM_CACHE_LINE_COUNT         (0)
+#endif
+#endif
+#ifndef FILESYSTEM_CACHE_READ_AHEAD
+#define FILESYSTEM_CACHE_READ_AHEAD         (3)
+#endif
+#ifndef FILESYSTEM_CACHE_PROG_BUFFER_SIZE
+#if FILESYSTEM_CACHE_ENABLED
+#define FILESYSTEM_CACHE_PROG_BUFFER_SIZE   (1024)
+#else
+#define FILESYSTEM_CACHE_PROG_BUFFER_SIZE   (0)
+#endif
+#endif
+
 /* FIXME */
 typedef struct {
     uint16_t version;
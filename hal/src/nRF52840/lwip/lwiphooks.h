@@ -154,7 +154,7 @@ struct netif* lwip_hook_ip6_route(const ip6_addr_t* src, const ip6_addr_t* dst);
  * If the hook consumed the packet, 'pbuf' is in the responsibility of the hook
  * (i.e. free it when done).
  */
-// #define LWIP_HOOK_IP4_INPUT(pbuf, input_netif) lwip_hook_ip4_input(pbuf, input_netif)
+#define LWIP_HOOK_IP4_INPUT(pbuf, input_netif) lwip_hook_ip4_input(pbuf, input_netif)
 
 // #define LWIP_HOOK_IP4_INPUT_POST_VALIDATION(pbuf, input_netif) lwip_hook_ip4_input_post_validation(pbuf, input_netif)
 #define LWIP_HOOK_IP4_INPUT_PRE_UPPER_LAYERS(pbuf, iphdr, input_netif) lwip_hook_ip4_input_pre_upper_layers(pbuf, iphdr, input_netif)
@@ -223,7 +223,7 @@ struct netif* lwip_hook_ip6_route(const ip6_addr_t* src, const ip6_addr_t* dst);
  * If the hook consumed the packet, 'pbuf' is in the responsibility of the hook
  * (i.e. free it when done).
  */
-// #define LWIP_HOOK_IP6_INPUT(pbuf, input_netif)
+#define LWIP_HOOK_IP6_INPUT(pbuf, input_netif) lwip_hook_ip6_input(pbuf, input_netif)
 
 // #define LWIP_HOOK_IP6_INPUT_ACCEPT_MULTICAST(pbuf, input_netif, dest_addr) lwip_hook_ip6_input_accept_multicast(pbuf, input_netif, dest_addr)
 // #define LWIP_HOOK_IP6_INPUT_POST_LOCAL_HANDLING(pbuf, ip6hdr, input_netif, proto) lwip_hook_ip6_input_post_local_handling(pbuf, ip6hdr, input_netif, proto)
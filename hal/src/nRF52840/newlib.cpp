@@ -1,4 +1,5 @@
 #include "service_debug.h"
+#include "alloc_tracker.h"
 #include <stdlib.h>
 #include <assert.h>
 #include "delay_hal.h"
@@ -15,11 +16,21 @@ extern "C" {
 
 void *operator new(size_t size)
 {
+#if ALLOC_TRACKER_ENABLED
+	if (alloc_tracker_heap_alloc) {
+		return alloc_tracker_heap_alloc(size, ALLOC_TRACKER_CALLER());
+	}
+#endif
 	return malloc(size);
 }
 
 void *operator new[](size_t size)
 {
+#if ALLOC_TRACKER_ENABLED
+	if (alloc_tracker_heap_alloc) {
+		return alloc_tracker_heap_alloc(size, ALLOC_TRACKER_CALLER());
+	}
+#endif
 	return malloc(size);
 }
 
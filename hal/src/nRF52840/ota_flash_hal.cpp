@@ -42,6 +42,16 @@
 #include "hal_platform.h"
 #include "platform_ncp.h"
 #include "deviceid_hal.h"
+#include "exflash_hal.h"
+#include "check.h"
+#if HAL_PLATFORM_COMPRESSED_OTA
+#include "inflate_stream.h"
+#endif
+#if HAL_PLATFORM_DELTA_OTA
+#include "delta_patch.h"
+#endif
+#include "chunked_crc32.h"
+#include <algorithm>
 #include <memory>
 
 #define OTA_CHUNK_SIZE                 (512)
@@ -332,15 +342,356 @@ uint16_t HAL_OTA_ChunkSize()
     return OTA_CHUNK_SIZE;
 }
 
+#ifdef USE_SERIAL_FLASH
+#define OTA_IMAGE_PROCESSING (1)
+#else
+#define OTA_IMAGE_PROCESSING (0)
+#endif
+
+#if OTA_IMAGE_PROCESSING
+
+namespace {
+
+using namespace particle;
+
+const size_t OTA_SECTOR_SIZE = 4096;
+const size_t OTA_READ_BUFFER_SIZE = 256;
+const uint32_t OTA_END_ADDRESS = EXTERNAL_FLASH_OTA_ADDRESS + EXTERNAL_FLASH_OTA_LENGTH;
+// Module info is located either at the beginning of the module or after the vector table
+const size_t OTA_MODULE_INFO_MAX_OFFSET = 0x200;
+
+uint32_t g_otaAddress = 0; // Address of the received image
+uint32_t g_otaLength = 0; // Size of the received image
+uint32_t g_otaModuleAddress = 0; // Address of the module after the received image has been processed
+int g_otaError = 0;
+bool g_otaStarted = false;
+bool g_otaProcessed = false;
+
+// CRC of the module, computed while the module is being written to the OTA section
+ChunkedCrc32 g_otaCrc;
+uint32_t g_otaCrcAddress = 0;
+
+void ota_crc_reset(uint32_t address)
+{
+    g_otaCrc.reset();
+    g_otaCrcAddress = address;
+}
+
+int ota_read_module_length(uint32_t address, uint32_t* length)
+{
+    uint32_t word = 0;
+    CHECK(hal_exflash_read(address, (uint8_t*)&word, sizeof(word)));
+    if ((word & APP_START_MASK) == 0x20000000) {
+        address += OTA_MODULE_INFO_MAX_OFFSET;
+    }
+    module_info_t info = {};
+    CHECK(hal_exflash_read(address, (uint8_t*)&info, sizeof(info)));
+    *length = module_length(&info);
+    return 0;
+}
+
+void ota_crc_update(uint32_t address, const uint8_t* data, size_t size)
+{
+    if (address < g_otaCrcAddress) {
+        return;
+    }
+    g_otaCrc.update(address - g_otaCrcAddress, data, size);
+    if (g_otaCrc.limit() == SIZE_MAX && g_otaCrc.size() >= OTA_MODULE_INFO_MAX_OFFSET + sizeof(module_info_t)) {
+        // The CRC covers the module data up to the module's end address
+        uint32_t length = 0;
+        if (ota_read_module_length(g_otaCrcAddress, &length) < 0) {
+            length = 0; // Invalidates the CRC
+        }
+        g_otaCrc.setLimit(length);
+    }
+}
+
+// Returns 1 if the module's CRC is valid, 0 if it's invalid, or -1 if the module needs to be read
+// back from the flash to validate it
+int ota_crc_check(uint32_t address)
+{
+    if (address != g_otaCrcAddress || !g_otaCrc.isComplete()) {
+        return -1;
+    }
+    uint8_t buf[4] = {};
+    if (hal_exflash_read(address + g_otaCrc.limit(), buf, sizeof(buf)) < 0) {
+        return -1;
+    }
+    const uint32_t expectedCrc = ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) | ((uint32_t)buf[2] << 8) | buf[3];
+    return g_otaCrc.value() == expectedCrc;
+}
+
+// Writes a processed module image to the OTA section, erasing sectors as the data is written
+class OtaFlashStream: public OutputStream {
+public:
+    OtaFlashStream(uint32_t address, uint32_t endAddress) :
+            addr_(address),
+            erasedAddr_(address),
+            endAddr_(endAddress) {
+    }
+
+    int write(const char* data, size_t size) override {
+        if (addr_ > endAddr_ || size > endAddr_ - addr_) {
+            return SYSTEM_ERROR_TOO_LARGE;
+        }
+        while (erasedAddr_ < addr_ + size) {
+            CHECK(hal_exflash_erase_sector(erasedAddr_, 1));
+            erasedAddr_ += OTA_SECTOR_SIZE;
+        }
+        CHECK(hal_exflash_write(addr_, (const uint8_t*)data, size));
+        ota_crc_update(addr_, (const uint8_t*)data, size);
+        addr_ += size;
+        return size;
+    }
+
+    int flush() override {
+        return 0;
+    }
+
+    int availForWrite() override {
+        return endAddr_ - addr_;
+    }
+
+    int waitEvent(unsigned flags, unsigned timeout) override {
+        return 0;
+    }
+
+    uint32_t address() const {
+        return addr_;
+    }
+
+private:
+    uint32_t addr_;
+    uint32_t erasedAddr_;
+    uint32_t endAddr_;
+};
+
+// Processed images are written starting from the first sector following the source data
+inline uint32_t ota_next_sector(uint32_t address)
+{
+    return (address + OTA_SECTOR_SIZE - 1) & ~(OTA_SECTOR_SIZE - 1);
+}
+
+#if HAL_PLATFORM_COMPRESSED_OTA
+
+// A compressed module image is stored as is at the beginning of the OTA section. Chunks received
+// in order are decompressed as they arrive; the rest of the data is decompressed from the flash
+// when the transfer is complete
+struct CompressedOta {
+    uint32_t offset; // Offset of the next byte of the compressed data to decompress
+    uint32_t moduleAddress; // Address of the decompressed module
+    OtaFlashStream flash;
+    InflateStream inflate;
+    int error;
+
+    explicit CompressedOta(uint32_t moduleAddress) :
+            offset(0),
+            moduleAddress(moduleAddress),
+            flash(moduleAddress, OTA_END_ADDRESS),
+            inflate(&flash),
+            error(0) {
+    }
+};
+
+std::unique_ptr<CompressedOta> g_compressedOta;
+
+void compressed_ota_decompress(CompressedOta* ota, const uint8_t* data, size_t size)
+{
+    const int ret = ota->inflate.write((const char*)data, size);
+    if (ret < 0) {
+        LOG(ERROR, "Unable to decompress OTA data: %d", ret);
+        ota->error = ret;
+        return;
+    }
+    ota->offset += size;
+}
+
+void compressed_ota_update(const uint8_t* data, uint32_t address, uint32_t length)
+{
+    if (address == g_otaAddress) {
+        // Module images start with the module's start address, which can't be mistaken for a zlib header
+        g_compressedOta.reset();
+        const int windowSize = InflateStream::zlibWindowSize((const char*)data, length);
+        if (windowSize < 0) {
+            return;
+        }
+        const uint32_t moduleAddress = ota_next_sector(g_otaAddress + g_otaLength);
+        g_compressedOta.reset(new(std::nothrow) CompressedOta(moduleAddress));
+        if (!g_compressedOta) {
+            return;
+        }
+        ota_crc_reset(moduleAddress);
+        g_compressedOta->error = g_compressedOta->inflate.init(windowSize, InflateStream::ZLIB_HEADER);
+        LOG(TRACE, "Compressed OTA image, window size: %d", windowSize);
+    }
+    const auto ota = g_compressedOta.get();
+    if (ota && !ota->error && address == g_otaAddress + ota->offset) {
+        compressed_ota_decompress(ota, data, length);
+    }
+}
+
+int compressed_ota_finish(uint32_t* address, uint32_t* length)
+{
+    const auto ota = g_compressedOta.get();
+    if (!ota) {
+        return 0;
+    }
+    // Decompress the chunks that were received out of order
+    uint8_t buf[OTA_READ_BUFFER_SIZE];
+    while (!ota->error && ota->offset < g_otaLength && !ota->inflate.done()) {
+        const size_t n = std::min<size_t>(sizeof(buf), g_otaLength - ota->offset);
+        const int ret = hal_exflash_read(g_otaAddress + ota->offset, buf, n);
+        if (ret < 0) {
+            ota->error = ret;
+            break;
+        }
+        compressed_ota_decompress(ota, buf, n);
+    }
+    int ret = ota->error;
+    if (!ret) {
+        ret = ota->inflate.finish();
+    }
+    *address = ota->moduleAddress;
+    *length = ota->flash.address() - ota->moduleAddress;
+    g_compressedOta.reset(); // Free the decompressor's memory
+    return ret;
+}
+
+#endif // HAL_PLATFORM_COMPRESSED_OTA
+
+#if HAL_PLATFORM_DELTA_OTA
+
+// Module stored in the internal flash that a delta patch is applied to
+class ModuleSource: public DeltaPatchSource {
+public:
+    ModuleSource(uintptr_t address, size_t size) :
+            addr_(address),
+            size_(size) {
+    }
+
+    int read(size_t offset, char* data, size_t size) override {
+        if (offset > size_ || size > size_ - offset) {
+            return SYSTEM_ERROR_OUT_OF_RANGE;
+        }
+        memcpy(data, (const char*)(addr_ + offset), size);
+        return 0;
+    }
+
+private:
+    uintptr_t addr_;
+    size_t size_;
+};
+
+// Reconstructs the module if the received image is a delta patch
+int delta_ota_apply(uint32_t* address, uint32_t* length)
+{
+    DeltaPatchHeader header = {};
+    if (*length < sizeof(header)) {
+        return 0;
+    }
+    CHECK(hal_exflash_read(*address, (uint8_t*)&header, sizeof(header)));
+    if (!DeltaPatchStream::isPatch((const char*)&header, sizeof(header))) {
+        return 0;
+    }
+    const auto bounds = find_module_bounds(header.moduleFunction, header.moduleIndex, header.mcuIdentifier);
+    if (!bounds || bounds->store != MODULE_STORE_MAIN || header.sourceSize > bounds->maximum_size) {
+        LOG(ERROR, "Delta patch source module not found");
+        return SYSTEM_ERROR_NOT_FOUND;
+    }
+    if (HAL_Core_Compute_CRC32((const uint8_t*)bounds->start_address, header.sourceSize) != header.sourceCrc) {
+        LOG(ERROR, "Delta patch doesn't match the installed module");
+        return SYSTEM_ERROR_BAD_DATA;
+    }
+    LOG(TRACE, "Applying delta patch, target size: %u", (unsigned)header.targetSize);
+    ModuleSource source(bounds->start_address, header.sourceSize);
+    const uint32_t moduleAddress = ota_next_sector(*address + *length);
+    ota_crc_reset(moduleAddress);
+    OtaFlashStream flash(moduleAddress, OTA_END_ADDRESS);
+    DeltaPatchStream patch(&source, &flash);
+    uint8_t buf[OTA_READ_BUFFER_SIZE];
+    for (uint32_t offs = 0; offs < *length && !patch.done();) {
+        const size_t n = std::min<size_t>(sizeof(buf), *length - offs);
+        CHECK(hal_exflash_read(*address + offs, buf, n));
+        CHECK(patch.write((const char*)buf, n));
+        offs += n;
+    }
+    CHECK(patch.finish());
+    *address = moduleAddress;
+    *length = header.targetSize;
+    return 0;
+}
+
+#endif // HAL_PLATFORM_DELTA_OTA
+
+// Decompresses the received image and applies it as a delta patch, if necessary
+int ota_process_image()
+{
+    if (g_otaProcessed) {
+        return g_otaError;
+    }
+    uint32_t address = g_otaAddress;
+    uint32_t length = g_otaLength;
+    int ret = 0;
+#if HAL_PLATFORM_COMPRESSED_OTA
+    ret = compressed_ota_finish(&address, &length);
+#endif
+#if HAL_PLATFORM_DELTA_OTA
+    if (!ret) {
+        ret = delta_ota_apply(&address, &length);
+    }
+#endif
+    if (ret < 0) {
+        LOG(ERROR, "Unable to process OTA image: %d", ret);
+    }
+    g_otaModuleAddress = address;
+    g_otaError = ret;
+    g_otaProcessed = true;
+    return ret;
+}
+
+} // namespace
+
+#endif // OTA_IMAGE_PROCESSING
+
+// Returns the address of the module image stored in the OTA section
+static uint32_t ota_module_address()
+{
+#if OTA_IMAGE_PROCESSING
+    if (g_otaStarted && g_otaProcessed && !g_otaError) {
+        return g_otaModuleAddress;
+    }
+#endif
+    return HAL_OTA_FlashAddress();
+}
+
 bool HAL_FLASH_Begin(uint32_t address, uint32_t length, void* reserved)
 {
+#if OTA_IMAGE_PROCESSING
+    g_otaAddress = address;
+    g_otaLength = length;
+    g_otaStarted = true;
+    g_otaProcessed = false;
+    ota_crc_reset(address);
+#if HAL_PLATFORM_COMPRESSED_OTA
+    g_compressedOta.reset();
+#endif
+#endif // OTA_IMAGE_PROCESSING
     FLASH_Begin(address, length);
     return true;
 }
 
 int HAL_FLASH_Update(const uint8_t *pBuffer, uint32_t address, uint32_t length, void* reserved)
 {
-    return FLASH_Update(pBuffer, address, length);
+    const int ret = FLASH_Update(pBuffer, address, length);
+#if OTA_IMAGE_PROCESSING
+    if (ret == 0) {
+#if HAL_PLATFORM_COMPRESSED_OTA
+        compressed_ota_update(pBuffer, address, length);
+#endif
+        ota_crc_update(address, pBuffer, length);
+    }
+#endif
+    return ret;
 }
 
 static hal_update_complete_t flash_bootloader(hal_module_t* mod, uint32_t moduleLength)
@@ -383,9 +734,39 @@ static hal_update_complete_t flash_bootloader(hal_module_t* mod, uint32_t module
 
 int HAL_FLASH_OTA_Validate(hal_module_t* mod, bool userDepsOptional, module_validation_flags_t flags, void* reserved)
 {
-    hal_module_t module;
+    hal_module_t module = {};
+    module_bounds_t bounds = module_ota;
+    bool module_fetched = false;
 
-    bool module_fetched = fetch_module(&module, &module_ota, userDepsOptional, flags);
+#if OTA_IMAGE_PROCESSING
+    if (!g_otaStarted || ota_process_image() == 0)
+#endif
+    {
+        const uint32_t address = ota_module_address();
+        if (address != HAL_OTA_FlashAddress()) {
+            // Validate the decompressed module
+            bounds.start_address += address - HAL_OTA_FlashAddress();
+            bounds.maximum_size -= address - HAL_OTA_FlashAddress();
+        }
+        uint16_t check_flags = flags;
+#if OTA_IMAGE_PROCESSING
+        // Skip reading back the module if its CRC has been computed while it was being written
+        int crc_valid = -1;
+        if (g_otaStarted && (flags & MODULE_VALIDATION_INTEGRITY)) {
+            crc_valid = ota_crc_check(address);
+            if (crc_valid >= 0) {
+                check_flags &= ~MODULE_VALIDATION_INTEGRITY;
+            }
+        }
+#endif
+        module_fetched = fetch_module(&module, &bounds, userDepsOptional, check_flags);
+#if OTA_IMAGE_PROCESSING
+        if (module_fetched && crc_valid >= 0) {
+            module.validity_checked |= MODULE_VALIDATION_INTEGRITY;
+            module.validity_result |= crc_valid ? MODULE_VALIDATION_INTEGRITY : 0;
+        }
+#endif
+    }
 
     if (mod) 
     {
@@ -416,7 +797,7 @@ hal_update_complete_t HAL_FLASH_End(hal_module_t* mod)
 			}
 			else
 			{
-				if (FLASH_AddToNextAvailableModulesSlot(FLASH_SERIAL, EXTERNAL_FLASH_OTA_ADDRESS,
+				if (FLASH_AddToNextAvailableModulesSlot(FLASH_SERIAL, ota_module_address(),
 					FLASH_INTERNAL, uint32_t(module.info->module_start_address),
 					(moduleLength + 4),//+4 to copy the CRC too
 					function,
@@ -443,6 +824,12 @@ hal_update_complete_t HAL_FLASH_End(hal_module_t* mod)
     {
         WARN("OTA module not applied");
     }
+#if OTA_IMAGE_PROCESSING
+    g_otaStarted = false;
+#if HAL_PLATFORM_COMPRESSED_OTA
+    g_compressedOta.reset();
+#endif
+#endif // OTA_IMAGE_PROCESSING
     if (mod)
     {
         memcpy(mod, &module, sizeof(hal_module_t));
@@ -29,15 +29,68 @@
 #include "eeprom_hal.h"
 #include "eeprom_emulation_impl.h"
 
+#if PLATFORM_THREADING
+#include "concurrent_hal.h"
+#endif
+
+// Buffer small writes in RAM until the system flushes them. Buffered writes are lost on reset
+#ifndef HAL_EEPROM_WRITE_COMBINING
+#define HAL_EEPROM_WRITE_COMBINING 0
+#endif
+
 FlashEEPROM flashEEPROM;
 
+namespace {
+
+#if PLATFORM_THREADING
+
+os_mutex_recursive_t eepromMutex = nullptr;
+
+// The background work is performed by the system thread
+class EepromLock
+{
+public:
+    EepromLock()
+    {
+        if (!eepromMutex) {
+            os_thread_scheduling(false, nullptr);
+            if (!eepromMutex) {
+                os_mutex_recursive_create(&eepromMutex);
+            }
+            os_thread_scheduling(true, nullptr);
+        }
+        os_mutex_recursive_lock(eepromMutex);
+    }
+
+    ~EepromLock()
+    {
+        os_mutex_recursive_unlock(eepromMutex);
+    }
+};
+
+#else
+
+struct EepromLock
+{
+    EepromLock()
+    {
+    }
+};
+
+#endif // PLATFORM_THREADING
+
+} // namespace
+
 void HAL_EEPROM_Init(void)
 {
+  EepromLock lock;
   flashEEPROM.init();
+  flashEEPROM.setWriteCombining(HAL_EEPROM_WRITE_COMBINING);
 }
 
 uint8_t HAL_EEPROM_Read(uint32_t index)
 {
+  EepromLock lock;
   uint8_t value = 0xFF;
   flashEEPROM.get(index, value);
   return value;
@@ -45,6 +98,7 @@ uint8_t HAL_EEPROM_Read(uint32_t index)
 
 void HAL_EEPROM_Write(uint32_t index, uint8_t data)
 {
+  EepromLock lock;
   flashEEPROM.put(index, data);
 }
 
@@ -55,25 +109,36 @@ size_t HAL_EEPROM_Length()
 
 void HAL_EEPROM_Get(uint32_t index, void *data, size_t length)
 {
+    EepromLock lock;
     flashEEPROM.get(index, data, length);
 }
 
 void HAL_EEPROM_Put(uint32_t index, const void *data, size_t length)
 {
+    EepromLock lock;
     flashEEPROM.put(index, data, length);
 }
 
 void HAL_EEPROM_Clear()
 {
+    EepromLock lock;
     flashEEPROM.clear();
 }
 
 bool HAL_EEPROM_Has_Pending_Erase()
 {
+    EepromLock lock;
     return flashEEPROM.hasPendingErase();
 }
 
 void HAL_EEPROM_Perform_Pending_Erase()
 {
+    EepromLock lock;
     flashEEPROM.performPendingErase();
 }
+
+bool HAL_EEPROM_Perform_Background_Work(void* reserved)
+{
+    EepromLock lock;
+    return flashEEPROM.performBackgroundWork();
+}
@@ -53,6 +53,9 @@
 #include "usart_hal.h"
 #include "deviceid_hal.h"
 #include "pinmap_impl.h"
+#if HAL_PLATFORM_DCD_LOG
+#include "dct_hal.h"
+#endif
 #include "ota_module.h"
 #include "hal_event.h"
 #include "system_error.h"
@@ -552,6 +555,13 @@ void HAL_Core_Mode_Button_Reset(uint16_t button)
 
 void HAL_Core_System_Reset(void)
 {
+#if HAL_PLATFORM_DCD_LOG
+    // The bootloader or the system firmware that runs after the reset may not support the
+    // log-structured DCD
+    if (!HAL_IsISR()) {
+        dcd_flush_data();
+    }
+#endif
     NVIC_SystemReset();
 }
 
@@ -15,4 +15,12 @@ ifeq ("$(firstword $(arm_gcc_version))", "4.8.4")
 NEWLIB_TWEAK_SPECS = $(NEWLIBNANO_MODULE_PATH)/src/custom-nano-4.8.4.specs
 else
 NEWLIB_TWEAK_SPECS = $(NEWLIBNANO_MODULE_PATH)/src/custom-nano.specs
-endif
\ No newline at end of file
+endif
+
+# The heap allocation tracker attributes allocations to the callers of malloc(), calloc() and
+# realloc(), see newlib_nano/src/malloc.c
+ifeq ("$(ALLOC_TRACKER_ENABLED)","1")
+ifneq (,$(filter $(PLATFORM_ID),6 8 10 12 13 14 22 23 24))
+LDFLAGS += -Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc
+endif
+endif
@@ -5,6 +5,7 @@
 #include <malloc.h>
 #include "interrupts_hal.h"
 #include "service_debug.h"
+#include "alloc_tracker.h"
 
 extern void *pvPortMalloc( size_t xWantedSize );
 extern void vPortFree( void *pv );
@@ -22,55 +23,99 @@ static void panic_if_in_isr() {
     }
 }
 
-void* _malloc_r(struct _reent *r, size_t s) {
-    (void)r;
+static void* heap_malloc(size_t s, const void* caller) {
     panic_if_in_isr();
     void* ptr = pvPortMalloc((size_t)s);
+    ALLOC_TRACKER_ALLOC(ALLOC_TRACKER_SOURCE_HEAP, ptr, s, caller);
     return ptr;
 }
 
-void _free_r(struct _reent* r, void* ptr) {
+static void* heap_calloc(size_t n, size_t elem, const void* caller) {
     panic_if_in_isr();
-    // Hack of the century. We cannot free reent->_current_locale, because it's in
-    // .text section on most of our platforms in flash and is simply a constant "C"
-    if (r && ptr == r->_current_locale) {
-        ptr = NULL;
-    }
-    vPortFree(ptr);
-}
-
-void _cfree_r(struct _reent* r, void* ptr) {
-    _free_r(r, ptr);
-}
-
-void* _calloc_r(struct _reent* r, size_t n, size_t elem) {
-    void* ptr = _malloc_r(r, (size_t)(n * elem));
+    void* ptr = pvPortMalloc((size_t)(n * elem));
+    ALLOC_TRACKER_ALLOC(ALLOC_TRACKER_SOURCE_HEAP, ptr, n * elem, caller);
     if (ptr != NULL) {
         memset(ptr, 0, (size_t)(elem * n));
     }
     return ptr;
 }
 
-void* _realloc_r(struct _reent* r, void *ptr, size_t newsize) {
-    (void)r;
-
+static void* heap_realloc(void *ptr, size_t newsize, const void* caller) {
     panic_if_in_isr();
 
     if (newsize == 0) {
+        ALLOC_TRACKER_FREE(ALLOC_TRACKER_SOURCE_HEAP, ptr);
         vPortFree(ptr);
         return NULL;
     }
 
     void *p = pvPortMalloc(newsize);
+    ALLOC_TRACKER_ALLOC(ALLOC_TRACKER_SOURCE_HEAP, p, newsize, caller);
     if (p) {
         if (ptr != NULL) {
             memcpy(p, ptr, newsize);
+            ALLOC_TRACKER_FREE(ALLOC_TRACKER_SOURCE_HEAP, ptr);
             vPortFree(ptr);
         }
     }
     return p;
 }
 
+// Allocations made by newlib itself, e.g. stdio buffers, are attributed to the newlib function
+// that called the reentrant function
+void* _malloc_r(struct _reent *r, size_t s) {
+    (void)r;
+    return heap_malloc(s, ALLOC_TRACKER_CALLER());
+}
+
+void _free_r(struct _reent* r, void* ptr) {
+    panic_if_in_isr();
+    // Hack of the century. We cannot free reent->_current_locale, because it's in
+    // .text section on most of our platforms in flash and is simply a constant "C"
+    if (r && ptr == r->_current_locale) {
+        ptr = NULL;
+    }
+    ALLOC_TRACKER_FREE(ALLOC_TRACKER_SOURCE_HEAP, ptr);
+    vPortFree(ptr);
+}
+
+void _cfree_r(struct _reent* r, void* ptr) {
+    _free_r(r, ptr);
+}
+
+void* _calloc_r(struct _reent* r, size_t n, size_t elem) {
+    (void)r;
+    return heap_calloc(n, elem, ALLOC_TRACKER_CALLER());
+}
+
+void* _realloc_r(struct _reent* r, void *ptr, size_t newsize) {
+    (void)r;
+    return heap_realloc(ptr, newsize, ALLOC_TRACKER_CALLER());
+}
+
+#if ALLOC_TRACKER_ENABLED
+
+// newlib's malloc(), calloc() and realloc() call the reentrant functions above, which would
+// attribute every allocation to them. When the tracker is enabled, the firmware is linked with
+// --wrap for these functions (see import.mk), so the allocations are attributed to their callers
+void* __wrap_malloc(size_t s) {
+    return heap_malloc(s, ALLOC_TRACKER_CALLER());
+}
+
+void* __wrap_calloc(size_t n, size_t elem) {
+    return heap_calloc(n, elem, ALLOC_TRACKER_CALLER());
+}
+
+void* __wrap_realloc(void* ptr, size_t newsize) {
+    return heap_realloc(ptr, newsize, ALLOC_TRACKER_CALLER());
+}
+
+void* alloc_tracker_heap_alloc(size_t size, const void* caller) {
+    return heap_malloc(size, caller);
+}
+
+#endif // ALLOC_TRACKER_ENABLED
+
 static struct mallinfo current_mallinfo = {0};
 
 struct mallinfo _mallinfo_r(struct _reent* r) {
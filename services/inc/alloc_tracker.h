@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Allocation tracking is disabled by default and has no runtime cost in that case. It can be
+// enabled by building the firmware with ALLOC_TRACKER_ENABLED=1
+#ifndef ALLOC_TRACKER_ENABLED
+#define ALLOC_TRACKER_ENABLED 0
+#endif
+
+// Maximum number of call sites that can be tracked (should be a power of two)
+#ifndef ALLOC_TRACKER_MAX_SITES
+#define ALLOC_TRACKER_MAX_SITES 64
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Allocation sources
+typedef enum alloc_tracker_source {
+    ALLOC_TRACKER_SOURCE_HEAP = 0, // malloc(), realloc(), calloc()
+    ALLOC_TRACKER_SOURCE_SYSTEM_POOL = 1, // system_pool_alloc()
+    ALLOC_TRACKER_SOURCE_COUNT = 2
+} alloc_tracker_source;
+
+// Per-source allocation statistics
+typedef struct alloc_tracker_stats {
+    uint32_t alloc_count; // Number of successful allocations
+    uint32_t free_count; // Number of freed blocks
+    uint32_t failed_count; // Number of failed allocations
+    uint32_t alloc_bytes; // Total number of allocated bytes
+    uint32_t max_failed_size; // Size of the largest allocation that failed
+} alloc_tracker_stats;
+
+// Per-call-site allocation statistics
+typedef struct alloc_tracker_site {
+    uint32_t address; // Return address of the allocation call
+    uint32_t alloc_count; // Number of allocations made at this call site
+    uint32_t alloc_bytes; // Total number of bytes allocated at this call site
+    uint8_t source; // Allocation source (a value defined by the `alloc_tracker_source` enum)
+    uint8_t reserved[3];
+} alloc_tracker_site;
+
+/**
+ * Records an allocation. `ptr` should be set to NULL if the allocation failed.
+ */
+void alloc_tracker_alloc(int source, const void* ptr, size_t size, const void* caller);
+/**
+ * Records a deallocation.
+ */
+void alloc_tracker_free(int source, const void* ptr);
+/**
+ * Gets the statistics for the specified allocation source.
+ */
+int alloc_tracker_get_stats(int source, alloc_tracker_stats* stats);
+/**
+ * Copies up to `max_count` tracked call sites to the provided array and returns the total number
+ * of tracked call sites.
+ */
+int alloc_tracker_get_sites(alloc_tracker_site* sites, size_t max_count);
+/**
+ * Number of allocations that couldn't be attributed to a call site because the call site table
+ * was full.
+ */
+uint32_t alloc_tracker_untracked_count(void);
+/**
+ * Resets all statistics.
+ */
+void alloc_tracker_reset(void);
+/**
+ * Allocates a block on the heap and attributes the allocation to the specified call site.
+ *
+ * This function is used by `operator new`, which would otherwise be reported as the call site of
+ * all allocations made with it. It's only defined when the tracker is enabled and only in the
+ * module that contains the heap implementation, hence the weak declaration.
+ */
+void* alloc_tracker_heap_alloc(size_t size, const void* caller) __attribute__((weak));
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+// Return address of the current function. An allocation function should capture it at its public
+// entry point and pass it down to ALLOC_TRACKER_ALLOC(), since the return address of any inner
+// function would be the same for all allocations
+#define ALLOC_TRACKER_CALLER() \
+        __builtin_return_address(0)
+
+#if ALLOC_TRACKER_ENABLED
+
+#define ALLOC_TRACKER_ALLOC(_source, _ptr, _size, _caller) \
+        alloc_tracker_alloc(_source, _ptr, _size, _caller)
+
+#define ALLOC_TRACKER_FREE(_source, _ptr) \
+        alloc_tracker_free(_source, _ptr)
+
+#else
+
+#define ALLOC_TRACKER_ALLOC(_source, _ptr, _size, _caller) \
+        do { \
+            (void)(_caller); \
+        } while (0)
+
+#define ALLOC_TRACKER_FREE(_source, _ptr) \
+        do { \
+        } while (0)
+
+#endif // !ALLOC_TRACKER_ENABLED
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// Maximum number of out-of-order chunks that can be kept until they can be combined with the
+// checksum of the preceding data
+#ifndef CHUNKED_CRC32_MAX_PENDING
+#define CHUNKED_CRC32_MAX_PENDING (16)
+#endif
+
+namespace particle {
+
+/**
+ * Computes the CRC-32 (IEEE 802.3) of a buffer.
+ *
+ * @param data Data.
+ * @param size Data size.
+ * @param crc CRC of the preceding data.
+ */
+inline uint32_t computeCrc32(const void* data, size_t size, uint32_t crc = 0) {
+    static const uint32_t table[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+    };
+    auto p = static_cast<const uint8_t*>(data);
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc ^= p[i];
+        crc = (crc >> 4) ^ table[crc & 0x0f];
+        crc = (crc >> 4) ^ table[crc & 0x0f];
+    }
+    return ~crc;
+}
+
+/**
+ * Combines the CRC-32 checksums of two consecutive blocks of data.
+ *
+ * @param crc1 CRC of the first block.
+ * @param crc2 CRC of the second block.
+ * @param size2 Size of the second block.
+ * @return CRC of the concatenated blocks.
+ */
+uint32_t combineCrc32(uint32_t crc1, uint32_t crc2, size_t size2);
+
+/**
+ * Computes the CRC-32 of data that is received in chunks, possibly out of order.
+ *
+ * Chunks that follow the already processed data are processed immediately. Other chunks are
+ * checksummed individually and combined with the rest of the data once the gap preceding them
+ * is filled. If there are too many such chunks, or chunks overlap, the checksum becomes invalid
+ * and the caller needs to fall back to checksumming the data in one pass.
+ */
+class ChunkedCrc32 {
+public:
+    explicit ChunkedCrc32(size_t limit = SIZE_MAX) {
+        reset(limit);
+    }
+
+    void reset(size_t limit = SIZE_MAX) {
+        limit_ = limit;
+        size_ = 0;
+        crc_ = 0;
+        pendingCount_ = 0;
+        valid_ = true;
+    }
+
+    /**
+     * Processes a chunk of data. Data past the limit is ignored.
+     *
+     * @param offset Offset of the chunk.
+     * @param data Chunk data.
+     * @param size Chunk size.
+     */
+    void update(size_t offset, const void* data, size_t size);
+
+    /**
+     * Sets the size of the data that needs to be checksummed.
+     *
+     * The checksum becomes invalid if some of the data past the limit has already been processed.
+     */
+    void setLimit(size_t limit);
+
+    size_t limit() const {
+        return limit_;
+    }
+
+    // Returns the size of the contiguous data that has been checksummed so far
+    size_t size() const {
+        return size_;
+    }
+
+    bool isValid() const {
+        return valid_;
+    }
+
+    // Returns `true` if all data up to the limit has been checksummed
+    bool isComplete() const {
+        return valid_ && size_ == limit_;
+    }
+
+    uint32_t value() const {
+        return crc_;
+    }
+
+private:
+    struct Chunk {
+        size_t offset;
+        size_t size;
+        uint32_t crc;
+    };
+
+    Chunk pending_[CHUNKED_CRC32_MAX_PENDING]; // Sorted by offset
+    size_t pendingCount_;
+    size_t limit_;
+    size_t size_;
+    uint32_t crc_;
+    bool valid_;
+
+    void addPending(size_t offset, size_t size, uint32_t crc);
+    void combinePending();
+};
+
+} // namespace particle
@@ -17,6 +17,8 @@
  ******************************************************************************
  */
 
+#pragma once
+
 #include <stddef.h>
 #include <stdint.h>
 
@@ -95,6 +97,7 @@ public:
     Store store;
 
     static const uint8_t latestVersion = 2;
+    static const unsigned SectorSize = sectorSize;
     static const uint32_t WATERMARK = 0x1E1C279A;   // 9A271C1E
 
     struct Header
@@ -177,6 +180,9 @@ public:
     public:
 		using crc_type = decltype(crc_);
 
+		// Set in version_flags when the sector is followed by a log of updates (see dcd_log.h)
+		static const uint8_t VERSION_FLAG_LOG = 0x01;
+
 		bool isValid() const {
 			return watermark==WATERMARK;
 		}
@@ -203,6 +209,25 @@ public:
             flags.counter = counter;
         }
 
+        /**
+         * Initializes the footer of a sector that is followed by a log of updates. The CRC of the
+         * sector data is stored separately since the sector CRC no longer matches once the log is appended to.
+         */
+        void makeValidLog(uint32_t dataCrc, uint8_t counter)
+        {
+            makeValidV2(0, counter);
+            version_flags = VERSION_FLAG_LOG;
+            reserved[0] = dataCrc;
+        }
+
+        bool isLog() const {
+        		return version_flags & VERSION_FLAG_LOG;
+        }
+
+        uint32_t dataCrc() const {
+        		return reserved[0];
+        }
+
         size_t size() const {
         		return sizeof(*this);
         }
@@ -434,6 +459,10 @@ public:
     		return calculateCRC(sectorStart+sizeof(Header), sectorSize-sizeof(Header)-sizeof(typename Footer::crc_type));
     }
 
+    static uint32_t computeCRC(const void* data, size_t length) {
+    		return calculateCRC(data, length);
+    }
+
     /**
      * Updates the cached sector data from the backing store.
      */
@@ -0,0 +1,372 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "dcd.h"
+
+#include <string.h>
+
+/**
+ * Log-structured variant of the DCD.
+ *
+ * A sector starts with a snapshot of the data in the v2 format: the header, `dataSize` bytes of
+ * data and the v2 footer at the end of the sector. The footer is marked with `VERSION_FLAG_LOG`
+ * and additionally stores the CRC of the snapshot data. The space between the snapshot data and
+ * the footer contains a log of updates that is appended to on every write:
+ *
+ * - Offset of the updated data (uint16_t)
+ * - Size of the updated data (uint16_t)
+ * - Updated data, padded to a multiple of 4 bytes
+ * - CRC of the offset, size and data fields (uint32_t)
+ *
+ * A record with an invalid CRC (e.g. when a write was interrupted) terminates the log. When the
+ * log is full, the current data is compacted into a new snapshot in the alternate sector, which
+ * is the only time a sector is erased. The alternate sector is written the same way as the v2
+ * implementation does it, so the data is never lost if a compaction is interrupted.
+ *
+ * Only the data that differs from the current contents is written, so rewriting a large structure
+ * with a few changed fields produces a small record, and rewriting unchanged data is a no-op.
+ *
+ * The data is read from a RAM cache that is populated from the snapshot and the log on first access.
+ *
+ * Compatibility with the v2 format: until the log is appended to, a snapshot is a valid v2 sector.
+ * After that, its v2 CRC no longer matches, and the v2 implementation would silently fall back to
+ * the alternate sector with a stale snapshot. `flush()` folds the log into a new snapshot and needs
+ * to be called before control is passed to code that may only understand the v1 or v2 format, such
+ * as an older bootloader or a downgraded system firmware. If there is no sector in the log format,
+ * the data is imported from a sector written by the v1 or v2 implementation.
+ */
+template <typename Base, unsigned dataSize>
+class LogDCD : public Base
+{
+public:
+    using Address = typename Base::Address;
+    using Result = typename Base::Result;
+    using Sector = typename Base::Sector;
+    using Header = typename Base::Header;
+    using Footer = typename Base::Footer;
+
+    /**
+     * The logical size of the data that can be stored.
+     */
+    const Address Length = dataSize;
+
+    LogDCD() :
+            current_(Base::Sector_Unknown),
+            source_(Base::Sector_Unknown),
+            logOffset_(0),
+            loaded_(false) {
+    }
+
+    bool isInitialized()
+    {
+        return currentLogSector() != Base::Sector_Unknown || Base::isInitialized();
+    }
+
+    /**
+     * Discards the cached data. The data is read from the backing store on next access.
+     */
+    void sync()
+    {
+        loaded_ = false;
+        Base::sync();
+    }
+
+    /**
+     * Folds the log of the current sector into a new snapshot, so that the current data can be
+     * read by the v1 and v2 implementations. Does nothing if the log is empty.
+     */
+    Result flush()
+    {
+        Result error = load();
+        if (error) return error;
+        if (current_ == Base::Sector_Unknown || logOffset_ == LOG_OFFSET) {
+            return Base::DCD_SUCCESS;
+        }
+        return compact(0, cache_, 0);
+    }
+
+    Result erase()
+    {
+        sync();
+        return Base::erase();
+    }
+
+    /**
+     * Retrieve a pointer to the data in the DCD.
+     *
+     * The returned pointer remains valid until the DCD is written to.
+     */
+    const uint8_t* read(const Address offset)
+    {
+        if (offset >= dataSize || load() != 0) {
+            return nullptr;
+        }
+        return cache_ + offset;
+    }
+
+    /**
+     * Write data to the DCD.
+     *
+     * @param data      The data to write
+     * @param offset    The logical offset in the DCD region to write to.
+     * @param length    The number of bytes of data to write.
+     * @return The result of the write operation. DCD_SUCCESS means the data was written successfully.
+     */
+    Result write(const Address offset, const void* data, size_t length, size_t version=Base::latestVersion)
+    {
+        if (offset >= dataSize)
+            return Base::DCD_INVALID_OFFSET;
+        if (offset+length > dataSize)
+            return Base::DCD_INVALID_LENGTH;
+        if (!length)
+            return Base::DCD_SUCCESS;
+
+        Result error = load();
+        if (error) return error;
+
+        // Write only the range of bytes that differs from the current data
+        const uint8_t* d = static_cast<const uint8_t*>(data);
+        const uint8_t* existing = cache_ + offset;
+        size_t first = 0;
+        while (first < length && d[first] == existing[first]) {
+            ++first;
+        }
+        if (first == length) {
+            return Base::DCD_SUCCESS;
+        }
+        size_t last = length;
+        while (d[last-1] == existing[last-1]) {
+            --last;
+        }
+        const Address changedOffset = offset + first;
+        d += first;
+        length = last - first;
+
+        if (current_ != Base::Sector_Unknown && logOffset_ + recordSize(length) <= this->footerOffset) {
+            error = append(changedOffset, d, length);
+            if (!error) {
+                memcpy(cache_ + changedOffset, d, length);
+                return Base::DCD_SUCCESS;
+            }
+            // The record may have been partially written
+            logOffset_ = this->footerOffset;
+        }
+        return compact(changedOffset, d, length);
+    }
+
+    /**
+     * Returns the number of bytes available in the log of the current sector.
+     */
+    size_t logAvailable()
+    {
+        if (load() != 0 || current_ == Base::Sector_Unknown) {
+            return 0;
+        }
+        return this->footerOffset - logOffset_;
+    }
+
+private:
+    struct __attribute__((packed)) Record {
+        uint16_t offset;
+        uint16_t length;
+    };
+
+    static const Address DATA_OFFSET = sizeof(Header);
+    static const Address LOG_OFFSET = (DATA_OFFSET + dataSize + 3) & ~3;
+
+    static_assert(dataSize < 0xffff, "dataSize is too large");
+    static_assert(LOG_OFFSET + sizeof(Record) + sizeof(uint32_t) < Base::SectorSize - sizeof(Footer),
+            "No space for the log of updates");
+
+    uint8_t cache_[dataSize];
+    Sector current_; // Sector in the log format containing the current data
+    Sector source_; // Sector the cached data has been loaded from
+    Address logOffset_; // Offset of the free space in the log
+    bool loaded_;
+
+    static size_t recordSize(size_t length)
+    {
+        return sizeof(Record) + ((length + 3) & ~3) + sizeof(uint32_t);
+    }
+
+    /**
+     * Determine if the sector contains a snapshot in the log format.
+     */
+    bool isLogSector(Sector sector)
+    {
+        const Header& header = this->sectorHeader(sector);
+        const Footer& footer = this->sectorFooter(sector);
+        if (!header.isValid() || !footer.isValid() || !footer.isLog()) {
+            return false;
+        }
+        const uint8_t* data = this->store.dataAt(this->addressOf(sector) + DATA_OFFSET);
+        return Base::computeCRC(data, dataSize) == footer.dataCrc();
+    }
+
+    /**
+     * Determines the sector in the log format containing the latest data. A sector that has been
+     * superseded is only used if the other sector is not valid.
+     */
+    Sector currentLogSector()
+    {
+        const bool valid0 = isLogSector(Base::Sector_0);
+        const bool valid1 = isLogSector(Base::Sector_1);
+        if (valid0 && valid1) {
+            const bool current0 = this->sectorHeader(Base::Sector_0).seal == Header::SEAL_VALID;
+            const bool current1 = this->sectorHeader(Base::Sector_1).seal == Header::SEAL_VALID;
+            if (current0 != current1) {
+                return current0 ? Base::Sector_0 : Base::Sector_1;
+            }
+            return this->_currentSector(this->sectorFooter(Base::Sector_0).counter(),
+                    this->sectorFooter(Base::Sector_1).counter(), Base::Sector_0, Base::Sector_1);
+        }
+        if (valid0) {
+            return Base::Sector_0;
+        }
+        if (valid1) {
+            return Base::Sector_1;
+        }
+        return Base::Sector_Unknown;
+    }
+
+    Result load()
+    {
+        if (loaded_) {
+            return 0;
+        }
+        current_ = currentLogSector();
+        if (current_ != Base::Sector_Unknown) {
+            source_ = current_;
+            memcpy(cache_, this->store.dataAt(this->addressOf(current_) + DATA_OFFSET), dataSize);
+            replayLog();
+        } else {
+            // Import the data written in the v1 or v2 format. The sector is converted on first write
+            source_ = this->currentSector();
+            if (source_ != Base::Sector_Unknown) {
+                memcpy(cache_, this->store.dataAt(this->addressOf(source_) + DATA_OFFSET), dataSize);
+            } else {
+                memset(cache_, 0xff, dataSize);
+            }
+        }
+        loaded_ = true;
+        return 0;
+    }
+
+    /**
+     * Applies the records in the log of the current sector to the cached data.
+     */
+    void replayLog()
+    {
+        const Address sector = this->addressOf(current_);
+        Address offset = LOG_OFFSET;
+        while (offset + recordSize(0) <= this->footerOffset) {
+            const uint8_t* p = this->store.dataAt(sector + offset);
+            Record r = {};
+            memcpy(&r, p, sizeof(r));
+            if (r.offset == 0xffff && r.length == 0xffff) {
+                break; // Free space
+            }
+            const size_t size = recordSize(r.length);
+            uint32_t crc = 0;
+            if (!r.length || r.offset + r.length > dataSize || offset + size > this->footerOffset) {
+                offset = this->footerOffset;
+                break;
+            }
+            memcpy(&crc, p + size - sizeof(crc), sizeof(crc));
+            if (Base::computeCRC(p, sizeof(r) + r.length) != crc) {
+                // Interrupted write. The rest of the log can't be used
+                offset = this->footerOffset;
+                break;
+            }
+            memcpy(cache_ + r.offset, p + sizeof(r), r.length);
+            offset += size;
+        }
+        logOffset_ = offset;
+    }
+
+    /**
+     * Appends a record to the log of the current sector.
+     */
+    Result append(const Address offset, const uint8_t* data, size_t length)
+    {
+        const Address address = this->addressOf(current_) + logOffset_;
+        Record r = {};
+        r.offset = offset;
+        r.length = length;
+        Result error = this->store.write(address, &r, sizeof(r));
+        if (error) return error;
+        error = this->store.write(address + sizeof(r), data, length);
+        if (error) return error;
+        const uint32_t crc = Base::computeCRC(this->store.dataAt(address), sizeof(r) + length);
+        const size_t size = recordSize(length);
+        error = this->store.write(address + size - sizeof(crc), &crc, sizeof(crc));
+        if (error) return error;
+        logOffset_ += size;
+        return 0;
+    }
+
+    /**
+     * Writes a snapshot of the current data with the given change applied to the alternate sector,
+     * and marks the current sector as superseded.
+     */
+    Result compact(const Address offset, const uint8_t* data, size_t length)
+    {
+        const Sector newSector = (source_ != Base::Sector_Unknown) ? this->alternateSectorTo(source_) : Base::Sector_1;
+        const Sector oldSector = this->alternateSectorTo(newSector);
+        Result error = Base::erase(newSector);
+        if (error) return error;
+
+        const Address destination = this->addressOf(newSector);
+        error = this->store.write(destination + DATA_OFFSET, cache_, offset);
+        if (error) return error;
+        error = this->store.write(destination + DATA_OFFSET + offset, data, length);
+        if (error) return error;
+        const Address end = offset + length;
+        error = this->store.write(destination + DATA_OFFSET + end, cache_ + end, dataSize - end);
+        if (error) return error;
+
+        uint8_t counter = 0;
+        const Footer& oldFooter = this->sectorFooter(oldSector);
+        if (source_ != Base::Sector_Unknown && oldFooter.isValid()) {
+            counter = uint8_t((oldFooter.counter() + 1) & 3);
+        }
+        Footer footer;
+        footer.makeValidLog(Base::computeCRC(this->store.dataAt(destination + DATA_OFFSET), dataSize), counter);
+        error = this->store.write(destination + this->footerOffset, &footer, footer.size() - sizeof(typename Footer::crc_type));
+        if (error) return error;
+        const typename Footer::crc_type crc = this->computeSectorCRC(newSector);
+        error = this->store.write(destination + Base::SectorSize - sizeof(crc), &crc, sizeof(crc));
+        if (error) return error;
+        Header header;
+        header.makeValid();
+        error = Base::write(newSector, header);
+        if (error) return error;
+
+        memcpy(cache_ + offset, data, length);
+        current_ = newSector;
+        source_ = newSector;
+        logOffset_ = LOG_OFFSET;
+
+        if (this->sectorHeader(oldSector).isHeader()) {
+            header.makeInvalid();
+            error = Base::write(oldSector, header);
+        }
+        return error;
+    }
+};
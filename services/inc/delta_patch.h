@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "stream.h"
+#include "system_error.h"
+#include "check.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+
+// Size of the buffer used to combine the source data with the patch data
+#ifndef DELTA_PATCH_BUFFER_SIZE
+#define DELTA_PATCH_BUFFER_SIZE (128)
+#endif
+
+namespace particle {
+
+const uint32_t DELTA_PATCH_MAGIC = 0x544c4450; // "PDLT"
+
+/**
+ * Delta patch header.
+ *
+ * The header is followed by a sequence of records, each consisting of the following fields (all
+ * integers are little endian):
+ *
+ * - Size of the diff data (uint32_t)
+ * - Size of the extra data (uint32_t)
+ * - Offset to adjust the source position by after the record is applied (int32_t)
+ * - Diff data. Each byte is added to the corresponding byte of the source module
+ * - Extra data. Copied to the target module as is
+ *
+ * Both the source and the patch data are processed sequentially, which allows applying the patch
+ * while it's being received and with a fixed amount of memory.
+ */
+struct __attribute__((packed)) DeltaPatchHeader {
+    uint32_t magic; // DELTA_PATCH_MAGIC
+    uint8_t moduleFunction; // Function of the source module (module_function_t)
+    uint8_t moduleIndex; // Index of the source module
+    uint8_t mcuIdentifier; // MCU identifier of the source module
+    uint8_t reserved;
+    uint32_t sourceSize; // Size of the source module
+    uint32_t sourceCrc; // CRC-32 of the source module
+    uint32_t targetSize; // Size of the target module
+};
+
+static_assert(sizeof(DeltaPatchHeader) == 20, "Unexpected size of the delta patch header");
+
+struct __attribute__((packed)) DeltaPatchRecord {
+    uint32_t diffSize;
+    uint32_t extraSize;
+    int32_t seek;
+};
+
+// Random-access interface to the module a delta patch is applied to
+class DeltaPatchSource {
+public:
+    virtual ~DeltaPatchSource() = default;
+
+    virtual int read(size_t offset, char* data, size_t size) = 0;
+};
+
+/**
+ * Output stream applying a delta patch.
+ *
+ * The patch data can be written in chunks of arbitrary size. The target module is written to
+ * the output stream.
+ */
+class DeltaPatchStream: public OutputStream {
+public:
+    DeltaPatchStream(DeltaPatchSource* source, OutputStream* output) :
+            source_(source),
+            output_(output),
+            state_(State::HEADER),
+            bufOffs_(0),
+            srcPos_(0),
+            written_(0),
+            diffLeft_(0),
+            extraLeft_(0),
+            seek_(0) {
+        memset(&header_, 0, sizeof(header_));
+    }
+
+    /**
+     * Applies a chunk of the patch data.
+     *
+     * @return Number of bytes consumed, or a negative error code. Data following the end of the
+     *         patch is not consumed.
+     */
+    int write(const char* data, size_t size) override {
+        size_t offs = 0;
+        while (offs < size && state_ != State::DONE) {
+            const char* const d = data + offs;
+            const size_t n = size - offs;
+            int ret = 0;
+            switch (state_) {
+            case State::HEADER:
+                ret = readHeader(d, n);
+                break;
+            case State::RECORD:
+                ret = readRecord(d, n);
+                break;
+            case State::DIFF:
+                ret = applyDiff(d, n);
+                break;
+            case State::EXTRA:
+                ret = applyExtra(d, n);
+                break;
+            case State::FAILED:
+                ret = SYSTEM_ERROR_BAD_DATA;
+                break;
+            default:
+                break;
+            }
+            if (ret < 0) {
+                state_ = State::FAILED;
+                return ret;
+            }
+            offs += ret;
+        }
+        return offs;
+    }
+
+    /**
+     * Checks whether the patch has been applied completely.
+     *
+     * @return 0 on success, or a negative error code.
+     */
+    int finish() {
+        return (state_ == State::DONE) ? 0 : SYSTEM_ERROR_BAD_DATA;
+    }
+
+    bool done() const {
+        return state_ == State::DONE;
+    }
+
+    // Returns the patch header. The header is available as soon as the first bytes of the patch have been written
+    const DeltaPatchHeader* header() const {
+        return (state_ == State::HEADER) ? nullptr : &header_;
+    }
+
+    int flush() override {
+        return output_->flush();
+    }
+
+    int availForWrite() override {
+        return done() ? 0 : INT_MAX;
+    }
+
+    int waitEvent(unsigned flags, unsigned timeout = 0) override {
+        return 0;
+    }
+
+    static bool isPatch(const char* data, size_t size) {
+        uint32_t magic = 0;
+        if (size < sizeof(magic)) {
+            return false;
+        }
+        memcpy(&magic, data, sizeof(magic));
+        return magic == DELTA_PATCH_MAGIC;
+    }
+
+private:
+    enum class State {
+        HEADER,
+        RECORD,
+        DIFF,
+        EXTRA,
+        DONE,
+        FAILED
+    };
+
+    DeltaPatchSource* source_;
+    OutputStream* output_;
+    DeltaPatchHeader header_;
+    State state_;
+    char buf_[DELTA_PATCH_BUFFER_SIZE];
+    size_t bufOffs_;
+    size_t srcPos_;
+    size_t written_;
+    size_t diffLeft_;
+    size_t extraLeft_;
+    int32_t seek_;
+
+    static_assert(DELTA_PATCH_BUFFER_SIZE >= sizeof(DeltaPatchHeader), "Delta patch buffer is too small");
+
+    // Accumulates a fixed-size structure in the buffer
+    int fill(const char* data, size_t size, size_t total) {
+        const size_t n = std::min(size, total - bufOffs_);
+        memcpy(buf_ + bufOffs_, data, n);
+        bufOffs_ += n;
+        return n;
+    }
+
+    int readHeader(const char* data, size_t size) {
+        const int n = fill(data, size, sizeof(DeltaPatchHeader));
+        if (bufOffs_ == sizeof(DeltaPatchHeader)) {
+            memcpy(&header_, buf_, sizeof(header_));
+            bufOffs_ = 0;
+            if (header_.magic != DELTA_PATCH_MAGIC) {
+                return SYSTEM_ERROR_BAD_DATA;
+            }
+            nextRecord();
+        }
+        return n;
+    }
+
+    int readRecord(const char* data, size_t size) {
+        const int n = fill(data, size, sizeof(DeltaPatchRecord));
+        if (bufOffs_ == sizeof(DeltaPatchRecord)) {
+            DeltaPatchRecord r = {};
+            memcpy(&r, buf_, sizeof(r));
+            bufOffs_ = 0;
+            const size_t targetLeft = header_.targetSize - written_;
+            if (r.diffSize > targetLeft || r.extraSize > targetLeft - r.diffSize ||
+                    r.diffSize > header_.sourceSize - srcPos_) {
+                return SYSTEM_ERROR_BAD_DATA;
+            }
+            diffLeft_ = r.diffSize;
+            extraLeft_ = r.extraSize;
+            seek_ = r.seek;
+            state_ = diffLeft_ ? State::DIFF : State::EXTRA;
+        }
+        return n;
+    }
+
+    int applyDiff(const char* data, size_t size) {
+        const size_t n = std::min({ size, diffLeft_, sizeof(buf_) });
+        const int ret = source_->read(srcPos_, buf_, n);
+        if (ret < 0) {
+            return ret;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            buf_[i] += data[i];
+        }
+        CHECK(output_->writeAll(buf_, n));
+        srcPos_ += n;
+        written_ += n;
+        diffLeft_ -= n;
+        if (!diffLeft_) {
+            if (extraLeft_) {
+                state_ = State::EXTRA;
+            } else {
+                CHECK(endRecord());
+            }
+        }
+        return n;
+    }
+
+    int applyExtra(const char* data, size_t size) {
+        const size_t n = std::min(size, extraLeft_);
+        CHECK(output_->writeAll(data, n));
+        written_ += n;
+        extraLeft_ -= n;
+        if (!extraLeft_) {
+            CHECK(endRecord());
+        }
+        return n;
+    }
+
+    int endRecord() {
+        const int64_t pos = (int64_t)srcPos_ + seek_;
+        if (pos < 0 || pos > header_.sourceSize) {
+            return SYSTEM_ERROR_BAD_DATA;
+        }
+        srcPos_ = pos;
+        nextRecord();
+        return 0;
+    }
+
+    void nextRecord() {
+        state_ = (written_ == header_.targetSize) ? State::DONE : State::RECORD;
+    }
+};
+
+} // namespace particle
@@ -58,6 +58,15 @@
 #define DIAG_NAME_CLOUD_RATE_LIMITED_EVENTS "pub:limit"
 #define DIAG_NAME_SYSTEM_TOTAL_RAM "sys:tram"
 #define DIAG_NAME_SYSTEM_USED_RAM "sys:uram"
+#define DIAG_NAME_SYSTEM_LARGEST_FREE_BLOCK "mem:maxfree"
+#define DIAG_NAME_SYSTEM_HEAP_FRAGMENTATION "mem:frag"
+#define DIAG_NAME_SYSTEM_FAILED_ALLOCATIONS "mem:allocfail"
+#define DIAG_NAME_NETWORK_SOCKET_TX_BYTES "net:sock:tx"
+#define DIAG_NAME_NETWORK_SOCKET_RX_BYTES "net:sock:rx"
+#define DIAG_NAME_NETWORK_SOCKET_TX_STALLS "net:sock:txstall"
+#define DIAG_NAME_NETWORK_SOCKET_TX_TIME "net:sock:txtime"
+#define DIAG_NAME_NETWORK_DNS_CACHE_HITS "net:dns:hits"
+#define DIAG_NAME_NETWORK_DNS_CACHE_MISSES "net:dns:misses"
 
 #ifdef __cplusplus
 extern "C" {
@@ -103,6 +112,15 @@ typedef enum diag_id {
     DIAG_ID_CLOUD_RATE_LIMITED_EVENTS = 20, // pub:throttle
     DIAG_ID_SYSTEM_TOTAL_RAM = 25, // sys:tram
     DIAG_ID_SYSTEM_USED_RAM = 26, // sys:uram
+    DIAG_ID_SYSTEM_LARGEST_FREE_BLOCK = 44, // mem:maxfree
+    DIAG_ID_SYSTEM_HEAP_FRAGMENTATION = 45, // mem:frag
+    DIAG_ID_SYSTEM_FAILED_ALLOCATIONS = 46, // mem:allocfail
+    DIAG_ID_NETWORK_SOCKET_TX_BYTES = 47, // net:sock:tx
+    DIAG_ID_NETWORK_SOCKET_RX_BYTES = 48, // net:sock:rx
+    DIAG_ID_NETWORK_SOCKET_TX_STALLS = 49, // net:sock:txstall
+    DIAG_ID_NETWORK_SOCKET_TX_TIME = 50, // net:sock:txtime
+    DIAG_ID_NETWORK_DNS_CACHE_HITS = 51, // net:dns:hits
+    DIAG_ID_NETWORK_DNS_CACHE_MISSES = 52, // net:dns:misses
     DIAG_ID_USER = 32768 // Base value for application-specific source IDs
 } diag_id;
 
@@ -22,8 +22,25 @@
 
 #include <cstring>
 #include <memory>
+#include <new>
 #include <vector>
 #include <limits>
+#include <algorithm>
+
+// Maximum number of bytes buffered in RAM when write combining is enabled
+#ifndef EEPROM_WRITE_COMBINING_BUFFER_SIZE
+#define EEPROM_WRITE_COMBINING_BUFFER_SIZE (32)
+#endif
+
+// Number of EEPROM indices processed by a single step of the background compaction
+#ifndef EEPROM_COMPACTION_SLICE_SIZE
+#define EEPROM_COMPACTION_SLICE_SIZE (32)
+#endif
+
+// Background compaction starts when less than 1/EEPROM_COMPACTION_THRESHOLD of the active page is free
+#ifndef EEPROM_COMPACTION_THRESHOLD
+#define EEPROM_COMPACTION_THRESHOLD (4)
+#endif
 
 /* EEPROM Emulation using Flash memory
  *
@@ -89,6 +106,24 @@
  * not call performPendingErase() before the next page swap, the
  * alternate page will be erased just before the page swap.
  *
+ * The page swap itself can also be done incrementally by calling
+ * performBackgroundWork() periodically from a context where a pause is
+ * acceptable (e.g. the system thread). Once the active page is mostly
+ * full, each call does a bounded amount of work: erasing the alternate
+ * page, copying a slice of the valid records to it, and finally copying
+ * the records written since the compaction started and marking the
+ * alternate page active. Writes keep going to the old active page in
+ * the meantime. If the old page fills up before the compaction is
+ * complete, a regular page swap is done and the compaction is aborted.
+ * A reset during the compaction leaves the alternate page in the COPY
+ * state, which is treated as a pending erase.
+ *
+ * Optionally, small writes can be combined in a RAM buffer and written
+ * to Flash as a single atomic batch by flush() or
+ * performBackgroundWork(). This reduces the number of records written
+ * for frequently updated values, but buffered writes are lost if the
+ * device resets before they are flushed.
+ *
  */
 
 template <typename Store, uintptr_t PageBase1, size_t PageSize1, uintptr_t PageBase2, size_t PageSize2>
@@ -167,6 +202,20 @@ public:
         }
     };
 
+    // State of the background page swap
+    enum class CompactionState
+    {
+        Idle,
+        Copying
+    };
+
+    // A write buffered in RAM
+    struct PendingWrite
+    {
+        Index index;
+        Data data;
+    };
+
     /* Public API */
 
     // Initialize the EEPROM pages
@@ -179,13 +228,16 @@ public:
         {
             clear();
         }
+
+        compactionState = CompactionState::Idle;
+        compactionCheckNeeded = true;
     }
 
     // Read the latest value of a byte of EEPROM in data or 0xFF if the
     // value was not programmed
     void get(Index index, Data &data)
     {
-        readRange(index, &data, sizeof(data));
+        get(index, &data, sizeof(data));
     }
 
     // Reads the latest valid values of a block of EEPROM into data.
@@ -193,14 +245,15 @@ public:
     void get(Index index, void *data, uint16_t length)
     {
         readRange(index, (Data *)data, length);
+        readPendingWrites(index, (Data *)data, length);
     }
 
     // Writes a new value for a byte of EEPROM
     // Performs a page swap (move all valid records to a new page)
     // if the current page is full
-    void put(Index index, Data data)
+    bool put(Index index, Data data)
     {
-        writeRange(index, &data, sizeof(data));
+        return put(index, &data, sizeof(data));
     }
 
     // Writes new values for a block of EEPROM
@@ -209,14 +262,100 @@ public:
     //
     // Performs a page swap (move all valid records to a new page)
     // if the current page is full
-    void put(Index index, const void *data, uint16_t length)
+    //
+    // Returns false without writing anything if there is not enough
+    // memory to write the buffered writes first
+    bool put(Index index, const void *data, uint16_t length)
+    {
+        if(writeCombining && combineWrite(index, (const Data *)data, length))
+        {
+            return true;
+        }
+
+        // Preserve the order of writes
+        return flush() && writeRange(index, (const Data *)data, length);
+    }
+
+    // Enables or disables buffering of small writes in RAM
+    void setWriteCombining(bool enabled)
+    {
+        if(!enabled)
+        {
+            flush();
+        }
+        writeCombining = enabled;
+    }
+
+    // Check if there are buffered writes that haven't been written to Flash yet
+    bool hasPendingWrites()
+    {
+        return pendingWriteCount > 0;
+    }
+
+    // Writes all buffered writes to Flash as a single atomic write
+    //
+    // Returns false if the writes remain buffered because there is not
+    // enough memory to write them. Nothing else may be written to Flash
+    // before them so that the writes are applied in order
+    bool flush()
+    {
+        if(pendingWriteCount == 0)
+        {
+            return true;
+        }
+
+        Index indexBegin = pendingWrites[0].index;
+        Index indexEnd = indexBegin + 1;
+        for(size_t i = 1; i < pendingWriteCount; i++)
+        {
+            indexBegin = std::min(indexBegin, pendingWrites[i].index);
+            indexEnd = std::max<Index>(indexEnd, pendingWrites[i].index + 1);
+        }
+
+        // Unchanged values in the range don't produce new records
+        uint16_t length = indexEnd - indexBegin;
+        std::unique_ptr<Data[]> data(new(std::nothrow) Data[length]);
+        if(!data)
+        {
+            return false;
+        }
+
+        readRange(indexBegin, data.get(), length);
+        readPendingWrites(indexBegin, data.get(), length);
+
+        if(!writeRange(indexBegin, data.get(), length))
+        {
+            return false;
+        }
+        pendingWriteCount = 0;
+        return true;
+    }
+
+    // Performs a bounded amount of deferred work: flushes buffered
+    // writes and does a single step of the background page swap
+    //
+    // Returns true if there is more work to do
+    bool performBackgroundWork()
     {
-        writeRange(index, (Data *)data, length);
+        flush();
+
+        switch(compactionState)
+        {
+            case CompactionState::Idle:
+                return startCompaction();
+            case CompactionState::Copying:
+                return continueCompaction();
+            default:
+                return false;
+        }
     }
 
     // Destroys all the data 💣
     void clear()
     {
+        pendingWriteCount = 0;
+        compactionState = CompactionState::Idle;
+
         erasePage(LogicalPage::Page1);
         erasePage(LogicalPage::Page2);
         writePageStatus(LogicalPage::Page1, PageHeader::ACTIVE);
@@ -231,6 +370,12 @@ public:
         return SmallestPageSize / sizeof(Record) / 2;
     }
 
+    // Check if a background page swap is in progress
+    bool isCompacting()
+    {
+        return compactionState != CompactionState::Idle;
+    }
+
     // Check if the old page needs to be erased
     bool hasPendingErase()
     {
@@ -350,21 +495,24 @@ public:
     }
 
     // Write each byte in the range if its value has changed.
-    void writeRange(Index indexBegin, const Data *data, uint16_t length)
+    //
+    // Returns false without writing anything if there is not enough
+    // memory to read the existing values
+    bool writeRange(Index indexBegin, const Data *data, uint16_t length)
     {
         // don't write anything if index is out of range
         Index indexEnd = indexBegin + length;
         if(indexEnd > capacity())
         {
-            return;
+            return true;
         }
 
         // Read existing values for range
-        std::unique_ptr<Data[]> existingData(new Data[length]);
+        std::unique_ptr<Data[]> existingData(new(std::nothrow) Data[length]);
         // don't write anything if memory is full
         if(!existingData)
         {
-            return;
+            return false;
         }
 
         Address writeAddressBegin;
@@ -384,6 +532,9 @@ public:
         {
             swapPagesAndWrite(indexBegin, data, length);
         }
+
+        compactionCheckNeeded = true;
+        return true;
     }
 
     // Read values and find the address where to write new records
@@ -643,6 +794,9 @@ public:
         LogicalPage sourcePage = getActivePage();
         LogicalPage destinationPage = getAlternatePage();
 
+        // The alternate page is about to be erased
+        compactionState = CompactionState::Idle;
+
         // loop protects against marginal erase: if a page was kind of
         // erased and read back as all 0xFF but when values are written
         // some bits written as 1 actually become 0
@@ -742,6 +896,12 @@ public:
     // Which page needs to be erased after a page swap.
     LogicalPage getPendingErasePage()
     {
+        // The alternate page is the destination of the background page swap
+        if(isCompacting())
+        {
+            return LogicalPage::NoPage;
+        }
+
         if(readPageStatus(getAlternatePage()) != PageHeader::ERASED)
         {
             return getAlternatePage();
@@ -752,10 +912,219 @@ public:
         }
     }
 
+    // Add a write to the RAM buffer. The buffer is flushed first if
+    // there's not enough room for all the bytes so that the write
+    // remains atomic
+    //
+    // Returns false if the write can't be buffered
+    bool combineWrite(Index indexBegin, const Data *data, uint16_t length)
+    {
+        Index indexEnd = indexBegin + length;
+        if(length > WriteCombiningBufferSize || indexEnd > capacity())
+        {
+            return false;
+        }
+
+        size_t newCount = 0;
+        for(Index index = indexBegin; index < indexEnd; index++)
+        {
+            if(!findPendingWrite(index))
+            {
+                newCount++;
+            }
+        }
+
+        if(pendingWriteCount + newCount > WriteCombiningBufferSize && !flush())
+        {
+            return false;
+        }
+
+        for(uint16_t i = 0; i < length; i++)
+        {
+            PendingWrite *write = findPendingWrite(indexBegin + i);
+            if(!write)
+            {
+                write = &pendingWrites[pendingWriteCount++];
+                write->index = indexBegin + i;
+            }
+            write->data = data[i];
+        }
+
+        return true;
+    }
+
+    PendingWrite *findPendingWrite(Index index)
+    {
+        for(size_t i = 0; i < pendingWriteCount; i++)
+        {
+            if(pendingWrites[i].index == index)
+            {
+                return &pendingWrites[i];
+            }
+        }
+
+        return nullptr;
+    }
+
+    // Overlay buffered writes on top of values read from Flash
+    void readPendingWrites(Index indexBegin, Data *data, uint16_t length)
+    {
+        Index indexEnd = indexBegin + length;
+        for(size_t i = 0; i < pendingWriteCount; i++)
+        {
+            const PendingWrite &write = pendingWrites[i];
+            if(write.index >= indexBegin && write.index < indexEnd)
+            {
+                data[write.index - indexBegin] = write.data;
+            }
+        }
+    }
+
+    // Address following the last valid record of a page
+    Address findEndOfValidRecords(LogicalPage page)
+    {
+        Address endAddress = getPageBegin(page) + sizeof(PageHeader);
+        forEachValidRecord(page, [&](Address address, const Record &record)
+        {
+            endAddress = address + sizeof(Record);
+        });
+
+        return endAddress;
+    }
+
+    // Check if the active page is full enough to start a background
+    // page swap and prepare the alternate page for it, one erase at a
+    // time
+    //
+    // Returns true if there is more work to do
+    bool startCompaction()
+    {
+        if(!compactionCheckNeeded || getActivePage() == LogicalPage::NoPage)
+        {
+            return false;
+        }
+
+        LogicalPage sourcePage = getActivePage();
+        LogicalPage destinationPage = getAlternatePage();
+
+        Address markAddress = findEndOfValidRecords(sourcePage);
+        size_t freeSize = getPageEnd(sourcePage) - markAddress;
+        if(freeSize * EEPROM_COMPACTION_THRESHOLD >= getPageSize(sourcePage))
+        {
+            compactionCheckNeeded = false;
+            return false;
+        }
+
+        // Erasing takes a while so the copy starts on the next call
+        if(hasPendingErase() || !verifyPage(destinationPage))
+        {
+            erasePage(destinationPage);
+            return true;
+        }
+
+        // If the write fails, the page will be erased on the next call
+        if(!writePageStatus(destinationPage, PageHeader::COPY))
+        {
+            return true;
+        }
+
+        compactionMark = markAddress;
+        compactionWriteAddress = getPageBegin(destinationPage) + sizeof(PageHeader);
+        compactionIndex = 0;
+        compactionState = CompactionState::Copying;
+        return true;
+    }
+
+    // Copy the latest values for the next slice of indices, or finish
+    // the page swap once all the indices have been copied
+    //
+    // Returns true if there is more work to do
+    bool continueCompaction()
+    {
+        LogicalPage sourcePage = getActivePage();
+        LogicalPage destinationPage = getAlternatePage();
+        Address endAddress = getPageEnd(destinationPage);
+        bool success = true;
+
+        if(compactionIndex < capacity())
+        {
+            Index indexBegin = compactionIndex;
+            Index indexEnd = std::min<size_t>(indexBegin + EEPROM_COMPACTION_SLICE_SIZE, capacity());
+
+            Address latestAddress[EEPROM_COMPACTION_SLICE_SIZE] = {};
+            forEachValidRecord(sourcePage, [&](Address address, const Record &record)
+            {
+                if(record.index >= indexBegin && record.index < indexEnd)
+                {
+                    latestAddress[record.index - indexBegin] = address;
+                }
+            });
+
+            for(Index i = 0; i < indexEnd - indexBegin && success; i++)
+            {
+                if(latestAddress[i] == 0)
+                {
+                    continue;
+                }
+
+                // Don't copy records that are 0xFF
+                const Record &record = *(const Record *) store.dataAt(latestAddress[i]);
+                if(record.data != FLASH_ERASED)
+                {
+                    success = writeRecord(compactionWriteAddress, endAddress, Record(record.index, record.data));
+                    compactionWriteAddress += sizeof(Record);
+                }
+            }
+
+            compactionIndex = indexEnd;
+            if(!success)
+            {
+                // The alternate page is in the COPY state and will be erased later
+                compactionState = CompactionState::Idle;
+            }
+            return true;
+        }
+
+        // Copy the records written since the compaction started, in
+        // order, including records that are 0xFF
+        for(Address address = compactionMark; address < getPageEnd(sourcePage) && success; address += sizeof(Record))
+        {
+            const Record &record = *(const Record *) store.dataAt(address);
+            if(!record.valid())
+            {
+                break;
+            }
+            success = writeRecord(compactionWriteAddress, endAddress, Record(record.index, record.data));
+            compactionWriteAddress += sizeof(Record);
+        }
+
+        success = success && writePageStatus(destinationPage, PageHeader::ACTIVE);
+        success = success && writePageStatus(sourcePage, PageHeader::INACTIVE);
+
+        compactionState = CompactionState::Idle;
+        if(success)
+        {
+            updateActivePage();
+        }
+        return false;
+    }
+
     // Hardware-dependent interface to read, erase and program memory
     Store store;
 
 protected:
-    LogicalPage activePage;
-    LogicalPage alternatePage;
+    static const size_t WriteCombiningBufferSize = EEPROM_WRITE_COMBINING_BUFFER_SIZE;
+
+    LogicalPage activePage = LogicalPage::NoPage;
+    LogicalPage alternatePage = LogicalPage::NoPage;
+
+    PendingWrite pendingWrites[WriteCombiningBufferSize];
+    size_t pendingWriteCount = 0;
+    bool writeCombining = false;
+
+    CompactionState compactionState = CompactionState::Idle;
+    bool compactionCheckNeeded = false;
+    Index compactionIndex = 0;
+    Address compactionMark = 0;
+    Address compactionWriteAddress = 0;
 };
@@ -109,6 +109,26 @@ public:
         shrink();
     }
 
+    // Returns the total number of bytes available for allocation
+    size_t freeSize() const {
+        size_t n = tailFreeSize();
+        for (const BlockHeader* b = freeList_; b != nullptr; b = b->next) {
+            n += b->size - sizeof(BlockHeader);
+        }
+        return n;
+    }
+
+    // Returns the size of the largest block that can be allocated
+    size_t largestFreeBlock() const {
+        size_t n = tailFreeSize();
+        for (const BlockHeader* b = freeList_; b != nullptr; b = b->next) {
+            if (b->size - sizeof(BlockHeader) > n) {
+                n = b->size - sizeof(BlockHeader);
+            }
+        }
+        return n;
+    }
+
     // FIXME: This API is here for compatibility with the existing system code and unit tests
     void* allocate(size_t size) {
         return this->alloc(size);
@@ -153,6 +173,11 @@ protected:
         return (sz + (sizeof(uintptr_t) - (sz % sizeof(uintptr_t))));
     }
 
+    size_t tailFreeSize() const {
+        const size_t n = size_ - (ptr_ - begin_);
+        return (n > sizeof(BlockHeader)) ? n - sizeof(BlockHeader) : 0;
+    }
+
     BlockHeader* getPrevFree(BlockHeader* block) const {
         for (BlockHeader* b = freeList_; b != nullptr; b = b->next) {
             if (b->next == block) {
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <new>
+
+#include "spark_wiring_interrupts.h"
+
+#include "allocator.h"
+#include "system_error.h"
+
+#ifndef SLAB_POOL_MAX_SIZE_CLASSES
+#define SLAB_POOL_MAX_SIZE_CLASSES (8)
+#endif
+
+#ifndef SLAB_POOL_MIN_BLOCK_SIZE
+#define SLAB_POOL_MIN_BLOCK_SIZE (16)
+#endif
+
+/**
+ * Size-class pool allocator.
+ *
+ * The pool's memory is carved on demand into blocks of a fixed set of sizes. Freed blocks are kept
+ * in per-class free lists and are never coalesced, so both alloc() and free() take constant time
+ * and mixed allocation sizes can't fragment the pool beyond the size class rounding.
+ *
+ * free() pushes blocks to a lock-free list and can be called from an ISR. alloc() is not reentrant
+ * and should be synchronized by the caller (see AtomicSlabAllocedPool).
+ */
+class SlabBasePool: public particle::SimpleAllocator {
+public:
+    virtual void* alloc(size_t size) override {
+        const int cls = sizeClass(size);
+        if (cls < 0) {
+            return nullptr;
+        }
+        Block* b = popFree(cls);
+        if (!b) {
+            b = allocFromTail(cls);
+        }
+        if (!b) {
+            // Borrow a block of a larger size class
+            for (size_t i = cls + 1; i < classCount_ && !b; ++i) {
+                b = popFree(i);
+            }
+        }
+        return b ? b->data : nullptr;
+    }
+
+    virtual void free(void* p) override {
+        if (!p) {
+            return;
+        }
+        Block* const b = reinterpret_cast<Block*>(static_cast<uint8_t*>(p) - sizeof(Block));
+        std::atomic<Block*>& head = released_[b->sizeClass];
+        Block* next = head.load(std::memory_order_relaxed);
+        do {
+            b->next = next;
+        } while (!head.compare_exchange_weak(next, b, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    // Returns the maximum size of a block that can be allocated from this pool
+    size_t maxBlockSize() const {
+        return classCount_ ? classSizes_[classCount_ - 1] : 0;
+    }
+
+    size_t sizeClassCount() const {
+        return classCount_;
+    }
+
+protected:
+    SlabBasePool() {
+        reset();
+    }
+
+    SlabBasePool(void* location, size_t size, const size_t* classSizes = nullptr, size_t classCount = 0) {
+        reset(static_cast<uint8_t*>(location), size, classSizes, classCount);
+    }
+
+    // If no size classes are provided, powers of two starting from SLAB_POOL_MIN_BLOCK_SIZE are used
+    void reset(uint8_t* data = nullptr, size_t size = 0, const size_t* classSizes = nullptr, size_t classCount = 0) {
+        begin_ = data;
+        ptr_ = data;
+        size_ = size;
+        classCount_ = 0;
+        if (classSizes) {
+            for (size_t i = 0; i < classCount && i < SLAB_POOL_MAX_SIZE_CLASSES; ++i) {
+                classSizes_[classCount_++] = aligned(classSizes[i]);
+            }
+        } else {
+            for (size_t s = SLAB_POOL_MIN_BLOCK_SIZE; classCount_ < SLAB_POOL_MAX_SIZE_CLASSES && s + sizeof(Block) <= size; s *= 2) {
+                classSizes_[classCount_++] = s;
+            }
+        }
+        for (size_t i = 0; i < SLAB_POOL_MAX_SIZE_CLASSES; ++i) {
+            free_[i] = nullptr;
+            released_[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    uint8_t* begin_;
+    size_t size_;
+
+// Leaving these protected to simplify unit testing
+// private:
+
+    struct Block {
+        union {
+            Block* next; // Next free block
+            uintptr_t sizeClass; // Size class of an allocated block
+        };
+        uint8_t data[0];
+    };
+
+    static_assert(sizeof(Block) == sizeof(uintptr_t), "SlabBasePool: unexpected size of the block header");
+
+    static size_t aligned(size_t sz) {
+        return (sz + sizeof(uintptr_t) - 1) & ~(sizeof(uintptr_t) - 1);
+    }
+
+    int sizeClass(size_t size) const {
+        // The number of size classes is small, a linear search is faster than a binary one
+        for (size_t i = 0; i < classCount_; ++i) {
+            if (size <= classSizes_[i]) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    Block* popFree(size_t cls) {
+        Block* b = free_[cls];
+        if (!b) {
+            // Take all blocks released since the last time the list was drained
+            b = released_[cls].exchange(nullptr, std::memory_order_acquire);
+            if (!b) {
+                return nullptr;
+            }
+        }
+        free_[cls] = b->next;
+        b->sizeClass = cls;
+        return b;
+    }
+
+    Block* allocFromTail(size_t cls) {
+        const size_t blockSize = sizeof(Block) + classSizes_[cls];
+        if (!begin_ || size_ - (ptr_ - begin_) < blockSize) {
+            return nullptr;
+        }
+        Block* const b = reinterpret_cast<Block*>(ptr_);
+        b->sizeClass = cls;
+        ptr_ += blockSize;
+        return b;
+    }
+
+    uint8_t* ptr_;
+
+    size_t classSizes_[SLAB_POOL_MAX_SIZE_CLASSES];
+    size_t classCount_;
+
+    Block* free_[SLAB_POOL_MAX_SIZE_CLASSES];
+    std::atomic<Block*> released_[SLAB_POOL_MAX_SIZE_CLASSES];
+};
+
+class SlabAllocedPool : public SlabBasePool {
+public:
+    explicit SlabAllocedPool(size_t size, const size_t* classSizes = nullptr, size_t classCount = 0) :
+        SlabBasePool(reinterpret_cast<void*>(new uint8_t[size]), size, classSizes, classCount) {
+    }
+
+    virtual ~SlabAllocedPool() {
+        delete[] begin_;
+    }
+};
+
+class SlabStaticPool : public SlabBasePool {
+public:
+    SlabStaticPool(void* ptr, size_t size, const size_t* classSizes = nullptr, size_t classCount = 0) :
+        SlabBasePool(ptr, size, classSizes, classCount) {
+    }
+};
+
+class AtomicSlabAllocedPool: public SlabBasePool {
+public:
+    virtual ~AtomicSlabAllocedPool() {
+        delete[] SlabBasePool::begin_;
+    }
+
+    int init(size_t size, const size_t* classSizes = nullptr, size_t classCount = 0) {
+        const auto p = new(std::nothrow) uint8_t[size];
+        if (!p) {
+            return SYSTEM_ERROR_NO_MEMORY;
+        }
+        SlabBasePool::reset(p, size, classSizes, classCount);
+        return 0;
+    }
+
+    virtual void* alloc(size_t size) override {
+        void* p = nullptr;
+        ATOMIC_BLOCK() {
+            p = SlabBasePool::alloc(size);
+        }
+        return p;
+    }
+
+    // free() doesn't need to disable interrupts
+};
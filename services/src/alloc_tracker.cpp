@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "alloc_tracker.h"
+
+#if ALLOC_TRACKER_ENABLED
+
+#include "spark_wiring_interrupts.h"
+
+#include "system_error.h"
+
+#include <cstring>
+
+namespace {
+
+static_assert((ALLOC_TRACKER_MAX_SITES & (ALLOC_TRACKER_MAX_SITES - 1)) == 0,
+        "ALLOC_TRACKER_MAX_SITES should be a power of two");
+
+// Call sites are stored in an open addressing hash table keyed by the return address
+alloc_tracker_site g_sites[ALLOC_TRACKER_MAX_SITES] = {};
+size_t g_siteCount = 0;
+uint32_t g_untrackedCount = 0;
+
+alloc_tracker_stats g_stats[ALLOC_TRACKER_SOURCE_COUNT] = {};
+
+alloc_tracker_site* findSite(uint32_t addr, uint8_t source) {
+    // Fibonacci hashing
+    size_t index = (addr * 2654435769u) >> 16;
+    for (size_t i = 0; i < ALLOC_TRACKER_MAX_SITES; ++i) {
+        index &= ALLOC_TRACKER_MAX_SITES - 1;
+        alloc_tracker_site* const site = &g_sites[index];
+        if (site->alloc_count == 0) {
+            if (g_siteCount == ALLOC_TRACKER_MAX_SITES) {
+                break;
+            }
+            site->address = addr;
+            site->source = source;
+            ++g_siteCount;
+            return site;
+        }
+        if (site->address == addr && site->source == source) {
+            return site;
+        }
+        ++index;
+    }
+    return nullptr;
+}
+
+} // namespace
+
+void alloc_tracker_alloc(int source, const void* ptr, size_t size, const void* caller) {
+    if (source < 0 || source >= ALLOC_TRACKER_SOURCE_COUNT) {
+        return;
+    }
+    ATOMIC_BLOCK() {
+        alloc_tracker_stats* const stats = &g_stats[source];
+        if (ptr) {
+            ++stats->alloc_count;
+            stats->alloc_bytes += size;
+            alloc_tracker_site* const site = findSite((uint32_t)(uintptr_t)caller, source);
+            if (site) {
+                ++site->alloc_count;
+                site->alloc_bytes += size;
+            } else {
+                ++g_untrackedCount;
+            }
+        } else {
+            ++stats->failed_count;
+            if (size > stats->max_failed_size) {
+                stats->max_failed_size = size;
+            }
+        }
+    }
+}
+
+void alloc_tracker_free(int source, const void* ptr) {
+    if (!ptr || source < 0 || source >= ALLOC_TRACKER_SOURCE_COUNT) {
+        return;
+    }
+    ATOMIC_BLOCK() {
+        ++g_stats[source].free_count;
+    }
+}
+
+int alloc_tracker_get_stats(int source, alloc_tracker_stats* stats) {
+    if (source < 0 || source >= ALLOC_TRACKER_SOURCE_COUNT || !stats) {
+        return SYSTEM_ERROR_INVALID_ARGUMENT;
+    }
+    ATOMIC_BLOCK() {
+        *stats = g_stats[source];
+    }
+    return 0;
+}
+
+int alloc_tracker_get_sites(alloc_tracker_site* sites, size_t max_count) {
+    size_t count = 0;
+    ATOMIC_BLOCK() {
+        for (size_t i = 0; i < ALLOC_TRACKER_MAX_SITES; ++i) {
+            const alloc_tracker_site& site = g_sites[i];
+            if (site.alloc_count == 0) {
+                continue;
+            }
+            if (count < max_count) {
+                sites[count] = site;
+            }
+            ++count;
+        }
+    }
+    return count;
+}
+
+uint32_t alloc_tracker_untracked_count(void) {
+    return g_untrackedCount;
+}
+
+void alloc_tracker_reset(void) {
+    ATOMIC_BLOCK() {
+        memset(g_sites, 0, sizeof(g_sites));
+        memset(g_stats, 0, sizeof(g_stats));
+        g_siteCount = 0;
+        g_untrackedCount = 0;
+    }
+}
+
+#endif // ALLOC_TRACKER_ENABLED
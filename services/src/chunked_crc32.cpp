@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "chunked_crc32.h"
+
+#include <cstring>
+
+namespace particle {
+
+namespace {
+
+uint32_t gf2MatrixTimes(const uint32_t* mat, uint32_t vec) {
+    uint32_t sum = 0;
+    while (vec) {
+        if (vec & 1) {
+            sum ^= *mat;
+        }
+        vec >>= 1;
+        ++mat;
+    }
+    return sum;
+}
+
+void gf2MatrixSquare(uint32_t* square, const uint32_t* mat) {
+    for (unsigned i = 0; i < 32; ++i) {
+        square[i] = gf2MatrixTimes(mat, mat[i]);
+    }
+}
+
+} // namespace
+
+// The algorithm is based on crc32_combine() from zlib: the CRC of the first block is advanced
+// through size2 zero bytes by multiplying it by a GF(2) matrix of the CRC polynomial
+uint32_t combineCrc32(uint32_t crc1, uint32_t crc2, size_t size2) {
+    if (!size2) {
+        return crc1;
+    }
+    uint32_t even[32]; // Operator for an even power of two zero bits
+    uint32_t odd[32]; // Operator for an odd power of two zero bits
+    // Operator for one zero bit
+    odd[0] = 0xedb88320;
+    uint32_t row = 1;
+    for (unsigned i = 1; i < 32; ++i) {
+        odd[i] = row;
+        row <<= 1;
+    }
+    gf2MatrixSquare(even, odd); // Two zero bits
+    gf2MatrixSquare(odd, even); // Four zero bits
+    // Apply size2 zero bytes to crc1 (the first squaring gives an operator for one zero byte)
+    for (;;) {
+        gf2MatrixSquare(even, odd);
+        if (size2 & 1) {
+            crc1 = gf2MatrixTimes(even, crc1);
+        }
+        size2 >>= 1;
+        if (!size2) {
+            break;
+        }
+        gf2MatrixSquare(odd, even);
+        if (size2 & 1) {
+            crc1 = gf2MatrixTimes(odd, crc1);
+        }
+        size2 >>= 1;
+        if (!size2) {
+            break;
+        }
+    }
+    return crc1 ^ crc2;
+}
+
+void ChunkedCrc32::update(size_t offset, const void* data, size_t size) {
+    if (!valid_ || offset >= limit_ || !size) {
+        return;
+    }
+    if (size > limit_ - offset) {
+        size = limit_ - offset;
+    }
+    // Data that has already been checksummed is expected to be received again unchanged,
+    // e.g. when a chunk is retransmitted
+    if (offset + size <= size_) {
+        return;
+    }
+    auto p = static_cast<const uint8_t*>(data);
+    if (offset < size_) {
+        const size_t n = size_ - offset;
+        p += n;
+        offset += n;
+        size -= n;
+    }
+    if (offset == size_) {
+        crc_ = computeCrc32(p, size, crc_);
+        size_ += size;
+        combinePending();
+    } else {
+        addPending(offset, size, computeCrc32(p, size));
+    }
+}
+
+void ChunkedCrc32::setLimit(size_t limit) {
+    if (size_ > limit) {
+        valid_ = false;
+        return;
+    }
+    for (size_t i = 0; i < pendingCount_; ++i) {
+        const Chunk& c = pending_[i];
+        if (c.offset >= limit) {
+            pendingCount_ = i; // Drop this and all following chunks
+            break;
+        }
+        if (c.offset + c.size > limit) {
+            valid_ = false;
+            return;
+        }
+    }
+    limit_ = limit;
+}
+
+void ChunkedCrc32::addPending(size_t offset, size_t size, uint32_t crc) {
+    size_t i = 0;
+    while (i < pendingCount_ && pending_[i].offset < offset) {
+        ++i;
+    }
+    if (i < pendingCount_ && pending_[i].offset == offset && pending_[i].size == size) {
+        return; // Retransmitted chunk
+    }
+    if ((i > 0 && pending_[i - 1].offset + pending_[i - 1].size > offset) ||
+            (i < pendingCount_ && offset + size > pending_[i].offset) ||
+            pendingCount_ == CHUNKED_CRC32_MAX_PENDING) {
+        valid_ = false;
+        return;
+    }
+    memmove(pending_ + i + 1, pending_ + i, (pendingCount_ - i) * sizeof(Chunk));
+    pending_[i] = { offset, size, crc };
+    ++pendingCount_;
+}
+
+void ChunkedCrc32::combinePending() {
+    size_t n = 0;
+    while (n < pendingCount_ && pending_[n].offset <= size_) {
+        const Chunk& c = pending_[n];
+        if (c.offset < size_) {
+            // The chunk overlaps with the data that has already been checksummed
+            valid_ = false;
+            return;
+        }
+        crc_ = combineCrc32(crc_, c.crc, c.size);
+        size_ += c.size;
+        ++n;
+    }
+    if (n > 0) {
+        memmove(pending_, pending_ + n, (pendingCount_ - n) * sizeof(Chunk));
+        pendingCount_ -= n;
+    }
+}
+
+} // namespace particle
@@ -61,6 +61,7 @@ typedef enum ctrl_request_type {
     CTRL_REQUEST_LOG_CONFIG = 80,
     CTRL_REQUEST_GET_MODULE_INFO = 90,
     CTRL_REQUEST_DIAGNOSTIC_INFO = 100,
+    CTRL_REQUEST_ALLOCATION_INFO = 101, // Requires ALLOC_TRACKER_ENABLED=1
     CTRL_REQUEST_WIFI_SET_ANTENNA = 110,
     CTRL_REQUEST_WIFI_GET_ANTENNA = 111,
     CTRL_REQUEST_WIFI_SCAN = 112, // Deprecated
@@ -70,6 +71,7 @@ typedef enum ctrl_request_type {
     CTRL_REQUEST_NETWORK_SET_CONFIGURATION = 120,
     CTRL_REQUEST_NETWORK_GET_CONFIGURATION = 121,
     CTRL_REQUEST_NETWORK_GET_STATUS = 122,
+    CTRL_REQUEST_NETWORK_GET_SOCKET_STATS = 123,
     CTRL_REQUEST_SET_CLAIM_CODE = 200,
     CTRL_REQUEST_IS_CLAIMED = 201,
     CTRL_REQUEST_SET_SECURITY_KEY = 210,
@@ -85,6 +87,7 @@ typedef enum ctrl_request_type {
     CTRL_REQUEST_FINISH_FIRMWARE_UPDATE = 251,
     CTRL_REQUEST_CANCEL_FIRMWARE_UPDATE = 252,
     CTRL_REQUEST_FIRMWARE_UPDATE_DATA = 253,
+    CTRL_REQUEST_FIRMWARE_UPDATE_DATA_STREAM = 254, // Pipelined variant of CTRL_REQUEST_FIRMWARE_UPDATE_DATA
     CTRL_REQUEST_DESCRIBE_STORAGE = 260,
     CTRL_REQUEST_READ_SECTION_DATA = 261,
     CTRL_REQUEST_WRITE_SECTION_DATA = 262,
@@ -105,6 +105,12 @@ void* system_pool_alloc(size_t size, void* reserved);
  */
 void system_pool_free(void* ptr, void* reserved);
 
+/**
+ * Retrieves the total amount of free memory in the system pool and the size of the largest block
+ * that can be allocated from it.
+ */
+int system_pool_get_info(size_t* free_size, size_t* largest_free_block);
+
 int system_invoke_event_handler(uint16_t handlerInfoSize, FilteringEventHandler* handlerInfo,
                 const char* event_name, const char* event_data, void* reserved);
 
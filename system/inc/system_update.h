@@ -144,6 +144,14 @@ typedef enum
 	 */
     SYSTEM_FLAG_OTA_UPDATE_FORCED,
 
+    /**
+     * When 1 (default), the system periodically probes the path to the cloud via each of the
+     * network interfaces to select the interface that should carry the cloud connection. The
+     * cellular interface is probed with an exponential backoff.
+     * When 0, the interfaces are used in their default order.
+     */
+    SYSTEM_FLAG_NETWORK_PROBING,
+
     SYSTEM_FLAG_MAX
 
 } system_flag_t;
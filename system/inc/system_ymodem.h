@@ -55,6 +55,12 @@ public:
 
     const uint32_t NAK_TIMEOUT = (5000);
 
+    /**
+     * Maximum number of bytes written to flash at once while the next packet is being received.
+     * Keeping the writes short ensures the receive buffer of the stream doesn't overflow.
+     */
+    const uint32_t WRITE_SLICE_SIZE = (128);
+
     enum protocol_msg_t
     {
         SOH = (0x01),   /* start of 128-byte data packet */
@@ -75,7 +81,8 @@ public:
         char file_size[FILE_SIZE_LENGTH];
     };
 
-    YModem(Stream& stream_) : stream(stream_)
+    YModem(Stream& stream_) : stream(stream_), packet_data(packet_buffers[0]), pending_data(packet_buffers[1]),
+        pending_size(0), pending_offset(0), write_error(0), transfer(nullptr)
     {
     }
 
@@ -94,7 +101,17 @@ public:
 
 
 private:
-    uint8_t packet_data[YModem::PACKET_1K_SIZE + YModem::PACKET_OVERHEAD];
+    /*
+     * A data packet is acknowledged as soon as it's received, and is written to flash while the
+     * sender is transmitting the next packet: one buffer receives the packet, while the other one
+     * holds the data that is still being written.
+     */
+    uint8_t packet_buffers[2][YModem::PACKET_1K_SIZE + YModem::PACKET_OVERHEAD];
+    uint8_t* packet_data;
+    uint8_t* pending_data;
+    uint32_t pending_size, pending_offset;
+    int write_error;
+    FileTransfer::Descriptor* transfer;
     int32_t session_done, file_done, packets_received, errors, session_begin;
 
     /**
@@ -113,6 +130,19 @@ private:
     int32_t handle_packet(uint8_t* packet_data, int32_t packet_length, FileTransfer::Descriptor& tx,
                           file_desc_t& desc);
     void parse_file_packet(FileTransfer::Descriptor& tx, file_desc_t& desc, uint8_t* packet_data);
+
+    /**
+     * @brief  Write the next slice of the pending packet data
+     * @retval true: Some data has been written
+     */
+    bool write_pending_slice();
+
+    /**
+     * @brief  Write all pending packet data
+     * @retval 0: Data written
+     *         Otherwise: Error code
+     */
+    int flush_pending();
 };
 
 #endif /* SYSTEM_YMODEM_H */
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "chunk_pipeline.h"
+
+#include "system_error.h"
+#include "check.h"
+
+#include <cstring>
+
+namespace particle {
+
+ChunkPipeline::ChunkPipeline() :
+        slots_(),
+        chunkSize_(0),
+        write_(nullptr),
+        ctx_(nullptr),
+        nextSeq_(0),
+        head_(0),
+        count_(0),
+        error_(0) {
+}
+
+int ChunkPipeline::init(size_t chunkSize, WriteCallback write, void* ctx) {
+    if (!buf_ || chunkSize_ != chunkSize) {
+        buf_.reset(new(std::nothrow) char[chunkSize * 2]);
+        CHECK_TRUE(buf_, SYSTEM_ERROR_NO_MEMORY);
+        chunkSize_ = chunkSize;
+    }
+    slots_[0] = { buf_.get(), 0 };
+    slots_[1] = { buf_.get() + chunkSize, 0 };
+    write_ = write;
+    ctx_ = ctx;
+    nextSeq_ = 0;
+    head_ = 0;
+    count_ = 0;
+    error_ = 0;
+    return 0;
+}
+
+int ChunkPipeline::receive(uint32_t seq, const char* data, size_t size) {
+    CHECK_TRUE(buf_, SYSTEM_ERROR_INVALID_STATE);
+    CHECK_TRUE(size > 0 && size <= chunkSize_, SYSTEM_ERROR_OUT_OF_RANGE);
+    CHECK(error_);
+    if (seq != nextSeq_) {
+        return 0; // Duplicate or out of order chunk
+    }
+    if (count_ == 2) {
+        CHECK(writeNext());
+    }
+    Slot& slot = slots_[(head_ + count_) % 2];
+    memcpy(slot.data, data, size);
+    slot.size = size;
+    ++count_;
+    ++nextSeq_;
+    return 0;
+}
+
+int ChunkPipeline::flush() {
+    while (count_ > 0) {
+        CHECK(writeNext());
+    }
+    return error_;
+}
+
+size_t ChunkPipeline::bufferedBytes() const {
+    size_t size = 0;
+    for (unsigned i = 0; i < count_; ++i) {
+        size += slots_[(head_ + i) % 2].size;
+    }
+    return size;
+}
+
+int ChunkPipeline::writeNext() {
+    CHECK(error_);
+    const Slot& slot = slots_[head_];
+    const int ret = write_(slot.data, slot.size, ctx_);
+    if (ret < 0) {
+        error_ = ret;
+        return ret;
+    }
+    head_ = (head_ + 1) % 2;
+    --count_;
+    return 0;
+}
+
+} // namespace particle
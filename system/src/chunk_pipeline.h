@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+namespace particle {
+
+/**
+ * Receives a stream of numbered chunks of data and writes them out in order.
+ *
+ * The chunks are buffered in a double buffer, so that a chunk can be acknowledged as soon as it's
+ * received, and written while the next one is being transferred. The acknowledgments are
+ * cumulative: `ack()` is the number of chunks received in order, which is the sequence number of
+ * the next expected chunk. A duplicate chunk, e.g. one that is retransmitted after its
+ * acknowledgment was lost, is ignored, as well as a chunk received ahead of the expected one. In
+ * both cases the sender learns what to send next from the acknowledgment.
+ */
+class ChunkPipeline {
+public:
+    // Writes a chunk of data. Returns 0 on success or a negative error code
+    typedef int(*WriteCallback)(const char* data, size_t size, void* ctx);
+
+    ChunkPipeline();
+
+    /**
+     * Allocates the buffers and resets the stream.
+     *
+     * @param chunkSize Maximum size of a chunk.
+     * @param write Callback writing the chunks.
+     * @param ctx Context data passed to the callback.
+     */
+    int init(size_t chunkSize, WriteCallback write, void* ctx);
+
+    /**
+     * Receives a chunk. If both buffers are occupied, the oldest chunk is written synchronously.
+     *
+     * @return 0 on success, or a negative error code. If writing of a chunk has failed, all
+     *         subsequent calls fail with the same error.
+     */
+    int receive(uint32_t seq, const char* data, size_t size);
+
+    /**
+     * Writes all buffered chunks.
+     */
+    int flush();
+
+    uint32_t ack() const {
+        return nextSeq_;
+    }
+
+    size_t bufferedBytes() const;
+
+    size_t chunkSize() const {
+        return chunkSize_;
+    }
+
+    int error() const {
+        return error_;
+    }
+
+private:
+    struct Slot {
+        char* data;
+        size_t size;
+    };
+
+    std::unique_ptr<char[]> buf_;
+    Slot slots_[2];
+    size_t chunkSize_;
+    WriteCallback write_;
+    void* ctx_;
+    uint32_t nextSeq_;
+    unsigned head_; // Index of the oldest buffered chunk
+    unsigned count_; // Number of buffered chunks
+    int error_;
+
+    int writeNext();
+};
+
+} // namespace particle
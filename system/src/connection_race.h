@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "system_error.h"
+#include "system_tick_hal.h"
+
+#include <cstdint>
+#include <cstddef>
+
+namespace particle {
+
+/**
+ * Connection attempts raced by `ConnectionRace`.
+ */
+class ConnectionRaceHandler {
+public:
+    virtual ~ConnectionRaceHandler() = default;
+
+    /**
+     * Starts the attempt with the given index.
+     *
+     * @return 0 on success or a negative result code if the attempt failed immediately.
+     */
+    virtual int startAttempt(size_t index) = 0;
+    /**
+     * Checks the status of a started attempt.
+     *
+     * @return 1 if the attempt succeeded, 0 if it's still in progress, or a negative result code
+     *         if it failed.
+     */
+    virtual int checkAttempt(size_t index) = 0;
+    /**
+     * Cancels an attempt that is still in progress.
+     */
+    virtual void cancelAttempt(size_t index) = 0;
+};
+
+/**
+ * Races connection attempts to several addresses of a server, as described in RFC 8305 (Happy
+ * Eyeballs).
+ *
+ * The attempts are started one by one in the order of their indices. The next attempt is started
+ * when the previous one fails, or when none of the attempts in progress has succeeded within the
+ * attempt delay. The first attempt that succeeds wins and the others are cancelled.
+ */
+class ConnectionRace {
+public:
+    static const system_tick_t DEFAULT_ATTEMPT_DELAY = 250; // Recommended by RFC 8305
+    static const system_tick_t DEFAULT_TIMEOUT = 3000;
+    static const size_t MAX_ATTEMPTS = 8;
+
+    explicit ConnectionRace(ConnectionRaceHandler* handler) :
+            handler_(handler),
+            count_(0),
+            next_(0),
+            startTime_(0),
+            lastAttemptTime_(0),
+            attemptDelay_(DEFAULT_ATTEMPT_DELAY),
+            timeout_(DEFAULT_TIMEOUT),
+            result_(SYSTEM_ERROR_INVALID_STATE) {
+    }
+
+    ~ConnectionRace() {
+        cancel();
+    }
+
+    /**
+     * Starts the race.
+     *
+     * @param count Number of attempts.
+     * @param now Current time.
+     * @param attemptDelay Delay between the starts of the attempts.
+     * @param timeout Maximum duration of the race.
+     */
+    int start(size_t count, system_tick_t now, system_tick_t attemptDelay = DEFAULT_ATTEMPT_DELAY,
+            system_tick_t timeout = DEFAULT_TIMEOUT) {
+        cancel();
+        if (!count || count > MAX_ATTEMPTS) {
+            return SYSTEM_ERROR_INVALID_ARGUMENT;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            state_[i] = NOT_STARTED;
+        }
+        count_ = count;
+        next_ = 0;
+        startTime_ = now;
+        lastAttemptTime_ = now;
+        attemptDelay_ = attemptDelay;
+        timeout_ = timeout;
+        result_ = SYSTEM_ERROR_WOULD_BLOCK;
+        startNextAttempt(now);
+        return 0;
+    }
+
+    /**
+     * Checks the attempts in progress and starts the next attempt if it's time to do so.
+     *
+     * @return Index of the attempt that succeeded, `SYSTEM_ERROR_WOULD_BLOCK` if the race is still
+     *         in progress, `SYSTEM_ERROR_NOT_FOUND` if all attempts failed or
+     *         `SYSTEM_ERROR_TIMEOUT` if none of the attempts succeeded in time.
+     */
+    int process(system_tick_t now) {
+        if (result_ != SYSTEM_ERROR_WOULD_BLOCK) {
+            return result_;
+        }
+        bool failed = false;
+        for (size_t i = 0; i < next_; ++i) {
+            if (state_[i] != IN_PROGRESS) {
+                continue;
+            }
+            const int r = handler_->checkAttempt(i);
+            if (r > 0) {
+                state_[i] = SUCCEEDED;
+                cancel();
+                result_ = i;
+                return result_;
+            }
+            if (r < 0) {
+                state_[i] = FAILED;
+                failed = true;
+            }
+        }
+        if (next_ < count_ && (failed || !inProgress() || now - lastAttemptTime_ >= attemptDelay_)) {
+            startNextAttempt(now);
+        }
+        if (!inProgress() && next_ == count_) {
+            result_ = SYSTEM_ERROR_NOT_FOUND;
+        } else if (now - startTime_ >= timeout_) {
+            cancel();
+            result_ = SYSTEM_ERROR_TIMEOUT;
+        }
+        return result_;
+    }
+
+    /**
+     * Cancels the attempts in progress.
+     */
+    void cancel() {
+        for (size_t i = 0; i < next_; ++i) {
+            if (state_[i] == IN_PROGRESS) {
+                handler_->cancelAttempt(i);
+                state_[i] = FAILED;
+            }
+        }
+        if (result_ == SYSTEM_ERROR_WOULD_BLOCK) {
+            result_ = SYSTEM_ERROR_CANCELLED;
+        }
+    }
+
+private:
+    enum State {
+        NOT_STARTED,
+        IN_PROGRESS,
+        SUCCEEDED,
+        FAILED
+    };
+
+    ConnectionRaceHandler* handler_;
+    State state_[MAX_ATTEMPTS];
+    size_t count_;
+    size_t next_; // Index of the next attempt
+    system_tick_t startTime_;
+    system_tick_t lastAttemptTime_;
+    system_tick_t attemptDelay_;
+    system_tick_t timeout_;
+    int result_;
+
+    // Starts the next attempt, skipping the attempts that fail immediately
+    void startNextAttempt(system_tick_t now) {
+        while (next_ < count_) {
+            const size_t i = next_++;
+            if (handler_->startAttempt(i) == 0) {
+                state_[i] = IN_PROGRESS;
+                lastAttemptTime_ = now;
+                break;
+            }
+            state_[i] = FAILED;
+        }
+    }
+
+    bool inProgress() const {
+        for (size_t i = 0; i < next_; ++i) {
+            if (state_[i] == IN_PROGRESS) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+} // namespace particle
@@ -42,6 +42,7 @@
 #endif // HAL_PLATFORM_COMPRESSED_BINARIES
 #include "scope_guard.h"
 #include "check.h"
+#include "chunk_pipeline.h"
 
 #include "platforms.h"
 
@@ -225,10 +226,23 @@ struct FirmwareUpdate {
 #endif // HAL_PLATFORM_COMPRESSED_BINARIES
     size_t bytesLeft; // Number of remaining bytes to receive
     size_t bytesWritten; // Number of bytes written to the OTA section
+    ChunkPipeline stream; // Buffered chunks received via CTRL_REQUEST_FIRMWARE_UPDATE_DATA_STREAM
 };
 
 std::unique_ptr<FirmwareUpdate> g_update;
 
+const size_t FIRMWARE_UPDATE_CHUNK_SIZE = 1024; // TODO: Determine depending on free RAM?
+
+// Header of the CTRL_REQUEST_FIRMWARE_UPDATE_DATA_STREAM request, followed by the chunk data
+struct __attribute__((packed)) StreamDataRequestHeader {
+    uint32_t seq; // Sequence number of the chunk, starting from 0 (little endian)
+};
+
+// Reply to the CTRL_REQUEST_FIRMWARE_UPDATE_DATA_STREAM request
+struct __attribute__((packed)) StreamDataReply {
+    uint32_t ack; // Number of chunks received in order, i.e. the sequence number of the next expected chunk
+};
+
 void cancelFirmwareUpdate() {
     if (!g_update) {
         return;
@@ -245,6 +259,67 @@ void firmwareUpdateCompletionHandler(int result, void* data) {
     system_pending_shutdown();
 }
 
+int saveFirmwareData(const char* data, size_t size) {
+#if HAL_PLATFORM_COMPRESSED_BINARIES
+    if (g_update->decomp) {
+        size_t srcOffs = 0;
+        for (;;) {
+            size_t srcBytes = size - srcOffs;
+            size_t destBytes = TINFL_LZ_DICT_SIZE - g_update->decompBufOffs;
+            const auto stat = tinfl_decompress(g_update->decomp.get(), (const mz_uint8*)data + srcOffs, &srcBytes,
+                    (mz_uint8*)g_update->decompBuf.get(), (mz_uint8*)g_update->decompBuf.get() + g_update->decompBufOffs,
+                    &destBytes, (g_update->bytesLeft > srcBytes) ? TINFL_FLAG_HAS_MORE_INPUT : 0);
+            if (stat < 0) {
+                return SYSTEM_ERROR_BAD_DATA;
+            }
+            srcOffs += srcBytes;
+            g_update->bytesLeft -= srcBytes;
+            if (destBytes > 0) {
+                g_update->descr.chunk_size = destBytes;
+                const int ret = Spark_Save_Firmware_Chunk(g_update->descr,
+                        (const uint8_t*)g_update->decompBuf.get() + g_update->decompBufOffs, nullptr);
+                if (ret != 0) {
+                    return ret;
+                }
+                g_update->decompBufOffs = (g_update->decompBufOffs + destBytes) % TINFL_LZ_DICT_SIZE;
+                g_update->descr.chunk_address += destBytes;
+                g_update->bytesWritten += destBytes;
+            }
+            if (stat != TINFL_STATUS_HAS_MORE_OUTPUT) {
+                break;
+            }
+        }
+    } else
+#endif // HAL_PLATFORM_COMPRESSED_BINARIES
+    {
+        g_update->descr.chunk_size = size;
+        const int ret = Spark_Save_Firmware_Chunk(g_update->descr, (const uint8_t*)data, nullptr);
+        if (ret != 0) {
+            return ret;
+        }
+        g_update->descr.chunk_address += size;
+        g_update->bytesLeft -= size;
+    }
+    return 0;
+}
+
+int writeStreamChunk(const char* data, size_t size, void* ctx) {
+    const int ret = saveFirmwareData(data, size);
+    return (ret > 0) ? SYSTEM_ERROR_UNKNOWN : ret;
+}
+
+// Writes the buffered chunks once the reply to a streamed chunk has been sent, so that the data
+// is written while the host is sending the next chunk
+void flushFirmwareUpdateStream(int result, void* data) {
+    if (!g_update) {
+        return;
+    }
+    const int ret = g_update->stream.flush();
+    if (ret != 0) {
+        LOG(ERROR, "Unable to write firmware data: %d", ret);
+    }
+}
+
 PB(FirmwareModuleType) moduleFunctionToPb(module_function_t func) {
     switch (func) {
     case MODULE_FUNCTION_BOOTLOADER:
@@ -290,7 +365,7 @@ int startFirmwareUpdateRequest(ctrl_request* req) {
         return SYSTEM_ERROR_NOT_SUPPORTED;
     }
     update->descr.store = FileTransfer::Store::FIRMWARE;
-    update->descr.chunk_size = 1024; // TODO: Determine depending on free RAM?
+    update->descr.chunk_size = FIRMWARE_UPDATE_CHUNK_SIZE;
     update->descr.chunk_address = 0;
     update->descr.file_address = 0;
     int ret = Spark_Prepare_For_Firmware_Update(update->descr, 0, nullptr);
@@ -318,7 +393,15 @@ void finishFirmwareUpdateRequest(ctrl_request* req) {
     if (ret != 0) {
         goto done;
     }
-    if (!g_update || g_update->bytesLeft > 0) {
+    if (!g_update) {
+        ret = SYSTEM_ERROR_INVALID_STATE;
+        goto done;
+    }
+    ret = g_update->stream.flush();
+    if (ret != 0) {
+        goto done;
+    }
+    if (g_update->bytesLeft > 0) {
         ret = SYSTEM_ERROR_INVALID_STATE;
         goto done;
     }
@@ -356,53 +439,43 @@ int firmwareUpdateDataRequest(ctrl_request* req) {
     if (!g_update) {
         return SYSTEM_ERROR_INVALID_STATE;
     }
+    CHECK(g_update->stream.flush());
     if (pbData.size == 0 || pbData.size > g_update->bytesLeft) {
         return SYSTEM_ERROR_OUT_OF_RANGE;
     }
+    CHECK(saveFirmwareData(pbData.data, pbData.size));
+    guard.dismiss();
+    return 0;
+}
 
-#if HAL_PLATFORM_COMPRESSED_BINARIES
-    if (g_update->decomp) {
-        size_t srcOffs = 0;
-        for (;;) {
-            size_t srcBytes = pbData.size - srcOffs;
-            size_t destBytes = TINFL_LZ_DICT_SIZE - g_update->decompBufOffs;
-            const auto stat = tinfl_decompress(g_update->decomp.get(), (const mz_uint8*)pbData.data + srcOffs, &srcBytes,
-                    (mz_uint8*)g_update->decompBuf.get(), (mz_uint8*)g_update->decompBuf.get() + g_update->decompBufOffs,
-                    &destBytes, (g_update->bytesLeft > srcBytes) ? TINFL_FLAG_HAS_MORE_INPUT : 0);
-            if (stat < 0) {
-                return SYSTEM_ERROR_BAD_DATA;
-            }
-            srcOffs += srcBytes;
-            g_update->bytesLeft -= srcBytes;
-            if (destBytes > 0) {
-                g_update->descr.chunk_size = destBytes;
-                const int ret = Spark_Save_Firmware_Chunk(g_update->descr,
-                        (const uint8_t*)g_update->decompBuf.get() + g_update->decompBufOffs, nullptr);
-                if (ret != 0) {
-                    return ret;
-                }
-                g_update->decompBufOffs = (g_update->decompBufOffs + destBytes) % TINFL_LZ_DICT_SIZE;
-                g_update->descr.chunk_address += destBytes;
-                g_update->bytesWritten += destBytes;
-            }
-            if (stat != TINFL_STATUS_HAS_MORE_OUTPUT) {
-                break;
-            }
+void firmwareUpdateStreamDataRequest(ctrl_request* req) {
+    const int ret = [req]() {
+        NAMED_SCOPE_GUARD(guard, {
+            cancelFirmwareUpdate();
+        });
+        CHECK_TRUE(g_update, SYSTEM_ERROR_INVALID_STATE);
+        StreamDataRequestHeader header = {};
+        CHECK_TRUE(req->request_size > sizeof(header), SYSTEM_ERROR_INVALID_ARGUMENT);
+        memcpy(&header, req->request_data, sizeof(header));
+        const char* const data = req->request_data + sizeof(header);
+        const size_t size = req->request_size - sizeof(header);
+        auto& stream = g_update->stream;
+        if (!stream.chunkSize()) {
+            // The buffers are allocated on the first streamed chunk
+            CHECK(stream.init(FIRMWARE_UPDATE_CHUNK_SIZE, writeStreamChunk, nullptr));
         }
-    } else
-#endif // HAL_PLATFORM_COMPRESSED_BINARIES
-    {
-        g_update->descr.chunk_size = pbData.size;
-        const int ret = Spark_Save_Firmware_Chunk(g_update->descr, (const uint8_t*)pbData.data, nullptr);
-        if (ret != 0) {
-            return ret;
+        if (header.seq == stream.ack()) {
+            CHECK_TRUE(size <= g_update->bytesLeft - stream.bufferedBytes(), SYSTEM_ERROR_OUT_OF_RANGE);
         }
-        g_update->descr.chunk_address += pbData.size;
-        g_update->bytesLeft -= pbData.size;
-    }
-
-    guard.dismiss();
-    return 0;
+        CHECK(stream.receive(header.seq, data, size));
+        CHECK(system_ctrl_alloc_reply_data(req, sizeof(StreamDataReply), nullptr));
+        StreamDataReply reply = {};
+        reply.ack = stream.ack();
+        memcpy(req->reply_data, &reply, sizeof(reply));
+        guard.dismiss();
+        return 0;
+    }();
+    system_ctrl_set_result(req, ret, (ret == 0) ? flushFirmwareUpdateStream : nullptr, nullptr, nullptr);
 }
 
 #if !HAL_PLATFORM_MESH
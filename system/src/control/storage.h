@@ -27,6 +27,7 @@ int startFirmwareUpdateRequest(ctrl_request* req);
 void finishFirmwareUpdateRequest(ctrl_request* req);
 int cancelFirmwareUpdateRequest(ctrl_request* req);
 int firmwareUpdateDataRequest(ctrl_request* req);
+void firmwareUpdateStreamDataRequest(ctrl_request* req);
 
 int describeStorageRequest(ctrl_request* req);
 int readSectionDataRequest(ctrl_request* req);
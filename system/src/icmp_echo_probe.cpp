@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "icmp_echo_probe.h"
+
+#if HAL_USE_SOCKET_HAL_POSIX
+
+#include "ifapi.h"
+#include "timer_hal.h"
+#include "system_error.h"
+
+#include <cstring>
+
+namespace particle {
+
+namespace {
+
+const uint16_t ICMP_ECHO_ID = 0x5043;
+
+const uint8_t ICMP_ECHO_REQUEST = 8;
+const uint8_t ICMP_ECHO_REPLY = 0;
+const uint8_t ICMP6_ECHO_REQUEST = 128;
+const uint8_t ICMP6_ECHO_REPLY = 129;
+
+const size_t IP6_HEADER_SIZE = 40;
+
+struct IcmpEchoHeader {
+    uint8_t type;
+    uint8_t code;
+    uint16_t checksum;
+    uint16_t id;
+    uint16_t seq;
+};
+
+struct IcmpEchoRequest {
+    IcmpEchoHeader hdr;
+    uint32_t data;
+};
+
+uint16_t icmpChecksum(const uint8_t* data, size_t size) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i + 1 < size; i += 2) {
+        sum += ((uint32_t)data[i] << 8) | data[i + 1];
+    }
+    if (size & 1) {
+        sum += (uint32_t)data[size - 1] << 8;
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return htons(~sum & 0xffff);
+}
+
+} // unnamed
+
+uint16_t IcmpEchoProbe::lastSeq_ = 0;
+
+IcmpEchoProbe::IcmpEchoProbe() :
+        sock_(-1),
+        family_(AF_UNSPEC),
+        seq_(0),
+        sent_(0) {
+}
+
+IcmpEchoProbe::~IcmpEchoProbe() {
+    close();
+}
+
+int IcmpEchoProbe::send(const sockaddr* addr, uint8_t ifindex) {
+    close();
+    sockaddr_storage dest = {};
+    if (addr->sa_family == AF_INET) {
+        memcpy(&dest, addr, sizeof(sockaddr_in));
+        ((sockaddr_in*)&dest)->sin_port = 0;
+        dest.s2_len = sizeof(sockaddr_in);
+    } else if (addr->sa_family == AF_INET6) {
+        memcpy(&dest, addr, sizeof(sockaddr_in6));
+        ((sockaddr_in6*)&dest)->sin6_port = 0;
+        dest.s2_len = sizeof(sockaddr_in6);
+    } else {
+        return SYSTEM_ERROR_NOT_SUPPORTED;
+    }
+    family_ = addr->sa_family;
+    sock_ = sock_socket(family_, SOCK_RAW, (family_ == AF_INET) ? IPPROTO_ICMP : IPPROTO_ICMPV6);
+    if (sock_ < 0) {
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    if (ifindex) {
+        struct ifreq ifr = {};
+        if (if_index_to_name(ifindex, ifr.ifr_name) ||
+                sock_setsockopt(sock_, SOL_SOCKET, SO_BINDTODEVICE, &ifr, sizeof(ifr))) {
+            close();
+            return SYSTEM_ERROR_NOT_FOUND;
+        }
+    }
+    seq_ = ++lastSeq_;
+    IcmpEchoRequest req = {};
+    req.hdr.type = (family_ == AF_INET) ? ICMP_ECHO_REQUEST : ICMP6_ECHO_REQUEST;
+    req.hdr.id = htons(ICMP_ECHO_ID);
+    req.hdr.seq = htons(seq_);
+    req.data = seq_;
+    if (family_ == AF_INET) {
+        /* The stack computes the checksum of ICMPv6 messages, as it covers the IPv6 pseudo-header */
+        req.hdr.checksum = icmpChecksum((const uint8_t*)&req, sizeof(req));
+    }
+    sent_ = HAL_Timer_Get_Milli_Seconds();
+    if (sock_sendto(sock_, &req, sizeof(req), 0, (const sockaddr*)&dest, dest.s2_len) < 0) {
+        close();
+        return SYSTEM_ERROR_NETWORK;
+    }
+    return 0;
+}
+
+int IcmpEchoProbe::receive() {
+    if (sock_ < 0) {
+        return SYSTEM_ERROR_INVALID_STATE;
+    }
+    uint8_t buf[64];
+    ssize_t n = 0;
+    while ((n = sock_recvfrom(sock_, buf, sizeof(buf), MSG_DONTWAIT, nullptr, nullptr)) > 0) {
+        /* Raw IPv4 sockets receive the IP header as well. Skip the IPv6 header too, if it's there */
+        size_t offs = 0;
+        if (family_ == AF_INET) {
+            offs = (buf[0] & 0x0f) * 4;
+        } else if ((buf[0] >> 4) == 6) {
+            offs = IP6_HEADER_SIZE;
+        }
+        if ((size_t)n < offs + sizeof(IcmpEchoHeader)) {
+            continue;
+        }
+        IcmpEchoHeader hdr = {};
+        memcpy(&hdr, buf + offs, sizeof(hdr));
+        const uint8_t type = (family_ == AF_INET) ? ICMP_ECHO_REPLY : ICMP6_ECHO_REPLY;
+        if (hdr.type == type && ntohs(hdr.id) == ICMP_ECHO_ID && ntohs(hdr.seq) == seq_) {
+            close();
+            return 1;
+        }
+    }
+    if (n < 0 && errno != EWOULDBLOCK && errno != EAGAIN) {
+        close();
+        return SYSTEM_ERROR_NETWORK;
+    }
+    return 0;
+}
+
+void IcmpEchoProbe::close() {
+    if (sock_ >= 0) {
+        sock_close(sock_);
+        sock_ = -1;
+    }
+}
+
+} // namespace particle
+
+#endif // HAL_USE_SOCKET_HAL_POSIX
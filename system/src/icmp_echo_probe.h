@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "hal_platform.h"
+
+#if HAL_USE_SOCKET_HAL_POSIX
+
+#include "socket_hal.h"
+#include "system_tick_hal.h"
+
+namespace particle {
+
+/**
+ * Non-blocking ICMP or ICMPv6 echo request.
+ */
+class IcmpEchoProbe {
+public:
+    IcmpEchoProbe();
+    ~IcmpEchoProbe();
+
+    /**
+     * Sends an echo request.
+     *
+     * @param addr Destination address. The port number is ignored.
+     * @param ifindex Index of the interface the request should be sent via, or 0 to use the
+     *        routing table.
+     */
+    int send(const sockaddr* addr, uint8_t ifindex = 0);
+    /**
+     * Checks if the echo reply has been received.
+     *
+     * @return 1 if the reply has been received, 0 if the request is still pending, or a negative
+     *         result code in case of an error.
+     */
+    int receive();
+    void close();
+
+    bool isPending() const {
+        return sock_ >= 0;
+    }
+
+    system_tick_t sentTime() const {
+        return sent_;
+    }
+
+private:
+    int sock_;
+    int family_;
+    uint16_t seq_;
+    system_tick_t sent_;
+
+    static uint16_t lastSeq_;
+};
+
+} // namespace particle
+
+#endif // HAL_USE_SOCKET_HAL_POSIX
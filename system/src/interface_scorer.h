@@ -0,0 +1,298 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "system_error.h"
+
+#include <cstdint>
+#include <cstddef>
+
+namespace particle {
+
+/**
+ * Selects the network interface that should carry the cloud connection.
+ *
+ * Every interface is scored by the smoothed round-trip time and the loss rate of the probes sent
+ * to the cloud endpoint via that interface, plus a penalty depending on the priority of the
+ * interface, so that Ethernet is preferred over Wi-Fi and cellular when the paths are similar.
+ * Lower scores are better.
+ *
+ * An interface that goes down or stops answering the probes is replaced immediately. Otherwise
+ * the preferred interface only changes after another interface has been better by a margin for
+ * several consecutive evaluations, which keeps the connection from flapping between interfaces
+ * with similar scores and makes the fail-back to a recovered interface gradual.
+ */
+class InterfaceScorer {
+public:
+    struct Config {
+        unsigned switchMargin; // Score improvement required to switch, in percent of the current score
+        unsigned minSwitchGain; // Minimum score improvement required to switch
+        unsigned switchEvaluations; // Number of consecutive evaluations required to switch
+        unsigned maxFailures; // Number of consecutive failed probes after which an interface is unusable
+        unsigned lossPenalty; // Score penalty for a 100% loss rate
+        unsigned priorityPenalty; // Score penalty for each priority level
+    };
+
+    struct Stats {
+        unsigned rtt; // Smoothed round-trip time in milliseconds
+        unsigned loss; // Loss rate in percent
+        unsigned score;
+        uint32_t probes; // Number of probes
+        uint32_t failures; // Number of failed probes
+    };
+
+    static const size_t MAX_INTERFACES = 4;
+    static const int NO_INTERFACE = -1;
+
+    InterfaceScorer() :
+            conf_(defaultConfig()),
+            count_(0),
+            preferred_(NO_INTERFACE),
+            candidate_(NO_INTERFACE),
+            candidateCount_(0) {
+    }
+
+    void config(const Config& conf) {
+        conf_ = conf;
+    }
+
+    const Config& config() const {
+        return conf_;
+    }
+
+    static Config defaultConfig() {
+        Config c = {};
+        c.switchMargin = 25;
+        c.minSwitchGain = 50;
+        c.switchEvaluations = 3;
+        c.maxFailures = 3;
+        c.lossPenalty = 2000;
+        c.priorityPenalty = 20;
+        return c;
+    }
+
+    /**
+     * Registers an interface.
+     *
+     * @param id Interface ID, such as the interface index.
+     * @param priority Priority of the interface. Lower values are preferred.
+     */
+    int addInterface(unsigned id, unsigned priority) {
+        if (find(id)) {
+            return SYSTEM_ERROR_ALREADY_EXISTS;
+        }
+        if (count_ == MAX_INTERFACES) {
+            return SYSTEM_ERROR_LIMIT_EXCEEDED;
+        }
+        Interface& iface = ifaces_[count_++];
+        iface = Interface();
+        iface.id = id;
+        iface.priority = priority;
+        return 0;
+    }
+
+    /**
+     * Marks an interface as available or unavailable, e.g. when its link goes up or down. The
+     * measurements are reset when the availability changes.
+     */
+    int setAvailable(unsigned id, bool available) {
+        Interface* iface = find(id);
+        if (!iface) {
+            return SYSTEM_ERROR_NOT_FOUND;
+        }
+        if (iface->available != available) {
+            const unsigned prio = iface->priority;
+            *iface = Interface();
+            iface->id = id;
+            iface->priority = prio;
+            iface->available = available;
+        }
+        return 0;
+    }
+
+    /**
+     * Records a successful probe.
+     */
+    int addSample(unsigned id, unsigned rtt) {
+        Interface* iface = find(id);
+        if (!iface) {
+            return SYSTEM_ERROR_NOT_FOUND;
+        }
+        if (!iface->samples) {
+            iface->srtt = rtt << RTT_SHIFT;
+        } else {
+            // srtt = 7/8 * srtt + 1/8 * rtt
+            iface->srtt += rtt - (iface->srtt >> RTT_SHIFT);
+        }
+        if (iface->samples < 0xffff) {
+            ++iface->samples;
+        }
+        iface->loss -= iface->loss >> LOSS_SHIFT;
+        iface->failures = 0;
+        ++iface->probes;
+        return 0;
+    }
+
+    /**
+     * Records a probe that timed out or couldn't be sent.
+     */
+    int addFailure(unsigned id) {
+        Interface* iface = find(id);
+        if (!iface) {
+            return SYSTEM_ERROR_NOT_FOUND;
+        }
+        // loss = 3/4 * loss + 1/4 * 100%
+        iface->loss += (MAX_LOSS >> LOSS_SHIFT) - (iface->loss >> LOSS_SHIFT);
+        if (iface->failures < 0xffff) {
+            ++iface->failures;
+        }
+        ++iface->probes;
+        ++iface->totalFailures;
+        return 0;
+    }
+
+    /**
+     * Re-evaluates the preferred interface.
+     *
+     * @return ID of the preferred interface or `NO_INTERFACE` if none of the interfaces is usable.
+     */
+    int evaluate() {
+        const Interface* best = nullptr;
+        for (size_t i = 0; i < count_; ++i) {
+            const Interface& iface = ifaces_[i];
+            if (!usable(iface)) {
+                continue;
+            }
+            if (!best || score(iface) < score(*best) ||
+                    (score(iface) == score(*best) && iface.priority < best->priority)) {
+                best = &iface;
+            }
+        }
+        const Interface* cur = (preferred_ != NO_INTERFACE) ? find(preferred_) : nullptr;
+        if (!cur || !usable(*cur)) {
+            // Fail over immediately
+            preferred_ = best ? (int)best->id : NO_INTERFACE;
+            resetCandidate();
+            return preferred_;
+        }
+        if (!best || best == cur) {
+            resetCandidate();
+            return preferred_;
+        }
+        const unsigned curScore = score(*cur);
+        unsigned gain = (unsigned)((uint64_t)curScore * conf_.switchMargin / 100);
+        if (gain < conf_.minSwitchGain) {
+            gain = conf_.minSwitchGain;
+        }
+        if (score(*best) + gain > curScore) {
+            resetCandidate();
+            return preferred_;
+        }
+        if (candidate_ != (int)best->id) {
+            candidate_ = best->id;
+            candidateCount_ = 0;
+        }
+        if (++candidateCount_ >= conf_.switchEvaluations) {
+            preferred_ = best->id;
+            resetCandidate();
+        }
+        return preferred_;
+    }
+
+    /**
+     * Returns the ID of the preferred interface or `NO_INTERFACE`.
+     */
+    int preferred() const {
+        return preferred_;
+    }
+
+    int stats(unsigned id, Stats* stats) const {
+        const Interface* iface = find(id);
+        if (!iface) {
+            return SYSTEM_ERROR_NOT_FOUND;
+        }
+        stats->rtt = iface->srtt >> RTT_SHIFT;
+        stats->loss = iface->loss * 100 / MAX_LOSS;
+        stats->score = score(*iface);
+        stats->probes = iface->probes;
+        stats->failures = iface->totalFailures;
+        return 0;
+    }
+
+    /**
+     * Unregisters all interfaces.
+     */
+    void reset() {
+        count_ = 0;
+        preferred_ = NO_INTERFACE;
+        resetCandidate();
+    }
+
+private:
+    static const unsigned RTT_SHIFT = 3; // Gain of 1/8
+    static const unsigned LOSS_SHIFT = 2; // Gain of 1/4
+    static const unsigned MAX_LOSS = 0x10000; // 100% loss
+
+    struct Interface {
+        uint32_t probes;
+        uint32_t totalFailures;
+        unsigned srtt; // Smoothed RTT scaled by 2^RTT_SHIFT
+        unsigned loss; // Smoothed loss rate scaled by MAX_LOSS
+        unsigned id;
+        unsigned priority;
+        uint16_t samples; // Number of successful probes
+        uint16_t failures; // Number of consecutive failed probes
+        bool available;
+    };
+
+    Interface ifaces_[MAX_INTERFACES];
+    Config conf_;
+    size_t count_;
+    int preferred_;
+    int candidate_;
+    unsigned candidateCount_;
+
+    bool usable(const Interface& iface) const {
+        return iface.available && iface.samples > 0 && iface.failures < conf_.maxFailures;
+    }
+
+    unsigned score(const Interface& iface) const {
+        return (iface.srtt >> RTT_SHIFT) + (unsigned)((uint64_t)iface.loss * conf_.lossPenalty / MAX_LOSS) +
+                iface.priority * conf_.priorityPenalty;
+    }
+
+    void resetCandidate() {
+        candidate_ = NO_INTERFACE;
+        candidateCount_ = 0;
+    }
+
+    Interface* find(unsigned id) {
+        for (size_t i = 0; i < count_; ++i) {
+            if (ifaces_[i].id == id) {
+                return &ifaces_[i];
+            }
+        }
+        return nullptr;
+    }
+
+    const Interface* find(unsigned id) const {
+        return const_cast<InterfaceScorer*>(this)->find(id);
+    }
+};
+
+} // namespace particle
@@ -53,6 +53,7 @@
 #include "rgbled.h"
 #include "led_service.h"
 #include "diagnostics.h"
+#include "alloc_tracker.h"
 #include "check.h"
 #include "spark_wiring_interrupts.h"
 #include "spark_wiring_cellular.h"
@@ -75,6 +76,11 @@
 #include "ifapi.h"
 #endif /* HAL_PLATFORM_LWIP */
 
+#if HAL_USE_SOCKET_HAL_POSIX
+#include "socket_hal.h"
+#include "netdb_hal.h"
+#endif /* HAL_USE_SOCKET_HAL_POSIX */
+
 #if HAL_PLATFORM_IFAPI
 #include "system_listening_mode.h"
 #endif /* HAL_PLATFORM_IFAPI */
@@ -694,6 +700,123 @@ RunTimeInfoDiagnosticData g_usedRamDiagData(DIAG_ID_SYSTEM_USED_RAM, DIAG_NAME_S
     }
 );
 
+#if ALLOC_TRACKER_ENABLED
+
+class FailedAllocationsDiagnosticData: public AbstractIntegerDiagnosticData {
+public:
+    FailedAllocationsDiagnosticData() :
+            AbstractIntegerDiagnosticData(DIAG_ID_SYSTEM_FAILED_ALLOCATIONS, DIAG_NAME_SYSTEM_FAILED_ALLOCATIONS) {
+    }
+
+    virtual int get(IntType& val) override {
+        val = 0;
+        for (int i = 0; i < ALLOC_TRACKER_SOURCE_COUNT; ++i) {
+            alloc_tracker_stats stats = {};
+            CHECK(alloc_tracker_get_stats(i, &stats));
+            val += stats.failed_count;
+        }
+        return 0;
+    }
+};
+
+RunTimeInfoDiagnosticData g_largestFreeBlockDiagData(DIAG_ID_SYSTEM_LARGEST_FREE_BLOCK, DIAG_NAME_SYSTEM_LARGEST_FREE_BLOCK,
+    [](const runtime_info_t& info) -> RunTimeInfoDiagnosticData::IntType {
+        return info.largest_free_block_heap;
+    }
+);
+
+// Heap fragmentation in percents: 0 means that all free memory is available as a single block
+RunTimeInfoDiagnosticData g_heapFragmentationDiagData(DIAG_ID_SYSTEM_HEAP_FRAGMENTATION, DIAG_NAME_SYSTEM_HEAP_FRAGMENTATION,
+    [](const runtime_info_t& info) -> RunTimeInfoDiagnosticData::IntType {
+        if (info.freeheap == 0 || info.largest_free_block_heap >= info.freeheap) {
+            return 0;
+        }
+        return 100 - (uint64_t)info.largest_free_block_heap * 100 / info.freeheap;
+    }
+);
+
+FailedAllocationsDiagnosticData g_failedAllocDiagData;
+
+#endif // ALLOC_TRACKER_ENABLED
+
+#if HAL_USE_SOCKET_HAL_POSIX
+
+// Integer diagnostic source computed from a statistics structure reported by a HAL module
+template<typename StatsT, int (*getStats)(StatsT*)>
+class StatsDiagnosticData: public AbstractIntegerDiagnosticData {
+public:
+    typedef IntType (*func_t)(const StatsT&);
+
+    StatsDiagnosticData(uint16_t id, const char* name, func_t f) :
+            AbstractIntegerDiagnosticData(id, name),
+            f_(f) {
+    }
+
+    virtual int get(IntType& val) override {
+        StatsT stats = {};
+        stats.size = sizeof(stats);
+        CHECK(getStats(&stats));
+        val = f_(stats);
+        return 0;
+    }
+
+private:
+    func_t f_;
+};
+
+int getSocketStats(sock_stats* stats) {
+    return sock_get_netif_stats(0 /* All interfaces */, stats, nullptr);
+}
+
+int getDnsCacheStats(netdb_cache_stats* stats) {
+    return netdb_get_cache_stats(stats, nullptr);
+}
+
+// Statistics of all sockets, including the closed ones
+typedef StatsDiagnosticData<sock_stats, getSocketStats> SocketStatsDiagnosticData;
+
+// Statistics of the cache of resolved host addresses
+typedef StatsDiagnosticData<netdb_cache_stats, getDnsCacheStats> DnsCacheDiagnosticData;
+
+SocketStatsDiagnosticData g_socketTxBytesDiagData(DIAG_ID_NETWORK_SOCKET_TX_BYTES, DIAG_NAME_NETWORK_SOCKET_TX_BYTES,
+    [](const sock_stats& stats) -> SocketStatsDiagnosticData::IntType {
+        return stats.tx_bytes;
+    }
+);
+
+SocketStatsDiagnosticData g_socketRxBytesDiagData(DIAG_ID_NETWORK_SOCKET_RX_BYTES, DIAG_NAME_NETWORK_SOCKET_RX_BYTES,
+    [](const sock_stats& stats) -> SocketStatsDiagnosticData::IntType {
+        return stats.rx_bytes;
+    }
+);
+
+SocketStatsDiagnosticData g_socketTxStallsDiagData(DIAG_ID_NETWORK_SOCKET_TX_STALLS, DIAG_NAME_NETWORK_SOCKET_TX_STALLS,
+    [](const sock_stats& stats) -> SocketStatsDiagnosticData::IntType {
+        return stats.tx_stalls;
+    }
+);
+
+SocketStatsDiagnosticData g_socketTxTimeDiagData(DIAG_ID_NETWORK_SOCKET_TX_TIME, DIAG_NAME_NETWORK_SOCKET_TX_TIME,
+    [](const sock_stats& stats) -> SocketStatsDiagnosticData::IntType {
+        return stats.tx_time;
+    }
+);
+
+// Lookups that didn't have to wait for a DNS query
+DnsCacheDiagnosticData g_dnsCacheHitsDiagData(DIAG_ID_NETWORK_DNS_CACHE_HITS, DIAG_NAME_NETWORK_DNS_CACHE_HITS,
+    [](const netdb_cache_stats& stats) -> DnsCacheDiagnosticData::IntType {
+        return stats.hits + stats.stale_hits;
+    }
+);
+
+DnsCacheDiagnosticData g_dnsCacheMissesDiagData(DIAG_ID_NETWORK_DNS_CACHE_MISSES, DIAG_NAME_NETWORK_DNS_CACHE_MISSES,
+    [](const netdb_cache_stats& stats) -> DnsCacheDiagnosticData::IntType {
+        return stats.misses;
+    }
+);
+
+#endif // HAL_USE_SOCKET_HAL_POSIX
+
 } // namespace
 
 /*******************************************************************************
@@ -42,6 +42,9 @@ int system_internet_test(void* reserved);
 int system_multicast_announce_presence(void* reserved);
 int system_cloud_set_inet_family_keepalive(int af, unsigned int value, int flags);
 int system_cloud_get_inet_family_keepalive(int af, unsigned int* value);
+#if HAL_USE_SOCKET_HAL_POSIX
+int system_cloud_get_server_address(struct sockaddr* addr, socklen_t* addrlen);
+#endif /* HAL_USE_SOCKET_HAL_POSIX */
 
 #ifdef __cplusplus
 }
@@ -27,6 +27,10 @@
 #include "spark_wiring_ticks.h"
 #include <arpa/inet.h>
 #include "spark_wiring_cloud.h"
+#include "connection_race.h"
+#include "icmp_echo_probe.h"
+#include "timer_hal.h"
+#include "delay_hal.h"
 
 namespace {
 
@@ -47,6 +51,88 @@ SystemCloudState s_state;
 
 const unsigned CLOUD_SOCKET_HALF_CLOSED_WAIT_TIMEOUT = 5000;
 
+const unsigned CLOUD_ADDRESS_RACE_POLL_INTERVAL = 10;
+/* The race delays every connection to a freshly resolved server, so it is kept short. If none
+ * of the addresses responds in time, they are tried in the order returned by the resolver */
+const system_tick_t CLOUD_ADDRESS_RACE_ATTEMPT_DELAY = 100;
+const system_tick_t CLOUD_ADDRESS_RACE_TIMEOUT = 500;
+
+/* Checks the reachability of the server addresses with echo requests */
+class IcmpEchoRaceHandler: public particle::ConnectionRaceHandler {
+public:
+    IcmpEchoRaceHandler(struct addrinfo* const* addrs) :
+            addrs_(addrs) {
+    }
+
+    int startAttempt(size_t index) override {
+        return probes_[index].send(addrs_[index]->ai_addr);
+    }
+
+    int checkAttempt(size_t index) override {
+        return probes_[index].receive();
+    }
+
+    void cancelAttempt(size_t index) override {
+        probes_[index].close();
+    }
+
+private:
+    struct addrinfo* const* addrs_;
+    particle::IcmpEchoProbe probes_[particle::ConnectionRace::MAX_ATTEMPTS];
+};
+
+/* Races the first address of each address family and moves the address that is reachable
+ * the fastest to the head of the list. Addresses of the same family usually share the path
+ * to the server, so only a broken family, such as IPv6 behind a broken NAT64, is detected.
+ * The order of the list is not changed if none of the addresses respond in time, e.g.
+ * because ICMP is filtered
+ */
+struct addrinfo* raceServerAddresses(struct addrinfo* info) {
+    struct addrinfo* addrs[particle::ConnectionRace::MAX_ATTEMPTS] = {};
+    size_t count = 0;
+    for (struct addrinfo* a = info; a != nullptr && count < particle::ConnectionRace::MAX_ATTEMPTS; a = a->ai_next) {
+        bool haveFamily = false;
+        for (size_t i = 0; i < count; ++i) {
+            if (addrs[i]->ai_family == a->ai_family) {
+                haveFamily = true;
+                break;
+            }
+        }
+        if (!haveFamily) {
+            addrs[count++] = a;
+        }
+    }
+    if (count < 2) {
+        return info;
+    }
+
+    IcmpEchoRaceHandler handler(addrs);
+    particle::ConnectionRace race(&handler);
+    const system_tick_t start = HAL_Timer_Get_Milli_Seconds();
+    if (race.start(count, start, CLOUD_ADDRESS_RACE_ATTEMPT_DELAY, CLOUD_ADDRESS_RACE_TIMEOUT) < 0) {
+        return info;
+    }
+    int r = 0;
+    while ((r = race.process(HAL_Timer_Get_Milli_Seconds())) == SYSTEM_ERROR_WOULD_BLOCK) {
+        HAL_Delay_Milliseconds(CLOUD_ADDRESS_RACE_POLL_INTERVAL);
+    }
+    if (r < 0) {
+        LOG(TRACE, "None of the server addresses responded (%d), trying them in order", r);
+        return info;
+    }
+    LOG(TRACE, "Server address #%d responded first, %u ms", r, (unsigned)(HAL_Timer_Get_Milli_Seconds() - start));
+    if (r > 0) {
+        struct addrinfo* prev = info;
+        while (prev->ai_next != addrs[r]) {
+            prev = prev->ai_next;
+        }
+        prev->ai_next = addrs[r]->ai_next;
+        addrs[r]->ai_next = info;
+        info = addrs[r];
+    }
+    return info;
+}
+
 } /* anonymous */
 
 int system_cloud_connect(int protocol, const ServerAddress* address, sockaddr* saddrCache)
@@ -132,6 +218,12 @@ int system_cloud_connect(int protocol, const ServerAddress* address, sockaddr* s
 
     if (info == nullptr) {
         LOG(ERROR, "Failed to determine server address");
+    } else if (type == CLOUD_SERVER_ADDRESS_TYPE_NEW_ADDRINFO) {
+        /* Don't wait for the connection to time out on an address that is unreachable, such as
+         * an IPv6 address on a network with a broken NAT64. The address that wins is cached
+         * with the session and used directly on subsequent reconnects
+         */
+        info = raceServerAddresses(info);
     }
 
     LOG(TRACE, "Address type: %d", type);
@@ -327,4 +419,16 @@ int system_cloud_is_connected(void* reserved)
     return s_state.socket >= 0 ? 0 : -1;
 }
 
+int system_cloud_get_server_address(struct sockaddr* addr, socklen_t* addrlen)
+{
+    const int s = s_state.socket;
+    if (s < 0) {
+        return SYSTEM_ERROR_INVALID_STATE;
+    }
+    if (sock_getpeername(s, addr, addrlen)) {
+        return SYSTEM_ERROR_NOT_FOUND;
+    }
+    return 0;
+}
+
 #endif /* HAL_USE_SOCKET_HAL_POSIX */
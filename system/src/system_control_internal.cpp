@@ -28,6 +28,15 @@
 #include "debug.h"
 #include "delay_hal.h"
 #include "hal_platform.h"
+#include "core_hal.h"
+#include "system_task.h"
+#include "alloc_tracker.h"
+#include "check.h"
+
+#if HAL_USE_SOCKET_HAL_POSIX && HAL_PLATFORM_IFAPI
+#include "socket_hal.h"
+#include "ifapi.h"
+#endif
 
 #include "control/network.h"
 #include "control/wifi.h"
@@ -38,6 +47,8 @@
 #include "control/mesh.h"
 #include "control/cloud.h"
 
+#include <memory>
+
 namespace particle {
 
 namespace system {
@@ -76,6 +87,96 @@ int formatReplyData(ctrl_request* req, ReplyFormatterCallback callback, void* da
     }
 }
 
+#if ALLOC_TRACKER_ENABLED
+
+// Formats the reply data for the CTRL_REQUEST_ALLOCATION_INFO request. All fields are 32-bit
+// little-endian integers:
+//
+// - Free heap memory, largest free heap block
+// - Free memory in the system pool, largest free block in the system pool
+// - Per-source statistics (see the alloc_tracker_stats structure), ALLOC_TRACKER_SOURCE_COUNT entries
+// - Number of allocations that were not attributed to a call site
+// - Number of call sites followed by the call site entries (see the alloc_tracker_site structure)
+int formatAllocationInfo(Appender* appender, void* data) {
+    const auto appendInt = [appender](uint32_t val) {
+        appender->append((const uint8_t*)&val, sizeof(val));
+    };
+    runtime_info_t info = {};
+    info.size = sizeof(info);
+    HAL_Core_Runtime_Info(&info, nullptr);
+    appendInt(info.freeheap);
+    appendInt(info.largest_free_block_heap);
+    size_t poolFree = 0, poolLargest = 0;
+    system_pool_get_info(&poolFree, &poolLargest);
+    appendInt(poolFree);
+    appendInt(poolLargest);
+    for (int i = 0; i < ALLOC_TRACKER_SOURCE_COUNT; ++i) {
+        alloc_tracker_stats stats = {};
+        CHECK(alloc_tracker_get_stats(i, &stats));
+        appender->append((const uint8_t*)&stats, sizeof(stats));
+    }
+    appendInt(alloc_tracker_untracked_count());
+    std::unique_ptr<alloc_tracker_site[]> sites(new(std::nothrow) alloc_tracker_site[ALLOC_TRACKER_MAX_SITES]);
+    CHECK_TRUE(sites, SYSTEM_ERROR_NO_MEMORY);
+    const size_t count = std::min<size_t>(alloc_tracker_get_sites(sites.get(), ALLOC_TRACKER_MAX_SITES),
+            ALLOC_TRACKER_MAX_SITES);
+    appendInt(count);
+    appender->append((const uint8_t*)sites.get(), count * sizeof(alloc_tracker_site));
+    return 0;
+}
+
+#endif // ALLOC_TRACKER_ENABLED
+
+#if HAL_USE_SOCKET_HAL_POSIX && HAL_PLATFORM_IFAPI
+
+// Formats the reply data for the CTRL_REQUEST_NETWORK_GET_SOCKET_STATS request. The statistics
+// are encoded as sock_stats structures, all other fields are 32-bit little-endian integers:
+//
+// - Statistics of all sockets, including the closed ones
+// - Number of interfaces followed by the interface index and statistics for each interface
+// - Socket descriptor and statistics for each open socket, until the end of the data
+int formatSocketStats(Appender* appender, void* data) {
+    const auto appendInt = [appender](uint32_t val) {
+        appender->append((const uint8_t*)&val, sizeof(val));
+    };
+    sock_stats stats = {};
+    stats.size = sizeof(stats);
+    CHECK(sock_get_netif_stats(0 /* All interfaces */, &stats, nullptr));
+    appender->append((const uint8_t*)&stats, sizeof(stats));
+    if_list* ifs = nullptr;
+    CHECK(if_get_list(&ifs));
+    uint32_t count = 0;
+    for (if_list* iface = ifs; iface; iface = iface->next) {
+        ++count;
+    }
+    appendInt(count);
+    for (if_list* iface = ifs; iface; iface = iface->next) {
+        uint8_t index = 0;
+        if_get_index(iface->iface, &index);
+        stats = sock_stats();
+        stats.size = sizeof(stats);
+        sock_get_netif_stats(index, &stats, nullptr);
+        appendInt(index);
+        appender->append((const uint8_t*)&stats, sizeof(stats));
+    }
+    if_free_list(ifs);
+    for (int s = 0;; ++s) {
+        stats = sock_stats();
+        stats.size = sizeof(stats);
+        const int ret = sock_get_stats(s, &stats, nullptr);
+        if (ret == SYSTEM_ERROR_OUT_OF_RANGE) {
+            break;
+        }
+        if (ret == 0) {
+            appendInt(s);
+            appender->append((const uint8_t*)&stats, sizeof(stats));
+        }
+    }
+    return 0;
+}
+
+#endif // HAL_USE_SOCKET_HAL_POSIX && HAL_PLATFORM_IFAPI
+
 SystemControl g_systemControl;
 
 } // particle::system::
@@ -209,6 +310,18 @@ void SystemControl::processRequest(ctrl_request* req, ControlRequestChannel* /*
         }
         break;
     }
+#if ALLOC_TRACKER_ENABLED
+    case CTRL_REQUEST_ALLOCATION_INFO: {
+        setResult(req, formatReplyData(req, formatAllocationInfo));
+        break;
+    }
+#endif // ALLOC_TRACKER_ENABLED
+#if HAL_USE_SOCKET_HAL_POSIX && HAL_PLATFORM_IFAPI
+    case CTRL_REQUEST_NETWORK_GET_SOCKET_STATS: {
+        setResult(req, formatReplyData(req, formatSocketStats));
+        break;
+    }
+#endif // HAL_USE_SOCKET_HAL_POSIX && HAL_PLATFORM_IFAPI
 #if Wiring_WiFi == 1 && !HAL_PLATFORM_NCP
     /* wifi requests */
     case CTRL_REQUEST_WIFI_GET_ANTENNA: {
@@ -312,6 +425,10 @@ void SystemControl::processRequest(ctrl_request* req, ControlRequestChannel* /*
         setResult(req, control::firmwareUpdateDataRequest(req));
         break;
     }
+    case CTRL_REQUEST_FIRMWARE_UPDATE_DATA_STREAM: {
+        control::firmwareUpdateStreamDataRequest(req);
+        break;
+    }
     case CTRL_REQUEST_DESCRIBE_STORAGE: {
         setResult(req, control::describeStorageRequest(req));
         break;
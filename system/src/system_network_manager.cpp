@@ -43,6 +43,10 @@ LOG_SOURCE_CATEGORY("system.nm")
 #include "system_cloud.h"
 #include "system_threading.h"
 #include "system_event.h"
+#include "system_cloud_connection.h"
+#include "system_update.h"
+#include "socket_hal.h"
+#include "timer_hal.h"
 
 #define CHECKV(_expr) \
         ({ \
@@ -95,6 +99,32 @@ int for_each_iface(F&& f) {
     return 0;
 }
 
+/* Interval between the rounds of probes of the path to the cloud */
+const system_tick_t PROBE_INTERVAL = 15000;
+/* Metered interfaces are probed less often, the interval doubles after every successful probe */
+const system_tick_t METERED_PROBE_INTERVAL = 2 * 60 * 1000;
+const system_tick_t MAX_METERED_PROBE_INTERVAL = 32 * 60 * 1000;
+/* Interval at which the replies to the probes are checked */
+const system_tick_t PROBE_POLL_INTERVAL = 50;
+const system_tick_t PROBE_TIMEOUT = 3000;
+
+/* Lower values are preferred if the paths via the interfaces are otherwise similar */
+int interfacePriority(const char* name) {
+    if (!strncmp(name, "en", 2)) {
+        return 0;
+    } else if (!strncmp(name, "wl", 2)) {
+        return 1;
+    } else if (!strncmp(name, "pp", 2)) {
+        return 2;
+    }
+    /* Other interfaces, such as the mesh interface, can't be used to reach the cloud */
+    return -1;
+}
+
+bool isMeteredInterface(const char* name) {
+    return !strncmp(name, "pp", 2);
+}
+
 void forceCloudPingIfConnected() {
     const auto task = new(std::nothrow) ISRTaskQueue::Task();
     if (!task) {
@@ -231,6 +261,7 @@ void setBorderRouterState(bool start) {
 #endif // HAL_PLATFORM_MESH
 
 NetworkManager::NetworkManager() {
+    probeTaskPending_ = false;
     state_ = State::NONE;
     ip4State_ = ProtocolState::UNCONFIGURED;
     ip6State_ = ProtocolState::UNCONFIGURED;
@@ -269,6 +300,11 @@ void NetworkManager::destroy() {
         resolv_event_handler_del(resolvEventHandlerCookie_);
         resolvEventHandlerCookie_ = nullptr;
     }
+
+    if (probeTimer_) {
+        os_timer_destroy(probeTimer_, nullptr);
+        probeTimer_ = nullptr;
+    }
 }
 
 int NetworkManager::enableNetworking() {
@@ -555,6 +591,7 @@ void NetworkManager::transition(State state) {
             LED_SIGNAL_START(NETWORK_CONNECTED, BACKGROUND);
             if (state_ != State::IP_CONFIGURED) {
                 system_notify_event(network_status, network_status_connected);
+                startProbing();
             }
             break;
         }
@@ -843,6 +880,234 @@ bool NetworkManager::haveLowerLayerConfiguration(if_t iface) const {
     return true;
 }
 
+void NetworkManager::startProbing() {
+    /* The probes are stopped by the probing task itself once the IP configuration is lost */
+    if (!probeTimer_) {
+        if (os_timer_create(&probeTimer_, PROBE_POLL_INTERVAL, &probeTimerCb, this, false /* one_shot */, nullptr)) {
+            probeTimer_ = nullptr;
+            LOG(ERROR, "Unable to create probe timer");
+            return;
+        }
+    }
+    if (!os_timer_is_active(probeTimer_, nullptr)) {
+        os_timer_change(probeTimer_, OS_TIMER_CHANGE_START, false, 0, 0xffffffff, nullptr);
+    }
+}
+
+void NetworkManager::stopProbing() {
+    os_timer_change(probeTimer_, OS_TIMER_CHANGE_STOP, false, 0, 0xffffffff, nullptr);
+    for (size_t i = 0; i < probeCount_; ++i) {
+        probes_[i].probe.close();
+    }
+    probeCount_ = 0;
+    probeScheduleCount_ = 0;
+    scorer_.reset();
+    updatePreferredInterface();
+    /* The IP configuration might have been restored while the timer was being stopped */
+    if (state_ == State::IP_CONFIGURED) {
+        startProbing();
+    }
+}
+
+void NetworkManager::probeTimerCb(os_timer_t timer) {
+    void* id = nullptr;
+    os_timer_get_id(timer, &id);
+    const auto self = static_cast<NetworkManager*>(id);
+    if (!self || self->probeTaskPending_.exchange(true)) {
+        return;
+    }
+    const auto task = new(std::nothrow) ISRTaskQueue::Task();
+    if (!task) {
+        self->probeTaskPending_ = false;
+        return;
+    }
+    /* Sockets are not used from the timer thread, the probes are sent and received by the system thread */
+    task->func = [](ISRTaskQueue::Task* task) {
+        delete task;
+        const auto self = NetworkManager::instance();
+        if (self->state_ != State::IP_CONFIGURED) {
+            self->stopProbing();
+        } else if (self->probeCount_ > 0) {
+            self->receiveProbes();
+        } else {
+            self->sendProbes();
+        }
+        self->probeTaskPending_ = false;
+    };
+    SystemISRTaskQueue.enqueue(task);
+}
+
+void NetworkManager::sendProbes() {
+    uint8_t enabled = 1;
+    system_get_flag(SYSTEM_FLAG_NETWORK_PROBING, &enabled, nullptr);
+    if (!enabled) {
+        cancelProbes();
+        return;
+    }
+    const system_tick_t now = HAL_Timer_Get_Milli_Seconds();
+    /* Probe the path to the cloud server if the device is connected, otherwise the gateways */
+    sockaddr_in cloudAddr = {};
+    socklen_t cloudAddrLen = sizeof(cloudAddr);
+    const bool haveCloudAddr = system_cloud_get_server_address((sockaddr*)&cloudAddr, &cloudAddrLen) == 0 &&
+            cloudAddr.sin_family == AF_INET;
+
+    if_addrs* addrs = nullptr;
+    CHECKV(if_get_if_addrs(&addrs));
+
+    unsigned available = 0;
+    for_each_iface([&](if_t iface, unsigned int flags) {
+        char name[IF_NAMESIZE] = {};
+        uint8_t ifindex = 0;
+        if (if_get_name(iface, name) || if_get_index(iface, &ifindex)) {
+            return;
+        }
+        const int prio = interfacePriority(name);
+        if (prio < 0) {
+            return;
+        }
+        scorer_.addInterface(ifindex, prio);
+        const sockaddr_in* gw = nullptr;
+        if (isInterfaceEnabled(iface) && getInterfaceIp4State(iface) == ProtocolState::CONFIGURED) {
+            for (auto addr = addrs; addr != nullptr; addr = addr->next) {
+                auto a = addr->if_addr;
+                if (addr->ifindex == ifindex && a && a->addr && a->addr->sa_family == AF_INET &&
+                        a->gw && a->gw->sa_family == AF_INET) {
+                    gw = (const sockaddr_in*)a->gw;
+                    break;
+                }
+            }
+        }
+        scorer_.setAvailable(ifindex, gw != nullptr);
+        if (!gw) {
+            /* Probe the interface as soon as it becomes available again */
+            const auto sched = probeSchedule(ifindex, false /* add */);
+            if (sched) {
+                sched->interval = 0;
+            }
+            return;
+        }
+        ++available;
+        const auto sched = probeSchedule(ifindex, true /* add */);
+        if (!sched || probeCount_ == InterfaceScorer::MAX_INTERFACES ||
+                (sched->interval > 0 && now - sched->lastTime < sched->interval)) {
+            return;
+        }
+        sched->lastTime = now;
+        sched->metered = isMeteredInterface(name);
+        InterfaceProbe* probe = &probes_[probeCount_++];
+        probe->ifindex = ifindex;
+        if (probe->probe.send(haveCloudAddr ? (const sockaddr*)&cloudAddr : (const sockaddr*)gw, ifindex) < 0) {
+            scorer_.addFailure(ifindex);
+            updateProbeSchedule(ifindex, false /* success */);
+        }
+    });
+
+    if_free_if_addrs(addrs);
+
+    if (available < 2) {
+        /* Nothing to choose from, fall back to the default order of the interfaces */
+        cancelProbes();
+        return;
+    }
+    os_timer_change(probeTimer_, OS_TIMER_CHANGE_PERIOD, false, PROBE_POLL_INTERVAL, 0xffffffff, nullptr);
+    /* Sockets that failed to send the probe are already closed */
+    receiveProbes();
+}
+
+void NetworkManager::receiveProbes() {
+    const system_tick_t now = HAL_Timer_Get_Milli_Seconds();
+    bool pending = false;
+    for (size_t i = 0; i < probeCount_; ++i) {
+        InterfaceProbe* p = &probes_[i];
+        if (!p->probe.isPending()) {
+            continue;
+        }
+        const int r = p->probe.receive();
+        if (r > 0) {
+            scorer_.addSample(p->ifindex, now - p->probe.sentTime());
+            updateProbeSchedule(p->ifindex, true /* success */);
+        } else if (r < 0 || now - p->probe.sentTime() >= PROBE_TIMEOUT) {
+            scorer_.addFailure(p->ifindex);
+            updateProbeSchedule(p->ifindex, false /* success */);
+            p->probe.close();
+        } else {
+            pending = true;
+        }
+    }
+    if (pending) {
+        return;
+    }
+    probeCount_ = 0;
+    updatePreferredInterface();
+    os_timer_change(probeTimer_, OS_TIMER_CHANGE_PERIOD, false, PROBE_INTERVAL, 0xffffffff, nullptr);
+}
+
+void NetworkManager::cancelProbes() {
+    for (size_t i = 0; i < probeCount_; ++i) {
+        probes_[i].probe.close();
+    }
+    probeCount_ = 0;
+    probeScheduleCount_ = 0;
+    scorer_.reset();
+    updatePreferredInterface();
+    os_timer_change(probeTimer_, OS_TIMER_CHANGE_PERIOD, false, PROBE_INTERVAL, 0xffffffff, nullptr);
+}
+
+NetworkManager::ProbeSchedule* NetworkManager::probeSchedule(uint8_t ifindex, bool add) {
+    for (size_t i = 0; i < probeScheduleCount_; ++i) {
+        if (probeSchedules_[i].ifindex == ifindex) {
+            return &probeSchedules_[i];
+        }
+    }
+    if (!add || probeScheduleCount_ == InterfaceScorer::MAX_INTERFACES) {
+        return nullptr;
+    }
+    ProbeSchedule* sched = &probeSchedules_[probeScheduleCount_++];
+    *sched = ProbeSchedule();
+    sched->ifindex = ifindex;
+    return sched;
+}
+
+void NetworkManager::updateProbeSchedule(uint8_t ifindex, bool success) {
+    /* Other interfaces are probed in every round */
+    const auto sched = probeSchedule(ifindex, false /* add */);
+    if (!sched || !sched->metered) {
+        return;
+    }
+    if (!success || !sched->interval) {
+        sched->interval = METERED_PROBE_INTERVAL;
+    } else if (sched->interval < MAX_METERED_PROBE_INTERVAL) {
+        sched->interval *= 2;
+    }
+}
+
+void NetworkManager::updatePreferredInterface() {
+    const int prev = scorer_.preferred();
+    const int preferred = scorer_.evaluate();
+    /* The routing hooks of the platform prefer the interface with the lowest metric */
+    for_each_iface([&](if_t iface, unsigned int flags) {
+        uint8_t ifindex = 0;
+        if (!if_get_index(iface, &ifindex)) {
+            const bool other = preferred != InterfaceScorer::NO_INTERFACE && ifindex != preferred;
+            if_set_metric(iface, other ? 1 : 0);
+        }
+    });
+    if (preferred == prev) {
+        return;
+    }
+    if (preferred != InterfaceScorer::NO_INTERFACE) {
+        char name[IF_NAMESIZE] = {};
+        if_index_to_name(preferred, name);
+        InterfaceScorer::Stats stats = {};
+        scorer_.stats(preferred, &stats);
+        LOG(INFO, "Preferred interface: %s, RTT: %u ms, loss: %u%%", name, stats.rtt, stats.loss);
+    } else {
+        LOG(INFO, "No preferred interface");
+    }
+    /* Let the cloud know about the new path without closing the session */
+    forceCloudPingIfConnected();
+}
+
 void NetworkManager::resolvEventHandlerCb(void* arg, const void* data) {
     auto self = static_cast<NetworkManager*>(arg);
     self->resolvEventHandler(data);
@@ -26,6 +26,10 @@
 #include "resolvapi.h"
 #include <atomic>
 #include "intrusive_list.h"
+#include "interface_scorer.h"
+#include "icmp_echo_probe.h"
+#include "concurrent_hal.h"
+#include "system_tick_hal.h"
 
 namespace particle { namespace system {
 
@@ -139,6 +143,29 @@ private:
     bool isDisabled(if_t iface);
     void resetInterfaceProtocolState(if_t iface = nullptr);
 
+    /* Probing of the path to the cloud via each of the interfaces */
+    struct InterfaceProbe {
+        IcmpEchoProbe probe;
+        uint8_t ifindex = 0;
+    };
+
+    struct ProbeSchedule {
+        system_tick_t lastTime = 0; // Time of the last probe
+        system_tick_t interval = 0; // Minimum interval between the probes, 0 if the interface is due
+        uint8_t ifindex = 0;
+        bool metered = false;
+    };
+
+    void startProbing();
+    void stopProbing();
+    static void probeTimerCb(os_timer_t timer);
+    void sendProbes();
+    void receiveProbes();
+    void cancelProbes();
+    ProbeSchedule* probeSchedule(uint8_t ifindex, bool add);
+    void updateProbeSchedule(uint8_t ifindex, bool success);
+    void updatePreferredInterface();
+
 private:
     if_event_handler_cookie_t ifEventHandlerCookie_ = {};
     resolv_event_handler_cookie_t resolvEventHandlerCookie_ = {};
@@ -150,6 +177,14 @@ private:
     std::atomic<DnsState> dns6State_;
 
     IntrusiveList<InterfaceRuntimeState> runState_;
+
+    InterfaceScorer scorer_;
+    InterfaceProbe probes_[InterfaceScorer::MAX_INTERFACES];
+    size_t probeCount_ = 0;
+    ProbeSchedule probeSchedules_[InterfaceScorer::MAX_INTERFACES];
+    size_t probeScheduleCount_ = 0;
+    os_timer_t probeTimer_ = nullptr;
+    std::atomic<bool> probeTaskPending_;
 };
 
 #if HAL_PLATFORM_MESH
@@ -32,6 +32,7 @@
 #include "core_hal.h"
 #include "system_tick_hal.h"
 #include "watchdog_hal.h"
+#include "eeprom_hal.h"
 #include "wlan_hal.h"
 #include "delay_hal.h"
 #include "timer_hal.h"
@@ -40,6 +41,7 @@
 #include "cellular_hal.h"
 #include "system_power.h"
 #include "simple_pool_allocator.h"
+#include "alloc_tracker.h"
 
 #include "spark_wiring_network.h"
 #include "spark_wiring_constants.h"
@@ -465,6 +467,8 @@ void Spark_Idle_Events(bool force_events/*=false*/)
 #if HAL_PLATFORM_FILESYSTEM
         particle::system::fetchAndExecuteCommand(millis());
 #endif // HAL_PLATFORM_FILESYSTEM
+
+        HAL_EEPROM_Perform_Background_Work(nullptr);
     }
     else
     {
@@ -651,15 +655,29 @@ void* system_pool_alloc(size_t size, void* reserved) {
     ATOMIC_BLOCK() {
         ptr = g_memPool.allocate(size);
     }
+    ALLOC_TRACKER_ALLOC(ALLOC_TRACKER_SOURCE_SYSTEM_POOL, ptr, size, ALLOC_TRACKER_CALLER());
     return ptr;
 }
 
 void system_pool_free(void* ptr, void* reserved) {
+    ALLOC_TRACKER_FREE(ALLOC_TRACKER_SOURCE_SYSTEM_POOL, ptr);
     ATOMIC_BLOCK() {
         g_memPool.deallocate(ptr);
     }
 }
 
+int system_pool_get_info(size_t* free_size, size_t* largest_free_block) {
+    ATOMIC_BLOCK() {
+        if (free_size) {
+            *free_size = g_memPool.freeSize();
+        }
+        if (largest_free_block) {
+            *largest_free_block = g_memPool.largestFreeBlock();
+        }
+    }
+    return 0;
+}
+
 int system_invoke_event_handler(uint16_t handlerInfoSize, FilteringEventHandler* handlerInfo,
                 const char* event_name, const char* event_data, void* reserved)
 {
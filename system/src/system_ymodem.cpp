@@ -37,6 +37,8 @@
 #include "rgbled.h"
 #include "file_transfer.h"
 
+#include <utility>
+
 /**
  * @brief  Test to see if a key has been pressed on the HyperTerminal
  * @param  key: The key pressed
@@ -82,10 +84,41 @@ inline int32_t YModem::receive_byte(uint8_t& c, uint32_t timeout)
         {
             return 0;
         }
+        // Write the previous packet while waiting for the data
+        write_pending_slice();
     }
     return -1;
 }
 
+bool YModem::write_pending_slice()
+{
+    if (pending_offset == pending_size || write_error)
+    {
+        return false;
+    }
+    uint32_t size = pending_size - pending_offset;
+    if (size > WRITE_SLICE_SIZE)
+    {
+        size = WRITE_SLICE_SIZE;
+    }
+    transfer->chunk_size = size;
+    write_error = Spark_Save_Firmware_Chunk(*transfer, pending_data + PACKET_HEADER + pending_offset, NULL);
+    if (!write_error)
+    {
+        transfer->chunk_address += size;
+        pending_offset += size;
+    }
+    return true;
+}
+
+int YModem::flush_pending()
+{
+    while (write_pending_slice())
+    {
+    }
+    return write_error;
+}
+
 /**
  * @brief  Receive a packet from sender
  * @param  data
@@ -184,6 +217,13 @@ int32_t YModem::handle_packet(uint8_t* packet_data, int32_t packet_length,
 
         /* End of transmission */
     case 0:
+        if (flush_pending())
+        {
+            /* End session if Spark_Save_Firmware_Chunk() fails */
+            send_byte(CA);
+            send_byte(CA);
+            return -2;
+        }
         send_byte(ACK);
         file_done = 1;
         return 1;
@@ -224,15 +264,17 @@ int32_t YModem::handle_packet(uint8_t* packet_data, int32_t packet_length,
         } /* Data packet */
         else
         {
-            tx.chunk_size = packet_length;
-            if (Spark_Save_Firmware_Chunk(tx, packet_data + PACKET_HEADER, NULL))
+            /* The packet is written while the next one is being received */
+            if (flush_pending())
             {
                 /* End session if Spark_Save_Firmware_Chunk() fails */
                 send_byte(CA);
                 send_byte(CA);
                 return -2;
             }
-            tx.chunk_address += tx.chunk_size;
+            std::swap(this->packet_data, pending_data);
+            pending_size = packet_length;
+            pending_offset = 0;
             send_byte(ACK);
         }
         packets_received++;
@@ -245,6 +287,10 @@ int32_t YModem::handle_packet(uint8_t* packet_data, int32_t packet_length,
 int32_t YModem::receive_file(FileTransfer::Descriptor& tx, YModem::file_desc_t& file_info)
 {
     memset(&file_info, 0, sizeof (file_info));
+    transfer = &tx;
+    pending_size = 0;
+    pending_offset = 0;
+    write_error = 0;
     session_done = 0;
     errors = 0;
     session_begin = 0;
@@ -0,0 +1,142 @@
+#include "alloc_tracker.h"
+
+#include "tools/catch.h"
+
+#include <vector>
+
+extern "C" {
+
+// newlib_nano/src/malloc.c
+void* __wrap_malloc(size_t size);
+void* __wrap_calloc(size_t count, size_t size);
+void* __wrap_realloc(void* ptr, size_t size);
+void _free_r(struct _reent* r, void* ptr);
+
+} // extern "C"
+
+namespace {
+
+void* const CALLER1 = (void*)0x1000;
+void* const CALLER2 = (void*)0x2000;
+
+alloc_tracker_stats getStats(int source) {
+    alloc_tracker_stats stats = {};
+    REQUIRE(alloc_tracker_get_stats(source, &stats) == 0);
+    return stats;
+}
+
+std::vector<alloc_tracker_site> getSites() {
+    std::vector<alloc_tracker_site> sites(ALLOC_TRACKER_MAX_SITES);
+    const int n = alloc_tracker_get_sites(sites.data(), sites.size());
+    REQUIRE(n >= 0);
+    sites.resize(n);
+    return sites;
+}
+
+__attribute__((noinline)) void* allocAtSite1(size_t size) {
+    return __wrap_malloc(size);
+}
+
+__attribute__((noinline)) void* allocAtSite2(size_t size) {
+    void* ptr = __wrap_calloc(1, size / 2);
+    return __wrap_realloc(ptr, size);
+}
+
+} // namespace
+
+TEST_CASE("alloc_tracker") {
+    alloc_tracker_reset();
+    int dummy[2] = {};
+
+    SECTION("tracks allocations per source") {
+        alloc_tracker_alloc(ALLOC_TRACKER_SOURCE_HEAP, &dummy[0], 10, CALLER1);
+        alloc_tracker_alloc(ALLOC_TRACKER_SOURCE_HEAP, &dummy[1], 20, CALLER1);
+        alloc_tracker_alloc(ALLOC_TRACKER_SOURCE_SYSTEM_POOL, &dummy[0], 5, CALLER2);
+        alloc_tracker_alloc(ALLOC_TRACKER_SOURCE_HEAP, nullptr, 1000, CALLER2);
+        alloc_tracker_free(ALLOC_TRACKER_SOURCE_HEAP, &dummy[0]);
+        alloc_tracker_free(ALLOC_TRACKER_SOURCE_HEAP, nullptr);
+
+        const auto heap = getStats(ALLOC_TRACKER_SOURCE_HEAP);
+        CHECK(heap.alloc_count == 2);
+        CHECK(heap.alloc_bytes == 30);
+        CHECK(heap.free_count == 1);
+        CHECK(heap.failed_count == 1);
+        CHECK(heap.max_failed_size == 1000);
+
+        const auto pool = getStats(ALLOC_TRACKER_SOURCE_SYSTEM_POOL);
+        CHECK(pool.alloc_count == 1);
+        CHECK(pool.alloc_bytes == 5);
+        CHECK(pool.free_count == 0);
+        CHECK(pool.failed_count == 0);
+    }
+
+    SECTION("tracks allocations per call site") {
+        alloc_tracker_alloc(ALLOC_TRACKER_SOURCE_HEAP, &dummy[0], 10, CALLER1);
+        alloc_tracker_alloc(ALLOC_TRACKER_SOURCE_HEAP, &dummy[0], 20, CALLER1);
+        alloc_tracker_alloc(ALLOC_TRACKER_SOURCE_HEAP, &dummy[0], 30, CALLER2);
+        alloc_tracker_alloc(ALLOC_TRACKER_SOURCE_SYSTEM_POOL, &dummy[0], 40, CALLER2);
+        auto sites = getSites();
+        REQUIRE(sites.size() == 3);
+        for (const auto& site: sites) {
+            if (site.address == (uintptr_t)CALLER1) {
+                CHECK(site.source == ALLOC_TRACKER_SOURCE_HEAP);
+                CHECK(site.alloc_count == 2);
+                CHECK(site.alloc_bytes == 30);
+            } else if (site.source == ALLOC_TRACKER_SOURCE_HEAP) {
+                CHECK(site.address == (uintptr_t)CALLER2);
+                CHECK(site.alloc_count == 1);
+                CHECK(site.alloc_bytes == 30);
+            } else {
+                CHECK(site.address == (uintptr_t)CALLER2);
+                CHECK(site.alloc_count == 1);
+                CHECK(site.alloc_bytes == 40);
+            }
+        }
+    }
+
+    SECTION("attributes heap allocations to the callers of malloc(), calloc() and realloc()") {
+        void* p1 = allocAtSite1(10);
+        void* p2 = allocAtSite1(20);
+        void* p3 = allocAtSite2(40);
+        REQUIRE(p1);
+        REQUIRE(p2);
+        REQUIRE(p3);
+        const auto sites = getSites();
+        // calloc() and realloc() are called from different places in allocAtSite2()
+        REQUIRE(sites.size() == 3);
+        size_t site1Count = 0;
+        for (const auto& site: sites) {
+            CHECK(site.source == ALLOC_TRACKER_SOURCE_HEAP);
+            if (site.alloc_count == 2) {
+                CHECK(site.alloc_bytes == 30);
+                ++site1Count;
+            } else {
+                CHECK(site.alloc_count == 1);
+                CHECK(((site.alloc_bytes == 20) || (site.alloc_bytes == 40)));
+            }
+        }
+        CHECK(site1Count == 1);
+        _free_r(nullptr, p1);
+        _free_r(nullptr, p2);
+        _free_r(nullptr, p3);
+        const auto heap = getStats(ALLOC_TRACKER_SOURCE_HEAP);
+        CHECK(heap.alloc_count == 4);
+        CHECK(heap.free_count == 4);
+    }
+
+    SECTION("counts allocations that don't fit in the call site table") {
+        for (uintptr_t i = 1; i <= ALLOC_TRACKER_MAX_SITES + 10; ++i) {
+            alloc_tracker_alloc(ALLOC_TRACKER_SOURCE_HEAP, &dummy[0], 1, (void*)(i * 4));
+        }
+        CHECK(getSites().size() == ALLOC_TRACKER_MAX_SITES);
+        CHECK(alloc_tracker_untracked_count() == 10);
+        CHECK(getStats(ALLOC_TRACKER_SOURCE_HEAP).alloc_count == ALLOC_TRACKER_MAX_SITES + 10);
+    }
+
+    SECTION("can be reset") {
+        alloc_tracker_alloc(ALLOC_TRACKER_SOURCE_HEAP, &dummy[0], 10, CALLER1);
+        alloc_tracker_reset();
+        CHECK(getSites().empty());
+        CHECK(getStats(ALLOC_TRACKER_SOURCE_HEAP).alloc_count == 0);
+    }
+}
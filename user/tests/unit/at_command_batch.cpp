@@ -0,0 +1,367 @@
+#include "at_parser.h"
+#include "at_command_batch.h"
+#include "at_response.h"
+
+#include "stream.h"
+#include "system_error.h"
+
+#include "tools/catch.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <deque>
+
+using namespace particle;
+
+namespace {
+
+// Stream that returns prerecorded DCE output in small chunks
+class ReplayStream: public Stream {
+public:
+    static const size_t CHUNK_SIZE = 7;
+
+    explicit ReplayStream(std::string input = std::string()) :
+            in_(std::move(input)),
+            pos_(0) {
+    }
+
+    void append(const std::string& input) {
+        in_ += input;
+    }
+
+    const std::string& output() const {
+        return out_;
+    }
+
+    int read(char* data, size_t size) override {
+        const size_t n = std::min(std::min(size, (size_t)CHUNK_SIZE), in_.size() - pos_);
+        memcpy(data, in_.data() + pos_, n);
+        pos_ += n;
+        return n;
+    }
+
+    int peek(char* data, size_t size) override {
+        return SYSTEM_ERROR_NOT_SUPPORTED;
+    }
+
+    int skip(size_t size) override {
+        return SYSTEM_ERROR_NOT_SUPPORTED;
+    }
+
+    int availForRead() override {
+        return in_.size() - pos_;
+    }
+
+    int write(const char* data, size_t size) override {
+        out_.append(data, size);
+        return size;
+    }
+
+    int flush() override {
+        return 0;
+    }
+
+    int availForWrite() override {
+        return 1024;
+    }
+
+    int waitEvent(unsigned flags, unsigned timeout) override {
+        if (flags & Stream::WRITABLE) {
+            return Stream::WRITABLE;
+        }
+        if (pos_ < in_.size()) {
+            return Stream::READABLE;
+        }
+        return SYSTEM_ERROR_TIMEOUT;
+    }
+
+private:
+    std::string in_;
+    std::string out_;
+    size_t pos_;
+};
+
+// Command and the DCE's response to it
+struct Exchange {
+    const char* cmd; // Command line
+    const char* resp; // Response lines, including the final result code
+    unsigned procTime; // Processing time in microseconds
+};
+
+/*
+ * Stream that simulates a DCE replaying a transcript of AT commands. The DCE processes the
+ * commands in order and can queue incoming command lines while it's busy. The time is simulated
+ * with a resolution of one microsecond.
+ */
+class ModemStream: public Stream {
+public:
+    // Transmission time of one character at 115200 baud
+    static const uint64_t CHAR_TIME = 87;
+    // Time it takes the DTE to react to received data
+    static const uint64_t WAKEUP_TIME = 1000;
+
+    explicit ModemStream(std::vector<Exchange> transcript) :
+            transcript_(std::move(transcript)),
+            next_(0),
+            now_(0),
+            txFree_(0),
+            rxFree_(0),
+            busyUntil_(0) {
+    }
+
+    uint64_t now() const {
+        return now_;
+    }
+
+    size_t commandCount() const {
+        return next_;
+    }
+
+    int read(char* data, size_t size) override {
+        size_t n = 0;
+        while (n < size && !out_.empty() && out_.front().time <= now_) {
+            data[n++] = out_.front().c;
+            out_.pop_front();
+        }
+        return n;
+    }
+
+    int peek(char* data, size_t size) override {
+        return SYSTEM_ERROR_NOT_SUPPORTED;
+    }
+
+    int skip(size_t size) override {
+        return SYSTEM_ERROR_NOT_SUPPORTED;
+    }
+
+    int availForRead() override {
+        return SYSTEM_ERROR_NOT_SUPPORTED;
+    }
+
+    int write(const char* data, size_t size) override {
+        for (size_t i = 0; i < size; ++i) {
+            txFree_ = std::max(txFree_, now_) + CHAR_TIME;
+            if (data[i] == '\r') {
+                receiveCommand(line_, txFree_);
+                line_.clear();
+            } else {
+                line_ += data[i];
+            }
+        }
+        return size;
+    }
+
+    int flush() override {
+        return 0;
+    }
+
+    int availForWrite() override {
+        return 1024;
+    }
+
+    int waitEvent(unsigned flags, unsigned timeout) override {
+        if (flags & Stream::WRITABLE) {
+            return Stream::WRITABLE;
+        }
+        if (out_.empty()) {
+            now_ += (uint64_t)timeout * 1000;
+            return SYSTEM_ERROR_TIMEOUT;
+        }
+        now_ = std::max(now_, out_.front().time) + WAKEUP_TIME;
+        return Stream::READABLE;
+    }
+
+private:
+    struct Char {
+        uint64_t time; // Time when the character is received by the DTE
+        char c;
+    };
+
+    std::vector<Exchange> transcript_;
+    std::deque<Char> out_;
+    std::string line_;
+    size_t next_;
+    uint64_t now_;
+    uint64_t txFree_; // Time when the DTE's transmitter becomes idle
+    uint64_t rxFree_; // Time when the DCE's transmitter becomes idle
+    uint64_t busyUntil_; // Time when the DCE finishes processing the current command
+
+    void receiveCommand(const std::string& cmd, uint64_t time) {
+        REQUIRE(next_ < transcript_.size());
+        const Exchange& e = transcript_[next_++];
+        REQUIRE(cmd == e.cmd);
+        const uint64_t start = std::max(time, busyUntil_);
+        transmit(cmd + "\r", start); // Echo
+        busyUntil_ = start + e.procTime;
+        transmit(std::string("\r\n") + e.resp + "\r\n", busyUntil_);
+    }
+
+    void transmit(const std::string& s, uint64_t time) {
+        for (char c: s) {
+            rxFree_ = std::max(rxFree_, time) + CHAR_TIME;
+            out_.push_back({ rxFree_, c });
+        }
+    }
+};
+
+// Initialization sequence of a cellular modem
+const std::vector<Exchange> INIT_TRANSCRIPT = {
+    { "AT", "OK", 2000 },
+    { "AT+CGMR", "L0.0.00.00.05.06 [Feb 03 2018 13:00:41]\r\n\r\nOK", 5000 },
+    { "AT+CCID", "+CCID: 89014103211118510720\r\n\r\nOK", 10000 },
+    { "AT+CGSN", "352753090041680\r\n\r\nOK", 5000 },
+    { "AT+CIMI", "310410123456789\r\n\r\nOK", 10000 }
+};
+
+// Signal quality query
+const std::vector<Exchange> SIGNAL_TRANSCRIPT = {
+    { "AT+COPS=3,2", "OK", 5000 },
+    { "AT+COPS?", "+COPS: 0,2,\"310410\",7\r\n\r\nOK", 10000 },
+    { "AT+CSQ", "+CSQ: 19,99\r\n\r\nOK", 5000 },
+    { "AT+CEREG?", "+CEREG: 2,5,\"2CF7\",\"8A5A782\",7\r\n\r\nOK", 5000 }
+};
+
+// Executes the transcript as a batch and returns the simulated time it took
+uint64_t execTranscript(const std::vector<Exchange>& transcript, size_t lookahead) {
+    ModemStream strm(transcript);
+    AtParser parser;
+    REQUIRE(parser.init(AtParserConfig().stream(&strm)) == 0);
+    AtCommandBatch batch;
+    batch.lookahead(lookahead);
+    for (const auto& e: transcript) {
+        REQUIRE(batch.add("%s", e.cmd) >= 0);
+    }
+    REQUIRE(parser.execBatch(&batch) == 0);
+    CHECK(strm.commandCount() == transcript.size());
+    for (size_t i = 0; i < transcript.size(); ++i) {
+        // Compare the response lines with the transcript
+        const auto& resp = batch.response(i);
+        CHECK(resp.result() == AtResponse::OK);
+        std::string s;
+        for (size_t j = 0; j < resp.lineCount(); ++j) {
+            s += resp.line(j);
+            s += "\r\n\r\n";
+        }
+        s += "OK";
+        CHECK(s == transcript[i].resp);
+    }
+    return strm.now();
+}
+
+} // namespace
+
+TEST_CASE("AtCommandBatch") {
+    SECTION("stores the commands") {
+        AtCommandBatch batch;
+        CHECK(batch.lookahead() == 1);
+        CHECK(batch.add("AT+CSQ") == 0);
+        CHECK(batch.add(1000, "AT+COPS=%d,%d", 3, 2) == 1);
+        CHECK(batch.add("%s", "") == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(batch.size() == 2);
+        CHECK(batch.response(0).result() == SYSTEM_ERROR_INVALID_STATE);
+        CHECK(batch.lookahead(0).lookahead() == 1);
+        batch.clear();
+        CHECK(batch.size() == 0);
+    }
+}
+
+TEST_CASE("AtParser::execBatch()") {
+    ReplayStream strm;
+    AtParser parser;
+    REQUIRE(parser.init(AtParserConfig().stream(&strm)) == 0);
+    AtCommandBatch batch;
+    REQUIRE(batch.add("AT+CCID") == 0);
+    REQUIRE(batch.add("AT+CGSN") == 1);
+    REQUIRE(batch.add("AT+COPS?") == 2);
+    REQUIRE(batch.add("AT+CSQ") == 3);
+
+    SECTION("demultiplexes the responses") {
+        int urcCount = 0;
+        REQUIRE(parser.addUrcHandler("+CEREG", [](AtResponseReader* reader, const char* prefix, void* data) {
+            int stat = 0;
+            if (reader->scanf("+CEREG: %d", &stat) == 1 && stat == 5) {
+                ++*(int*)data;
+            }
+            return 0;
+        }, &urcCount) == 0);
+        strm.append("AT+CCID\r\r\n+CCID: 89014103211118510720\r\n\r\nOK\r\n");
+        strm.append("AT+CGSN\r\r\n+CEREG: 5\r\n352753090041680\r\n\r\nOK\r\n");
+        strm.append("AT+COPS?\r\r\n\r\n+CME ERROR: 30\r\n");
+        strm.append("AT+CSQ\r\r\n\r\n+CSQ: 19,99\r\n\r\nOK\r\n");
+        batch.lookahead(2);
+        REQUIRE(parser.execBatch(&batch) == 0);
+        CHECK(strm.output() == "AT+CCID\rAT+CGSN\rAT+COPS?\rAT+CSQ\r");
+        CHECK(urcCount == 1);
+        char iccid[32] = {};
+        CHECK(batch.response(0).result() == AtResponse::OK);
+        CHECK(batch.response(0).scanf("+CCID: %31s", iccid) == 1);
+        CHECK(strcmp(iccid, "89014103211118510720") == 0);
+        CHECK(batch.response(1).result() == AtResponse::OK);
+        CHECK(batch.response(1).lineCount() == 1);
+        CHECK(strcmp(batch.response(1).line(0), "352753090041680") == 0);
+        CHECK(batch.response(2).result() == AtResponse::CME_ERROR);
+        CHECK(batch.response(2).resultErrorCode() == 30);
+        CHECK(batch.response(2).lineCount() == 0);
+        int rssi = 0, qual = 0;
+        CHECK(batch.response(3).result() == AtResponse::OK);
+        CHECK(batch.response(3).scanf("+CSQ: %d,%d", &rssi, &qual) == 2);
+        CHECK(rssi == 19);
+        CHECK(qual == 99);
+        CHECK(batch.response(3).line(1) == nullptr);
+    }
+
+    SECTION("handles echoes of commands received before the response to the previous command") {
+        strm.append("AT+CCID\r\r\nAT+CGSN\r\r\nAT+COPS?\r\r\n+CCID: 8901\r\n\r\nOK\r\n");
+        strm.append("\r\n352753090041680\r\n\r\nOK\r\nAT+CSQ\r\r\n\r\n+COPS: 0,2,\"310410\",7\r\n\r\nOK\r\n");
+        strm.append("\r\n+CSQ: 19,99\r\n\r\nOK\r\n");
+        batch.lookahead(4);
+        REQUIRE(parser.execBatch(&batch) == 0);
+        CHECK(strcmp(batch.response(0).line(0), "+CCID: 8901") == 0);
+        CHECK(strcmp(batch.response(1).line(0), "352753090041680") == 0);
+        CHECK(strcmp(batch.response(2).line(0), "+COPS: 0,2,\"310410\",7") == 0);
+        CHECK(strcmp(batch.response(3).line(0), "+CSQ: 19,99") == 0);
+        for (size_t i = 0; i < batch.size(); ++i) {
+            CHECK(batch.response(i).result() == AtResponse::OK);
+            CHECK(batch.response(i).lineCount() == 1);
+        }
+    }
+
+    SECTION("sends one command at a time by default") {
+        parser.echoEnabled(false);
+        strm.append("\r\n+CCID: 8901\r\n\r\nOK\r\n");
+        // The DTE can't know the number of commands the DCE has received
+        batch.clear();
+        REQUIRE(batch.add("AT+CCID") == 0);
+        REQUIRE(batch.add("AT+CGSN") == 1);
+        CHECK(parser.execBatch(&batch) == SYSTEM_ERROR_TIMEOUT);
+        CHECK(strm.output() == "AT+CCID\rAT+CGSN\r");
+        CHECK(batch.response(0).result() == AtResponse::OK);
+        CHECK(batch.response(1).result() == SYSTEM_ERROR_TIMEOUT);
+    }
+
+    SECTION("fails the remaining commands in case of an error and leaves the parser usable") {
+        strm.append("AT+CCID\r\r\n+CCID: 8901\r\n\r\nOK\r\nAT+CGSN\r\r\n");
+        batch.lookahead(2);
+        CHECK(parser.execBatch(&batch) == SYSTEM_ERROR_TIMEOUT);
+        CHECK(batch.response(0).result() == AtResponse::OK);
+        for (size_t i = 1; i < batch.size(); ++i) {
+            CHECK(batch.response(i).result() == SYSTEM_ERROR_TIMEOUT);
+        }
+        strm.append("AT\r\r\nOK\r\n");
+        CHECK(parser.execCommand("AT") == AtResponse::OK);
+    }
+}
+
+TEST_CASE("AtParser::execBatch() performance") {
+    // Sending the commands ahead of time hides the latency of the serial link and the DTE
+    const uint64_t initSeq = execTranscript(INIT_TRANSCRIPT, 1);
+    const uint64_t initPipelined = execTranscript(INIT_TRANSCRIPT, 4);
+    const uint64_t initMax = initSeq * 17 / 20;
+    CHECK(initPipelined < initMax);
+
+    const uint64_t signalSeq = execTranscript(SIGNAL_TRANSCRIPT, 1);
+    const uint64_t signalPipelined = execTranscript(SIGNAL_TRANSCRIPT, 4);
+    const uint64_t signalMax = signalSeq * 17 / 20;
+    CHECK(signalPipelined < signalMax);
+}
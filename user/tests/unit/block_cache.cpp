@@ -0,0 +1,237 @@
+#include "block_cache.h"
+
+#include "tools/catch.h"
+#include "tools/random.h"
+
+#include <string>
+
+using namespace particle;
+
+namespace {
+
+const size_t BLOCK_SIZE = 4096;
+const size_t BLOCK_COUNT = 16;
+const size_t DEVICE_SIZE = BLOCK_SIZE * BLOCK_COUNT;
+const size_t READ_SIZE = 256; // littlefs' read and program sizes
+const size_t PROG_SIZE = 256;
+
+// NOR flash emulated in RAM
+class RamDevice: public BlockDevice {
+public:
+    RamDevice() :
+            data_(DEVICE_SIZE, '\xff'),
+            worn_(false) {
+    }
+
+    int read(uint32_t addr, void* data, size_t size) override {
+        const size_t end = addr + size;
+        REQUIRE(end <= DEVICE_SIZE);
+        memcpy(data, data_.data() + addr, size);
+        return 0;
+    }
+
+    int write(uint32_t addr, const void* data, size_t size) override {
+        const size_t end = addr + size;
+        REQUIRE(end <= DEVICE_SIZE);
+        if (worn_) {
+            return 0;
+        }
+        for (size_t i = 0; i < size; ++i) {
+            data_[addr + i] &= ((const char*)data)[i];
+        }
+        return 0;
+    }
+
+    int erase(uint32_t addr, size_t size) override {
+        REQUIRE((addr % BLOCK_SIZE) == 0);
+        REQUIRE((size % BLOCK_SIZE) == 0);
+        const size_t end = addr + size;
+        REQUIRE(end <= DEVICE_SIZE);
+        if (!worn_) {
+            memset(&data_[addr], 0xff, size);
+        }
+        return 0;
+    }
+
+    const std::string& data() const {
+        return data_;
+    }
+
+    // Makes program and erase operations succeed without changing the contents of the flash
+    void worn(bool enabled) {
+        worn_ = enabled;
+    }
+
+private:
+    std::string data_;
+    bool worn_;
+};
+
+std::string read(BlockCache* cache, uint32_t addr, size_t size) {
+    std::string s(size, '\0');
+    REQUIRE(cache->read(addr, &s[0], size) == 0);
+    return s;
+}
+
+/*
+    Emulates the access pattern of an application that opens a small file, reads it and closes
+    it again, the way FileQueue and TlvFile do. littlefs fetches the metadata pair of the root
+    directory by reading the revision counts of both blocks and then the entries of the current
+    block, and reads the file data in chunks of the read size.
+*/
+void readFile(BlockCache* cache, size_t fileBlock, size_t fileSize) {
+    char buf[READ_SIZE] = {};
+    REQUIRE(cache->read(0, buf, 4) == 0);
+    REQUIRE(cache->read(BLOCK_SIZE, buf, 4) == 0);
+    for (size_t offs = 0; offs < 1024; offs += READ_SIZE) {
+        REQUIRE(cache->read(offs, buf, READ_SIZE) == 0);
+    }
+    for (size_t offs = 0; offs < fileSize; offs += READ_SIZE) {
+        REQUIRE(cache->read(fileBlock * BLOCK_SIZE + offs, buf, READ_SIZE) == 0);
+    }
+}
+
+} // namespace
+
+TEST_CASE("BlockCache") {
+    RamDevice dev;
+    BlockCache cache(&dev);
+
+    SECTION("passes all operations through to the device when there are no buffers") {
+        REQUIRE(cache.init(DEVICE_SIZE, 0, 0, 0, 0) == 0);
+        REQUIRE(cache.prog(100, "abc", 3) == 0);
+        CHECK(dev.data().substr(100, 3) == "abc");
+        CHECK(read(&cache, 100, 3) == "abc");
+        CHECK(read(&cache, 100, 3) == "abc");
+        REQUIRE(cache.erase(0, BLOCK_SIZE) == 0);
+        const auto& s = cache.stats();
+        CHECK(s.deviceReads == 2);
+        CHECK(s.deviceWrites == 1);
+        CHECK(s.deviceErases == 1);
+    }
+
+    SECTION("serves repeated reads from the cache") {
+        REQUIRE(cache.init(DEVICE_SIZE, 512, 4, 0, 0) == 0);
+        for (int i = 0; i < 10; ++i) {
+            read(&cache, 100, 200);
+        }
+        const auto& s = cache.stats();
+        CHECK(s.reads == 10);
+        CHECK(s.deviceReads == 1);
+        CHECK(s.deviceReadBytes == 512);
+        CHECK(s.readHits == 9);
+        CHECK(s.readMisses == 1);
+    }
+
+    SECTION("reads ahead on sequential access") {
+        REQUIRE(cache.init(DEVICE_SIZE, 512, 8, 3, 0) == 0);
+        for (size_t offs = 0; offs < 8 * 512; offs += READ_SIZE) {
+            read(&cache, offs, READ_SIZE);
+        }
+        // The first read is not known to be sequential
+        const auto& s = cache.stats();
+        CHECK(s.deviceReads == 3);
+        CHECK(s.deviceReadBytes == 9 * 512);
+        // Random access doesn't trigger read-ahead
+        cache.resetStats();
+        read(&cache, 10 * BLOCK_SIZE + 1000, 4);
+        CHECK(s.deviceReadBytes == 512);
+    }
+
+    SECTION("coalesces programs of adjacent ranges") {
+        REQUIRE(cache.init(DEVICE_SIZE, 512, 4, 0, 1024) == 0);
+        std::string data = test::randomBytes(1024);
+        for (size_t offs = 0; offs < data.size(); offs += PROG_SIZE) {
+            REQUIRE(cache.prog(BLOCK_SIZE + offs, data.data() + offs, PROG_SIZE) == 0);
+        }
+        const auto& s = cache.stats();
+        CHECK(s.progs == 4);
+        CHECK(s.deviceWrites == 0);
+        // The buffered data is written before it's read from the device
+        CHECK(read(&cache, BLOCK_SIZE, 1024) == data);
+        CHECK(s.deviceWrites == 1);
+        CHECK(dev.data().substr(BLOCK_SIZE, 1024) == data);
+        // A program of a non-adjacent range writes the buffered data
+        REQUIRE(cache.prog(2 * BLOCK_SIZE, "a", 1) == 0);
+        REQUIRE(cache.prog(3 * BLOCK_SIZE, "b", 1) == 0);
+        CHECK(s.deviceWrites == 2);
+        CHECK(dev.data()[2 * BLOCK_SIZE] == 'a');
+        REQUIRE(cache.sync() == 0);
+        CHECK(s.deviceWrites == 3);
+        CHECK(dev.data()[3 * BLOCK_SIZE] == 'b');
+    }
+
+    SECTION("reads programmed and erased data back from the device") {
+        REQUIRE(cache.init(DEVICE_SIZE, 512, 4, 0, 256) == 0);
+        REQUIRE(cache.prog(100, "abc", 3) == 0);
+        CHECK(read(&cache, 0, 512).substr(100, 3) == "abc");
+        const auto& s = cache.stats();
+        CHECK(s.deviceReads == 1);
+        // The data read back by littlefs to verify a program operation reflects the flash
+        dev.worn(true);
+        REQUIRE(cache.prog(200, "def", 3) == 0);
+        CHECK(read(&cache, 200, 3) == "\xff\xff\xff");
+        CHECK(s.deviceReads == 2);
+        REQUIRE(cache.erase(0, BLOCK_SIZE) == 0);
+        CHECK(read(&cache, 100, 3) == "abc");
+        CHECK(s.deviceReads == 3);
+        dev.worn(false);
+        REQUIRE(cache.erase(0, BLOCK_SIZE) == 0);
+        CHECK(read(&cache, 100, 3) == "\xff\xff\xff");
+        CHECK(s.deviceReads == 4);
+    }
+
+    SECTION("keeps the cached data consistent with the device") {
+        REQUIRE(cache.init(DEVICE_SIZE, 256, 6, 2, 512) == 0);
+        std::string model(DEVICE_SIZE, '\xff');
+        for (int i = 0; i < 5000; ++i) {
+            const int op = test::randomInt(0, 9);
+            if (op == 0) {
+                const uint32_t addr = test::randomInt(0, BLOCK_COUNT - 1) * BLOCK_SIZE;
+                REQUIRE(cache.erase(addr, BLOCK_SIZE) == 0);
+                memset(&model[addr], 0xff, BLOCK_SIZE);
+            } else if (op < 4) {
+                const size_t size = test::randomInt(1, 600);
+                const uint32_t addr = test::randomInt(0, DEVICE_SIZE - size);
+                const std::string data = test::randomBytes(size);
+                REQUIRE(cache.prog(addr, data.data(), size) == 0);
+                for (size_t j = 0; j < size; ++j) {
+                    model[addr + j] &= data[j];
+                }
+            } else if (op < 9) {
+                const size_t size = test::randomInt(1, 1000);
+                const uint32_t addr = test::randomInt(0, DEVICE_SIZE - size);
+                REQUIRE(read(&cache, addr, size) == model.substr(addr, size));
+            } else {
+                REQUIRE(cache.sync() == 0);
+                REQUIRE(dev.data() == model);
+            }
+        }
+    }
+
+    SECTION("reduces the number of flash reads performed by littlefs") {
+        const unsigned ITERATIONS = 100;
+        for (size_t fileSize: { 2048, 8192 }) {
+            // Without the cache
+            REQUIRE(cache.init(DEVICE_SIZE, 0, 0, 0, 0) == 0);
+            cache.resetStats();
+            for (unsigned i = 0; i < ITERATIONS; ++i) {
+                readFile(&cache, 5, fileSize);
+            }
+            const uint32_t uncachedReads = cache.stats().deviceReads;
+            CHECK(uncachedReads == ITERATIONS * (2 + 4 + fileSize / READ_SIZE));
+            // With the cache
+            REQUIRE(cache.init(DEVICE_SIZE, 512, 8, 3, 1024) == 0);
+            readFile(&cache, 5, fileSize);
+            cache.resetStats();
+            for (unsigned i = 0; i < ITERATIONS; ++i) {
+                readFile(&cache, 5, fileSize);
+            }
+            // A small file is read almost entirely from the cache, a file that is larger than the
+            // cache is read in fewer transfers
+            const uint32_t cachedReads = cache.stats().deviceReads;
+            const uint32_t maxReads = (fileSize == 2048) ? uncachedReads / 100 : uncachedReads / 4;
+            CHECK(cachedReads < maxReads);
+        }
+    }
+}
@@ -0,0 +1,107 @@
+#include "chunk_pipeline.h"
+#include "system_error.h"
+
+#include "tools/catch.h"
+#include "tools/random.h"
+
+#include <string>
+
+namespace {
+
+using namespace particle;
+
+const size_t CHUNK_SIZE = 16;
+
+struct Output {
+    std::string data;
+    unsigned writeCount = 0;
+    int error = 0;
+
+    static int write(const char* data, size_t size, void* ctx) {
+        const auto out = static_cast<Output*>(ctx);
+        if (out->error) {
+            return out->error;
+        }
+        out->data.append(data, size);
+        ++out->writeCount;
+        return 0;
+    }
+};
+
+} // namespace
+
+TEST_CASE("ChunkPipeline") {
+    ChunkPipeline p;
+    Output out;
+    REQUIRE(p.init(CHUNK_SIZE, Output::write, &out) == 0);
+    REQUIRE(p.chunkSize() == CHUNK_SIZE);
+
+    SECTION("buffers up to two chunks before writing") {
+        CHECK(p.receive(0, "aaa", 3) == 0);
+        CHECK(p.receive(1, "bb", 2) == 0);
+        CHECK(p.ack() == 2);
+        CHECK(p.bufferedBytes() == 5);
+        CHECK(out.writeCount == 0);
+        CHECK(p.receive(2, "c", 1) == 0);
+        CHECK(out.data == "aaa");
+        CHECK(p.bufferedBytes() == 3);
+        CHECK(p.flush() == 0);
+        CHECK(out.data == "aaabbc");
+        CHECK(p.bufferedBytes() == 0);
+    }
+
+    SECTION("ignores duplicate and out of order chunks") {
+        CHECK(p.receive(0, "a", 1) == 0);
+        CHECK(p.receive(0, "x", 1) == 0);
+        CHECK(p.receive(2, "y", 1) == 0);
+        CHECK(p.ack() == 1);
+        CHECK(p.receive(1, "b", 1) == 0);
+        CHECK(p.ack() == 2);
+        CHECK(p.flush() == 0);
+        CHECK(out.data == "ab");
+    }
+
+    SECTION("fails on chunks of invalid size") {
+        const std::string s(CHUNK_SIZE + 1, 'a');
+        CHECK(p.receive(0, s.data(), s.size()) == SYSTEM_ERROR_OUT_OF_RANGE);
+        CHECK(p.receive(0, s.data(), 0) == SYSTEM_ERROR_OUT_OF_RANGE);
+        CHECK(p.ack() == 0);
+    }
+
+    SECTION("write errors are sticky") {
+        CHECK(p.receive(0, "a", 1) == 0);
+        out.error = SYSTEM_ERROR_IO;
+        CHECK(p.flush() == SYSTEM_ERROR_IO);
+        out.error = 0;
+        CHECK(p.receive(1, "b", 1) == SYSTEM_ERROR_IO);
+        CHECK(p.flush() == SYSTEM_ERROR_IO);
+        CHECK(p.error() == SYSTEM_ERROR_IO);
+        CHECK(out.data.empty());
+        // The stream is reset by init()
+        REQUIRE(p.init(CHUNK_SIZE, Output::write, &out) == 0);
+        CHECK(p.receive(0, "c", 1) == 0);
+        CHECK(p.flush() == 0);
+        CHECK(out.data == "c");
+    }
+
+    SECTION("writes a stream of random chunks in order") {
+        std::string data;
+        uint32_t seq = 0;
+        while (seq < 1000) {
+            const auto chunk = test::randomString(1, CHUNK_SIZE);
+            // Occasionally retransmit the previous chunk
+            if (seq > 0 && test::randomInt(0, 3) == 0) {
+                REQUIRE(p.receive(seq - 1, chunk.data(), chunk.size()) == 0);
+            }
+            REQUIRE(p.receive(seq, chunk.data(), chunk.size()) == 0);
+            data += chunk;
+            ++seq;
+            REQUIRE(p.ack() == seq);
+            if (test::randomInt(0, 9) == 0) {
+                REQUIRE(p.flush() == 0);
+            }
+        }
+        REQUIRE(p.flush() == 0);
+        CHECK(out.data == data);
+    }
+}
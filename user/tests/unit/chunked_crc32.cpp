@@ -0,0 +1,137 @@
+#include "chunked_crc32.h"
+
+#include "tools/catch.h"
+#include "tools/random.h"
+
+#include <boost/crc.hpp>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace particle;
+
+namespace {
+
+uint32_t referenceCrc32(const std::string& data) {
+    boost::crc_32_type crc;
+    crc.process_bytes(data.data(), data.size());
+    return crc.checksum();
+}
+
+struct Chunk {
+    size_t offset;
+    size_t size;
+};
+
+std::vector<Chunk> splitIntoChunks(size_t size, size_t chunkSize) {
+    std::vector<Chunk> chunks;
+    for (size_t offs = 0; offs < size; offs += chunkSize) {
+        chunks.push_back({ offs, std::min(chunkSize, size - offs) });
+    }
+    return chunks;
+}
+
+void update(ChunkedCrc32* crc, const std::string& data, const Chunk& c) {
+    crc->update(c.offset, data.data() + c.offset, c.size);
+}
+
+} // namespace
+
+TEST_CASE("computeCrc32()") {
+    CHECK(computeCrc32("123456789", 9) == 0xcbf43926);
+    CHECK(computeCrc32(nullptr, 0) == 0);
+    const auto data = test::randomBytes(1000);
+    const uint32_t crc = computeCrc32(data.data(), 300);
+    CHECK(computeCrc32(data.data() + 300, 700, crc) == referenceCrc32(data));
+}
+
+TEST_CASE("combineCrc32()") {
+    for (int i = 0; i < 100; ++i) {
+        const auto data = test::randomBytes(1, 2000);
+        const size_t n = test::randomInt(0, data.size());
+        const uint32_t crc1 = computeCrc32(data.data(), n);
+        const uint32_t crc2 = computeCrc32(data.data() + n, data.size() - n);
+        CHECK(combineCrc32(crc1, crc2, data.size() - n) == referenceCrc32(data));
+    }
+}
+
+TEST_CASE("ChunkedCrc32") {
+    const auto data = test::randomBytes(64 * 1024);
+    const size_t chunkSize = 512;
+    auto chunks = splitIntoChunks(data.size(), chunkSize);
+    ChunkedCrc32 crc;
+
+    SECTION("chunks received in order") {
+        for (const auto& c: chunks) {
+            update(&crc, data, c);
+        }
+        crc.setLimit(data.size());
+        CHECK(crc.isComplete());
+        CHECK(crc.value() == referenceCrc32(data));
+    }
+
+    SECTION("chunks received out of order") {
+        // Shuffle the chunks within small windows, so that the number of pending chunks stays bounded
+        const size_t window = CHUNKED_CRC32_MAX_PENDING;
+        for (size_t i = 0; i < chunks.size(); i += window) {
+            std::shuffle(chunks.begin() + i, chunks.begin() + std::min(i + window, chunks.size()), test::randomGenerator());
+        }
+        for (const auto& c: chunks) {
+            update(&crc, data, c);
+            CHECK(crc.isValid());
+        }
+        crc.setLimit(data.size());
+        CHECK(crc.isComplete());
+        CHECK(crc.value() == referenceCrc32(data));
+    }
+
+    SECTION("retransmitted chunks are ignored") {
+        update(&crc, data, chunks[0]);
+        update(&crc, data, chunks[2]);
+        update(&crc, data, chunks[2]);
+        update(&crc, data, chunks[0]);
+        for (const auto& c: chunks) {
+            update(&crc, data, c);
+        }
+        crc.setLimit(data.size());
+        CHECK(crc.isComplete());
+        CHECK(crc.value() == referenceCrc32(data));
+    }
+
+    SECTION("the checksum is computed up to the limit") {
+        // The last chunks arrive before the limit is known
+        const size_t limit = data.size() - 4 * chunkSize - 100;
+        std::rotate(chunks.begin(), chunks.end() - 4, chunks.end());
+        update(&crc, data, chunks[0]);
+        update(&crc, data, chunks[1]);
+        update(&crc, data, chunks[2]);
+        update(&crc, data, chunks[3]);
+        update(&crc, data, chunks[4]);
+        crc.setLimit(limit);
+        for (size_t i = 5; i < chunks.size(); ++i) {
+            update(&crc, data, chunks[i]);
+        }
+        CHECK(crc.isComplete());
+        CHECK(crc.value() == referenceCrc32(data.substr(0, limit)));
+    }
+
+    SECTION("a pending chunk crossing the limit invalidates the checksum") {
+        update(&crc, data, chunks[10]);
+        crc.setLimit(chunks[10].offset + 1);
+        CHECK_FALSE(crc.isValid());
+    }
+
+    SECTION("too many pending chunks invalidate the checksum") {
+        for (size_t i = 1; i <= CHUNKED_CRC32_MAX_PENDING + 1; ++i) {
+            update(&crc, data, chunks[i]);
+        }
+        CHECK_FALSE(crc.isValid());
+    }
+
+    SECTION("overlapping chunks invalidate the checksum") {
+        crc.update(1000, data.data() + 1000, 500);
+        crc.update(1200, data.data() + 1200, 500);
+        CHECK_FALSE(crc.isValid());
+    }
+}
@@ -0,0 +1,148 @@
+#include "connection_race.h"
+
+#include "tools/catch.h"
+
+#include <vector>
+
+using namespace particle;
+
+namespace {
+
+// Attempt that succeeds or fails after a given time
+struct Attempt {
+    int result; // Result of the attempt
+    system_tick_t duration; // Time it takes to complete the attempt
+    int startResult; // Result of startAttempt()
+    system_tick_t started;
+    bool cancelled;
+};
+
+class Handler: public ConnectionRaceHandler {
+public:
+    std::vector<Attempt> attempts;
+    std::vector<size_t> order; // Order in which the attempts were started
+    system_tick_t now;
+
+    Handler() :
+            now(0) {
+    }
+
+    void add(int result, system_tick_t duration, int startResult = 0) {
+        attempts.push_back({ result, duration, startResult, 0, false });
+    }
+
+    int startAttempt(size_t index) override {
+        REQUIRE(index < attempts.size());
+        order.push_back(index);
+        attempts[index].started = now;
+        return attempts[index].startResult;
+    }
+
+    int checkAttempt(size_t index) override {
+        const Attempt& a = attempts.at(index);
+        REQUIRE(!a.cancelled);
+        if (now - a.started < a.duration) {
+            return 0;
+        }
+        return a.result;
+    }
+
+    void cancelAttempt(size_t index) override {
+        attempts.at(index).cancelled = true;
+    }
+};
+
+// Runs the race in steps of 10ms
+int run(ConnectionRace* race, Handler* h, system_tick_t* elapsed = nullptr) {
+    const system_tick_t start = h->now;
+    int r = 0;
+    while ((r = race->process(h->now)) == SYSTEM_ERROR_WOULD_BLOCK) {
+        h->now += 10;
+        const system_tick_t t = h->now - start;
+        REQUIRE(t < 60000);
+    }
+    if (elapsed) {
+        *elapsed = h->now - start;
+    }
+    return r;
+}
+
+} // namespace
+
+TEST_CASE("ConnectionRace") {
+    Handler h;
+    ConnectionRace race(&h);
+
+    SECTION("uses the first address if it succeeds before the attempt delay") {
+        h.add(1, 100);
+        h.add(1, 10);
+        REQUIRE(race.start(h.attempts.size(), h.now) == 0);
+        system_tick_t t = 0;
+        CHECK(run(&race, &h, &t) == 0);
+        CHECK(t == 100);
+        CHECK(h.order.size() == 1);
+    }
+
+    SECTION("starts the next attempt after the attempt delay and takes the first one that succeeds") {
+        h.add(1, 2000); // Slow path, e.g. via a broken NAT64
+        h.add(1, 100);
+        h.add(1, 100);
+        REQUIRE(race.start(h.attempts.size(), h.now) == 0);
+        system_tick_t t = 0;
+        CHECK(run(&race, &h, &t) == 1);
+        CHECK(t == 250 + 100);
+        CHECK(h.attempts[1].started == 250);
+        // The pending attempt is cancelled and the remaining one is not started
+        CHECK(h.attempts[0].cancelled);
+        CHECK_FALSE(h.attempts[1].cancelled);
+        CHECK(h.order.size() == 2);
+    }
+
+    SECTION("starts the next attempt immediately if an attempt fails") {
+        h.add(SYSTEM_ERROR_NETWORK, 30);
+        h.add(SYSTEM_ERROR_NETWORK, 0, SYSTEM_ERROR_NOT_SUPPORTED);
+        h.add(1, 20);
+        REQUIRE(race.start(h.attempts.size(), h.now) == 0);
+        system_tick_t t = 0;
+        CHECK(run(&race, &h, &t) == 2);
+        CHECK(h.attempts[2].started == 30);
+        CHECK(t == 50);
+        CHECK(h.order.size() == 3);
+    }
+
+    SECTION("fails if none of the attempts succeeds") {
+        h.add(SYSTEM_ERROR_NETWORK, 500);
+        h.add(SYSTEM_ERROR_NETWORK, 100);
+        REQUIRE(race.start(h.attempts.size(), h.now) == 0);
+        system_tick_t t = 0;
+        CHECK(run(&race, &h, &t) == SYSTEM_ERROR_NOT_FOUND);
+        CHECK(t == 500);
+    }
+
+    SECTION("times out if the attempts take too long") {
+        h.add(1, 5000);
+        h.add(1, 5000);
+        REQUIRE(race.start(h.attempts.size(), h.now, 100, 1000) == 0);
+        system_tick_t t = 0;
+        CHECK(run(&race, &h, &t) == SYSTEM_ERROR_TIMEOUT);
+        CHECK(t == 1000);
+        CHECK(h.attempts[0].cancelled);
+        CHECK(h.attempts[1].cancelled);
+        CHECK(race.process(h.now) == SYSTEM_ERROR_TIMEOUT);
+    }
+
+    SECTION("cancels the pending attempts when it's destroyed") {
+        h.add(1, 5000);
+        {
+            ConnectionRace r(&h);
+            REQUIRE(r.start(1, h.now) == 0);
+            CHECK(r.process(h.now) == SYSTEM_ERROR_WOULD_BLOCK);
+        }
+        CHECK(h.attempts[0].cancelled);
+    }
+
+    SECTION("rejects invalid arguments") {
+        CHECK(race.start(0, h.now) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(race.start(ConnectionRace::MAX_ATTEMPTS + 1, h.now) == SYSTEM_ERROR_INVALID_ARGUMENT);
+    }
+}
@@ -0,0 +1,173 @@
+#include "dcd_log.h"
+#include "flash_storage.h"
+#include "chunked_crc32.h"
+
+#include "tools/catch.h"
+#include "tools/random.h"
+
+#include <string>
+
+namespace {
+
+const int SectorSize = 16000;
+const int SectorBase = 4000;
+const unsigned DataSize = 1000;
+
+using Store = RAMFlashStorage<SectorBase, 2, SectorSize>;
+
+uint32_t crc32(const void* data, size_t size) {
+    return particle::computeCrc32(data, size);
+}
+
+using BaseDCD = DCD<Store, SectorSize, SectorBase, SectorBase + SectorSize, crc32>;
+
+class TestDCD: public LogDCD<BaseDCD, DataSize> {
+public:
+    std::string data() {
+        return std::string((const char*)read(0), DataSize);
+    }
+
+    int write(unsigned offset, const std::string& data) {
+        return LogDCD::write(offset, data.data(), data.size());
+    }
+
+    // Reads the data as the double-buffered implementation would
+    std::string baseData() {
+        return std::string((const char*)BaseDCD::read(0), DataSize);
+    }
+};
+
+} // namespace
+
+TEST_CASE("LogDCD") {
+    TestDCD dcd;
+    std::string data(DataSize, '\xff');
+
+    SECTION("uninitialized data is read as 0xff") {
+        CHECK_FALSE(dcd.isInitialized());
+        CHECK(dcd.data() == data);
+        CHECK(dcd.read(DataSize) == nullptr);
+    }
+
+    SECTION("fails to write outside of the data region") {
+        CHECK(dcd.write(DataSize, "a") == TestDCD::DCD_INVALID_OFFSET);
+        CHECK(dcd.write(DataSize - 1, "ab") == TestDCD::DCD_INVALID_LENGTH);
+    }
+
+    SECTION("small writes are appended to the log without erasing the sector") {
+        REQUIRE(dcd.write(0, std::string(DataSize, 'x')) == 0);
+        CHECK(dcd.isInitialized());
+        data = std::string(DataSize, 'x');
+        dcd.store.resetEraseCount();
+        for (int i = 0; i < 500; ++i) {
+            const unsigned offs = test::randomInt(0, DataSize - 4);
+            const std::string s = test::randomString(4);
+            REQUIRE(dcd.write(offs, s) == 0);
+            data.replace(offs, s.size(), s);
+        }
+        CHECK(dcd.store.getEraseCount() == 0);
+        CHECK(dcd.data() == data);
+        dcd.sync();
+        CHECK(dcd.data() == data);
+    }
+
+    SECTION("only the changed bytes are written") {
+        REQUIRE(dcd.write(0, std::string(DataSize, 'x')) == 0);
+        const size_t avail = dcd.logAvailable();
+        std::string s(500, 'x');
+        REQUIRE(dcd.write(100, s) == 0);
+        CHECK(dcd.logAvailable() == avail);
+        s[10] = 'y';
+        s[12] = 'z';
+        REQUIRE(dcd.write(100, s) == 0);
+        CHECK(dcd.logAvailable() == avail - 12); // 4-byte header, 3 bytes of data padded to 4, CRC
+    }
+
+    SECTION("the data is compacted into the alternate sector when the log is full") {
+        for (int i = 0; i < 5000; ++i) {
+            const unsigned offs = test::randomInt(0, DataSize - 10);
+            const std::string s = test::randomString(test::randomInt(1, 10));
+            REQUIRE(dcd.write(offs, s) == 0);
+            data.replace(offs, s.size(), s);
+        }
+        // Each record takes at most 20 bytes, and there's about 15K of space in the log
+        CHECK(dcd.store.getEraseCount() < 10);
+        dcd.sync();
+        CHECK(dcd.data() == data);
+    }
+
+    SECTION("a snapshot is readable by the double-buffered implementation until the log is appended to") {
+        REQUIRE(dcd.write(0, std::string(DataSize, 'a')) == 0);
+        CHECK(dcd.baseData() == std::string(DataSize, 'a'));
+        // Fill the log and force a compaction
+        while (dcd.logAvailable() >= 16) {
+            REQUIRE(dcd.write(0, test::randomString(4)) == 0);
+        }
+        REQUIRE(dcd.write(0, std::string(DataSize, 'b')) == 0);
+        REQUIRE(dcd.write(0, "c") == 0);
+        // The previous snapshot is used when the CRC of the current sector doesn't match
+        CHECK(dcd.baseData() == std::string(DataSize, 'a'));
+        data = std::string(DataSize, 'b');
+        data[0] = 'c';
+        dcd.sync();
+        CHECK(dcd.data() == data);
+    }
+
+    SECTION("flushing the log makes the current data readable by the double-buffered implementation") {
+        REQUIRE(dcd.write(0, std::string(DataSize, 'a')) == 0);
+        REQUIRE(dcd.flush() == 0);
+        dcd.store.resetEraseCount();
+        // Nothing to fold
+        REQUIRE(dcd.flush() == 0);
+        CHECK(dcd.store.getEraseCount() == 0);
+        REQUIRE(dcd.write(10, "bcd") == 0);
+        data = std::string(DataSize, 'a');
+        data.replace(10, 3, "bcd");
+        CHECK(dcd.baseData() != data);
+        REQUIRE(dcd.flush() == 0);
+        CHECK(dcd.store.getEraseCount() == 1);
+        CHECK(dcd.baseData() == data);
+        dcd.sync();
+        CHECK(dcd.data() == data);
+        // The new snapshot takes further updates in its log
+        REQUIRE(dcd.write(20, "e") == 0);
+        data[20] = 'e';
+        CHECK(dcd.store.getEraseCount() == 1);
+        dcd.sync();
+        CHECK(dcd.data() == data);
+    }
+
+    SECTION("data written by the double-buffered implementation is imported") {
+        data = test::randomString(DataSize);
+        REQUIRE(dcd.BaseDCD::write(0, data.data(), data.size()) == 0);
+        dcd.sync();
+        CHECK(dcd.data() == data);
+        REQUIRE(dcd.write(10, "abc") == 0);
+        data.replace(10, 3, "abc");
+        dcd.sync();
+        CHECK(dcd.data() == data);
+    }
+
+    SECTION("interrupted writes don't corrupt the data") {
+        REQUIRE(dcd.write(0, std::string(DataSize, 'x')) == 0);
+        data = std::string(DataSize, 'x');
+        for (int i = 0; i < 3000; ++i) {
+            const unsigned offs = test::randomInt(0, DataSize - 10);
+            const std::string s = test::randomString(test::randomInt(1, 10));
+            std::string newData = data;
+            newData.replace(offs, s.size(), s);
+            // Interrupt either a record or a compaction at a random point
+            const int writeCount = test::randomInt(0, (i % 2) ? 30 : 1100);
+            dcd.store.discardWritesAfter(writeCount, [&]() {
+                dcd.write(offs, s);
+            });
+            dcd.sync();
+            const std::string d = dcd.data();
+            if (d == newData) {
+                data = newData;
+            } else {
+                REQUIRE(d == data);
+            }
+        }
+    }
+}
@@ -0,0 +1,328 @@
+#include "delta_patch.h"
+
+#include "tools/catch.h"
+#include "tools/random.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace particle;
+
+namespace {
+
+const size_t MIN_MATCH_SIZE = 16;
+const size_t MAX_MISMATCH_RUN = 8;
+
+// Host-side patch generator. Finds regions of the target that match the source with a few bytes
+// changed, and encodes everything else as extra data
+class DeltaPatcher {
+public:
+    DeltaPatcher(const std::string& source, const std::string& target) :
+            src_(source),
+            dest_(target),
+            extraSize_(0) {
+        for (size_t i = 0; i + MIN_MATCH_SIZE <= src_.size(); ++i) {
+            index_.emplace(src_.substr(i, MIN_MATCH_SIZE), i);
+        }
+    }
+
+    std::string create() {
+        std::string patch;
+        DeltaPatchHeader h = {};
+        h.magic = DELTA_PATCH_MAGIC;
+        h.moduleFunction = 5; // MODULE_FUNCTION_USER_PART
+        h.moduleIndex = 1;
+        h.sourceSize = src_.size();
+        h.targetSize = dest_.size();
+        patch.append((const char*)&h, sizeof(h));
+        size_t srcPos = 0; // Source position of the current match
+        size_t destPos = 0; // Target position of the current match
+        size_t matchSize = 0;
+        while (destPos + matchSize < dest_.size()) {
+            // Find the next match
+            const size_t extraPos = destPos + matchSize;
+            size_t nextDestPos = extraPos;
+            int nextSrcPos = -1;
+            for (; nextDestPos < dest_.size(); ++nextDestPos) {
+                nextSrcPos = findMatch(nextDestPos, srcPos + matchSize + (nextDestPos - extraPos));
+                if (nextSrcPos >= 0) {
+                    break;
+                }
+            }
+            const size_t nextMatchSize = (nextSrcPos >= 0) ? extendMatch(nextSrcPos, nextDestPos) : 0;
+            const int32_t seek = (nextSrcPos >= 0) ? nextSrcPos - (int)(srcPos + matchSize) : 0;
+            appendRecord(&patch, srcPos, destPos, matchSize, nextDestPos - extraPos, seek);
+            srcPos = (nextSrcPos >= 0) ? nextSrcPos : srcPos + matchSize;
+            destPos = nextDestPos;
+            matchSize = nextMatchSize;
+        }
+        if (matchSize > 0) {
+            appendRecord(&patch, srcPos, destPos, matchSize, 0, 0);
+        }
+        return patch;
+    }
+
+    size_t extraSize() const {
+        return extraSize_;
+    }
+
+private:
+    std::string src_;
+    std::string dest_;
+    std::unordered_multimap<std::string, size_t> index_;
+    size_t extraSize_;
+
+    int findMatch(size_t destPos, size_t expectedSrcPos) const {
+        if (destPos + MIN_MATCH_SIZE > dest_.size()) {
+            return -1;
+        }
+        // Prefer continuing from the current source position
+        if (expectedSrcPos + MIN_MATCH_SIZE <= src_.size() &&
+                src_.compare(expectedSrcPos, MIN_MATCH_SIZE, dest_, destPos, MIN_MATCH_SIZE) == 0) {
+            return expectedSrcPos;
+        }
+        const auto it = index_.find(dest_.substr(destPos, MIN_MATCH_SIZE));
+        return (it != index_.end()) ? it->second : -1;
+    }
+
+    // Extends a match while the number of consecutive mismatching bytes is small
+    size_t extendMatch(size_t srcPos, size_t destPos) const {
+        size_t size = 0;
+        size_t lastMatch = 0;
+        size_t mismatchRun = 0;
+        while (srcPos + size < src_.size() && destPos + size < dest_.size() && mismatchRun < MAX_MISMATCH_RUN) {
+            if (src_[srcPos + size] == dest_[destPos + size]) {
+                mismatchRun = 0;
+                lastMatch = size + 1;
+            } else {
+                ++mismatchRun;
+            }
+            ++size;
+        }
+        return lastMatch;
+    }
+
+    void appendRecord(std::string* patch, size_t srcPos, size_t destPos, size_t diffSize, size_t extraSize, int32_t seek) {
+        DeltaPatchRecord r = {};
+        r.diffSize = diffSize;
+        r.extraSize = extraSize;
+        r.seek = seek;
+        patch->append((const char*)&r, sizeof(r));
+        for (size_t i = 0; i < diffSize; ++i) {
+            patch->push_back(dest_[destPos + i] - src_[srcPos + i]);
+        }
+        patch->append(dest_, destPos + diffSize, extraSize);
+        extraSize_ += extraSize;
+    }
+};
+
+// File-backed flash storage
+class FileFlash {
+public:
+    FileFlash() :
+            file_(std::tmpfile()) {
+    }
+
+    ~FileFlash() {
+        std::fclose(file_);
+    }
+
+    int write(size_t offset, const char* data, size_t size) {
+        if (std::fseek(file_, offset, SEEK_SET) != 0 || std::fwrite(data, 1, size, file_) != size) {
+            return SYSTEM_ERROR_IO;
+        }
+        return 0;
+    }
+
+    int read(size_t offset, char* data, size_t size) {
+        if (std::fseek(file_, offset, SEEK_SET) != 0 || std::fread(data, 1, size, file_) != size) {
+            return SYSTEM_ERROR_IO;
+        }
+        return 0;
+    }
+
+    std::string data(size_t offset, size_t size) {
+        std::string s(size, '\0');
+        read(offset, &s[0], size);
+        return s;
+    }
+
+private:
+    std::FILE* file_;
+};
+
+class FlashSource: public DeltaPatchSource {
+public:
+    FlashSource(FileFlash* flash, size_t address) :
+            flash_(flash),
+            addr_(address),
+            maxReadSize_(0) {
+    }
+
+    int read(size_t offset, char* data, size_t size) override {
+        maxReadSize_ = std::max(maxReadSize_, size);
+        return flash_->read(addr_ + offset, data, size);
+    }
+
+    size_t maxReadSize() const {
+        return maxReadSize_;
+    }
+
+private:
+    FileFlash* flash_;
+    size_t addr_;
+    size_t maxReadSize_;
+};
+
+class FlashOutputStream: public OutputStream {
+public:
+    FlashOutputStream(FileFlash* flash, size_t address) :
+            flash_(flash),
+            addr_(address),
+            written_(0) {
+    }
+
+    int write(const char* data, size_t size) override {
+        const int ret = flash_->write(addr_ + written_, data, size);
+        if (ret < 0) {
+            return ret;
+        }
+        written_ += size;
+        return size;
+    }
+
+    int flush() override {
+        return 0;
+    }
+
+    int availForWrite() override {
+        return INT_MAX;
+    }
+
+    int waitEvent(unsigned flags, unsigned timeout) override {
+        return 0;
+    }
+
+    size_t written() const {
+        return written_;
+    }
+
+private:
+    FileFlash* flash_;
+    size_t addr_;
+    size_t written_;
+};
+
+// Generates a modified version of a module: a few constants changed, some code inserted and removed
+std::string modifyModule(const std::string& source) {
+    std::string target = source;
+    for (int i = 0; i < 20; ++i) {
+        target[test::randomInt(0, target.size() - 1)] ^= 0x10;
+    }
+    target.insert(10000, test::randomBytes(300));
+    target.erase(30000, 500);
+    target += test::randomBytes(1000);
+    return target;
+}
+
+const size_t SOURCE_ADDRESS = 0;
+const size_t PATCH_ADDRESS = 128 * 1024;
+const size_t TARGET_ADDRESS = 256 * 1024;
+
+int applyPatch(FileFlash* flash, size_t patchSize, size_t chunkSize, size_t* targetSize) {
+    FlashSource source(flash, SOURCE_ADDRESS);
+    FlashOutputStream out(flash, TARGET_ADDRESS);
+    DeltaPatchStream patch(&source, &out);
+    std::vector<char> buf(chunkSize);
+    for (size_t offs = 0; offs < patchSize && !patch.done(); offs += chunkSize) {
+        const size_t n = std::min(chunkSize, patchSize - offs);
+        REQUIRE(flash->read(PATCH_ADDRESS + offs, buf.data(), n) == 0);
+        const int ret = patch.write(buf.data(), n);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    *targetSize = out.written();
+    return patch.finish();
+}
+
+} // namespace
+
+TEST_CASE("DeltaPatchStream") {
+    const std::string source = test::randomBytes(64 * 1024);
+    const std::string target = modifyModule(source);
+    DeltaPatcher patcher(source, target);
+    const std::string patch = patcher.create();
+    FileFlash flash;
+    REQUIRE(flash.write(SOURCE_ADDRESS, source.data(), source.size()) == 0);
+    size_t targetSize = 0;
+
+    SECTION("reconstructs the target module from the source module and the patch") {
+        // Only the inserted and appended data is transferred as is
+        CHECK(patcher.extraSize() < 1500);
+        REQUIRE(flash.write(PATCH_ADDRESS, patch.data(), patch.size()) == 0);
+        for (size_t chunkSize: { 1, 13, 512, (int)patch.size() }) {
+            REQUIRE(applyPatch(&flash, patch.size(), chunkSize, &targetSize) == 0);
+            CHECK(targetSize == target.size());
+            CHECK(flash.data(TARGET_ADDRESS, target.size()) == target);
+        }
+    }
+
+    SECTION("the source module is read in bounded chunks") {
+        FlashSource src(&flash, SOURCE_ADDRESS);
+        FlashOutputStream out(&flash, TARGET_ADDRESS);
+        DeltaPatchStream strm(&src, &out);
+        REQUIRE(strm.write(patch.data(), patch.size()) == (int)patch.size());
+        REQUIRE(strm.finish() == 0);
+        const size_t bufSize = DELTA_PATCH_BUFFER_SIZE;
+        CHECK(src.maxReadSize() == bufSize);
+        REQUIRE(strm.header() != nullptr);
+        CHECK(strm.header()->targetSize == target.size());
+    }
+
+    SECTION("data following the patch is not consumed") {
+        std::string data = patch + std::string(100, 'x');
+        FlashSource src(&flash, SOURCE_ADDRESS);
+        FlashOutputStream out(&flash, TARGET_ADDRESS);
+        DeltaPatchStream strm(&src, &out);
+        CHECK(strm.write(data.data(), data.size()) == (int)patch.size());
+        CHECK(strm.done());
+    }
+
+    SECTION("fails on a truncated patch") {
+        REQUIRE(flash.write(PATCH_ADDRESS, patch.data(), patch.size()) == 0);
+        CHECK(applyPatch(&flash, patch.size() - 100, 512, &targetSize) == SYSTEM_ERROR_BAD_DATA);
+    }
+
+    SECTION("fails on a malformed patch") {
+        std::string p = patch;
+        SECTION("invalid magic number") {
+            p[0] ^= 0xff;
+        }
+        SECTION("record exceeding the size of the target module") {
+            DeltaPatchRecord r = {};
+            memcpy(&r, &p[sizeof(DeltaPatchHeader)], sizeof(r));
+            r.extraSize = target.size() + 1;
+            memcpy(&p[sizeof(DeltaPatchHeader)], &r, sizeof(r));
+        }
+        SECTION("seeking outside of the source module") {
+            DeltaPatchRecord r = {};
+            memcpy(&r, &p[sizeof(DeltaPatchHeader)], sizeof(r));
+            r.seek = source.size() * 2;
+            memcpy(&p[sizeof(DeltaPatchHeader)], &r, sizeof(r));
+        }
+        REQUIRE(flash.write(PATCH_ADDRESS, p.data(), p.size()) == 0);
+        CHECK(applyPatch(&flash, p.size(), 512, &targetSize) == SYSTEM_ERROR_BAD_DATA);
+    }
+}
+
+TEST_CASE("DeltaPatchStream::isPatch()") {
+    const uint32_t magic = DELTA_PATCH_MAGIC;
+    CHECK(DeltaPatchStream::isPatch((const char*)&magic, sizeof(magic)));
+    CHECK_FALSE(DeltaPatchStream::isPatch((const char*)&magic, sizeof(magic) - 1));
+    const char moduleImage[] = { 0x00, 0x40, 0x0d, 0x00 };
+    CHECK_FALSE(DeltaPatchStream::isPatch(moduleImage, sizeof(moduleImage)));
+}
@@ -0,0 +1,158 @@
+#include "dns_cache.h"
+
+#include "tools/catch.h"
+
+#include <string>
+
+using namespace particle;
+
+namespace {
+
+const uint8_t INET = 2;
+const uint8_t INET6 = 10;
+
+const uint32_t NOW = 1560000000;
+
+const uint8_t ADDR1[4] = { 192, 168, 1, 1 };
+const uint8_t ADDR2[4] = { 10, 0, 0, 2 };
+const uint8_t ADDR6[16] = { 0x00, 0x64, 0xff, 0x9b, 0, 0, 0, 0, 0, 0, 0, 0, 192, 168, 1, 1 };
+
+std::string lookup(DnsCache* cache, const char* name, uint8_t family, uint32_t now, int expected,
+        bool* revalidate = nullptr) {
+    uint8_t addr[DnsCache::MAX_ADDRESS_SIZE] = {};
+    size_t size = sizeof(addr);
+    const int r = cache->lookup(name, family, addr, &size, now, revalidate);
+    REQUIRE(r == expected);
+    if (r == DnsCache::NOT_FOUND) {
+        return std::string();
+    }
+    return std::string((const char*)addr, size);
+}
+
+std::string str(const uint8_t* addr, size_t size) {
+    return std::string((const char*)addr, size);
+}
+
+} // namespace
+
+TEST_CASE("DnsCache") {
+    DnsCache cache;
+    const uint32_t maxAge = DnsCache::DEFAULT_MAX_AGE;
+    const uint32_t maxStale = DnsCache::DEFAULT_MAX_STALE;
+
+    SECTION("returns fresh entries") {
+        lookup(&cache, "a.particle.io", INET, NOW, DnsCache::NOT_FOUND);
+        REQUIRE(cache.update("a.particle.io", INET, ADDR1, 4, NOW) == 0);
+        REQUIRE(cache.update("a.particle.io", INET6, ADDR6, 16, NOW) == 0);
+        CHECK(lookup(&cache, "a.particle.io", INET, NOW + 10, DnsCache::FRESH) == str(ADDR1, 4));
+        CHECK(lookup(&cache, "A.Particle.IO", INET6, NOW + maxAge - 1, DnsCache::FRESH) == str(ADDR6, 16));
+        lookup(&cache, "b.particle.io", INET, NOW, DnsCache::NOT_FOUND);
+        const auto& s = cache.stats();
+        CHECK(s.hits == 2);
+        CHECK(s.misses == 2);
+        CHECK(s.updates == 2);
+    }
+
+    SECTION("returns stale entries and requests revalidation once") {
+        REQUIRE(cache.update("a.particle.io", INET, ADDR1, 4, NOW) == 0);
+        bool reval = false;
+        CHECK(lookup(&cache, "a.particle.io", INET, NOW + maxAge, DnsCache::STALE, &reval) == str(ADDR1, 4));
+        CHECK(reval);
+        lookup(&cache, "a.particle.io", INET, NOW + maxAge, DnsCache::STALE, &reval);
+        CHECK_FALSE(reval);
+        // Revalidation failed
+        cache.cancelRevalidation("a.particle.io", INET);
+        lookup(&cache, "a.particle.io", INET, NOW + maxAge, DnsCache::STALE, &reval);
+        CHECK(reval);
+        // Revalidation succeeded
+        REQUIRE(cache.update("a.particle.io", INET, ADDR2, 4, NOW + maxAge) == 0);
+        CHECK(lookup(&cache, "a.particle.io", INET, NOW + maxAge, DnsCache::FRESH, &reval) == str(ADDR2, 4));
+        CHECK_FALSE(reval);
+        CHECK(cache.stats().staleHits == 3);
+    }
+
+    SECTION("treats entries as stale if the time is unknown") {
+        REQUIRE(cache.update("a.particle.io", INET, ADDR1, 4, NOW) == 0);
+        REQUIRE(cache.update("b.particle.io", INET, ADDR2, 4, DnsCache::UNKNOWN_TIME) == 0);
+        lookup(&cache, "a.particle.io", INET, DnsCache::UNKNOWN_TIME, DnsCache::STALE);
+        lookup(&cache, "b.particle.io", INET, NOW, DnsCache::STALE);
+        // The clock went backwards
+        lookup(&cache, "a.particle.io", INET, NOW - 100, DnsCache::STALE);
+    }
+
+    SECTION("discards entries that have been stale for too long") {
+        REQUIRE(cache.update("a.particle.io", INET, ADDR1, 4, NOW) == 0);
+        lookup(&cache, "a.particle.io", INET, NOW + maxAge + maxStale - 1, DnsCache::STALE);
+        lookup(&cache, "a.particle.io", INET, NOW + maxAge + maxStale, DnsCache::NOT_FOUND);
+        CHECK(cache.size() == 0);
+    }
+
+    SECTION("replaces the least recently used entry when full") {
+        char name[16] = {};
+        for (size_t i = 0; i < DnsCache::MAX_ENTRIES; ++i) {
+            snprintf(name, sizeof(name), "host%u", (unsigned)i);
+            REQUIRE(cache.update(name, INET, ADDR1, 4, NOW) == 0);
+        }
+        lookup(&cache, "host0", INET, NOW, DnsCache::FRESH);
+        REQUIRE(cache.update("new", INET, ADDR2, 4, NOW) == 0);
+        CHECK(cache.size() == (size_t)DnsCache::MAX_ENTRIES);
+        lookup(&cache, "host0", INET, NOW, DnsCache::FRESH);
+        lookup(&cache, "host1", INET, NOW, DnsCache::NOT_FOUND);
+        lookup(&cache, "new", INET, NOW, DnsCache::FRESH);
+    }
+
+    SECTION("can be serialized and restored") {
+        char name[16] = {};
+        for (size_t i = 0; i < DnsCache::MAX_ENTRIES; ++i) {
+            snprintf(name, sizeof(name), "host%u", (unsigned)i);
+            REQUIRE(cache.update(name, (i & 1) ? INET6 : INET, (i & 1) ? ADDR6 : ADDR1, (i & 1) ? 16 : 4, NOW + i) == 0);
+        }
+        lookup(&cache, "host0", INET, NOW, DnsCache::FRESH);
+        std::string data(cache.serializedSize(), '\0');
+        const int n = cache.serialize((uint8_t*)&data[0], data.size());
+        REQUIRE(n == (int)data.size());
+        DnsCache c;
+        REQUIRE(c.deserialize((const uint8_t*)data.data(), data.size()) == 0);
+        CHECK(c.size() == (size_t)DnsCache::MAX_ENTRIES);
+        CHECK(lookup(&c, "host3", INET6, NOW + 3, DnsCache::FRESH) == str(ADDR6, 16));
+        lookup(&c, "host2", INET, NOW + 2 + maxAge, DnsCache::STALE);
+        // The order of use is preserved
+        REQUIRE(c.update("new", INET, ADDR2, 4, NOW) == 0);
+        lookup(&c, "host0", INET, NOW, DnsCache::FRESH);
+        lookup(&c, "host1", INET6, NOW, DnsCache::NOT_FOUND);
+        // Invalid data
+        CHECK(c.deserialize((const uint8_t*)data.data(), data.size() - 1) == SYSTEM_ERROR_BAD_DATA);
+        CHECK(c.size() == 0);
+        data[0] = 'x';
+        CHECK(c.deserialize((const uint8_t*)data.data(), data.size()) == SYSTEM_ERROR_BAD_DATA);
+        CHECK(c.serialize((uint8_t*)&data[0], 7) == SYSTEM_ERROR_TOO_LARGE);
+    }
+
+    SECTION("caches hosts without an address of the family") {
+        REQUIRE(cache.update("a.particle.io", INET, ADDR1, 4, NOW) == 0);
+        REQUIRE(cache.update("a.particle.io", INET6, nullptr, 0, NOW) == 0);
+        CHECK(lookup(&cache, "a.particle.io", INET6, NOW + 10, DnsCache::FRESH).empty());
+        bool reval = false;
+        CHECK(lookup(&cache, "a.particle.io", INET6, NOW + maxAge, DnsCache::STALE, &reval).empty());
+        CHECK(reval);
+        // The host got an IPv6 address
+        REQUIRE(cache.update("a.particle.io", INET6, ADDR6, 16, NOW + maxAge) == 0);
+        CHECK(lookup(&cache, "a.particle.io", INET6, NOW + maxAge, DnsCache::FRESH) == str(ADDR6, 16));
+        REQUIRE(cache.update("b.particle.io", INET6, nullptr, 0, NOW) == 0);
+        std::string data(cache.serializedSize(), '\0');
+        REQUIRE(cache.serialize((uint8_t*)&data[0], data.size()) == (int)data.size());
+        DnsCache c;
+        REQUIRE(c.deserialize((const uint8_t*)data.data(), data.size()) == 0);
+        CHECK(lookup(&c, "b.particle.io", INET6, NOW, DnsCache::FRESH).empty());
+        CHECK(lookup(&c, "a.particle.io", INET, NOW, DnsCache::FRESH) == str(ADDR1, 4));
+    }
+
+        SECTION("rejects invalid entries") {
+        const std::string longName(DnsCache::MAX_NAME_LENGTH + 1, 'a');
+        CHECK(cache.update(longName.c_str(), INET, ADDR1, 4, NOW) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(cache.update("", INET, ADDR1, 4, NOW) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(cache.update("a", INET, ADDR6, 17, NOW) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(cache.update("a", INET, nullptr, 4, NOW) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(cache.size() == 0);
+    }
+}
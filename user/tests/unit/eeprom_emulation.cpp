@@ -4,6 +4,9 @@
 #include <string>
 #include <fstream>
 #include <sstream>
+#include <iostream>
+#include <random>
+#include <vector>
 #include "eeprom_emulation.h"
 #include "flash_storage.h"
 
@@ -1338,3 +1341,368 @@ TEST_CASE("Page swap with data in multiple batches", "[eeprom]")
         REQUIRE(dataRead == data);
     }
 }
+
+TEST_CASE("Write combining", "[eeprom]")
+{
+    TestEEPROM eeprom;
+    EEPROMTester tester(eeprom);
+    eeprom.init();
+    eeprom.setWriteCombining(true);
+
+    SECTION("Buffered writes can be read back before they're flushed")
+    {
+        eeprom.put(10, 0xAA);
+        uint16_t block = 0x1234;
+        eeprom.put(20, &block, sizeof(block));
+
+        REQUIRE(eeprom.hasPendingWrites());
+        tester.requireContents(PageBase1, PAGE_ACTIVE);
+
+        uint8_t data[12];
+        eeprom.get(10, data, sizeof(data));
+        REQUIRE(data[0] == 0xAA);
+        REQUIRE(data[1] == 0xFF);
+        REQUIRE(data[10] == 0x34);
+        REQUIRE(data[11] == 0x12);
+    }
+
+    SECTION("Repeated writes to the same index produce a single record")
+    {
+        for(int i = 0; i < 10; i++)
+        {
+            eeprom.put(10, (uint8_t)i);
+        }
+        eeprom.put(11, 0xBB);
+
+        eeprom.flush();
+
+        REQUIRE_FALSE(eeprom.hasPendingWrites());
+        // Records are written backwards from the end
+        tester.requireContents(PageBase1, PAGE_ACTIVE, {
+            Record(11, 0xBB),
+            Record(10, 9)
+        });
+    }
+
+    SECTION("The buffer is flushed when it's full")
+    {
+        uint8_t data[EEPROM_WRITE_COMBINING_BUFFER_SIZE] = {};
+        eeprom.put(0, data, sizeof(data));
+        REQUIRE(eeprom.hasPendingWrites());
+        tester.requireContents(PageBase1, PAGE_ACTIVE);
+
+        eeprom.put(100, 0x01);
+
+        // The first block was written, the second one is buffered
+        uint8_t dataRead = 0xFF;
+        eeprom.store.read(PageBase1 + sizeof(TestEEPROM::PageHeader), &dataRead, sizeof(dataRead));
+        REQUIRE(dataRead == 0);
+        eeprom.get(100, dataRead);
+        REQUIRE(dataRead == 0x01);
+    }
+
+    SECTION("Large writes are not buffered")
+    {
+        eeprom.put(0, 0x01);
+        uint8_t data[EEPROM_WRITE_COMBINING_BUFFER_SIZE + 1] = {};
+        eeprom.put(1, data, sizeof(data));
+        REQUIRE_FALSE(eeprom.hasPendingWrites());
+
+        uint8_t dataRead;
+        eeprom.get(0, dataRead);
+        REQUIRE(dataRead == 0x01);
+    }
+
+    SECTION("Disabling write combining flushes the buffer")
+    {
+        eeprom.put(10, 0xAA);
+        eeprom.setWriteCombining(false);
+
+        REQUIRE_FALSE(eeprom.hasPendingWrites());
+        tester.requireContents(PageBase1, PAGE_ACTIVE, {
+            Record(10, 0xAA)
+        });
+    }
+
+    SECTION("Buffered writes are flushed in the background")
+    {
+        eeprom.put(10, 0xAA);
+        eeprom.performBackgroundWork();
+        REQUIRE_FALSE(eeprom.hasPendingWrites());
+        tester.requireContents(PageBase1, PAGE_ACTIVE, {
+            Record(10, 0xAA)
+        });
+    }
+}
+
+namespace {
+
+// Runs the background work to completion
+void runBackgroundWork(TestEEPROM &eeprom)
+{
+    for(int i = 0; i < 1000 && eeprom.performBackgroundWork(); i++)
+    {
+    }
+}
+
+void requireData(TestEEPROM &eeprom, const std::vector<uint8_t> &expected)
+{
+    std::vector<uint8_t> data(expected.size());
+    eeprom.get(0, data.data(), data.size());
+    REQUIRE(data == expected);
+}
+
+} // namespace
+
+TEST_CASE("Background page swap", "[eeprom]")
+{
+    TestEEPROM eeprom;
+    eeprom.init();
+    std::vector<uint8_t> expected(eeprom.capacity(), 0xFF);
+
+    auto put = [&](uint16_t index, uint8_t value)
+    {
+        eeprom.put(index, value);
+        expected[index] = value;
+    };
+
+    SECTION("Nothing to do when the active page has enough room")
+    {
+        put(0, 1);
+        REQUIRE_FALSE(eeprom.performBackgroundWork());
+        REQUIRE_FALSE(eeprom.isCompacting());
+    }
+
+    // Fill 3/4 of page 1
+    const size_t recordCount = (PageSize1 - sizeof(TestEEPROM::PageHeader)) / sizeof(Record) * 3 / 4 + 1;
+    for(size_t i = 0; i < recordCount; i++)
+    {
+        put(i % eeprom.capacity(), i / eeprom.capacity());
+    }
+    REQUIRE(eeprom.getActivePage() == Page1);
+
+    SECTION("Swaps pages in multiple steps")
+    {
+        REQUIRE(eeprom.performBackgroundWork());
+        REQUIRE(eeprom.isCompacting());
+        REQUIRE(eeprom.readPageStatus(Page2) == PAGE_COPY);
+        // The destination page is not reported as erasable
+        REQUIRE_FALSE(eeprom.hasPendingErase());
+
+        int steps = 1;
+        while(eeprom.performBackgroundWork())
+        {
+            steps++;
+        }
+        REQUIRE(steps > 2);
+
+        REQUIRE_FALSE(eeprom.isCompacting());
+        REQUIRE(eeprom.getActivePage() == Page2);
+        REQUIRE(eeprom.readPageStatus(Page1) == PAGE_INACTIVE);
+        requireData(eeprom, expected);
+    }
+
+    SECTION("Writes made during the page swap are preserved")
+    {
+        REQUIRE(eeprom.performBackgroundWork());
+        int step = 0;
+        do
+        {
+            put(step % 3, step);
+            put(eeprom.capacity() - 1, step);
+            put(100, 0xFF);
+            step++;
+        } while(eeprom.performBackgroundWork());
+
+        REQUIRE(eeprom.getActivePage() == Page2);
+        requireData(eeprom, expected);
+    }
+
+    SECTION("Old page is erased before the next background page swap")
+    {
+        runBackgroundWork(eeprom);
+        REQUIRE(eeprom.getActivePage() == Page2);
+        REQUIRE(eeprom.hasPendingErase());
+
+        // Fill 3/4 of page 2
+        for(size_t i = 0; i < (PageSize2 / sizeof(Record)) * 3 / 4; i++)
+        {
+            put(i % eeprom.capacity(), 0x40 + i / eeprom.capacity());
+        }
+
+        runBackgroundWork(eeprom);
+        REQUIRE(eeprom.getActivePage() == Page1);
+        requireData(eeprom, expected);
+    }
+
+    SECTION("Foreground page swap aborts the background one")
+    {
+        REQUIRE(eeprom.performBackgroundWork());
+        REQUIRE(eeprom.performBackgroundWork());
+        REQUIRE(eeprom.isCompacting());
+
+        eeprom.swapPagesAndWrite(0, nullptr, 0);
+
+        REQUIRE_FALSE(eeprom.isCompacting());
+        REQUIRE(eeprom.getActivePage() == Page2);
+        requireData(eeprom, expected);
+    }
+
+    SECTION("Reset during the page swap")
+    {
+        REQUIRE(eeprom.performBackgroundWork());
+        REQUIRE(eeprom.performBackgroundWork());
+        put(1, 0x55);
+
+        // Simulate a reset
+        TestEEPROM eepromAfterReset;
+        eepromAfterReset.store = eeprom.store;
+        eepromAfterReset.init();
+
+        REQUIRE(eepromAfterReset.getActivePage() == Page1);
+        REQUIRE(eepromAfterReset.hasPendingErase());
+        requireData(eepromAfterReset, expected);
+
+        runBackgroundWork(eepromAfterReset);
+        REQUIRE(eepromAfterReset.getActivePage() == Page2);
+        requireData(eepromAfterReset, expected);
+    }
+}
+
+namespace {
+
+/**
+ * Flash storage simulator that keeps track of the time spent erasing and programming the
+ * memory, using typical timings of the STM32F2 internal flash.
+ */
+template<int Base, int Sectors, int SectorSize>
+class TimedFlashStorage: public RAMFlashStorage<Base, Sectors, SectorSize>
+{
+    using BaseStorage = RAMFlashStorage<Base, Sectors, SectorSize>;
+
+public:
+    static const unsigned SECTOR_ERASE_TIME_US = 250000;
+    static const unsigned WORD_PROGRAM_TIME_US = 16;
+
+    uint64_t elapsedMicros = 0;
+
+    int eraseSector(unsigned address)
+    {
+        elapsedMicros += SECTOR_ERASE_TIME_US;
+        return BaseStorage::eraseSector(address);
+    }
+
+    int write(unsigned offset, const void* data, unsigned size)
+    {
+        elapsedMicros += (size + 3) / 4 * WORD_PROGRAM_TIME_US;
+        return BaseStorage::write(offset, data, size);
+    }
+};
+
+using TimedStore = TimedFlashStorage<TestBase, TestPageCount, TestPageSize>;
+using TimedEEPROM = EEPROMEmulation<TimedStore, PageBase1, PageSize1, PageBase2, PageSize2>;
+
+struct LatencyStats
+{
+    uint64_t maxPutMicros = 0;
+    uint64_t maxBackgroundMicros = 0;
+    uint64_t totalPutMicros = 0;
+};
+
+// Writes random blocks of data, optionally running a step of the background work after each write
+LatencyStats measureLatency(TimedEEPROM &eeprom, bool background, bool writeCombining, unsigned iterations)
+{
+    std::default_random_engine gen(1);
+    std::uniform_int_distribution<int> lengthDist(1, 8);
+    std::uniform_int_distribution<int> byteDist(0, 255);
+    LatencyStats stats;
+
+    eeprom.init();
+    eeprom.setWriteCombining(writeCombining);
+    std::vector<uint8_t> expected(eeprom.capacity(), 0xFF);
+
+    for(unsigned i = 0; i < iterations; i++)
+    {
+        const uint16_t length = lengthDist(gen);
+        const uint16_t index = std::uniform_int_distribution<int>(0, eeprom.capacity() - length)(gen);
+        uint8_t data[8];
+        for(uint16_t j = 0; j < length; j++)
+        {
+            data[j] = byteDist(gen);
+        }
+
+        uint64_t t = eeprom.store.elapsedMicros;
+        eeprom.put(index, data, length);
+        std::memcpy(&expected[index], data, length);
+        const uint64_t putMicros = eeprom.store.elapsedMicros - t;
+        stats.maxPutMicros = std::max(stats.maxPutMicros, putMicros);
+        stats.totalPutMicros += putMicros;
+
+        if(background)
+        {
+            t = eeprom.store.elapsedMicros;
+            eeprom.performBackgroundWork();
+            stats.maxBackgroundMicros = std::max(stats.maxBackgroundMicros, eeprom.store.elapsedMicros - t);
+        }
+    }
+
+    eeprom.flush();
+    std::vector<uint8_t> data(expected.size());
+    eeprom.get(0, data.data(), data.size());
+    REQUIRE(data == expected);
+
+    return stats;
+}
+
+} // namespace
+
+TEST_CASE("Background page swap bounds the write latency", "[eeprom]")
+{
+    const unsigned iterations = 5000;
+    const uint64_t eraseMicros = TimedStore::SECTOR_ERASE_TIME_US;
+
+    SECTION("Without background work, some writes wait for a page erase")
+    {
+        std::unique_ptr<TimedEEPROM> eeprom(new TimedEEPROM());
+        const auto stats = measureLatency(*eeprom, false /* background */, false /* writeCombining */, iterations);
+        REQUIRE(stats.maxPutMicros >= eraseMicros);
+    }
+
+    SECTION("With background work, no write waits for a page erase")
+    {
+        std::unique_ptr<TimedEEPROM> eeprom(new TimedEEPROM());
+        const auto stats = measureLatency(*eeprom, true /* background */, false /* writeCombining */, iterations);
+        REQUIRE(stats.maxPutMicros < eraseMicros);
+        // A step that doesn't erase the flash writes a bounded number of records
+        REQUIRE(stats.maxBackgroundMicros <= eraseMicros);
+    }
+
+    SECTION("With write combining, no write touches the flash")
+    {
+        std::unique_ptr<TimedEEPROM> eeprom(new TimedEEPROM());
+        const auto stats = measureLatency(*eeprom, true /* background */, true /* writeCombining */, iterations);
+        REQUIRE(stats.maxPutMicros == 0);
+    }
+}
+
+TEST_CASE("EEPROM write latency benchmark", "[.][benchmark]")
+{
+    const unsigned iterations = 50000;
+    const struct {
+        const char* name;
+        bool background;
+        bool writeCombining;
+    } configs[] = {
+        { "synchronous page swap", false, false },
+        { "background page swap", true, false },
+        { "background page swap + write combining", true, true }
+    };
+    for(const auto& config: configs)
+    {
+        std::unique_ptr<TimedEEPROM> eeprom(new TimedEEPROM());
+        const auto stats = measureLatency(*eeprom, config.background, config.writeCombining, iterations);
+        std::cout << config.name << ": max put() " << stats.maxPutMicros << " us, avg put() " <<
+                (stats.totalPutMicros / iterations) << " us, max background step " << stats.maxBackgroundMicros <<
+                " us, flash time " << eeprom->store.elapsedMicros / 1000 << " ms" << std::endl;
+    }
+}
@@ -0,0 +1,157 @@
+#include "flash_device.h"
+#include "eeprom_emulation.h"
+
+#include "tools/catch.h"
+
+#include <cstdio>
+#include <string>
+
+namespace {
+
+const std::string ImageFile = "flash_device_test.bin";
+const uint32_t ImageSize = 64 * 1024;
+const uint32_t SectorSize = FLASH_DEVICE_SECTOR_SIZE;
+const uint32_t PageSize = FLASH_DEVICE_PAGE_SIZE;
+
+void removeImage() {
+    std::remove(ImageFile.c_str());
+    std::remove((ImageFile + ".wear").c_str());
+}
+
+class TestFlash: public FlashDevice {
+public:
+    TestFlash() {
+        removeImage();
+        open(ImageFile, ImageSize);
+    }
+
+    ~TestFlash() {
+        close();
+        removeImage();
+    }
+};
+
+} // namespace
+
+TEST_CASE("FlashDevice") {
+    TestFlash flash;
+    const auto ok = FlashDevice::FLASH_OK;
+
+    SECTION("a new image is erased") {
+        CHECK(flash.created());
+        CHECK(flash.size() == ImageSize);
+        for (uint32_t i = 0; i < ImageSize; ++i) {
+            REQUIRE(flash.data_at(0)[i] == 0xff);
+        }
+    }
+
+    SECTION("fails to access data outside of the device") {
+        uint8_t b = 0;
+        CHECK(flash.read(ImageSize, &b, 1) == FlashDevice::FLASH_INVALID_RANGE);
+        CHECK(flash.program(ImageSize - 1, "ab", 2) == FlashDevice::FLASH_INVALID_RANGE);
+        CHECK(flash.erase_sector(ImageSize) == FlashDevice::FLASH_INVALID_RANGE);
+    }
+
+    SECTION("programming can only clear bits") {
+        const uint8_t a = 0x0f;
+        REQUIRE(flash.program(10, &a, 1) == ok);
+        const uint8_t b = 0x07;
+        CHECK(flash.program(10, &b, 1) == ok);
+        CHECK(flash.data_at(10)[0] == 0x07);
+        const uint8_t c = 0xf0;
+        CHECK(flash.program(10, &c, 1) == FlashDevice::FLASH_NOT_ERASED);
+        CHECK(flash.data_at(10)[0] == 0x00);
+        CHECK(flash.stats().program_errors == 1);
+        // Programming the same data again is not an error
+        const uint8_t d = 0x00;
+        CHECK(flash.program(10, &d, 1) == ok);
+    }
+
+    SECTION("erasing a sector sets all of its bits") {
+        const std::string s(SectorSize * 2, 'x');
+        REQUIRE(flash.program(0, s.data(), s.size()) == ok);
+        REQUIRE(flash.erase_sector(SectorSize + 100) == ok);
+        CHECK(flash.data_at(SectorSize - 1)[0] == 'x');
+        CHECK(flash.data_at(SectorSize)[0] == 0xff);
+        CHECK(flash.data_at(SectorSize * 2 - 1)[0] == 0xff);
+        CHECK(flash.program(SectorSize, "y", 1) == ok);
+    }
+
+    SECTION("program operations are split at page boundaries") {
+        REQUIRE(flash.program(PageSize - 1, "abc", 3) == ok);
+        CHECK(flash.stats().page_programs == 2);
+        CHECK(flash.stats().bytes_programmed == 3);
+        REQUIRE(flash.program(PageSize * 4, std::string(PageSize * 3, 'a').data(), PageSize * 3) == ok);
+        CHECK(flash.stats().page_programs == 5);
+    }
+
+    SECTION("operations are accounted for in the statistics") {
+        FlashDevice::Timing timing;
+        timing.read_ns_per_byte = 1000;
+        timing.program_us_per_page = 100;
+        timing.erase_us_per_sector = 10000;
+        flash.set_timing(timing);
+        uint8_t buf[10] = {};
+        REQUIRE(flash.read(0, buf, sizeof(buf)) == ok);
+        REQUIRE(flash.program(0, buf, sizeof(buf)) == ok);
+        REQUIRE(flash.erase(0, SectorSize + 1) == ok);
+        const auto& stats = flash.stats();
+        CHECK(stats.reads == 1);
+        CHECK(stats.bytes_read == 10);
+        CHECK(stats.page_programs == 1);
+        CHECK(stats.sector_erases == 2);
+        CHECK(stats.busy_us == 10 + 100 + 20000);
+        flash.reset_stats();
+        CHECK(flash.stats().sector_erases == 0);
+    }
+
+    SECTION("the contents and the wear are persisted") {
+        REQUIRE(flash.program(100, "abc", 3) == ok);
+        REQUIRE(flash.erase_sector(SectorSize) == ok);
+        REQUIRE(flash.erase_sector(SectorSize) == ok);
+        flash.close();
+        flash.open(ImageFile, ImageSize);
+        CHECK_FALSE(flash.created());
+        CHECK(std::string((const char*)flash.data_at(100), 3) == "abc");
+        CHECK(flash.stats().max_sector_erases == 2);
+    }
+
+    SECTION("a worn out sector can't be erased or programmed") {
+        FlashDevice::Timing timing;
+        timing.endurance = 3;
+        flash.set_timing(timing);
+        for (int i = 0; i < 3; ++i) {
+            REQUIRE(flash.erase_sector(0) == ok);
+        }
+        CHECK(flash.erase_sector(0) == FlashDevice::FLASH_WORN_OUT);
+        CHECK(flash.program(0, "a", 1) == FlashDevice::FLASH_WORN_OUT);
+        CHECK(flash.program(SectorSize, "a", 1) == ok);
+    }
+}
+
+TEST_CASE("EEPROM emulation on the emulated flash") {
+    // FlashDeviceStore uses the global flash device
+    FlashDevice& flash = flash_device();
+    removeImage();
+    flash.open(ImageFile, ImageSize);
+    const uint32_t EepromPageSize = 16 * 1024;
+    using TestEEPROM = EEPROMEmulation<FlashDeviceStore<EepromPageSize>, 0, EepromPageSize, EepromPageSize, EepromPageSize>;
+    TestEEPROM eeprom;
+    eeprom.init();
+    CHECK(flash.stats().program_errors == 0);
+
+    SECTION("values can be written and read") {
+        for (int i = 0; i < 5000; ++i) {
+            eeprom.put(i % 100, uint8_t(i));
+        }
+        uint8_t value = 0;
+        eeprom.get(99, value);
+        CHECK(value == uint8_t(4999));
+        // A page is erased as a whole
+        CHECK((flash.stats().sector_erases % (EepromPageSize / SectorSize)) == 0);
+        CHECK(flash.stats().program_errors == 0);
+    }
+
+    flash.close();
+    removeImage();
+}
@@ -0,0 +1,288 @@
+#ifdef UNIT_TEST_MINIZ
+
+#include "inflate_stream.h"
+#include "flash_storage.h"
+
+#include "tools/catch.h"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace particle;
+
+namespace {
+
+const uint8_t TEXT_IMAGE_Z[] = {
+    0x28, 0xcf, 0x75, 0xcf, 0xbb, 0xad, 0x25, 0x44, 0x14, 0x00, 0x41, 0x9f, 0x28, 0x36, 0x84, 0x7b,
+    0xbe, 0x33, 0x83, 0x8d, 0x0f, 0x12, 0x11, 0xa0, 0xd5, 0x33, 0x56, 0xc2, 0x42, 0x88, 0xf8, 0x21,
+    0x00, 0xca, 0xed, 0xb6, 0xea, 0xf3, 0xf9, 0x7c, 0x7e, 0xfe, 0xf6, 0xdb, 0x1f, 0x7f, 0xfd, 0xfd,
+    0xe3, 0xfb, 0x9f, 0x5f, 0xdf, 0x7e, 0xf9, 0xfa, 0xe7, 0xc7, 0xf7, 0xaf, 0x6f, 0xbf, 0xfe, 0xfe,
+    0xd3, 0x7f, 0x3d, 0x34, 0x52, 0xa3, 0x34, 0x5a, 0x63, 0x34, 0x56, 0xe3, 0x68, 0x5c, 0x8d, 0x87,
+    0x11, 0x92, 0x87, 0xe4, 0x21, 0x79, 0x48, 0x1e, 0x92, 0x87, 0xe4, 0x21, 0x79, 0x48, 0x1e, 0x92,
+    0x87, 0xe4, 0x29, 0x79, 0x4a, 0x9e, 0x92, 0xa7, 0xe4, 0x29, 0x79, 0x4a, 0x9e, 0x92, 0xa7, 0xe4,
+    0x29, 0x79, 0x4a, 0x5e, 0x92, 0x97, 0xe4, 0x25, 0x79, 0x49, 0x5e, 0x92, 0x97, 0xe4, 0x25, 0x79,
+    0x49, 0x5e, 0x92, 0x97, 0xe4, 0x2d, 0x79, 0x4b, 0xde, 0x92, 0xb7, 0xe4, 0x2d, 0x79, 0x4b, 0xde,
+    0x92, 0xb7, 0xe4, 0x2d, 0x79, 0x4b, 0x3e, 0x92, 0x8f, 0xe4, 0x23, 0xf9, 0x48, 0x3e, 0x92, 0x8f,
+    0xe4, 0x23, 0xf9, 0x48, 0x3e, 0x92, 0x8f, 0xe4, 0x2b, 0xf9, 0x4a, 0xbe, 0x92, 0xaf, 0xe4, 0x2b,
+    0xf9, 0x4a, 0xbe, 0x92, 0xaf, 0xe4, 0x2b, 0xf9, 0x4a, 0x7e, 0x24, 0x3f, 0x92, 0x1f, 0xc9, 0x8f,
+    0xe4, 0x47, 0xf2, 0x23, 0xf9, 0x91, 0xfc, 0x48, 0x7e, 0x24, 0x3f, 0x92, 0x5f, 0xc9, 0xaf, 0xe4,
+    0x57, 0xf2, 0x2b, 0xf9, 0x95, 0xfc, 0x4a, 0x7e, 0x25, 0xbf, 0x92, 0x5f, 0xc9, 0xaf, 0xe4, 0x4f,
+    0xf2, 0x27, 0xf9, 0x93, 0xfc, 0x49, 0xfe, 0x24, 0x7f, 0x92, 0x3f, 0xc9, 0x9f, 0xe4, 0x4f, 0xf2,
+    0x07, 0x79, 0x7c, 0x3e, 0x1a, 0xa1, 0x91, 0x1a, 0xa5, 0xd1, 0x1a, 0xa3, 0xb1, 0x1a, 0x47, 0xe3,
+    0x6a, 0x48, 0x1e, 0x92, 0x87, 0xe4, 0x21, 0x79, 0x48, 0x1e, 0x92, 0x87, 0xe4, 0x21, 0x79, 0x48,
+    0x1e, 0x92, 0x87, 0xe4, 0x29, 0x79, 0x4a, 0x9e, 0x92, 0xa7, 0xe4, 0x29, 0x79, 0x4a, 0x9e, 0x92,
+    0xa7, 0xe4, 0x29, 0x79, 0x4a, 0x5e, 0x92, 0x97, 0xe4, 0x25, 0x79, 0x49, 0x5e, 0x92, 0x97, 0xe4,
+    0x25, 0x79, 0x49, 0x5e, 0x92, 0x97, 0xe4, 0x2d, 0x79, 0x4b, 0xde, 0x92, 0xb7, 0xe4, 0x2d, 0x79,
+    0x4b, 0xde, 0x92, 0xb7, 0xe4, 0x2d, 0x79, 0x4b, 0x3e, 0x92, 0x8f, 0xe4, 0x23, 0xf9, 0x48, 0x3e,
+    0x92, 0x8f, 0xe4, 0x23, 0xf9, 0x48, 0x3e, 0x92, 0x8f, 0xe4, 0x2b, 0xf9, 0x4a, 0xbe, 0x92, 0xaf,
+    0xe4, 0x2b, 0xf9, 0x4a, 0xbe, 0x92, 0xaf, 0xe4, 0x2b, 0xf9, 0x4a, 0x7e, 0x24, 0x3f, 0x92, 0x1f,
+    0xc9, 0x8f, 0xe4, 0x47, 0xf2, 0x23, 0xf9, 0x91, 0xfc, 0x48, 0x7e, 0x24, 0x3f, 0x92, 0x5f, 0xc9,
+    0xaf, 0xe4, 0x57, 0xf2, 0x2b, 0xf9, 0x95, 0xfc, 0x4a, 0x7e, 0x25, 0xbf, 0x92, 0x5f, 0xc9, 0xaf,
+    0xe4, 0x4f, 0xf2, 0x27, 0xf9, 0x93, 0xfc, 0x49, 0xfe, 0x24, 0x7f, 0x92, 0x3f, 0xc9, 0x9f, 0xe4,
+    0x4f, 0xf2, 0x07, 0x79, 0x7e, 0x3e, 0x1a, 0xa1, 0x91, 0x1a, 0xa5, 0xd1, 0x1a, 0xa3, 0xb1, 0x1a,
+    0x47, 0xe3, 0x6a, 0x48, 0x1e, 0x92, 0x87, 0xe4, 0x21, 0x79, 0x48, 0x1e, 0x92, 0x87, 0xe4, 0x21,
+    0x79, 0x48, 0x1e, 0x92, 0x87, 0xe4, 0x29, 0x79, 0x4a, 0x9e, 0x92, 0xa7, 0xe4, 0x29, 0x79, 0x4a,
+    0x9e, 0x92, 0xa7, 0xe4, 0x29, 0x79, 0x4a, 0x5e, 0x92, 0x97, 0xe4, 0x25, 0x79, 0x49, 0x5e, 0x92,
+    0x97, 0xe4, 0x25, 0x79, 0x49, 0x5e, 0x92, 0x97, 0xe4, 0x2d, 0x79, 0x4b, 0xde, 0x92, 0xb7, 0xe4,
+    0x2d, 0x79, 0x4b, 0xde, 0x92, 0xb7, 0xe4, 0x2d, 0x79, 0x4b, 0x3e, 0x92, 0x8f, 0xe4, 0x23, 0xf9,
+    0x48, 0x3e, 0x92, 0x8f, 0xe4, 0x23, 0xf9, 0x48, 0x3e, 0x92, 0x8f, 0xe4, 0x2b, 0xf9, 0x4a, 0xbe,
+    0x92, 0xaf, 0xe4, 0x2b, 0xf9, 0x4a, 0xbe, 0x92, 0xaf, 0xe4, 0x2b, 0xf9, 0x4a, 0x7e, 0x24, 0x3f,
+    0x92, 0x1f, 0xc9, 0x8f, 0xe4, 0x47, 0xf2, 0x23, 0xf9, 0x91, 0xfc, 0x48, 0x7e, 0x24, 0x3f, 0x92,
+    0x5f, 0xc9, 0xaf, 0xe4, 0x57, 0xf2, 0x2b, 0xf9, 0x95, 0xfc, 0x4a, 0x7e, 0x25, 0xbf, 0x92, 0x5f,
+    0xc9, 0xaf, 0xe4, 0x4f, 0xf2, 0x27, 0xf9, 0x93, 0xfc, 0x49, 0xfe, 0x24, 0x7f, 0x92, 0x3f, 0xc9,
+    0x9f, 0xe4, 0x4f, 0xf2, 0x07, 0x79, 0x7d, 0x3e, 0x1a, 0xa1, 0x91, 0x1a, 0xa5, 0xd1, 0x1a, 0xa3,
+    0xb1, 0x1a, 0x47, 0xe3, 0x6a, 0x48, 0x1e, 0x92, 0x87, 0xe4, 0x21, 0x79, 0x48, 0x1e, 0x92, 0x87,
+    0xe4, 0x21, 0x79, 0x48, 0x1e, 0x92, 0x87, 0xe4, 0x29, 0x79, 0x4a, 0x9e, 0x92, 0xa7, 0xe4, 0x29,
+    0x79, 0x4a, 0x9e, 0x92, 0xa7, 0xe4, 0x29, 0x79, 0x4a, 0x5e, 0x92, 0x97, 0xe4, 0x25, 0x79, 0x49,
+    0x5e, 0x92, 0x97, 0xe4, 0x25, 0x79, 0x49, 0x5e, 0x92, 0x97, 0xe4, 0x2d, 0x79, 0x4b, 0xde, 0x92,
+    0xb7, 0xe4, 0x2d, 0x79, 0x4b, 0xde, 0x92, 0xb7, 0xe4, 0x2d, 0x79, 0x4b, 0x3e, 0x92, 0x8f, 0xe4,
+    0x23, 0xf9, 0x48, 0x3e, 0x92, 0x8f, 0xe4, 0x23, 0xf9, 0x48, 0x3e, 0x92, 0x8f, 0xe4, 0x2b, 0xf9,
+    0x4a, 0xbe, 0x92, 0xaf, 0xe4, 0x2b, 0xf9, 0x4a, 0xbe, 0x92, 0xaf, 0xe4, 0x2b, 0xf9, 0x4a, 0x7e,
+    0x24, 0x3f, 0x92, 0x1f, 0xc9, 0x8f, 0xe4, 0x47, 0xf2, 0x23, 0xf9, 0x91, 0xfc, 0x48, 0x7e, 0x24,
+    0x3f, 0x92, 0x5f, 0xc9, 0xaf, 0xe4, 0x57, 0xf2, 0x2b, 0xf9, 0x95, 0xfc, 0x4a, 0x7e, 0x25, 0xbf,
+    0x92, 0x5f, 0xc9, 0xaf, 0xe4, 0x4f, 0xf2, 0x27, 0xf9, 0x93, 0xfc, 0x49, 0xfe, 0x24, 0x7f, 0x92,
+    0x3f, 0xc9, 0x9f, 0xe4, 0x4f, 0xf2, 0xf7, 0xff, 0xf2, 0x7f, 0x01, 0xa9, 0xd7, 0xd8, 0xae,
+};
+
+const uint8_t ZERO_IMAGE_Z[] = {
+    0x18, 0xd3, 0xed, 0xc1, 0x31, 0x01, 0x00, 0x00, 0x00, 0xc2, 0xa0, 0xf5, 0x4f, 0x6d, 0x0c, 0x1f,
+    0xa0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x80, 0xb7, 0x01, 0x40, 0x00, 0x00, 0x01,
+};
+
+const uint8_t ZERO_IMAGE_32K_Z[] = {
+    0x78, 0xda, 0xed, 0xc1, 0x31, 0x01, 0x00, 0x00, 0x00, 0xc2, 0xa0, 0xf5, 0x4f, 0x6d, 0x0c, 0x1f,
+    0xa0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x80, 0xb7, 0x01, 0x40, 0x00, 0x00, 0x01,
+};
+
+// Expected contents of TEXT_IMAGE_Z (compressed with a 1KB window)
+std::string textImage() {
+    std::string s;
+    char buf[32];
+    for (int i = 0; i < 400; ++i) {
+        snprintf(buf, sizeof(buf), "%04d: Particle Device OS\n", i);
+        s += buf;
+    }
+    return s;
+}
+
+class StringOutputStream: public OutputStream {
+public:
+    int write(const char* data, size_t size) override {
+        data_.append(data, size);
+        return size;
+    }
+
+    int flush() override {
+        return 0;
+    }
+
+    int availForWrite() override {
+        return INT_MAX;
+    }
+
+    int waitEvent(unsigned flags, unsigned timeout) override {
+        return 0;
+    }
+
+    const std::string& data() const {
+        return data_;
+    }
+
+private:
+    std::string data_;
+};
+
+const unsigned FlashBase = 0;
+const unsigned FlashSectorSize = 4096;
+using TestFlash = RAMFlashStorage<FlashBase, 8, FlashSectorSize>;
+
+// Writes decompressed data to the emulated flash, erasing sectors as the data is written
+class FlashOutputStream: public OutputStream {
+public:
+    FlashOutputStream(TestFlash* flash, unsigned address) :
+            flash_(flash),
+            addr_(address),
+            erasedAddr_(address) {
+    }
+
+    int write(const char* data, size_t size) override {
+        while (erasedAddr_ < addr_ + size) {
+            if (flash_->eraseSector(erasedAddr_) != 0) {
+                return SYSTEM_ERROR_TOO_LARGE;
+            }
+            erasedAddr_ += FlashSectorSize;
+        }
+        if (flash_->write(addr_, data, size) != 0) {
+            return SYSTEM_ERROR_TOO_LARGE;
+        }
+        addr_ += size;
+        return size;
+    }
+
+    int flush() override {
+        return 0;
+    }
+
+    int availForWrite() override {
+        return INT_MAX;
+    }
+
+    int waitEvent(unsigned flags, unsigned timeout) override {
+        return 0;
+    }
+
+private:
+    TestFlash* flash_;
+    unsigned addr_;
+    unsigned erasedAddr_;
+};
+
+int inflate(const uint8_t* data, size_t size, size_t chunkSize, size_t windowSize, std::string* out) {
+    StringOutputStream strm;
+    InflateStream inflate(&strm);
+    int ret = inflate.init(windowSize, InflateStream::ZLIB_HEADER);
+    if (ret < 0) {
+        return ret;
+    }
+    for (size_t offs = 0; offs < size; offs += chunkSize) {
+        ret = inflate.write((const char*)data + offs, std::min(chunkSize, size - offs));
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    ret = inflate.finish();
+    *out = strm.data();
+    return ret;
+}
+
+} // namespace
+
+TEST_CASE("InflateStream") {
+    std::string out;
+
+    SECTION("decompresses data written in chunks of arbitrary size") {
+        const auto expected = textImage();
+        for (size_t chunkSize: { 1, 7, 100, 512, (int)sizeof(TEXT_IMAGE_Z) }) {
+            REQUIRE(inflate(TEXT_IMAGE_Z, sizeof(TEXT_IMAGE_Z), chunkSize, 1024, &out) == 0);
+            CHECK(out == expected);
+        }
+    }
+
+    SECTION("output larger than the window buffer is produced in multiple passes") {
+        REQUIRE(inflate(ZERO_IMAGE_Z, sizeof(ZERO_IMAGE_Z), sizeof(ZERO_IMAGE_Z), 512, &out) == 0);
+        CHECK(out == std::string(16384, '\0'));
+        REQUIRE(inflate(ZERO_IMAGE_32K_Z, sizeof(ZERO_IMAGE_32K_Z), 16, 32768, &out) == 0);
+        CHECK(out == std::string(16384, '\0'));
+    }
+
+    SECTION("fails if the window buffer is smaller than the compressor's window") {
+        CHECK(inflate(ZERO_IMAGE_32K_Z, sizeof(ZERO_IMAGE_32K_Z), sizeof(ZERO_IMAGE_32K_Z), 1024, &out) < 0);
+    }
+
+    SECTION("fails on truncated or corrupted data") {
+        CHECK(inflate(TEXT_IMAGE_Z, sizeof(TEXT_IMAGE_Z) - 10, 512, 1024, &out) == SYSTEM_ERROR_BAD_DATA);
+        std::vector<uint8_t> data(TEXT_IMAGE_Z, TEXT_IMAGE_Z + sizeof(TEXT_IMAGE_Z));
+        data[data.size() - 1] ^= 0x01; // Adler-32 checksum
+        CHECK(inflate(data.data(), data.size(), 512, 1024, &out) == SYSTEM_ERROR_BAD_DATA);
+    }
+
+    SECTION("data following the compressed stream is not consumed") {
+        std::vector<uint8_t> data(ZERO_IMAGE_Z, ZERO_IMAGE_Z + sizeof(ZERO_IMAGE_Z));
+        data.resize(data.size() + 100, 0xff);
+        StringOutputStream strm;
+        InflateStream inflate(&strm);
+        REQUIRE(inflate.init(512, InflateStream::ZLIB_HEADER) == 0);
+        CHECK(inflate.write((const char*)data.data(), data.size()) == (int)sizeof(ZERO_IMAGE_Z));
+        CHECK(inflate.done());
+        CHECK(inflate.finish() == 0);
+    }
+
+    SECTION("init() validates the window size") {
+        StringOutputStream strm;
+        InflateStream inflate(&strm);
+        CHECK(inflate.init(1000) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(inflate.init(INFLATE_STREAM_MAX_WINDOW_SIZE * 2) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(inflate.write((const char*)TEXT_IMAGE_Z, sizeof(TEXT_IMAGE_Z)) == SYSTEM_ERROR_BAD_DATA);
+    }
+}
+
+TEST_CASE("InflateStream::zlibWindowSize()") {
+    const char deflate32k[] = { 0x78, (char)0xda };
+    const char deflate1k[] = { 0x28, (char)0xcf };
+    const char badChecksum[] = { 0x78, (char)0xdb };
+    const char moduleImage[] = { 0x00, 0x40, 0x0d, 0x00 }; // Module start address: 0x000d4000
+    CHECK(InflateStream::zlibWindowSize(deflate32k, sizeof(deflate32k)) == 32768);
+    CHECK(InflateStream::zlibWindowSize(deflate1k, sizeof(deflate1k)) == 1024);
+    CHECK(InflateStream::zlibWindowSize(badChecksum, sizeof(badChecksum)) == SYSTEM_ERROR_BAD_DATA);
+    CHECK(InflateStream::zlibWindowSize(moduleImage, sizeof(moduleImage)) == SYSTEM_ERROR_BAD_DATA);
+    CHECK(InflateStream::zlibWindowSize(deflate32k, 1) == SYSTEM_ERROR_NOT_ENOUGH_DATA);
+}
+
+TEST_CASE("Compressed OTA with chunks received out of order") {
+    // Mimics the OTA HAL: chunks are stored at their natural offsets, the chunks received in
+    // order are decompressed immediately and the rest is decompressed from the flash
+    const unsigned chunkSize = 64;
+    const unsigned chunkCount = (sizeof(TEXT_IMAGE_Z) + chunkSize - 1) / chunkSize;
+    const unsigned moduleAddress = FlashSectorSize;
+    std::vector<unsigned> chunks(chunkCount);
+    for (unsigned i = 0; i < chunkCount; ++i) {
+        chunks[i] = i;
+    }
+    std::default_random_engine gen(1);
+    for (unsigned round = 0; round < 10; ++round) {
+        // Keep the first few chunks in order, then shuffle the rest
+        std::shuffle(chunks.begin() + chunkCount / 4, chunks.end(), gen);
+        TestFlash flash;
+        REQUIRE(flash.eraseSector(FlashBase) == 0);
+        FlashOutputStream out(&flash, moduleAddress);
+        InflateStream inflate(&out);
+        REQUIRE(inflate.init(1024, InflateStream::ZLIB_HEADER) == 0);
+        unsigned offset = 0;
+        for (unsigned i: chunks) {
+            const unsigned offs = i * chunkSize;
+            const unsigned size = std::min<unsigned>(chunkSize, sizeof(TEXT_IMAGE_Z) - offs);
+            REQUIRE(flash.write(FlashBase + offs, TEXT_IMAGE_Z + offs, size) == 0);
+            if (offs == offset) {
+                REQUIRE(inflate.write((const char*)TEXT_IMAGE_Z + offs, size) >= 0);
+                offset += size;
+            }
+        }
+        CHECK(offset >= (chunkCount / 4) * chunkSize);
+        while (offset < sizeof(TEXT_IMAGE_Z)) {
+            char buf[32];
+            const unsigned size = std::min<unsigned>(sizeof(buf), sizeof(TEXT_IMAGE_Z) - offset);
+            REQUIRE(flash.read(FlashBase + offset, buf, size) == 0);
+            REQUIRE(inflate.write(buf, size) >= 0);
+            offset += size;
+        }
+        REQUIRE(inflate.finish() == 0);
+        const auto expected = textImage();
+        CHECK(std::string((const char*)flash.dataAt(moduleAddress), expected.size()) == expected);
+    }
+}
+
+#endif // UNIT_TEST_MINIZ
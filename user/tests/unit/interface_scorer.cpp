@@ -0,0 +1,165 @@
+#include "interface_scorer.h"
+
+#include "tools/catch.h"
+
+using namespace particle;
+
+namespace {
+
+const unsigned ETH = 2;
+const unsigned CELL = 3;
+
+void addSamples(InterfaceScorer* s, unsigned id, unsigned rtt, unsigned count) {
+    for (unsigned i = 0; i < count; ++i) {
+        REQUIRE(s->addSample(id, rtt) == 0);
+    }
+}
+
+void addFailures(InterfaceScorer* s, unsigned id, unsigned count) {
+    for (unsigned i = 0; i < count; ++i) {
+        REQUIRE(s->addFailure(id) == 0);
+    }
+}
+
+} // namespace
+
+TEST_CASE("InterfaceScorer") {
+    InterfaceScorer s;
+    const auto conf = s.config();
+    REQUIRE(s.addInterface(ETH, 0) == 0);
+    REQUIRE(s.addInterface(CELL, 2) == 0);
+
+    SECTION("doesn't select interfaces without measurements") {
+        CHECK(s.evaluate() == (int)InterfaceScorer::NO_INTERFACE);
+        REQUIRE(s.setAvailable(ETH, true) == 0);
+        CHECK(s.evaluate() == (int)InterfaceScorer::NO_INTERFACE);
+        // Samples of an unavailable interface are not taken into account
+        addSamples(&s, CELL, 100, 1);
+        CHECK(s.evaluate() == (int)InterfaceScorer::NO_INTERFACE);
+        addSamples(&s, ETH, 100, 1);
+        CHECK(s.evaluate() == (int)ETH);
+    }
+
+    SECTION("selects the first usable interface immediately") {
+        REQUIRE(s.setAvailable(ETH, true) == 0);
+        REQUIRE(s.setAvailable(CELL, true) == 0);
+        addSamples(&s, CELL, 300, 1);
+        CHECK(s.evaluate() == (int)CELL);
+        CHECK(s.preferred() == (int)CELL);
+    }
+
+    SECTION("prefers the interface with the higher priority when the scores are similar") {
+        REQUIRE(s.setAvailable(ETH, true) == 0);
+        REQUIRE(s.setAvailable(CELL, true) == 0);
+        addSamples(&s, ETH, 100, 1);
+        addSamples(&s, CELL, 90, 1);
+        CHECK(s.evaluate() == (int)ETH);
+        InterfaceScorer::Stats st = {};
+        REQUIRE(s.stats(CELL, &st) == 0);
+        CHECK(st.score == 90 + 2 * conf.priorityPenalty);
+    }
+
+    SECTION("switches to a better interface after several evaluations") {
+        REQUIRE(s.setAvailable(ETH, true) == 0);
+        REQUIRE(s.setAvailable(CELL, true) == 0);
+        addSamples(&s, CELL, 500, 1);
+        CHECK(s.evaluate() == (int)CELL);
+        addSamples(&s, ETH, 50, 1);
+        for (unsigned i = 1; i < conf.switchEvaluations; ++i) {
+            CHECK(s.evaluate() == (int)CELL);
+        }
+        CHECK(s.evaluate() == (int)ETH);
+    }
+
+    SECTION("doesn't switch if the improvement is below the margin") {
+        REQUIRE(s.setAvailable(ETH, true) == 0);
+        REQUIRE(s.setAvailable(CELL, true) == 0);
+        addSamples(&s, ETH, 400, 1);
+        CHECK(s.evaluate() == (int)ETH);
+        // 340 + 40 is less than 25% better than 400
+        addSamples(&s, CELL, 340, 1);
+        for (int i = 0; i < 10; ++i) {
+            CHECK(s.evaluate() == (int)ETH);
+        }
+        // The improvement needs to persist for several consecutive evaluations
+        addSamples(&s, CELL, 100, 20);
+        CHECK(s.evaluate() == (int)ETH);
+        addSamples(&s, CELL, 900, 20);
+        CHECK(s.evaluate() == (int)ETH);
+        addSamples(&s, CELL, 100, 20);
+        for (unsigned i = 1; i < conf.switchEvaluations; ++i) {
+            CHECK(s.evaluate() == (int)ETH);
+        }
+        CHECK(s.evaluate() == (int)CELL);
+    }
+
+    SECTION("fails over immediately when the interface goes down or stops responding") {
+        REQUIRE(s.setAvailable(ETH, true) == 0);
+        REQUIRE(s.setAvailable(CELL, true) == 0);
+        addSamples(&s, ETH, 50, 1);
+        addSamples(&s, CELL, 500, 1);
+        CHECK(s.evaluate() == (int)ETH);
+        REQUIRE(s.setAvailable(ETH, false) == 0);
+        CHECK(s.evaluate() == (int)CELL);
+        REQUIRE(s.setAvailable(ETH, true) == 0);
+        addSamples(&s, ETH, 50, 1);
+        for (unsigned i = 1; i < conf.switchEvaluations; ++i) {
+            CHECK(s.evaluate() == (int)CELL);
+        }
+        CHECK(s.evaluate() == (int)ETH);
+        addFailures(&s, ETH, conf.maxFailures - 1);
+        CHECK(s.evaluate() == (int)ETH);
+        addFailures(&s, ETH, 1);
+        CHECK(s.evaluate() == (int)CELL);
+        addFailures(&s, CELL, conf.maxFailures);
+        CHECK(s.evaluate() == (int)InterfaceScorer::NO_INTERFACE);
+    }
+
+    SECTION("fails back after the lost probes are offset by successful ones") {
+        REQUIRE(s.setAvailable(ETH, true) == 0);
+        REQUIRE(s.setAvailable(CELL, true) == 0);
+        addSamples(&s, ETH, 50, 1);
+        addSamples(&s, CELL, 300, 1);
+        CHECK(s.evaluate() == (int)ETH);
+        addFailures(&s, ETH, conf.maxFailures);
+        CHECK(s.evaluate() == (int)CELL);
+        // Ethernet is usable again but its loss rate is still high
+        addSamples(&s, ETH, 50, 1);
+        InterfaceScorer::Stats st = {};
+        REQUIRE(s.stats(ETH, &st) == 0);
+        CHECK(st.loss > 40);
+        for (int i = 0; i < 5; ++i) {
+            CHECK(s.evaluate() == (int)CELL);
+        }
+        int evals = 0;
+        while (s.evaluate() != (int)ETH) {
+            addSamples(&s, ETH, 50, 1);
+            REQUIRE(++evals < 20);
+        }
+        REQUIRE(s.stats(ETH, &st) == 0);
+        CHECK(st.loss < 15);
+        CHECK(st.probes == conf.maxFailures + 2 + evals);
+        CHECK(st.failures == conf.maxFailures);
+    }
+
+    SECTION("smooths the round-trip time") {
+        REQUIRE(s.setAvailable(ETH, true) == 0);
+        addSamples(&s, ETH, 100, 1);
+        addSamples(&s, ETH, 900, 1);
+        InterfaceScorer::Stats st = {};
+        REQUIRE(s.stats(ETH, &st) == 0);
+        CHECK(st.rtt == 200);
+        addSamples(&s, ETH, 200, 100);
+        REQUIRE(s.stats(ETH, &st) == 0);
+        CHECK(st.rtt == 200);
+    }
+
+    SECTION("rejects unknown and duplicate interfaces") {
+        CHECK(s.addInterface(ETH, 1) == SYSTEM_ERROR_ALREADY_EXISTS);
+        CHECK(s.addSample(1, 100) == SYSTEM_ERROR_NOT_FOUND);
+        CHECK(s.setAvailable(1, true) == SYSTEM_ERROR_NOT_FOUND);
+        CHECK(s.addInterface(4, 1) == 0);
+        CHECK(s.addInterface(5, 1) == 0);
+        CHECK(s.addInterface(6, 1) == SYSTEM_ERROR_LIMIT_EXCEEDED);
+    }
+}
@@ -0,0 +1,211 @@
+#include "pcapng_buffer.h"
+
+#include "tools/catch.h"
+#include "tools/random.h"
+
+#include <string>
+#include <vector>
+
+using namespace particle;
+
+namespace {
+
+struct Block {
+    uint32_t type;
+    std::string body; // Block contents between the length fields
+};
+
+struct Packet {
+    uint32_t iface;
+    uint64_t timestamp;
+    uint32_t capLen;
+    uint32_t origLen;
+    uint32_t flags;
+    std::string data;
+};
+
+int writeToString(const uint8_t* data, size_t size, void* ctx) {
+    static_cast<std::string*>(ctx)->append((const char*)data, size);
+    return 0;
+}
+
+uint32_t readUint32(const std::string& s, size_t offs) {
+    const size_t end = offs + 4;
+    REQUIRE(end <= s.size());
+    uint32_t v = 0;
+    memcpy(&v, s.data() + offs, 4);
+    return v;
+}
+
+std::vector<Block> parseBlocks(const std::string& file) {
+    std::vector<Block> blocks;
+    size_t offs = 0;
+    while (offs < file.size()) {
+        const uint32_t type = readUint32(file, offs);
+        const uint32_t size = readUint32(file, offs + 4);
+        const uint32_t rem = size % 4;
+        REQUIRE(rem == 0);
+        REQUIRE(size >= 12);
+        REQUIRE(readUint32(file, offs + size - 4) == size);
+        blocks.push_back({ type, file.substr(offs + 8, size - 12) });
+        offs += size;
+    }
+    return blocks;
+}
+
+Packet parsePacket(const Block& b) {
+    REQUIRE(b.type == (uint32_t)PcapngBuffer::ENHANCED_PACKET_BLOCK);
+    Packet p = {};
+    p.iface = readUint32(b.body, 0);
+    p.timestamp = ((uint64_t)readUint32(b.body, 4) << 32) | readUint32(b.body, 8);
+    p.capLen = readUint32(b.body, 12);
+    p.origLen = readUint32(b.body, 16);
+    p.data = b.body.substr(20, p.capLen);
+    const size_t optOffs = 20 + ((p.capLen + 3) & ~3);
+    REQUIRE(readUint32(b.body, optOffs) == (2 | (4 << 16))); // epb_flags
+    p.flags = readUint32(b.body, optOffs + 4);
+    return p;
+}
+
+std::string dump(const PcapngBuffer& buf) {
+    std::string s;
+    REQUIRE(buf.dump(writeToString, &s) == 0);
+    return s;
+}
+
+} // namespace
+
+TEST_CASE("PcapngBuffer") {
+    PcapngBuffer buf;
+    REQUIRE(buf.init(1024) == 0);
+
+    SECTION("writes the section header and interface description blocks") {
+        REQUIRE(buf.addInterface(PcapngBuffer::LINKTYPE_RAW, 0, "pp3") == 0);
+        REQUIRE(buf.addInterface(PcapngBuffer::LINKTYPE_RAW, 128, "wl4") == 1);
+        const auto blocks = parseBlocks(dump(buf));
+        REQUIRE(blocks.size() == 3);
+        CHECK(blocks[0].type == (uint32_t)PcapngBuffer::SECTION_HEADER_BLOCK);
+        CHECK(readUint32(blocks[0].body, 0) == (uint32_t)PcapngBuffer::BYTE_ORDER_MAGIC);
+        CHECK(readUint32(blocks[0].body, 4) == 1); // Version 1.0
+        CHECK(blocks[1].type == (uint32_t)PcapngBuffer::INTERFACE_DESCRIPTION_BLOCK);
+        CHECK(readUint32(blocks[1].body, 0) == (uint32_t)PcapngBuffer::LINKTYPE_RAW);
+        CHECK(readUint32(blocks[1].body, 4) == 0);
+        CHECK(readUint32(blocks[1].body, 8) == (2 | (3 << 16))); // if_name
+        CHECK(blocks[1].body.substr(12, 3) == "pp3");
+        CHECK(readUint32(blocks[2].body, 4) == 128);
+        CHECK(blocks[2].body.substr(12, 3) == "wl4");
+    }
+
+    SECTION("stores packets in the order they were added") {
+        REQUIRE(buf.addInterface(PcapngBuffer::LINKTYPE_RAW, 0, "pp3") == 0);
+        const std::string p1 = test::randomBytes(61);
+        const std::string p2 = test::randomBytes(100);
+        REQUIRE(buf.addPacket(0, 0x123456789aull, PcapngBuffer::OUTBOUND, p1.data(), p1.size()) == 0);
+        // Packet added in several parts
+        REQUIRE(buf.startPacket(0, 2000, PcapngBuffer::INBOUND, p2.size()) == 0);
+        for (size_t offs = 0; offs < p2.size(); offs += 30) {
+            REQUIRE(buf.appendPacket(p2.data() + offs, std::min<size_t>(30, p2.size() - offs)) == 0);
+        }
+        REQUIRE(buf.endPacket() == 0);
+        const auto blocks = parseBlocks(dump(buf));
+        REQUIRE(blocks.size() == 4);
+        const Packet a = parsePacket(blocks[2]);
+        CHECK(a.iface == 0);
+        CHECK((a.timestamp == 0x123456789aull));
+        CHECK(a.capLen == p1.size());
+        CHECK(a.origLen == p1.size());
+        CHECK(a.flags == PcapngBuffer::OUTBOUND);
+        CHECK(a.data == p1);
+        const Packet b = parsePacket(blocks[3]);
+        CHECK(b.timestamp == 2000);
+        CHECK(b.flags == PcapngBuffer::INBOUND);
+        CHECK(b.data == p2);
+        const auto& s = buf.stats();
+        CHECK(s.packets == 2);
+        CHECK(s.bytes == p1.size() + p2.size());
+    }
+
+    SECTION("truncates packets to the snapshot length") {
+        REQUIRE(buf.addInterface(PcapngBuffer::LINKTYPE_RAW, 40, "en2") == 0);
+        const std::string p = test::randomBytes(200);
+        REQUIRE(buf.addPacket(0, 0, PcapngBuffer::INBOUND, p.data(), p.size()) == 0);
+        const auto blocks = parseBlocks(dump(buf));
+        REQUIRE(blocks.size() == 3);
+        const Packet a = parsePacket(blocks[2]);
+        CHECK(a.capLen == 40);
+        CHECK(a.origLen == 200);
+        CHECK(a.data == p.substr(0, 40));
+        CHECK(buf.stats().truncated == 1);
+    }
+
+    SECTION("discards the oldest packets when the buffer is full") {
+        REQUIRE(buf.addInterface(PcapngBuffer::LINKTYPE_RAW, 0, "th1") == 0);
+        std::vector<std::string> packets;
+        for (unsigned i = 0; i < 500; ++i) {
+            packets.push_back(test::randomBytes(1, 200));
+            const auto& p = packets.back();
+            REQUIRE(buf.addPacket(0, i, PcapngBuffer::OUTBOUND, p.data(), p.size()) == 0);
+            CHECK(buf.size() <= 1024);
+        }
+        const auto blocks = parseBlocks(dump(buf));
+        REQUIRE(blocks.size() > 3);
+        // The newest packets are kept
+        const size_t count = blocks.size() - 2;
+        for (size_t i = 0; i < count; ++i) {
+            const Packet p = parsePacket(blocks[2 + i]);
+            const size_t index = packets.size() - count + i;
+            CHECK(p.timestamp == index);
+            CHECK(p.data == packets[index]);
+        }
+        const auto& s = buf.stats();
+        CHECK(s.packets == 500);
+        CHECK(s.evicted == 500 - count);
+    }
+
+    SECTION("rejects packets that don't fit in the buffer") {
+        REQUIRE(buf.addInterface(PcapngBuffer::LINKTYPE_RAW, 0, "pp3") == 0);
+        const std::string p = test::randomBytes(1500);
+        CHECK(buf.addPacket(0, 0, PcapngBuffer::INBOUND, p.data(), p.size()) == SYSTEM_ERROR_TOO_LARGE);
+        CHECK(buf.stats().dropped == 1);
+        CHECK(buf.size() == 0);
+        // Incomplete packets are discarded as well
+        REQUIRE(buf.startPacket(0, 0, PcapngBuffer::INBOUND, 100) == 0);
+        REQUIRE(buf.appendPacket(p.data(), 50) == 0);
+        CHECK(buf.endPacket() == SYSTEM_ERROR_INVALID_ARGUMENT);
+        REQUIRE(buf.addPacket(0, 0, PcapngBuffer::INBOUND, p.data(), 10) == 0);
+        const auto blocks = parseBlocks(dump(buf));
+        REQUIRE(blocks.size() == 3);
+        CHECK(parsePacket(blocks[2]).data == p.substr(0, 10));
+    }
+
+    SECTION("moves the captured packets to another buffer") {
+        REQUIRE(buf.addInterface(PcapngBuffer::LINKTYPE_RAW, 0, "wl4") == 0);
+        const std::string p1 = test::randomBytes(100);
+        REQUIRE(buf.addPacket(0, 1000, PcapngBuffer::OUTBOUND, p1.data(), p1.size()) == 0);
+        const std::string file = dump(buf);
+        PcapngBuffer buf2;
+        CHECK(buf.movePackets(&buf2) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        REQUIRE(buf2.init(512) == 0);
+        REQUIRE(buf.movePackets(&buf2) == 0);
+        CHECK(dump(buf2) == file);
+        CHECK(buf2.capacity() == 1024);
+        // The packets are now captured into the storage of the other buffer
+        CHECK(buf.capacity() == 512);
+        CHECK(buf.size() == 0);
+        const std::string p2 = test::randomBytes(50);
+        REQUIRE(buf.addPacket(0, 2000, PcapngBuffer::INBOUND, p2.data(), p2.size()) == 0);
+        const auto blocks = parseBlocks(dump(buf));
+        REQUIRE(blocks.size() == 3);
+        CHECK(blocks[1].body.substr(12, 3) == "wl4");
+        CHECK(parsePacket(blocks[2]).data == p2);
+        CHECK(dump(buf2) == file);
+    }
+
+    SECTION("fails to add packets for unknown interfaces") {
+        CHECK(buf.addPacket(0, 0, PcapngBuffer::INBOUND, "abc", 3) == SYSTEM_ERROR_NOT_FOUND);
+        for (size_t i = 0; i < PcapngBuffer::MAX_INTERFACES; ++i) {
+            REQUIRE(buf.addInterface(PcapngBuffer::LINKTYPE_RAW, 0, "if") == (int)i);
+        }
+        CHECK(buf.addInterface(PcapngBuffer::LINKTYPE_RAW, 0, "if") == SYSTEM_ERROR_LIMIT_EXCEEDED);
+    }
+}
@@ -259,3 +259,35 @@ TEST_CASE("SimpleStaticPool") {
 
     testPool<TestSimpleStaticPool>(buf.data(), buf.size());
 }
+
+TEST_CASE("SimpleBasePool free space statistics") {
+    Mocks mocks;
+
+    TestSimpleAllocedPool pool(DEFAULT_POOL_SIZE);
+    const size_t initialFree = pool.freeSize();
+    CHECK(initialFree > 0);
+    CHECK(initialFree < DEFAULT_POOL_SIZE);
+    CHECK(pool.largestFreeBlock() == initialFree);
+
+    std::vector<void*> blocks;
+    for (int i = 0; i < 8; ++i) {
+        void* p = pool.allocate(32);
+        REQUIRE(p != nullptr);
+        blocks.push_back(p);
+    }
+    const size_t tailFree = pool.largestFreeBlock();
+    CHECK(pool.freeSize() == tailFree);
+
+    // Free every other block to fragment the pool
+    for (size_t i = 0; i < blocks.size() - 1; i += 2) {
+        pool.deallocate(blocks[i]);
+    }
+    CHECK(pool.freeSize() > tailFree);
+    CHECK(pool.largestFreeBlock() == tailFree);
+
+    for (size_t i = 1; i < blocks.size(); i += 2) {
+        pool.deallocate(blocks[i]);
+    }
+    CHECK(pool.freeSize() == initialFree);
+    CHECK(pool.largestFreeBlock() == initialFree);
+}
@@ -0,0 +1,152 @@
+#include "ppp_output_buffer.h"
+
+#include "tools/catch.h"
+#include "tools/random.h"
+
+#include <string>
+#include <vector>
+
+using namespace particle;
+
+namespace {
+
+const size_t MUX_FRAME_SIZE = 1500;
+const size_t BATCH_FRAME_SIZE = 128;
+const size_t PBUF_SIZE = 256; // Size of the chunks produced by the PPP stack
+
+// Stand-in for the multiplexer channel
+class Channel {
+public:
+    std::string data;
+    std::vector<size_t> writes;
+    int error = 0;
+
+    static int write(const uint8_t* data, size_t size, void* ctx) {
+        const auto self = (Channel*)ctx;
+        if (self->error) {
+            return self->error;
+        }
+        self->data.append((const char*)data, size);
+        self->writes.push_back(size);
+        return size;
+    }
+};
+
+// Generates an HDLC frame of the given size, including the closing flag
+std::string frame(size_t size) {
+    std::string f = test::randomBytes(size - 1);
+    for (char& c: f) {
+        if (c == (char)PppOutputBuffer::FLAG) {
+            c = 0x7d;
+        }
+    }
+    return f + (char)PppOutputBuffer::FLAG;
+}
+
+// Writes a frame the way lwIP's pppos layer does: one write per pbuf. Returns the number of writes
+size_t writeFrame(PppOutputBuffer* buf, const std::string& f) {
+    size_t count = 0;
+    for (size_t offs = 0; offs < f.size(); offs += PBUF_SIZE) {
+        const size_t n = std::min(PBUF_SIZE, f.size() - offs);
+        REQUIRE(buf->write((const uint8_t*)f.data() + offs, n) == 0);
+        ++count;
+    }
+    return count;
+}
+
+} // namespace
+
+TEST_CASE("PppOutputBuffer") {
+    Channel ch;
+    PppOutputBuffer buf;
+    REQUIRE(buf.init(MUX_FRAME_SIZE, BATCH_FRAME_SIZE, Channel::write, &ch) == 0);
+
+    SECTION("writes a large frame with a single write") {
+        const auto f = frame(1000);
+        writeFrame(&buf, f);
+        CHECK(ch.writes.size() == 1);
+        CHECK(ch.data == f);
+        CHECK(!buf.hasPendingFrames());
+    }
+
+    SECTION("batches small frames") {
+        std::string expected;
+        for (int i = 0; i < 10; ++i) {
+            const auto f = frame(50);
+            writeFrame(&buf, f);
+            expected += f;
+        }
+        CHECK(ch.writes.empty());
+        CHECK(buf.hasPendingFrames());
+        REQUIRE(buf.flush() == 0);
+        CHECK(ch.writes.size() == 1);
+        CHECK(ch.data == expected);
+        // A large frame is written together with the batched frames
+        const auto f1 = frame(50);
+        writeFrame(&buf, f1);
+        const auto f2 = frame(500);
+        writeFrame(&buf, f2);
+        CHECK(ch.writes.size() == 2);
+        CHECK(ch.data == expected + f1 + f2);
+    }
+
+    SECTION("writes the batched frames when the buffer is full") {
+        for (int i = 0; i < 20; ++i) {
+            writeFrame(&buf, frame(100));
+        }
+        REQUIRE(buf.flush() == 0);
+        // The frames are not split between the writes
+        REQUIRE(ch.writes.size() == 2);
+        CHECK(ch.writes[0] == 1500);
+        CHECK(ch.writes[1] == 500);
+    }
+
+    SECTION("writes a frame larger than the buffer in several parts") {
+        const auto f = frame(MUX_FRAME_SIZE * 2 + 100);
+        writeFrame(&buf, f);
+        CHECK(ch.writes.size() == 3);
+        CHECK(ch.data == f);
+    }
+
+    SECTION("doesn't count unframed data as a part of the next frame") {
+        const std::string cmd = "ATD*99***1#\r\n";
+        REQUIRE(buf.writeRaw((const uint8_t*)cmd.data(), cmd.size()) == 0);
+        CHECK(ch.writes.size() == 1);
+        // The frame would reach the batching threshold together with the command
+        const auto f = frame(BATCH_FRAME_SIZE - 8);
+        writeFrame(&buf, f);
+        CHECK(ch.writes.size() == 1);
+        CHECK(buf.hasPendingFrames());
+        REQUIRE(buf.flush() == 0);
+        CHECK(ch.writes.size() == 2);
+        CHECK(ch.data == cmd + f);
+        CHECK(buf.stats().frames == 1);
+    }
+
+    SECTION("reports write errors") {
+        ch.error = SYSTEM_ERROR_IO;
+        CHECK(buf.write((const uint8_t*)frame(500).data(), 500) == SYSTEM_ERROR_IO);
+        CHECK(buf.stats().errors == 1);
+    }
+
+    SECTION("reduces the number of multiplexer frames per IP packet") {
+        // Bulk transfer: full-size frames interleaved with TCP ACKs
+        std::string expected;
+        size_t pbufCount = 0;
+        for (int i = 0; i < 100; ++i) {
+            const auto f = frame(test::randomInt(0, 3) ? 1400 : 60);
+            pbufCount += writeFrame(&buf, f);
+            expected += f;
+        }
+        REQUIRE(buf.flush() == 0);
+        CHECK(ch.data == expected);
+        const auto& s = buf.stats();
+        CHECK(s.frames == 100);
+        // Without the buffer, every pbuf becomes a separate multiplexer frame. With the buffer,
+        // there's at most one multiplexer frame per IP packet
+        CHECK(s.writes <= s.frames);
+        const size_t maxWrites = pbufCount / 4;
+        CHECK(s.writes < maxWrites);
+        CHECK(s.bytes == expected.size());
+    }
+}
@@ -2,6 +2,12 @@
 #include "catch.hpp"
 #include "spark_wiring_print.h"
 
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <string>
+
 
 class BufferPrint : public Print
 {
@@ -56,3 +62,144 @@ SCENARIO("Print.printf() with a a > 20 char string", "[print]")
     print.printf("abcdabcdabcdabcd %d xyzxyzxyzxyzxyzxyzxyzxyz", 100);
     REQUIRE(String("abcdabcdabcdabcd 100 xyzxyzxyzxyzxyzxyzxyzxyz") == print.result());
 }
+
+namespace {
+
+class NullPrint : public Print
+{
+public:
+    size_t writeCount = 0;
+
+    size_t write(uint8_t c) override
+    {
+        ++writeCount;
+        return 1;
+    }
+
+    size_t write(const uint8_t* buffer, size_t size) override
+    {
+        ++writeCount;
+        return size;
+    }
+
+    // Formatting code used by Print::printf() previously
+    size_t twoPassPrintf(const char* format, ...)
+    {
+        const int bufsize = 20;
+        char test[bufsize];
+        va_list marker;
+        va_start(marker, format);
+        size_t n = vsnprintf(test, bufsize, format, marker);
+        va_end(marker);
+        if (n < bufsize) {
+            n = print(test);
+        } else {
+            char bigger[n + 1];
+            va_start(marker, format);
+            n = vsnprintf(bigger, n + 1, format, marker);
+            va_end(marker);
+            n = print(bigger);
+        }
+        return n;
+    }
+};
+
+template<typename... ArgsT>
+void checkPrintf(const char* format, ArgsT... args)
+{
+    char expected[512];
+    const int n = snprintf(expected, sizeof(expected), format, args...);
+    BufferPrint print;
+    CHECK(print.printf(format, args...) == (size_t)n);
+    CHECK(std::string(print.result().c_str()) == std::string(expected));
+}
+
+} // namespace
+
+TEST_CASE("Print.printf() produces the same output as snprintf()", "[print]")
+{
+    SECTION("integers") {
+        checkPrintf("%d %i %u", -123, 456, 789u);
+        checkPrintf("%x %X %o %#x %#o", 0xbeef, 0xbeef, 8, 255, 8);
+        checkPrintf("%ld %lu %lld %llu", -1L, 2UL, -3LL, 18446744073709551615ULL);
+        checkPrintf("%hd %hhu %zu %jd %td", 65537, 257, (size_t)42, (intmax_t)-42, (ptrdiff_t)-1);
+        checkPrintf("%+d % d %+d", 5, 5, -5);
+    }
+    SECTION("field width and precision") {
+        checkPrintf("[%5d] [%-5d] [%05d] [%05d]", 42, 42, 42, -42);
+        checkPrintf("[%.3d] [%08.3d] [%#010x] [%010X]", 7, 7, 0xab, 0xab);
+        checkPrintf("[%*d] [%-*d] [%*d] [%.*d]", 6, 1, 6, 2, -6, 3, 4, 5);
+        checkPrintf("[%10s] [%-10s] [%.2s] [%*.*s]", "abc", "abc", "abc", 5, 1, "xyz");
+        checkPrintf("[%3c] [%-3c]", 'a', 'b');
+        checkPrintf("[%.0d]", 0);
+    }
+    SECTION("floating point") {
+        checkPrintf("%f %.2f %e %g %G", 3.14159, 2.71828, 12345.678, 0.0001, 1e20);
+        checkPrintf("[%10.3f] [%-10.3f] [%010.3f] [%+.1f]", -1.5, 1.5, -1.5, 2.0);
+        checkPrintf("[%08f] [%-8f]", INFINITY, NAN);
+        checkPrintf("%f", 1e300);
+    }
+    SECTION("misc") {
+        checkPrintf("100%% done");
+        checkPrintf("%p", (void*)0x1234);
+        checkPrintf("%s", "");
+        checkPrintf("no conversions");
+        checkPrintf("%s and %s", "a string which is much longer than the formatter's internal chunk buffer",
+                "another string of a similar length, to make sure nothing gets lost between chunks");
+        checkPrintf("[%100d]", 1);
+        checkPrintf("[%.40d]", 1);
+    }
+}
+
+TEST_CASE("Print.printf() writes output in chunks", "[print]")
+{
+    NullPrint print;
+    std::string s(1000, 'a');
+    CHECK(print.printf("%s %d", s.c_str(), 1) == 1002);
+    // The long string is written directly, the rest is buffered
+    CHECK(print.writeCount == 2);
+    print.writeCount = 0;
+    CHECK(print.printf("%d %d %d %s", 1, 2, 3, "abc") == 9);
+    CHECK(print.writeCount == 1);
+}
+
+TEST_CASE("Print.printf() benchmark", "[.][benchmark]")
+{
+    struct {
+        const char* name;
+        std::function<size_t(NullPrint&, bool)> fn;
+    } formats[] = {
+        { "short message", [](NullPrint& p, bool twoPass) {
+            return twoPass ? p.twoPassPrintf("ok %d", 1) : p.printf("ok %d", 1);
+        } },
+        { "log line", [](NullPrint& p, bool twoPass) {
+            const char* fmt = "%010u [%s] %s: %s";
+            return twoPass ? p.twoPassPrintf(fmt, 123456u, "app.network", "INFO", "Connecting to the cloud") :
+                    p.printf(fmt, 123456u, "app.network", "INFO", "Connecting to the cloud");
+        } },
+        { "telemetry", [](NullPrint& p, bool twoPass) {
+            const char* fmt = "{\"t\":%.2f,\"h\":%.1f,\"rssi\":%d,\"up\":%lu}";
+            return twoPass ? p.twoPassPrintf(fmt, 23.45, 56.7, -67, 86400UL) :
+                    p.printf(fmt, 23.45, 56.7, -67, 86400UL);
+        } },
+        { "hex dump", [](NullPrint& p, bool twoPass) {
+            const char* fmt = "%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x";
+            return twoPass ? p.twoPassPrintf(fmt, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12) :
+                    p.printf(fmt, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12);
+        } }
+    };
+    const unsigned ITERATIONS = 200000;
+    for (auto& f: formats) {
+        double t[2] = {};
+        for (int twoPass = 0; twoPass < 2; ++twoPass) {
+            NullPrint print;
+            const auto t1 = std::chrono::steady_clock::now();
+            for (unsigned i = 0; i < ITERATIONS; ++i) {
+                f.fn(print, twoPass);
+            }
+            const auto t2 = std::chrono::steady_clock::now();
+            t[twoPass] = std::chrono::duration<double, std::nano>(t2 - t1).count() / ITERATIONS;
+        }
+        std::cout << f.name << ": streaming " << t[0] << " ns, two-pass " << t[1] << " ns" << std::endl;
+    }
+}
@@ -0,0 +1,174 @@
+#include "slab_pool_allocator.h"
+#include "simple_pool_allocator.h"
+
+#include "tools/catch.h"
+#include "tools/random.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <set>
+
+namespace {
+
+const size_t POOL_SIZE = 4096;
+
+class TestSlabPool: public SlabAllocedPool {
+public:
+    using SlabAllocedPool::SlabAllocedPool;
+
+    size_t classSize(size_t cls) const {
+        return classSizes_[cls];
+    }
+
+    size_t tailFreeSize() const {
+        return size_ - (ptr_ - begin_);
+    }
+};
+
+struct WorkloadResult {
+    double opsPerSec;
+    unsigned failed;
+    unsigned allocs;
+};
+
+// Synthetic mixed workload: keeps a random set of live blocks of varying sizes, biased towards
+// small allocations, and randomly allocates or frees blocks
+WorkloadResult runMixedWorkload(particle::SimpleAllocator* pool, unsigned iterations) {
+    std::default_random_engine gen(1);
+    std::uniform_int_distribution<int> op(0, 99);
+    std::uniform_int_distribution<int> small(1, 64);
+    std::uniform_int_distribution<int> large(65, 512);
+    std::vector<void*> live;
+    WorkloadResult r = {};
+    const auto t1 = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < iterations; ++i) {
+        if (live.empty() || (op(gen) < 50 && live.size() < 64)) {
+            const size_t size = (op(gen) < 80) ? small(gen) : large(gen);
+            void* p = pool->alloc(size);
+            ++r.allocs;
+            if (p) {
+                live.push_back(p);
+            } else {
+                ++r.failed;
+            }
+        } else {
+            const size_t idx = std::uniform_int_distribution<size_t>(0, live.size() - 1)(gen);
+            pool->free(live[idx]);
+            live[idx] = live.back();
+            live.pop_back();
+        }
+    }
+    const auto t2 = std::chrono::steady_clock::now();
+    for (void* p: live) {
+        pool->free(p);
+    }
+    r.opsPerSec = iterations / std::chrono::duration<double>(t2 - t1).count();
+    return r;
+}
+
+} // namespace
+
+TEST_CASE("SlabAllocedPool") {
+    TestSlabPool pool(POOL_SIZE);
+
+    SECTION("uses power-of-two size classes by default") {
+        REQUIRE(pool.sizeClassCount() == SLAB_POOL_MAX_SIZE_CLASSES);
+        size_t size = SLAB_POOL_MIN_BLOCK_SIZE;
+        for (size_t i = 0; i < pool.sizeClassCount(); ++i) {
+            CHECK(pool.classSize(i) == size);
+            size *= 2;
+        }
+        CHECK(pool.maxBlockSize() == pool.classSize(pool.sizeClassCount() - 1));
+    }
+
+    SECTION("allocated blocks are aligned and don't overlap") {
+        std::set<uintptr_t> blocks;
+        for (;;) {
+            const size_t size = test::randomInt(1, 100);
+            auto p = (uint8_t*)pool.alloc(size);
+            if (!p) {
+                break;
+            }
+            CHECK(((uintptr_t)p % sizeof(uintptr_t)) == 0);
+            memset(p, 0xaa, size);
+            const auto it = blocks.lower_bound((uintptr_t)p);
+            if (it != blocks.end()) {
+                CHECK(*it >= (uintptr_t)p + size);
+            }
+            blocks.insert((uintptr_t)p);
+        }
+        CHECK(blocks.size() > 0);
+    }
+
+    SECTION("freed blocks are reused") {
+        void* p1 = pool.alloc(10);
+        REQUIRE(p1 != nullptr);
+        pool.free(p1);
+        const size_t tail = pool.tailFreeSize();
+        void* p2 = pool.alloc(16);
+        CHECK(p2 == p1);
+        CHECK(pool.tailFreeSize() == tail);
+    }
+
+    SECTION("allocations larger than the largest size class fail") {
+        CHECK(pool.alloc(pool.maxBlockSize() + 1) == nullptr);
+        CHECK(pool.alloc(pool.maxBlockSize()) != nullptr);
+    }
+
+    SECTION("blocks of a larger size class are used when the pool is exhausted") {
+        void* p = pool.alloc(100);
+        REQUIRE(p != nullptr);
+        while (pool.alloc(17) != nullptr) {
+        }
+        while (pool.alloc(1) != nullptr) {
+        }
+        pool.free(p);
+        CHECK(pool.alloc(10) == p);
+        // The block returns to its original size class
+        pool.free(p);
+        CHECK(pool.alloc(100) == p);
+    }
+
+    SECTION("free() is safe to call concurrently with alloc()") {
+        // Blocks released to the lock-free list are picked up by the next alloc()
+        std::vector<void*> blocks;
+        for (int i = 0; i < 10; ++i) {
+            blocks.push_back(pool.alloc(32));
+        }
+        for (void* p: blocks) {
+            pool.free(p);
+        }
+        std::set<void*> reused;
+        for (int i = 0; i < 10; ++i) {
+            reused.insert(pool.alloc(32));
+        }
+        CHECK(reused == std::set<void*>(blocks.begin(), blocks.end()));
+    }
+}
+
+TEST_CASE("SlabStaticPool with custom size classes") {
+    std::vector<uint8_t> buf(POOL_SIZE);
+    const size_t sizes[] = { 10, 60 };
+    SlabStaticPool pool(buf.data(), buf.size(), sizes, 2);
+    CHECK(pool.sizeClassCount() == 2);
+    CHECK(pool.maxBlockSize() >= 60);
+    void* p = pool.alloc(60);
+    CHECK(p >= (void*)buf.data());
+    CHECK(p < (void*)(buf.data() + buf.size()));
+    CHECK(pool.alloc(pool.maxBlockSize() + 1) == nullptr);
+    pool.free(p);
+}
+
+TEST_CASE("Slab pool vs first-fit pool benchmark", "[.][benchmark]") {
+    const unsigned ITERATIONS = 1000000;
+    SimpleAllocedPool simplePool(16 * 1024);
+    SlabAllocedPool slabPool(16 * 1024);
+    const auto simple = runMixedWorkload(&simplePool, ITERATIONS);
+    const auto slab = runMixedWorkload(&slabPool, ITERATIONS);
+    std::cout << "SimpleAllocedPool: " << (unsigned)simple.opsPerSec << " ops/s, " << simple.failed << " of " <<
+            simple.allocs << " allocations failed" << std::endl;
+    std::cout << "SlabAllocedPool: " << (unsigned)slab.opsPerSec << " ops/s, " << slab.failed << " of " <<
+            slab.allocs << " allocations failed" << std::endl;
+}
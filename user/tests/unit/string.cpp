@@ -5,6 +5,10 @@
 
 #include "spark_wiring_string.h"
 
+#include "tools/random.h"
+
+#include <vector>
+
 TEST_CASE("Can use HEX radix with String numeric conversion constructors") {
 
     REQUIRE(!strcmp(String(32, HEX),"20"));
@@ -77,3 +81,179 @@ TEST_CASE("Can format a string using printf like syntax") {
 TEST_CASE("Can convert a string to lowercase") {
     REQUIRE(String("In LOWERCAse").toLowerCase()==String("in lowercase"));
 }
+
+namespace {
+
+template<typename T>
+bool isStoredInPlace(const T& s) {
+    const char* const p = reinterpret_cast<const char*>(&s);
+    return s.c_str() >= p && s.c_str() < p + sizeof(s);
+}
+
+} // namespace
+
+TEST_CASE("String layout is unchanged") {
+    // String objects are passed between modules
+    struct Layout {
+        char* buffer;
+        unsigned int capacity;
+        unsigned int len;
+        unsigned char flags;
+    };
+    REQUIRE(sizeof(String) == sizeof(Layout));
+}
+
+TEST_CASE("Strings can be moved") {
+    SECTION("heap buffer") {
+        String a("abcdefghijklmnopqrstuvwxyz");
+        const char* p = a.c_str();
+        String b(std::move(a));
+        REQUIRE(b == "abcdefghijklmnopqrstuvwxyz");
+        REQUIRE(b.c_str() == p);
+        b = String("xyz");
+        REQUIRE(b == "xyz");
+    }
+    SECTION("in-place buffer") {
+        SmallString<8> a("abc");
+        String b(std::move(a));
+        REQUIRE(b == "abc");
+        REQUIRE_FALSE(isStoredInPlace(b));
+        REQUIRE(a == "");
+        REQUIRE(isStoredInPlace(a));
+    }
+    SECTION("into an in-place buffer") {
+        String a("abcdefghijklmnopqrstuvwxyz");
+        const char* p = a.c_str();
+        SmallString<8> b(std::move(a));
+        REQUIRE(b == "abcdefghijklmnopqrstuvwxyz");
+        REQUIRE(b.c_str() == p);
+        SmallString<8> c("abc");
+        SmallString<8> d(std::move(c));
+        REQUIRE(d == "abc");
+        REQUIRE(isStoredInPlace(d));
+    }
+}
+
+TEST_CASE("SmallString") {
+    SmallString<15> s;
+    REQUIRE(s.c_str() != nullptr);
+    REQUIRE(isStoredInPlace(s));
+    s = "0123456789";
+    REQUIRE(isStoredInPlace(s));
+    s = String(INT_MIN);
+    REQUIRE(s == "-2147483648");
+    REQUIRE(isStoredInPlace(s));
+    s = std::string(15, 'a').c_str();
+    REQUIRE(isStoredInPlace(s));
+    s.concat('b');
+    REQUIRE_FALSE(isStoredInPlace(s));
+    REQUIRE(s == (std::string(15, 'a') + 'b').c_str());
+    SmallString<15> s2(s);
+    REQUIRE(s2 == s);
+    REQUIRE_FALSE(isStoredInPlace(s2));
+    SmallString<15> s3("abc");
+    s3 = s3 + "def";
+    REQUIRE(s3 == "abcdef");
+    REQUIRE(isStoredInPlace(s3));
+}
+
+TEST_CASE("Concatenation grows the buffer geometrically") {
+    String s;
+    unsigned reallocs = 0;
+    const char* p = s.c_str();
+    for (int i = 0; i < 1000; ++i) {
+        s += 'x';
+        if (s.c_str() != p) {
+            p = s.c_str();
+            ++reallocs;
+        }
+    }
+    REQUIRE(s.length() == 1000);
+    REQUIRE(reallocs < 20);
+}
+
+TEST_CASE("StaticString") {
+    StaticString<8> s("abc");
+    REQUIRE(s == "abc");
+    REQUIRE(isStoredInPlace(s));
+    REQUIRE(s.concat("defgh"));
+    REQUIRE(s == "abcdefgh");
+    SECTION("fails to grow past its capacity") {
+        REQUIRE_FALSE(s.concat('i'));
+        REQUIRE(s == "abcdefgh");
+        s = "012345678";
+        REQUIRE(s == "");
+        REQUIRE(isStoredInPlace(s));
+        s = "0123";
+        REQUIRE(s == "0123");
+        REQUIRE(isStoredInPlace(s));
+    }
+    SECTION("can be copied and assigned") {
+        StaticString<8> s2(s);
+        REQUIRE(s2 == "abcdefgh");
+        REQUIRE(isStoredInPlace(s2));
+        String s3 = s2;
+        REQUIRE(s3 == "abcdefgh");
+        s2 = String("xyz");
+        REQUIRE(s2 == "xyz");
+        REQUIRE(isStoredInPlace(s2));
+        s2 = s;
+        REQUIRE(s2 == "abcdefgh");
+        s2 = String(123);
+        REQUIRE(s2 == "123");
+        REQUIRE(isStoredInPlace(s2));
+    }
+}
+
+TEST_CASE("String soak test") {
+    // Performs a long series of random operations on a set of strings and checks the results
+    // against std::string. StaticString buffers must never leave the object
+    const size_t count = 16;
+    std::vector<String> strs(count);
+    std::vector<SmallString<16>> smallStrs(count);
+    std::vector<StaticString<32>> staticStrs(count);
+    std::vector<std::string> expected(count);
+    std::vector<std::string> expectedStatic(count);
+    for (int i = 0; i < 100000; ++i) {
+        const size_t n = test::randomInt(0, count - 1);
+        const std::string v = test::randomString(0, 24);
+        switch (test::randomInt(0, 3)) {
+        case 0:
+            strs[n] = v.c_str();
+            smallStrs[n] = v.c_str();
+            expected[n] = v;
+            staticStrs[n] = v.c_str();
+            expectedStatic[n] = v;
+            break;
+        case 1:
+            strs[n].concat(v.c_str());
+            smallStrs[n].concat(v.c_str());
+            expected[n] += v;
+            if (expectedStatic[n].size() + v.size() <= 32) {
+                REQUIRE(staticStrs[n].concat(v.c_str()));
+                expectedStatic[n] += v;
+            } else {
+                REQUIRE_FALSE(staticStrs[n].concat(v.c_str()));
+            }
+            break;
+        case 2:
+            strs[n] = strs[(n + 1) % count];
+            smallStrs[n] = SmallString<16>(smallStrs[(n + 1) % count]);
+            expected[n] = expected[(n + 1) % count];
+            staticStrs[n] = staticStrs[(n + 1) % count];
+            expectedStatic[n] = expectedStatic[(n + 1) % count];
+            break;
+        default:
+            strs[n] = String(i);
+            smallStrs[n] = String(i);
+            expected[n] = std::to_string(i);
+            staticStrs[n] = String(i);
+            expectedStatic[n] = std::to_string(i);
+            break;
+        }
+        REQUIRE(strs[n] == expected[n].c_str());
+        REQUIRE(smallStrs[n] == expected[n].c_str());
+        REQUIRE(staticStrs[n] == expectedStatic[n].c_str());
+        REQUIRE(isStoredInPlace(staticStrs[n]));
+    }
+}
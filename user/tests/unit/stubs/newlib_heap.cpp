@@ -0,0 +1,47 @@
+#include "service_debug.h"
+
+#include <stdlib.h>
+#include <malloc.h>
+
+#include <stdexcept>
+
+struct _reent;
+
+// Functions used by newlib_nano/src/malloc.c
+extern "C" {
+
+void* pvPortMalloc(size_t size) {
+    return ::malloc(size);
+}
+
+void vPortFree(void* ptr) {
+    ::free(ptr);
+}
+
+size_t xPortGetFreeHeapSize() {
+    return 0;
+}
+
+size_t xPortGetMinimumEverFreeHeapSize() {
+    return 0;
+}
+
+size_t xPortGetHeapSize() {
+    return 0;
+}
+
+size_t xPortGetBlockSize(void* ptr) {
+    return ::malloc_usable_size(ptr);
+}
+
+void __malloc_lock(struct _reent* r) {
+}
+
+void __malloc_unlock(struct _reent* r) {
+}
+
+void panic_(ePanicCode code, void* extraInfo, void (*delay)(uint32_t)) {
+    throw std::runtime_error("panic");
+}
+
+} // extern "C"
@@ -0,0 +1,6 @@
+// Stub for newlib's <reent.h>, which is included by newlib_nano/src/malloc.c
+#pragma once
+
+struct _reent {
+    const char* _current_locale;
+};
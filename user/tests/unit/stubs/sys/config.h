@@ -0,0 +1,2 @@
+// Stub for newlib's <sys/config.h>, which is included by newlib_nano/src/malloc.c
+#pragma once
@@ -1,4 +1,5 @@
 #include "usb_control_request_channel.h"
+#include "chunk_pipeline.h"
 #include "active_object.h"
 
 #include "mocks/alloc.h"
@@ -10,6 +11,7 @@
 #include <boost/optional.hpp>
 
 #include <set>
+#include <map>
 #include <list>
 
 ISRTaskQueue SystemISRTaskQueue;
@@ -394,6 +396,170 @@ inline bool ServiceRequest::send() {
     return channel_->sendServiceRequest(*this);
 }
 
+/*
+    Simulates a firmware update streamed to the device in numbered chunks, and returns its duration in microseconds. The time is virtual: each service request takes
+    USB_TRANSFER_TIME of the host's time, and handling a request and writing a chunk to flash take
+    the device's time. A request is processed only when the device is not busy, and its result
+    becomes visible to the host only after the handler has set it.
+
+    In the stop-and-wait mode, the host sends one chunk at a time, and the chunk is written before
+    the reply is sent. In the pipelined mode, the host sends the next chunk without waiting for the
+    reply to the previous one, and the device buffers the chunk and writes it in the completion
+    handler, i.e. while the host is sending the next chunk.
+*/
+class FirmwareUpdateSimulation {
+public:
+    static const unsigned USB_TRANSFER_TIME = 500;
+    static const unsigned HANDLER_TIME = 100;
+    static const unsigned FLASH_WRITE_TIME = 5000; // Per chunk
+    static const size_t CHUNK_SIZE = 1024;
+
+    FirmwareUpdateSimulation(Channel* channel, bool pipelined) :
+            channel_(channel),
+            hostTime_(0),
+            deviceTime_(0),
+            pipelined_(pipelined) {
+        REQUIRE(pipeline_.init(CHUNK_SIZE, write, this) == 0);
+        channel_->requestHandler([this](ctrl_request* req, ControlRequestChannel* ch) {
+            this->processRequest(req, ch);
+        });
+    }
+
+    uint64_t run(const std::string& image) {
+        const uint16_t TEST_REQ = 1234;
+        // In the pipelined mode, the host keeps two chunks in flight
+        const size_t window = pipelined_ ? 2 : 1;
+        std::list<Request> reqs;
+        uint32_t nextSeq = 0;
+        uint32_t sendSeq = 0; // Chunks are sent in order
+        for (;;) {
+            while (reqs.size() < window && nextSeq * CHUNK_SIZE < image.size()) {
+                Request req;
+                req.seq = nextSeq++;
+                req.data = std::string((const char*)&req.seq, sizeof(req.seq));
+                req.data += image.substr(req.seq * CHUNK_SIZE, CHUNK_SIZE);
+                REQUIRE(serviceRequest(channel_->serviceRequest(ServiceRequest::INIT).type(TEST_REQ).size(req.data.size())));
+                const auto rep = channel_->serviceReply();
+                req.id = rep.id();
+                req.state = (rep.status() == ServiceReply::PENDING) ? State::WAIT_ALLOC : State::SEND_DATA;
+                reqs.push_back(req);
+            }
+            if (reqs.empty()) {
+                break;
+            }
+            auto req = reqs.begin();
+            do {
+                bool done = false;
+                switch (req->state) {
+                case State::WAIT_ALLOC: {
+                    REQUIRE(serviceRequest(channel_->serviceRequest(ServiceRequest::CHECK).id(req->id)));
+                    if (channel_->serviceReply().status() == ServiceReply::OK) {
+                        req->state = State::SEND_DATA;
+                    }
+                    break;
+                }
+                case State::SEND_DATA: {
+                    if (req->seq == sendSeq) {
+                        REQUIRE(serviceRequest(channel_->serviceRequest(ServiceRequest::SEND).id(req->id).data(req->data)));
+                        req->state = State::WAIT_REPLY;
+                        ++sendSeq;
+                    }
+                    break;
+                }
+                case State::WAIT_REPLY: {
+                    REQUIRE(serviceRequest(channel_->serviceRequest(ServiceRequest::CHECK).id(req->id)));
+                    const auto rep = channel_->serviceReply();
+                    if (rep.status() == ServiceReply::OK && hostTime_ >= replyTime_[req->seq]) {
+                        REQUIRE(rep.result() == SYSTEM_ERROR_NONE);
+                        REQUIRE(serviceRequest(channel_->serviceRequest(ServiceRequest::RECV).id(req->id).size(sizeof(uint32_t))));
+                        uint32_t ack = 0;
+                        memcpy(&ack, channel_->serviceReply().data().data(), sizeof(ack));
+                        REQUIRE(ack == req->seq + 1);
+                        done = true;
+                    }
+                    break;
+                }
+                }
+                const auto tmpReq = req;
+                ++req;
+                if (done) {
+                    reqs.erase(tmpReq);
+                }
+            } while (req != reqs.end());
+        }
+        // Finish the update
+        deviceTime_ = std::max(deviceTime_, hostTime_);
+        while (processNextTask()) {
+        }
+        REQUIRE(pipeline_.flush() == 0);
+        REQUIRE(written_ == image);
+        return deviceTime_;
+    }
+
+private:
+    enum class State {
+        WAIT_ALLOC,
+        SEND_DATA,
+        WAIT_REPLY
+    };
+
+    struct Request {
+        std::string data;
+        uint32_t seq;
+        uint16_t id;
+        State state;
+    };
+
+    Channel* channel_;
+    ChunkPipeline pipeline_;
+    std::string written_;
+    std::map<uint32_t, uint64_t> replyTime_; // Time at which the result of a request was set
+    uint64_t hostTime_;
+    uint64_t deviceTime_;
+    bool pipelined_;
+
+    bool serviceRequest(ServiceRequest req) {
+        const bool ok = req.send();
+        hostTime_ += USB_TRANSFER_TIME;
+        // Let the device process the queued tasks while it's not busy
+        while (deviceTime_ <= hostTime_) {
+            deviceTime_ = hostTime_;
+            if (!processNextTask()) {
+                break;
+            }
+        }
+        return ok;
+    }
+
+    void processRequest(ctrl_request* req, ControlRequestChannel* ch) {
+        deviceTime_ += HANDLER_TIME;
+        uint32_t seq = 0;
+        REQUIRE(req->request_size > sizeof(seq));
+        memcpy(&seq, req->request_data, sizeof(seq));
+        int ret = pipeline_.receive(seq, req->request_data + sizeof(seq), req->request_size - sizeof(seq));
+        if (ret == 0 && !pipelined_) {
+            ret = pipeline_.flush();
+        }
+        REQUIRE(ch->allocReplyData(req, sizeof(uint32_t)) == 0);
+        const uint32_t ack = pipeline_.ack();
+        memcpy(req->reply_data, &ack, sizeof(ack));
+        replyTime_[seq] = deviceTime_;
+        ch->setResult(req, ret, pipelined_ ? flush : nullptr, this);
+    }
+
+    static int write(const char* data, size_t size, void* ctx) {
+        const auto self = static_cast<FirmwareUpdateSimulation*>(ctx);
+        self->written_.append(data, size);
+        self->deviceTime_ += FLASH_WRITE_TIME;
+        return 0;
+    }
+
+    static void flush(int result, void* data) {
+        const auto self = static_cast<FirmwareUpdateSimulation*>(data);
+        REQUIRE(self->pipeline_.flush() == 0);
+    }
+};
+
 } // namespace
 
 TEST_CASE("UsbControlRequestChannel") {
@@ -836,3 +1002,22 @@ TEST_CASE("UsbControlRequestChannel") {
         channel.checkMemory(); // Ensure there are no memory leaks
     }
 }
+
+TEST_CASE("UsbControlRequestChannel firmware update throughput") {
+    const auto image = randomBytes(100 * 1024);
+    uint64_t stopAndWaitTime = 0;
+    uint64_t pipelinedTime = 0;
+    {
+        Channel channel;
+        stopAndWaitTime = FirmwareUpdateSimulation(&channel, false /* pipelined */).run(image);
+        channel.checkMemory();
+    }
+    {
+        Channel channel;
+        pipelinedTime = FirmwareUpdateSimulation(&channel, true /* pipelined */).run(image);
+        channel.checkMemory();
+    }
+    // Writing of a chunk should overlap with the transfer of the next one
+    const uint64_t maxPipelinedTime = stopAndWaitTime * 9 / 10;
+    CHECK(pipelinedTime < maxPipelinedTime);
+}
@@ -0,0 +1,267 @@
+#include "system_ymodem.h"
+#include "system_update.h"
+#include "timer_hal.h"
+
+#include "tools/catch.h"
+#include "tools/random.h"
+
+#include "hippomocks.h"
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <string>
+
+namespace {
+
+const size_t FILE_SIZE = 50 * 1024 + 123;
+
+// Performance characteristics of the simulated link and flash
+const unsigned FLASH_WRITE_TIME_PER_BYTE = 4; // Microseconds
+const unsigned SENDER_TURNAROUND_TIME = 1000; // Time it takes the sender to respond to an ACK (microseconds)
+const unsigned POLL_TIME = 5; // Time it takes the receiver to poll the stream (microseconds)
+const size_t RX_BUFFER_SIZE = 256; // Size of the receive buffer of the stream
+
+uint16_t crc16(const std::string& data) {
+    uint16_t crc = 0;
+    for (char c: data) {
+        crc ^= (uint8_t)c << 8;
+        for (int i = 0; i < 8; ++i) {
+            crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+std::string packet(uint8_t seq, std::string data) {
+    const size_t size = (data.size() > YModem::PACKET_SIZE) ? YModem::PACKET_1K_SIZE : YModem::PACKET_SIZE;
+    data.resize(size, (seq == 0) ? 0x00 : 0x1a);
+    const uint16_t crc = crc16(data);
+    std::string p;
+    p += (char)((size == YModem::PACKET_SIZE) ? YModem::SOH : YModem::STX);
+    p += (char)seq;
+    p += (char)~seq;
+    p += data;
+    p += (char)(crc >> 8);
+    p += (char)(crc & 0xff);
+    return p;
+}
+
+/*
+    Stream connecting the receiver to a simulated YModem sender over a serial line with flow
+    control. The time is virtual: transferring a byte over the line takes 10 bits at the given
+    baud rate, and the receiver's time advances when it polls the stream or writes to flash.
+*/
+class LoopbackStream: public Stream {
+public:
+    LoopbackStream(unsigned baudRate, const std::string& file) :
+            byteTime_(10000000.0 / baudRate),
+            now_(0),
+            lineTime_(0),
+            current_(0),
+            canceled_(false) {
+        // File name packet
+        std::string info("firmware.bin");
+        info += '\0';
+        info += std::to_string(file.size()) + ' ';
+        packets_.push_back(packet(0, info));
+        // Data packets
+        for (size_t offs = 0; offs < file.size(); offs += YModem::PACKET_1K_SIZE) {
+            packets_.push_back(packet(packets_.size(), file.substr(offs, YModem::PACKET_1K_SIZE)));
+        }
+        packets_.push_back(std::string(1, YModem::EOT));
+        // Empty file name packet ends the session
+        packets_.push_back(packet(0, std::string()));
+        transmit(packets_[0], 0);
+    }
+
+    // Current time in microseconds
+    double now() const {
+        return now_;
+    }
+
+    void advance(double time) {
+        now_ += time;
+    }
+
+    bool canceled() const {
+        return canceled_;
+    }
+
+    bool done() const {
+        return current_ == packets_.size() - 1;
+    }
+
+    double byteTime() const {
+        return byteTime_;
+    }
+
+    // Stream
+    int available() override {
+        deliver();
+        if (rx_.empty()) {
+            now_ += POLL_TIME;
+            return 0;
+        }
+        return rx_.size();
+    }
+
+    int read() override {
+        deliver();
+        if (rx_.empty()) {
+            return -1;
+        }
+        const uint8_t c = rx_.front();
+        rx_.pop_front();
+        return c;
+    }
+
+    int peek() override {
+        deliver();
+        return rx_.empty() ? -1 : rx_.front();
+    }
+
+    void flush() override {
+    }
+
+    // Print
+    size_t write(uint8_t c) override {
+        // The sender responds to the byte once it's transferred
+        const double time = now_ + byteTime_ + SENDER_TURNAROUND_TIME;
+        switch (c) {
+        case YModem::ACK:
+            if (current_ + 1 < packets_.size()) {
+                transmit(packets_[++current_], time);
+            }
+            break;
+        case YModem::NAK:
+            transmit(packets_[current_], time);
+            break;
+        case YModem::CA:
+            canceled_ = true;
+            break;
+        default:
+            break;
+        }
+        return 1;
+    }
+
+private:
+    std::deque<std::pair<double, uint8_t>> tx_; // Bytes pending transmission and the time they can be sent at
+    std::deque<uint8_t> rx_; // Bytes received by the stream
+    std::vector<std::string> packets_;
+    double byteTime_;
+    double now_;
+    double lineTime_; // Time at which the last byte has been transferred over the line
+    size_t current_;
+    bool canceled_;
+
+    void transmit(const std::string& data, double time) {
+        for (char c: data) {
+            tx_.push_back(std::make_pair(time, (uint8_t)c));
+        }
+    }
+
+    void deliver() {
+        while (!tx_.empty() && rx_.size() < RX_BUFFER_SIZE) {
+            const double t = std::max(lineTime_, tx_.front().first) + byteTime_;
+            if (t > now_) {
+                break;
+            }
+            rx_.push_back(tx_.front().second);
+            tx_.pop_front();
+            lineTime_ = t;
+        }
+        if (rx_.size() == RX_BUFFER_SIZE && lineTime_ < now_) {
+            lineTime_ = now_; // The line is stalled by the flow control
+        }
+    }
+};
+
+struct Transfer {
+    std::string file;
+    std::string flash;
+    int32_t result;
+    double time; // Microseconds
+    int writeError;
+
+    Transfer() :
+            result(0),
+            time(0),
+            writeError(0) {
+    }
+
+    void run(unsigned baudRate) {
+        LoopbackStream stream(baudRate, file);
+        MockRepository mocks;
+        mocks.OnCallFunc(HAL_Timer_Get_Milli_Seconds).Do([&]() {
+            return (system_tick_t)(stream.now() / 1000);
+        });
+        mocks.OnCallFunc(Spark_Prepare_For_Firmware_Update).Do([&](FileTransfer::Descriptor& tx, uint32_t flags, void* reserved) {
+            tx.file_address = 0;
+            return 0;
+        });
+        mocks.OnCallFunc(Spark_Save_Firmware_Chunk).Do([&](FileTransfer::Descriptor& tx, const uint8_t* chunk, void* reserved) {
+            if (writeError) {
+                return writeError;
+            }
+            if (flash.size() < tx.chunk_address + tx.chunk_size) {
+                flash.resize(tx.chunk_address + tx.chunk_size);
+            }
+            flash.replace(tx.chunk_address, tx.chunk_size, (const char*)chunk, tx.chunk_size);
+            stream.advance(tx.chunk_size * FLASH_WRITE_TIME_PER_BYTE);
+            return 0;
+        });
+        YModem ymodem(stream);
+        YModem::file_desc_t desc = {};
+        FileTransfer::Descriptor tx;
+        result = ymodem.receive_file(tx, desc);
+        time = stream.now();
+        if (result > 0) {
+            REQUIRE(stream.done());
+            REQUIRE(std::string(desc.file_name) == "firmware.bin");
+        } else {
+            REQUIRE(stream.canceled());
+        }
+    }
+
+    // Time it would take to receive the file if each packet was written before acknowledging it
+    double stopAndWaitTime(unsigned baudRate) const {
+        const double byteTime = 10000000.0 / baudRate;
+        const size_t packetCount = (file.size() + YModem::PACKET_1K_SIZE - 1) / YModem::PACKET_1K_SIZE;
+        const double packetTime = (YModem::PACKET_1K_SIZE + YModem::PACKET_OVERHEAD + 1 /* ACK */) * byteTime +
+                SENDER_TURNAROUND_TIME + YModem::PACKET_1K_SIZE * FLASH_WRITE_TIME_PER_BYTE;
+        return packetCount * packetTime;
+    }
+};
+
+} // namespace
+
+TEST_CASE("YModem") {
+    Transfer t;
+    t.file = test::randomBytes(FILE_SIZE);
+
+    SECTION("receives a file") {
+        t.run(115200);
+        CHECK(t.result == (int32_t)FILE_SIZE);
+        REQUIRE(t.flash.size() >= FILE_SIZE);
+        CHECK(t.flash.substr(0, FILE_SIZE) == t.file);
+    }
+
+    SECTION("cancels the transfer if the data cannot be written") {
+        t.writeError = -1;
+        t.run(115200);
+        CHECK(t.result == -2);
+    }
+
+    SECTION("writes a packet while the next one is being received") {
+        for (unsigned baudRate: { 115200, 921600, 4000000, 12000000 }) {
+            t.flash.clear();
+            t.run(baudRate);
+            REQUIRE(t.result == (int32_t)FILE_SIZE);
+            REQUIRE(t.flash.substr(0, FILE_SIZE) == t.file);
+            const double maxTime = t.stopAndWaitTime(baudRate);
+            CHECK(t.time < maxTime);
+        }
+    }
+}
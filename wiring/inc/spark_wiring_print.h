@@ -28,6 +28,7 @@
 #define __SPARK_WIRING_PRINT_
 
 #include <stddef.h>
+#include <stdarg.h>
 #include <string.h>
 #include <stdint.h> // for uint8_t
 #include "system_tick_hal.h"
@@ -52,6 +53,7 @@ class Print
   protected:
     void setWriteError(int err = 1) { write_error = err; }
     size_t printf_impl(bool newline, const char* format, ...);
+    size_t vprintf_impl(bool newline, const char* format, va_list args);
 
   public:
     Print() : write_error(0) {}
@@ -31,6 +31,8 @@
 #ifdef __cplusplus
 
 #include <stdarg.h>
+#include <string.h>
+#include <utility>
 #include "spark_wiring_print.h" // for HEX, DEC ... constants
 #include "spark_wiring_printable.h"
 
@@ -200,13 +202,24 @@ public:
         static String format(const char* format, ...);
 
 protected:
+	enum Flag {
+		STATIC_BUFFER = 0x01, // the buffer is provided by a subclass and is not allocated on the heap
+		FIXED_BUFFER = 0x02   // the buffer can't be replaced with a larger one
+	};
+
+	// The layout of this class is a part of the dynalib ABI: String objects are passed between
+	// modules, which free and reallocate each other's buffers
 	char *buffer;	        // the actual char array
 	unsigned int capacity;  // the array length minus one (for the '\0')
 	unsigned int len;       // the String length (not counting the '\0')
-	unsigned char flags;    // unused, for future features
+	unsigned char flags;    // see the Flag enum
 protected:
+	// creates an empty string that uses the provided buffer of size + 1 characters
+	String(char *buf, unsigned int size, unsigned char flags);
+
 	void init(void);
 	void invalidate(void);
+	bool isHeapBuffer(void) const;
 	unsigned char changeBuffer(unsigned int maxStrLen);
 	unsigned char concat(const char *cstr, unsigned int length);
 
@@ -235,6 +248,53 @@ public:
 	StringSumHelper(unsigned long num) : String(num) {}
 };
 
+// A String that stores up to N characters in a buffer which is a part of the object itself, and
+// switches to a heap buffer once it needs to hold a longer string. Short strings are created and
+// modified without touching the heap.
+//
+// SmallString and StaticString objects must only be modified by code that is built against this
+// version of String: older modules ignore the buffer flags and would free the in-place buffer
+template<unsigned int N>
+class SmallString : public String
+{
+public:
+	SmallString(const char *cstr = "") : String(buf_, N, STATIC_BUFFER) { if (cstr) copy(cstr, strlen(cstr)); else invalidate(); }
+	SmallString(const char *cstr, unsigned int length) : String(buf_, N, STATIC_BUFFER) { if (cstr) copy(cstr, length); else invalidate(); }
+	SmallString(const String &str) : String(buf_, N, STATIC_BUFFER) { String::operator=(str); }
+	SmallString(const SmallString &str) : String(buf_, N, STATIC_BUFFER) { String::operator=(str); }
+	SmallString(String &&rval) : String(buf_, N, STATIC_BUFFER) { String::operator=(std::move(rval)); }
+	SmallString(SmallString &&rval) : String(buf_, N, STATIC_BUFFER) { String::operator=(std::move(rval)); }
+
+	SmallString & operator = (const SmallString &rhs) { String::operator=(rhs); return *this; }
+	SmallString & operator = (SmallString &&rval) { String::operator=(std::move(rval)); return *this; }
+	using String::operator=;
+
+private:
+	char buf_[N + 1];
+};
+
+// A String backed by a fixed-size buffer of N characters, which is a part of the object itself.
+// StaticString never allocates memory on the heap: operations that would make the string longer
+// than N characters fail in the same way as if the heap was exhausted, except that the string
+// is left empty rather than invalid
+template<unsigned int N>
+class StaticString : public String
+{
+public:
+	StaticString(const char *cstr = "") : String(buf_, N, STATIC_BUFFER | FIXED_BUFFER) { if (cstr) copy(cstr, strlen(cstr)); else invalidate(); }
+	StaticString(const char *cstr, unsigned int length) : String(buf_, N, STATIC_BUFFER | FIXED_BUFFER) { if (cstr) copy(cstr, length); else invalidate(); }
+	StaticString(const String &str) : String(buf_, N, STATIC_BUFFER | FIXED_BUFFER) { String::operator=(str); }
+	StaticString(const StaticString &str) : String(buf_, N, STATIC_BUFFER | FIXED_BUFFER) { String::operator=(str); }
+
+	StaticString & operator = (const StaticString &rhs) { String::operator=(rhs); return *this; }
+	using String::operator=;
+
+	static constexpr unsigned int maxLength() { return N; }
+
+private:
+	char buf_[N + 1];
+};
+
 #include <ostream>
 std::ostream& operator << ( std::ostream& os, const String& value );
 
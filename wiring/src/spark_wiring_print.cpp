@@ -24,9 +24,13 @@
   ******************************************************************************
  */
 
+#include <ctype.h>
 #include <math.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+#include <type_traits>
 #include "spark_wiring_print.h"
 #include "spark_wiring_string.h"
 #include "spark_wiring_stream.h"
@@ -253,29 +257,445 @@ size_t Print::printFloat(double number, uint8_t digits)
   return n;
 }
 
-size_t Print::printf_impl(bool newline, const char* format, ...)
-{
-    const int bufsize = 20;
-    char test[bufsize];
-    va_list marker;
-    va_start(marker, format);
-    size_t n = vsnprintf(test, bufsize, format, marker);
-    va_end(marker);
-
-    if (n<bufsize)
-    {
-        n = print(test);
+namespace {
+
+// Size of the stack buffer used to accumulate formatted output before passing it to Print::write()
+const size_t PRINTF_CHUNK_SIZE = 64;
+// Size of the stack buffer used to format a single numeric conversion
+const size_t PRINTF_CONV_BUF_SIZE = 32;
+// Maximum length of a conversion specification passed to snprintf()
+const size_t PRINTF_MAX_SPEC_SIZE = 24;
+
+enum PrintfLength {
+    PRINTF_LENGTH_DEFAULT,
+    PRINTF_LENGTH_CHAR, // hh
+    PRINTF_LENGTH_SHORT, // h
+    PRINTF_LENGTH_LONG, // l
+    PRINTF_LENGTH_LONG_LONG, // ll
+    PRINTF_LENGTH_INTMAX, // j
+    PRINTF_LENGTH_SIZE, // z
+    PRINTF_LENGTH_PTRDIFF, // t
+    PRINTF_LENGTH_LONG_DOUBLE // L
+};
+
+/**
+ * Buffers formatted output in chunks and passes it to the underlying Print instance.
+ */
+class PrintfWriter {
+public:
+    explicit PrintfWriter(Print* print) :
+            print_(print),
+            size_(0),
+            count_(0) {
     }
-    else
-    {
-        char bigger[n+1];
-        va_start(marker, format);
-        n = vsnprintf(bigger, n+1, format, marker);
-        va_end(marker);
-        n = print(bigger);
+
+    void write(const char* data, size_t size) {
+        if (size_ == 0 && size >= sizeof(buf_)) {
+            // Bypass the buffer
+            count_ += print_->write((const uint8_t*)data, size);
+            return;
+        }
+        while (size > 0) {
+            if (size_ == sizeof(buf_)) {
+                flush();
+            }
+            size_t n = sizeof(buf_) - size_;
+            if (n > size) {
+                n = size;
+            }
+            memcpy(buf_ + size_, data, n);
+            size_ += n;
+            data += n;
+            size -= n;
+        }
     }
+
+    void fill(char c, size_t count) {
+        while (count > 0) {
+            if (size_ == sizeof(buf_)) {
+                flush();
+            }
+            size_t n = sizeof(buf_) - size_;
+            if (n > count) {
+                n = count;
+            }
+            memset(buf_ + size_, c, n);
+            size_ += n;
+            count -= n;
+        }
+    }
+
+    // Writes a converted value applying the field width
+    void writePadded(const char* str, size_t size, size_t width, bool leftAlign, bool zeroPad) {
+        if (size >= width) {
+            write(str, size);
+        } else if (leftAlign) {
+            write(str, size);
+            fill(' ', width - size);
+        } else if (zeroPad) {
+            // Zeros go after the sign and the radix prefix
+            size_t prefix = 0;
+            if (str[prefix] == '-' || str[prefix] == '+' || str[prefix] == ' ') {
+                ++prefix;
+            }
+            if (prefix + 1 < size && str[prefix] == '0' && (str[prefix + 1] == 'x' || str[prefix + 1] == 'X')) {
+                prefix += 2;
+            }
+            if (prefix < size && isxdigit((unsigned char)str[prefix])) {
+                write(str, prefix);
+                fill('0', width - size);
+                write(str + prefix, size - prefix);
+            } else {
+                // inf or nan
+                fill(' ', width - size);
+                write(str, size);
+            }
+        } else {
+            fill(' ', width - size);
+            write(str, size);
+        }
+    }
+
+    // Integer conversions are common and don't need snprintf()
+    void writeInteger(uintmax_t value, unsigned base, bool upper, char sign, bool alt, int precision, size_t width,
+            bool leftAlign, bool zeroPad) {
+        const char* const digitChars = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+        char digits[sizeof(uintmax_t) * 3]; // Enough for an octal representation
+        char* const end = digits + sizeof(digits);
+        char* d = end;
+        if (value != 0 || precision != 0) {
+            do {
+                *--d = digitChars[value % base];
+                value /= base;
+            } while (value != 0);
+        }
+        const size_t digitCount = end - d;
+        char prefix[2];
+        size_t prefixLen = 0;
+        if (sign) {
+            prefix[prefixLen++] = sign;
+        }
+        if (alt && base == 16 && digitCount > 0 && !(digitCount == 1 && *d == '0')) {
+            prefix[prefixLen++] = '0';
+            prefix[prefixLen++] = upper ? 'X' : 'x';
+        }
+        size_t zeros = (precision > 0 && (size_t)precision > digitCount) ? precision - digitCount : 0;
+        if (alt && base == 8 && zeros == 0 && (digitCount == 0 || *d != '0')) {
+            zeros = 1;
+        }
+        size_t size = prefixLen + zeros + digitCount;
+        if (size < width) {
+            // The '0' flag is ignored if a precision is specified
+            if (zeroPad && !leftAlign && precision < 0) {
+                zeros += width - size;
+            } else if (!leftAlign) {
+                fill(' ', width - size);
+            }
+        }
+        write(prefix, prefixLen);
+        fill('0', zeros);
+        write(d, digitCount);
+        if (leftAlign && size < width) {
+            fill(' ', width - size);
+        }
+    }
+
+    template<typename T>
+    void writeValue(const char* spec, T value, size_t width, bool leftAlign, bool zeroPad) {
+        char buf[PRINTF_CONV_BUF_SIZE];
+        const int n = snprintf(buf, sizeof(buf), spec, value);
+        if (n < 0) {
+            return;
+        }
+        if ((size_t)n < sizeof(buf)) {
+            writePadded(buf, n, width, leftAlign, zeroPad);
+        } else {
+            // Only happens for conversions with a large precision or huge floating point values
+            char bigger[n + 1];
+            snprintf(bigger, n + 1, spec, value);
+            writePadded(bigger, n, width, leftAlign, zeroPad);
+        }
+    }
+
+    size_t flush() {
+        if (size_ > 0) {
+            count_ += print_->write((const uint8_t*)buf_, size_);
+            size_ = 0;
+        }
+        return count_;
+    }
+
+private:
+    Print* print_;
+    char buf_[PRINTF_CHUNK_SIZE];
+    size_t size_;
+    size_t count_;
+};
+
+} // namespace
+
+size_t Print::vprintf_impl(bool newline, const char* format, va_list args)
+{
+    // Literal text is copied as is and each conversion is formatted separately into a small stack
+    // buffer, so the output is produced in a single pass and its total length doesn't matter
+    PrintfWriter out(this);
+    const char* p = format;
+    for (;;) {
+        const char* const text = p;
+        while (*p && *p != '%') {
+            ++p;
+        }
+        out.write(text, p - text);
+        if (!*p) {
+            break;
+        }
+        const char* const specStart = p++;
+        char spec[PRINTF_MAX_SPEC_SIZE];
+        size_t specLen = 0;
+        spec[specLen++] = '%';
+        // Flags. The field width is applied by the writer, so '-' and '0' are not passed to snprintf()
+        bool leftAlign = false;
+        bool zeroPad = false;
+        bool plus = false;
+        bool space = false;
+        bool alt = false;
+        for (;; ++p) {
+            if (*p == '-') {
+                leftAlign = true;
+            } else if (*p == '0') {
+                zeroPad = true;
+            } else if (*p == '+') {
+                plus = true;
+            } else if (*p == ' ') {
+                space = true;
+            } else if (*p == '#') {
+                alt = true;
+            } else {
+                break;
+            }
+        }
+        if (plus) {
+            spec[specLen++] = '+';
+        }
+        if (space) {
+            spec[specLen++] = ' ';
+        }
+        if (alt) {
+            spec[specLen++] = '#';
+        }
+        // Field width
+        size_t width = 0;
+        if (*p == '*') {
+            const int w = va_arg(args, int);
+            if (w < 0) {
+                leftAlign = true;
+                width = -w;
+            } else {
+                width = w;
+            }
+            ++p;
+        } else {
+            while (isdigit((unsigned char)*p)) {
+                width = width * 10 + (*p++ - '0');
+            }
+        }
+        // Precision
+        int precision = -1;
+        if (*p == '.') {
+            ++p;
+            if (*p == '*') {
+                precision = va_arg(args, int);
+                ++p;
+            } else {
+                precision = 0;
+                while (isdigit((unsigned char)*p)) {
+                    precision = precision * 10 + (*p++ - '0');
+                }
+            }
+            if (precision >= 0) {
+                specLen += snprintf(spec + specLen, sizeof(spec) - specLen, ".%d", precision);
+            }
+        }
+        // Length modifier
+        PrintfLength length = PRINTF_LENGTH_DEFAULT;
+        switch (*p) {
+        case 'h':
+            spec[specLen++] = *p++;
+            length = PRINTF_LENGTH_SHORT;
+            if (*p == 'h') {
+                spec[specLen++] = *p++;
+                length = PRINTF_LENGTH_CHAR;
+            }
+            break;
+        case 'l':
+            spec[specLen++] = *p++;
+            length = PRINTF_LENGTH_LONG;
+            if (*p == 'l') {
+                spec[specLen++] = *p++;
+                length = PRINTF_LENGTH_LONG_LONG;
+            }
+            break;
+        case 'j':
+            spec[specLen++] = *p++;
+            length = PRINTF_LENGTH_INTMAX;
+            break;
+        case 'z':
+            spec[specLen++] = *p++;
+            length = PRINTF_LENGTH_SIZE;
+            break;
+        case 't':
+            spec[specLen++] = *p++;
+            length = PRINTF_LENGTH_PTRDIFF;
+            break;
+        case 'L':
+            spec[specLen++] = *p++;
+            length = PRINTF_LENGTH_LONG_DOUBLE;
+            break;
+        default:
+            break;
+        }
+        const char conv = *p;
+        if (!conv) {
+            // Incomplete conversion specification
+            out.write(specStart, p - specStart);
+            break;
+        }
+        ++p;
+        spec[specLen++] = conv;
+        spec[specLen] = '\0';
+        switch (conv) {
+        case '%': {
+            out.write("%", 1);
+            break;
+        }
+        case 's': {
+            const char* str = va_arg(args, const char*);
+            if (!str) {
+                str = "(null)";
+            }
+            size_t n = 0;
+            while ((precision < 0 || n < (size_t)precision) && str[n]) {
+                ++n;
+            }
+            out.writePadded(str, n, width, leftAlign, false);
+            break;
+        }
+        case 'c': {
+            const char c = va_arg(args, int);
+            out.writePadded(&c, 1, width, leftAlign, false);
+            break;
+        }
+        case 'd':
+        case 'i': {
+            intmax_t v = 0;
+            switch (length) {
+            case PRINTF_LENGTH_CHAR:
+                v = (signed char)va_arg(args, int);
+                break;
+            case PRINTF_LENGTH_SHORT:
+                v = (short)va_arg(args, int);
+                break;
+            case PRINTF_LENGTH_LONG:
+                v = va_arg(args, long);
+                break;
+            case PRINTF_LENGTH_LONG_LONG:
+                v = va_arg(args, long long);
+                break;
+            case PRINTF_LENGTH_INTMAX:
+                v = va_arg(args, intmax_t);
+                break;
+            case PRINTF_LENGTH_SIZE:
+                v = (std::make_signed<size_t>::type)va_arg(args, size_t);
+                break;
+            case PRINTF_LENGTH_PTRDIFF:
+                v = va_arg(args, ptrdiff_t);
+                break;
+            default:
+                v = va_arg(args, int);
+                break;
+            }
+            const char sign = (v < 0) ? '-' : (plus ? '+' : (space ? ' ' : '\0'));
+            const uintmax_t absValue = (v < 0) ? -(uintmax_t)v : (uintmax_t)v;
+            out.writeInteger(absValue, 10, false, sign, false, precision, width, leftAlign, zeroPad);
+            break;
+        }
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X': {
+            uintmax_t v = 0;
+            switch (length) {
+            case PRINTF_LENGTH_CHAR:
+                v = (unsigned char)va_arg(args, unsigned);
+                break;
+            case PRINTF_LENGTH_SHORT:
+                v = (unsigned short)va_arg(args, unsigned);
+                break;
+            case PRINTF_LENGTH_LONG:
+                v = va_arg(args, unsigned long);
+                break;
+            case PRINTF_LENGTH_LONG_LONG:
+                v = va_arg(args, unsigned long long);
+                break;
+            case PRINTF_LENGTH_INTMAX:
+                v = va_arg(args, uintmax_t);
+                break;
+            case PRINTF_LENGTH_SIZE:
+                v = va_arg(args, size_t);
+                break;
+            case PRINTF_LENGTH_PTRDIFF:
+                v = (std::make_unsigned<ptrdiff_t>::type)va_arg(args, ptrdiff_t);
+                break;
+            default:
+                v = va_arg(args, unsigned);
+                break;
+            }
+            const unsigned base = (conv == 'u') ? 10 : ((conv == 'o') ? 8 : 16);
+            out.writeInteger(v, base, conv == 'X', '\0', alt, precision, width, leftAlign, zeroPad);
+            break;
+        }
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A': {
+            if (length == PRINTF_LENGTH_LONG_DOUBLE) {
+                out.writeValue(spec, va_arg(args, long double), width, leftAlign, zeroPad);
+            } else {
+                out.writeValue(spec, va_arg(args, double), width, leftAlign, zeroPad);
+            }
+            break;
+        }
+        case 'p': {
+            out.writeValue(spec, va_arg(args, void*), width, leftAlign, false);
+            break;
+        }
+        case 'n': {
+            // Not supported
+            va_arg(args, void*);
+            break;
+        }
+        default: {
+            // Unknown conversion, print it as is
+            out.write(specStart, p - specStart);
+            break;
+        }
+        }
+    }
+    size_t n = out.flush();
     if (newline)
         n += println();
     return n;
 }
 
+size_t Print::printf_impl(bool newline, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    const size_t n = vprintf_impl(newline, format, args);
+    va_end(args);
+    return n;
+}
@@ -168,9 +168,18 @@ String::String(double value, int decimalPlaces)
 	dtoa(value, decimalPlaces, buf);
         *this = buf;
 }
+String::String(char *buf, unsigned int size, unsigned char flags)
+{
+	buffer = buf;
+	capacity = size;
+	len = 0;
+	this->flags = flags;
+	buffer[0] = 0;
+}
+
 String::~String()
 {
-	free(buffer);
+	if (isHeapBuffer()) free(buffer);
 }
 
 /*********************************************/
@@ -187,11 +196,22 @@ inline void String::init(void)
 
 void String::invalidate(void)
 {
+	if (flags & STATIC_BUFFER) {
+		// the buffer provided by a subclass can't be recovered once it's released
+		len = 0;
+		buffer[0] = 0;
+		return;
+	}
 	if (buffer) free(buffer);
 	buffer = NULL;
 	capacity = len = 0;
 }
 
+inline bool String::isHeapBuffer(void) const
+{
+	return buffer && !(flags & STATIC_BUFFER);
+}
+
 unsigned char String::reserve(unsigned int size)
 {
 	if (buffer && capacity >= size) return 1;
@@ -204,10 +224,28 @@ unsigned char String::reserve(unsigned int size)
 
 unsigned char String::changeBuffer(unsigned int maxStrLen)
 {
-	char *newbuffer = (char *)realloc(buffer, maxStrLen + 1);
+	if (flags & STATIC_BUFFER) {
+		if (maxStrLen <= capacity) return 1;
+		if (flags & FIXED_BUFFER) return 0;
+	}
+	const bool heap = isHeapBuffer();
+	// Grow geometrically when the string is being extended so that a series of
+	// concatenations doesn't reallocate the buffer on every step
+	unsigned int newCapacity = maxStrLen;
+	if (buffer && capacity + capacity / 2 > newCapacity) {
+		newCapacity = capacity + capacity / 2;
+	}
+	char *newbuffer = (char *)(heap ? realloc(buffer, newCapacity + 1) : malloc(newCapacity + 1));
+	if (!newbuffer && newCapacity > maxStrLen) {
+		newCapacity = maxStrLen;
+		newbuffer = (char *)(heap ? realloc(buffer, newCapacity + 1) : malloc(newCapacity + 1));
+	}
 	if (newbuffer) {
+		// the string moves from the buffer provided by a subclass to the heap
+		if (!heap && buffer) memcpy(newbuffer, buffer, len + 1);
 		buffer = newbuffer;
-		capacity = maxStrLen;
+		capacity = newCapacity;
+		flags &= ~STATIC_BUFFER;
 		return 1;
 	}
 	return 0;
@@ -236,19 +274,22 @@ String & String::copy(const __FlashStringHelper *pstr, unsigned int length) {
 #ifdef __GXX_EXPERIMENTAL_CXX0X__
 void String::move(String &rhs)
 {
-	if (buffer) {
-		if (capacity >= rhs.len) {
-			strcpy(buffer, rhs.buffer);
-			len = rhs.len;
-			rhs.len = 0;
-			return;
-		} else {
-			free(buffer);
-		}
+	if (!rhs.buffer) {
+		invalidate();
+		return;
+	}
+	// Only heap buffers can change hands, buffers provided by subclasses are copied
+	if ((buffer && capacity >= rhs.len) || !rhs.isHeapBuffer() || (flags & FIXED_BUFFER)) {
+		copy(rhs.buffer, rhs.len);
+		rhs.len = 0;
+		rhs.buffer[0] = 0;
+		return;
 	}
+	if (isHeapBuffer()) free(buffer);
 	buffer = rhs.buffer;
 	capacity = rhs.capacity;
 	len = rhs.len;
+	flags &= ~STATIC_BUFFER;
 	rhs.buffer = NULL;
 	rhs.capacity = 0;
 	rhs.len = 0;